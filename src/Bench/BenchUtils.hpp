@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdio>
+#include <functional>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QThread>
+
+// Every benchmark prints its results as JSON objects, one per line, so that runs of different commits can be compared with any JSON-aware tool
+namespace Bench
+{
+inline void report(QString const& bench, QString const& scenario, QJsonObject params, QJsonObject const& metrics)
+{
+    QJsonObject line;
+    line.insert("bench", bench);
+    line.insert("scenario", scenario);
+    line.insert("params", params);
+    line.insert("metrics", metrics);
+    std::fputs(QJsonDocument(line).toJson(QJsonDocument::Compact).append('\n').constData(), stdout);
+    std::fflush(stdout);
+}
+
+// Polls predicate until it returns true or timeout expires. Returns last value of predicate
+inline bool waitFor(std::function<bool()> const& predicate, int timeoutMs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!predicate())
+    {
+        if (timer.elapsed() > timeoutMs)
+            return predicate();
+        QThread::usleep(200);
+    }
+    return true;
+}
+
+// Runs f until minTimeMs have passed, at least minIterations times. Returns mean nanoseconds per call
+inline double measureNsPerCall(std::function<void()> const& f, int minTimeMs = 200, int minIterations = 3)
+{
+    qint64 iterations = 0;
+    QElapsedTimer timer;
+    timer.start();
+    do
+    {
+        f();
+        ++iterations;
+    } while ((iterations < minIterations) || (timer.elapsed() < minTimeMs));
+    return static_cast<double>(timer.nsecsElapsed()) / iterations;
+}
+
+inline QByteArray makePayload(int size)
+{
+    QByteArray payload(size, Qt::Uninitialized);
+    for (int i = 0; i < size; ++i)
+        payload[i] = static_cast<char>('a' + (i % 26));
+    return payload;
+}
+
+inline QList<int> toIntList(QString const& commaSeparated)
+{
+    QList<int> result;
+    for (QString const& item : commaSeparated.split(',', Qt::SkipEmptyParts))
+        result.append(item.trimmed().toInt());
+    return result;
+}
+} // namespace Bench
@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <random>
+
+#include <QtConcurrent>
+#include <QtCore/QCommandLineOption>
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+
+#include "Common/Protocol.hpp"
+#include "Common/Utils.hpp"
+#include "Server/Kernels.hpp"
+
+#include "BenchUtils.hpp"
+
+using namespace Protocol;
+
+namespace
+{
+const QString g_benchName{"bench_kernels"};
+
+// Server splits every task the same way, see ExampleServer::m_maxChunkCount and m_minChunkSize
+struct ChunkingParams
+{
+    int maxChunkCount = 100;
+    int minChunkSize = 100;
+};
+
+// Realistic input is random; the rest are the usual worst and best cases of comparison sorts and merges
+QVector<int> makeSortInput(QString const& shape, int elementCount)
+{
+    std::mt19937 rng(42);
+    QVector<int> numbers(elementCount);
+    if (shape == QStringLiteral("random"))
+    {
+        std::uniform_int_distribution<int> distribution(std::numeric_limits<int>::min(), std::numeric_limits<int>::max());
+        for (int& n : numbers)
+            n = distribution(rng);
+    }
+    else if (shape == QStringLiteral("few_unique"))
+    {
+        std::uniform_int_distribution<int> distribution(0, 7);
+        for (int& n : numbers)
+            n = distribution(rng);
+    }
+    else if (shape == QStringLiteral("sorted"))
+    {
+        std::iota(numbers.begin(), numbers.end(), 0);
+    }
+    else if (shape == QStringLiteral("reversed"))
+    {
+        std::iota(numbers.rbegin(), numbers.rend(), 0);
+    }
+    else if (shape == QStringLiteral("equal"))
+    {
+        std::fill(numbers.begin(), numbers.end(), 7);
+    }
+    else if (shape == QStringLiteral("organ_pipe")) // ascending, then descending
+    {
+        for (int i = 0; i < elementCount; ++i)
+            numbers[i] = qMin(i, elementCount - 1 - i);
+    }
+    return numbers;
+}
+
+// Same steps as SortArray task: chunks sorted in the pool, then merged one by one in the finished() handler
+QVector<int> sortChunked(QVector<int> const& numbers, ChunkingParams const& chunking)
+{
+    auto sequence = divideIntoChunks(numbers, chunking.maxChunkCount, chunking.minChunkSize);
+    QFuture<QVector<int>> future = QtConcurrent::mapped(sequence, &Kernels::sortArray);
+    future.waitForFinished();
+    QVector<int> result;
+    result.reserve(numbers.size());
+    for (auto const& part : future)
+    {
+        auto idxMiddle = result.size();
+        result.append(part);
+        std::inplace_merge(result.begin(), (result.begin() + idxMiddle), result.end());
+    }
+    return result;
+}
+
+void benchSort(QStringList const& shapes, QList<int> const& elementCounts, ChunkingParams const& chunking, int minTimeMs)
+{
+    for (QString const& shape : shapes)
+    {
+        for (int elementCount : elementCounts)
+        {
+            const QVector<int> numbers = makeSortInput(shape, elementCount);
+            QVector<int> expected = numbers;
+            std::sort(expected.begin(), expected.end());
+            for (const QString mode : {QStringLiteral("single"), QStringLiteral("chunked")})
+            {
+                const bool isChunked = (mode == QStringLiteral("chunked"));
+                const bool isValid = (isChunked ? sortChunked(numbers, chunking) : Kernels::sortArray(numbers)) == expected;
+                const double elapsedNs = Bench::measureNsPerCall([&]() {
+                    if (isChunked)
+                        sortChunked(numbers, chunking);
+                    else
+                        Kernels::sortArray(numbers);
+                }, minTimeMs);
+
+                QJsonObject params{{"shape", shape}, {"elements", elementCount}, {"mode", mode}, {"threads", QThreadPool::globalInstance()->maxThreadCount()}};
+                QJsonObject metrics{{"valid", isValid}, {"elapsed_ms", elapsedNs / 1e6}, {"elements_per_sec", elementCount * 1e9 / elapsedNs}};
+                Bench::report(g_benchName, QStringLiteral("sort"), params, metrics);
+            }
+        }
+    }
+}
+
+QVector<int> findPrimesChunked(int numFrom, int numTo, ChunkingParams const& chunking)
+{
+    auto sequence = divideIntoChunks(numFrom, numTo, chunking.maxChunkCount, chunking.minChunkSize);
+    return QtConcurrent::blockingMappedReduced(sequence, &Kernels::findPrimeNumbersT, &Kernels::findPrimeNumbers_reduce, QtConcurrent::OrderedReduce);
+}
+
+// Trial division costs grow with sqrt of the numbers, so the same width of range is far more expensive at the top of int range.
+// Top range ends 2 below INT_MAX: findPrimeNumbers() steps over odd numbers and would overflow past it
+void benchPrimes(QStringList const& ranges, QList<int> const& widths, ChunkingParams const& chunking, int minTimeMs)
+{
+    for (QString const& range : ranges)
+    {
+        for (int width : widths)
+        {
+            int numFrom = 0;
+            int numTo = width - 1;
+            if (range == QStringLiteral("high"))
+            {
+                numTo = std::numeric_limits<int>::max() - 2;
+                numFrom = numTo - width + 1;
+            }
+            else if (range == QStringLiteral("empty")) // reversed bounds, nothing to do but the checks
+            {
+                numFrom = width;
+                numTo = 0;
+            }
+            for (const QString mode : {QStringLiteral("single"), QStringLiteral("chunked")})
+            {
+                const bool isChunked = (mode == QStringLiteral("chunked"));
+                const int primeCount = (isChunked ? findPrimesChunked(numFrom, numTo, chunking) : Kernels::findPrimeNumbers(numFrom, numTo)).size();
+                const double elapsedNs = Bench::measureNsPerCall([&]() {
+                    if (isChunked)
+                        findPrimesChunked(numFrom, numTo, chunking);
+                    else
+                        Kernels::findPrimeNumbers(numFrom, numTo);
+                }, minTimeMs);
+
+                QJsonObject params{{"range", range}, {"from", numFrom}, {"to", numTo}, {"mode", mode}, {"threads", QThreadPool::globalInstance()->maxThreadCount()}};
+                QJsonObject metrics{{"primes", primeCount}, {"elapsed_ms", elapsedNs / 1e6}, {"numbers_per_sec", qMax(0, width) * 1e9 / elapsedNs}};
+                Bench::report(g_benchName, QStringLiteral("primes"), params, metrics);
+            }
+        }
+    }
+}
+
+QVector<QPoint> calculateFunctionChunked(EquationType equationType, int x_from, int x_to, int x_step, ChunkingParams const& chunking)
+{
+    QVector<std::tuple<EquationType, int, int, int, const int, const int, const int>> sequence;
+    for (auto const& range : divideIntoChunks(x_from, x_to, chunking.maxChunkCount, chunking.minChunkSize))
+        sequence.append(std::make_tuple(equationType, std::get<0>(range), std::get<1>(range), x_step, 3, -2, 1));
+    return QtConcurrent::blockingMappedReduced(sequence, &Kernels::calculateFunctionT, &Kernels::calculateFunction_reduce, QtConcurrent::OrderedReduce);
+}
+
+// Narrow range with step 1 is what the Client asks for; wide range with a large step has the same point count, but values which overflow int in the quadratic
+void benchFunction(QList<int> const& pointCounts, ChunkingParams const& chunking, int minTimeMs)
+{
+    for (const EquationType equationType : {EquationType::Linear, EquationType::Quadratic})
+    {
+        for (const QString range : {QStringLiteral("narrow"), QStringLiteral("wide")})
+        {
+            for (int pointCount : pointCounts)
+            {
+                int x_step = 1;
+                int x_from = -pointCount / 2;
+                if (range == QStringLiteral("wide"))
+                {
+                    x_step = qMax(1, std::numeric_limits<int>::max() / qMax(1, pointCount));
+                    x_from = -(pointCount / 2) * x_step;
+                }
+                const int x_to = x_from + (pointCount - 1) * x_step;
+                for (const QString mode : {QStringLiteral("single"), QStringLiteral("chunked")})
+                {
+                    const bool isChunked = (mode == QStringLiteral("chunked"));
+                    const double elapsedNs = Bench::measureNsPerCall([&]() {
+                        if (isChunked)
+                            calculateFunctionChunked(equationType, x_from, x_to, x_step, chunking);
+                        else
+                            Kernels::calculateFunction(equationType, x_from, x_to, x_step, 3, -2, 1);
+                    }, minTimeMs);
+
+                    QJsonObject params{{"equation", toQString(equationType)}, {"range", range}, {"points", pointCount}, {"step", x_step}, {"mode", mode}};
+                    QJsonObject metrics{{"elapsed_ms", elapsedNs / 1e6}, {"points_per_sec", pointCount * 1e9 / elapsedNs}};
+                    Bench::report(g_benchName, QStringLiteral("function"), params, metrics);
+                }
+            }
+        }
+    }
+}
+
+// Cost of splitting task's input before anything is computed: index ranges alone, and SortArray's copy of the array into chunks
+void benchChunks(QList<int> const& elementCounts, ChunkingParams const& chunking, int minTimeMs)
+{
+    for (int elementCount : elementCounts)
+    {
+        const QVector<int> numbers = makeSortInput(QStringLiteral("random"), elementCount);
+        for (const QString input : {QStringLiteral("range"), QStringLiteral("array")})
+        {
+            const bool isArray = (input == QStringLiteral("array"));
+            const int chunkCount = isArray ? divideIntoChunks(numbers, chunking.maxChunkCount, chunking.minChunkSize).size()
+                                           : divideIntoChunks(0, elementCount - 1, chunking.maxChunkCount, chunking.minChunkSize).size();
+            const double elapsedNs = Bench::measureNsPerCall([&]() {
+                if (isArray)
+                    divideIntoChunks(numbers, chunking.maxChunkCount, chunking.minChunkSize);
+                else
+                    divideIntoChunks(0, elementCount - 1, chunking.maxChunkCount, chunking.minChunkSize);
+            }, minTimeMs);
+            // Share of a single-threaded sort of the same input, which is what chunking is meant to speed up
+            const double sortNs = isArray ? Bench::measureNsPerCall([&numbers]() { Kernels::sortArray(numbers); }, minTimeMs) : 0.0;
+
+            QJsonObject params{{"input", input}, {"elements", elementCount}, {"max_chunks", chunking.maxChunkCount}, {"min_chunk_size", chunking.minChunkSize}};
+            QJsonObject metrics{{"chunks", chunkCount}, {"elapsed_us", elapsedNs / 1e3}};
+            if (isArray)
+                metrics.insert("share_of_sort", elapsedNs / sortNs);
+            Bench::report(g_benchName, QStringLiteral("chunks"), params, metrics);
+        }
+    }
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser cmdParser;
+    cmdParser.setApplicationDescription("Benchmarks of Server's task computations. Prints one JSON object per result line.");
+    cmdParser.addHelpOption();
+    QCommandLineOption scenarioOption("scenario", "Scenario to run: sort, primes, function, chunks.", "name", "sort");
+    QCommandLineOption shapesOption("shapes", "Comma-separated list of sort inputs: random, few_unique, sorted, reversed, equal, organ_pipe.", "list", "random,few_unique,sorted,reversed,equal,organ_pipe");
+    QCommandLineOption rangesOption("ranges", "Comma-separated list of prime search ranges: low, high, empty.", "list", "low,high,empty");
+    QCommandLineOption elementsOption("elements", "Comma-separated list of input sizes: array lengths, range widths or point counts.", "list", "1000,100000,1000000");
+    QCommandLineOption maxChunksOption("max-chunks", "Maximum chunk count a task is split into.", "count", "100");
+    QCommandLineOption minChunkSizeOption("min-chunk-size", "Minimum chunk size.", "count", "100");
+    QCommandLineOption threadsOption("threads", "QThreadPool thread count, 0 - ideal thread count.", "count", "0");
+    QCommandLineOption minTimeOption("min-time", "Minimum time in msec each measurement runs for.", "msec", "200");
+    cmdParser.addOptions({scenarioOption, shapesOption, rangesOption, elementsOption, maxChunksOption, minChunkSizeOption, threadsOption, minTimeOption});
+    cmdParser.process(a);
+
+    const int threadCount = cmdParser.value(threadsOption).toInt();
+    QThreadPool::globalInstance()->setMaxThreadCount((threadCount > 0) ? threadCount : QThread::idealThreadCount());
+    ChunkingParams chunking;
+    chunking.maxChunkCount = cmdParser.value(maxChunksOption).toInt();
+    chunking.minChunkSize = cmdParser.value(minChunkSizeOption).toInt();
+    const QList<int> elementCounts = Bench::toIntList(cmdParser.value(elementsOption));
+    const int minTimeMs = cmdParser.value(minTimeOption).toInt();
+
+    const QString scenario = cmdParser.value(scenarioOption);
+    if (scenario == QStringLiteral("sort"))
+        benchSort(cmdParser.value(shapesOption).split(',', Qt::SkipEmptyParts), elementCounts, chunking, minTimeMs);
+    else if (scenario == QStringLiteral("primes"))
+        benchPrimes(cmdParser.value(rangesOption).split(',', Qt::SkipEmptyParts), elementCounts, chunking, minTimeMs);
+    else if (scenario == QStringLiteral("function"))
+        benchFunction(elementCounts, chunking, minTimeMs);
+    else if (scenario == QStringLiteral("chunks"))
+        benchChunks(elementCounts, chunking, minTimeMs);
+    else
+        cmdParser.showHelp(1);
+    return 0;
+}
@@ -0,0 +1,1267 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <limits>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <QtCore/QCommandLineOption>
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QEventLoop>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QMap>
+#include <QtCore/QMutex>
+#include <QtCore/QTimer>
+#include <QtCore/QtEndian>
+#include <QtCore/QVector>
+#include <QtNetwork/QTcpServer>
+
+#include "Common/Metrics.hpp"
+#include "Common/Protocol.hpp"
+#include "Net/ClientTable.hpp"
+#include "Net/Compression.hpp"
+#include "Net/FrameReader.hpp"
+#include "Net/MessageChannel.hpp"
+#include "Net/NetHeaders.hpp"
+#include "Net/SendQueue.hpp"
+#include "Net/TimerWheel.hpp"
+
+#include "BenchUtils.hpp"
+
+namespace
+{
+const QString g_benchName{"bench_net"};
+constexpr int g_timeoutMs = 60000;
+
+const std::function<void(QString)> f_logNone = [](QString) {};
+const std::function<void(QString)> f_logStderr = [](QString msg) { qWarning("%s", qUtf8Printable(msg)); };
+
+// Clients are spread over clientThreadCount NetThreads, which is closer to a real fleet than one thread per client
+QVector<TcpClient*> makeClients(int clientCount, int clientThreadCount, quint16 serverPort, std::atomic<qint64>& receivedCount)
+{
+    QVector<NetThread*> threads;
+    QVector<TcpClient*> clients;
+    for (int i = 0; i < clientCount; ++i)
+    {
+        NetThread* pThread = (i < clientThreadCount) ? nullptr : threads.at(i % clientThreadCount);
+        auto connectionThread = Net::instantiateWaitThreadedConnection<TcpClient>(pThread);
+        TcpClient* pClient = std::get<0>(connectionThread);
+        if (i < clientThreadCount)
+            threads.append(std::get<1>(connectionThread));
+        pClient->setLoggingFunctions(f_logNone, f_logStderr);
+        pClient->setEnableReconnect(false);
+        pClient->setCallbackFunction([&receivedCount](QByteArray, NetConnection* const, Net::AddressPort) {
+            receivedCount.fetch_add(1, std::memory_order_relaxed);
+        });
+        Net::ConnectionSettings clientSettings;
+        clientSettings.ipDestination = QHostAddress::LocalHost;
+        clientSettings.portOut = serverPort;
+        Net::openWaitThreadedConnection(pClient, clientSettings);
+        clients.append(pClient);
+    }
+    return clients;
+}
+
+// Echo server with N shards. Every client sends all its messages at once and waits for all echoes; aggregate msgs/sec should grow with N until cores run out
+void benchShards(QList<int> const& shardCounts, int clientCount, int clientThreadCount, int messageCount, int payloadSize)
+{
+    const QByteArray payload = Bench::makePayload(payloadSize);
+    for (int shardCount : shardCounts)
+    {
+        TcpServer* pServer = std::get<0>(Net::instantiateWaitThreadedConnection<TcpServer>());
+        pServer->setLoggingFunctions(f_logNone, f_logStderr);
+        pServer->setShardCount(shardCount);
+        // Echo everything back, so that both receive and send paths of shards are loaded
+        pServer->setCallbackFunction([pServer](QByteArray msg, NetConnection* const, Net::AddressPort addrPort) {
+            emit pServer->sendMessageToQueued(msg, addrPort);
+        });
+        std::atomic<int> connectedCount{0};
+        QObject::connect(pServer, &TcpServer::clientConnected, pServer, [&connectedCount]() {
+            connectedCount.fetch_add(1, std::memory_order_relaxed);
+        }, Qt::DirectConnection);
+        Net::ConnectionSettings serverSettings;
+        serverSettings.ipLocal = QHostAddress::LocalHost;
+        Net::openWaitThreadedConnection(pServer, serverSettings);
+        const quint16 serverPort = pServer->getConnectionSettingsActive().portIn;
+
+        std::atomic<qint64> receivedCount{0};
+        const QVector<TcpClient*> clients = makeClients(clientCount, clientThreadCount, serverPort, receivedCount);
+        // Echo can only be routed after server has registered the client
+        Bench::waitFor([&connectedCount, clientCount]() { return connectedCount.load() >= clientCount; }, g_timeoutMs);
+
+        const qint64 expectedCount = static_cast<qint64>(clientCount) * messageCount;
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < messageCount; ++i)
+        {
+            for (TcpClient* pClient : clients)
+                emit pClient->sendMessageQueued(payload);
+        }
+        const bool isComplete = Bench::waitFor([&receivedCount, expectedCount]() { return receivedCount.load() >= expectedCount; }, g_timeoutMs);
+        const qint64 elapsedNs = timer.nsecsElapsed();
+
+        QJsonObject params{{"shards", shardCount}, {"clients", clientCount}, {"client_threads", clientThreadCount}, {"messages_per_client", messageCount}, {"payload_bytes", payloadSize}};
+        QJsonObject metrics{{"complete", isComplete}, {"elapsed_ms", elapsedNs / 1e6}, {"msgs_per_sec", receivedCount.load() * 1e9 / elapsedNs}};
+        Bench::report(g_benchName, QStringLiteral("shards"), params, metrics);
+
+        for (TcpClient* pClient : clients)
+            Net::destroyWaitThreadedConnection(pClient);
+        Net::destroyWaitThreadedConnection(pServer);
+    }
+}
+// Connected loopback pair of Qt sockets. Side driven by a helper thread is detached to a raw descriptor, so that it can't interfere with the other side's event processing
+struct SocketPair
+{
+    QTcpServer listener;
+    QTcpSocket writer;
+    QTcpSocket* pReader = nullptr;
+    int detachedFd = -1;
+
+    bool open()
+    {
+        if (!listener.listen(QHostAddress::LocalHost))
+            return false;
+        writer.connectToHost(QHostAddress::LocalHost, listener.serverPort());
+        if (!writer.waitForConnected(g_timeoutMs) || !listener.waitForNewConnection(g_timeoutMs))
+            return false;
+        pReader = listener.nextPendingConnection();
+        return (pReader != nullptr);
+    }
+    // Connection outlives QTcpSocket, which closes only its own descriptor
+    int detach(QTcpSocket* pSocket)
+    {
+        detachedFd = ::dup(static_cast<int>(pSocket->socketDescriptor()));
+        pSocket->abort();
+        return detachedFd;
+    }
+    ~SocketPair()
+    {
+        if (detachedFd >= 0)
+            ::close(detachedFd);
+    }
+};
+
+// Reads and discards everything until byteCount bytes have arrived
+std::thread startSink(int fd, qint64 byteCount)
+{
+    return std::thread([fd, byteCount]() {
+        QByteArray buffer(1024 * 1024, Qt::Uninitialized);
+        qint64 received = 0;
+        pollfd pfd{fd, POLLIN, 0};
+        while (received < byteCount)
+        {
+            if (::poll(&pfd, 1, g_timeoutMs) <= 0)
+                return;
+            const ssize_t n = ::recv(fd, buffer.data(), static_cast<size_t>(buffer.size()), MSG_DONTWAIT);
+            if (n == 0)
+                return;
+            if (n > 0)
+                received += n;
+        }
+    });
+}
+
+// Old framing (header + payload concatenated into a new QByteArray, written through socket's buffer) against Net::SendQueue (header and payload as separate iovecs)
+void benchFraming(QList<int> const& payloadSizes, int messageCount)
+{
+    for (int payloadSize : payloadSizes)
+    {
+        const QByteArray payload = Bench::makePayload(payloadSize);
+        const qint64 expectedBytes = static_cast<qint64>(messageCount) * (Net::SendQueue::s_headerSize + payloadSize);
+        for (const QString mode : {QStringLiteral("concat"), QStringLiteral("scatter")})
+        {
+            SocketPair pair;
+            if (!pair.open() || (pair.detach(pair.pReader) < 0))
+            {
+                f_logStderr(QStringLiteral("framing: failed to open loopback connection"));
+                return;
+            }
+            std::thread sink = startSink(pair.detachedFd, expectedBytes);
+            Net::SendQueue sendQueue;
+            QElapsedTimer timer;
+            timer.start();
+            for (int i = 0; i < messageCount; ++i)
+            {
+                if (mode == QStringLiteral("concat"))
+                {
+                    const quint32 msgSize = static_cast<quint32>(payload.size());
+                    QByteArray header(reinterpret_cast<const char*>(&msgSize), sizeof(msgSize));
+                    pair.writer.write(header + payload);
+                    while (pair.writer.bytesToWrite() > Net::SendQueue::s_deviceBufferLimit)
+                        pair.writer.waitForBytesWritten(g_timeoutMs);
+                }
+                else
+                {
+                    sendQueue.enqueueFrame(payload);
+                    sendQueue.drain(&pair.writer);
+                    while (sendQueue.queuedBytes() > Net::SendQueue::s_deviceBufferLimit)
+                    {
+                        if (pair.writer.bytesToWrite() > 0)
+                            pair.writer.waitForBytesWritten(g_timeoutMs);
+                        else
+                            QThread::usleep(50); // kernel buffer is full and socket holds nothing, so there is no event to wait for
+                        sendQueue.drain(&pair.writer);
+                    }
+                }
+            }
+            while (!sendQueue.isEmpty() || (pair.writer.bytesToWrite() > 0))
+            {
+                if (pair.writer.bytesToWrite() > 0)
+                    pair.writer.waitForBytesWritten(g_timeoutMs);
+                else
+                    QThread::usleep(50);
+                sendQueue.drain(&pair.writer);
+            }
+            sink.join();
+            const qint64 elapsedNs = timer.nsecsElapsed();
+
+            QJsonObject params{{"mode", mode}, {"payload_bytes", payloadSize}, {"messages", messageCount}};
+            QJsonObject metrics{{"elapsed_ms", elapsedNs / 1e6},
+                                {"frames_per_sec", messageCount * 1e9 / elapsedNs},
+                                {"mb_per_sec", expectedBytes * 1e3 / elapsedNs},
+                                {"vectored_writes", static_cast<qint64>(sendQueue.stats().vectoredWrites)},
+                                {"zerocopy_writes", static_cast<qint64>(sendQueue.stats().zeroCopyWrites)}};
+            Bench::report(g_benchName, QStringLiteral("framing"), params, metrics);
+        }
+    }
+}
+
+// Sends frameCount frames of payloadSize bytes as fast as the reader takes them
+std::thread startSource(int fd, int frameCount, int payloadSize)
+{
+    return std::thread([fd, frameCount, payloadSize]() {
+        const int batchFrameCount = qMax(1, (256 * 1024) / (payloadSize + Net::SendQueue::s_headerSize));
+        QByteArray batch;
+        const QByteArray payload = Bench::makePayload(payloadSize);
+        const quint32 header = (Net::g_endianness == QDataStream::BigEndian) ? qToBigEndian<quint32>(payloadSize) : qToLittleEndian<quint32>(payloadSize);
+        for (int i = 0; i < batchFrameCount; ++i)
+            batch.append(reinterpret_cast<const char*>(&header), sizeof(header)).append(payload);
+        pollfd pfd{fd, POLLOUT, 0};
+        for (int sentFrames = 0; sentFrames < frameCount; sentFrames += batchFrameCount)
+        {
+            const int framesNow = qMin(batchFrameCount, frameCount - sentFrames);
+            const char* pData = batch.constData();
+            qint64 leftBytes = static_cast<qint64>(framesNow) * (payloadSize + Net::SendQueue::s_headerSize);
+            while (leftBytes > 0)
+            {
+                if (::poll(&pfd, 1, g_timeoutMs) <= 0)
+                    return;
+                const ssize_t n = ::send(fd, pData, static_cast<size_t>(leftBytes), MSG_DONTWAIT | MSG_NOSIGNAL);
+                if (n > 0)
+                {
+                    pData += n;
+                    leftBytes -= n;
+                }
+                else if ((n < 0) && (errno != EAGAIN) && (errno != EINTR))
+                {
+                    return;
+                }
+            }
+        }
+    });
+}
+
+// TcpServer/TcpClient receive loop before Net::FrameReader: QDataStream per readyRead, resize() per frame, readPartialDone() arguments always evaluated
+int parseLegacy(QTcpSocket* pSocket, Net::PendingMessage& pendingMsg, QByteArray& lastFrame)
+{
+    int frameCount = 0;
+    MAKE_QDATASTREAM_NET_D(streamSocket, pSocket);
+    while (pSocket->bytesAvailable() > 0)
+    {
+        if (pendingMsg.pendingSize == 0)
+        {
+            if (pSocket->bytesAvailable() < static_cast<qint64>(sizeof(pendingMsg.pendingSize)))
+                break;
+            streamSocket >> pendingMsg.pendingSize;
+            pendingMsg.msg.resize(pendingMsg.pendingSize);
+            pendingMsg.curPos = 0;
+        }
+        const decltype(Net::PendingMessage::pendingSize) availableSize = static_cast<decltype(availableSize)>(pSocket->bytesAvailable());
+        if (availableSize < pendingMsg.pendingSize)
+        {
+            streamSocket.readRawData((pendingMsg.msg.data() + pendingMsg.curPos), availableSize);
+            const QByteArray chunk = pendingMsg.msg.mid(pendingMsg.curPos, availableSize);
+            const QDateTime dt = QDateTime::currentDateTimeUtc();
+            Q_UNUSED(chunk) Q_UNUSED(dt)
+            pendingMsg.curPos += availableSize;
+            pendingMsg.pendingSize -= availableSize;
+            break;
+        }
+        streamSocket.readRawData((pendingMsg.msg.data() + pendingMsg.curPos), pendingMsg.pendingSize);
+        const QByteArray chunk = pendingMsg.msg.mid(pendingMsg.curPos, pendingMsg.pendingSize);
+        const QDateTime dt = QDateTime::currentDateTimeUtc();
+        Q_UNUSED(chunk) Q_UNUSED(dt)
+        lastFrame = pendingMsg.msg; // delivered message is shared with its consumer, so next resize() detaches
+        pendingMsg.curPos = 0;
+        pendingMsg.pendingSize = 0;
+        ++frameCount;
+    }
+    return frameCount;
+}
+
+// Receive path alone: helper thread floods one socket with frames, Qt socket in this thread parses them with old loop and with Net::FrameReader
+void benchRecv(QList<int> const& payloadSizes, int messageCount)
+{
+    for (int payloadSize : payloadSizes)
+    {
+        for (const QString mode : {QStringLiteral("legacy"), QStringLiteral("framereader")})
+        {
+            SocketPair pair;
+            if (!pair.open() || (pair.detach(&pair.writer) < 0))
+            {
+                f_logStderr(QStringLiteral("recv: failed to open loopback connection"));
+                return;
+            }
+            QTcpSocket* pSocket = pair.pReader;
+            Net::PendingMessage pendingMsg;
+            Net::FrameReader frameReader;
+            QByteArray lastFrame;
+            int receivedCount = 0;
+            QElapsedTimer timer;
+            timer.start();
+            std::thread source = startSource(pair.detachedFd, messageCount, payloadSize);
+            while (receivedCount < messageCount)
+            {
+                if ((pSocket->bytesAvailable() == 0) && !pSocket->waitForReadyRead(g_timeoutMs))
+                    break;
+                if (mode == QStringLiteral("legacy"))
+                {
+                    receivedCount += parseLegacy(pSocket, pendingMsg, lastFrame);
+                }
+                else
+                {
+                    while (frameReader.readFrame(pSocket, lastFrame))
+                        ++receivedCount;
+                }
+            }
+            const qint64 elapsedNs = timer.nsecsElapsed();
+            source.join();
+
+            QJsonObject params{{"mode", mode}, {"payload_bytes", payloadSize}, {"messages", messageCount}};
+            QJsonObject metrics{{"complete", receivedCount == messageCount},
+                                {"elapsed_ms", elapsedNs / 1e6},
+                                {"frames_per_sec", receivedCount * 1e9 / elapsedNs},
+                                {"mb_per_sec", static_cast<double>(receivedCount) * (payloadSize + Net::SendQueue::s_headerSize) * 1e3 / elapsedNs}};
+            Bench::report(g_benchName, QStringLiteral("recv"), params, metrics);
+        }
+    }
+}
+
+// Raw loopback clients multiplexed with poll() in a plain thread, so that client side costs the same for every backend and 10k connections don't need 10k QTcpSockets.
+// Each client streams messageCount frames and expects all of them echoed back
+std::thread startEchoClients(quint16 serverPort, int clientCount, int messageCount, int payloadSize,
+                             std::atomic<int>& connectedCount, std::atomic<bool>& isStarted, std::atomic<qint64>& receivedBytes)
+{
+    return std::thread([=, &connectedCount, &isStarted, &receivedBytes]() {
+        const qint64 frameSize = Net::SendQueue::s_headerSize + payloadSize;
+        const qint64 totalBytes = frameSize * messageCount;
+        // Stream of frames is periodic, so sending is just walking over a batch of whole frames
+        const QByteArray payload = Bench::makePayload(payloadSize);
+        const quint32 header = (Net::g_endianness == QDataStream::BigEndian) ? qToBigEndian<quint32>(payloadSize) : qToLittleEndian<quint32>(payloadSize);
+        QByteArray batch;
+        for (int i = 0; i < qMax(1, static_cast<int>((64 * 1024) / frameSize)); ++i)
+            batch.append(reinterpret_cast<const char*>(&header), sizeof(header)).append(payload);
+
+        sockaddr_in serverAddr{};
+        serverAddr.sin_family = AF_INET;
+        serverAddr.sin_port = htons(serverPort);
+        serverAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        std::vector<int> fds;
+        std::vector<pollfd> pfds;
+        for (int i = 0; i < clientCount; ++i)
+        {
+            const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            if ((fd < 0) || (::connect(fd, reinterpret_cast<const sockaddr*>(&serverAddr), sizeof(serverAddr)) != 0))
+            {
+                f_logStderr(QString("backends: client connect failed - %1").arg(strerror(errno)));
+                if (fd >= 0)
+                    ::close(fd);
+                break;
+            }
+            fds.push_back(fd);
+            pfds.push_back(pollfd{fd, POLLIN | POLLOUT, 0});
+            connectedCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        while (!isStarted.load())
+            QThread::usleep(200);
+
+        std::vector<qint64> sentBytes(fds.size(), 0);
+        std::vector<qint64> clientReceivedBytes(fds.size(), 0);
+        QByteArray buffer(64 * 1024, Qt::Uninitialized);
+        size_t doneCount = 0;
+        while (doneCount < fds.size())
+        {
+            if (::poll(pfds.data(), pfds.size(), g_timeoutMs) <= 0)
+                break;
+            for (size_t i = 0; i < pfds.size(); ++i)
+            {
+                if (pfds[i].fd < 0)
+                    continue;
+                if ((pfds[i].revents & POLLOUT) && (sentBytes[i] < totalBytes))
+                {
+                    const qint64 batchOffset = sentBytes[i] % batch.size();
+                    const qint64 sendSize = qMin(batch.size() - batchOffset, totalBytes - sentBytes[i]);
+                    const ssize_t n = ::send(fds[i], batch.constData() + batchOffset, static_cast<size_t>(sendSize), MSG_DONTWAIT | MSG_NOSIGNAL);
+                    if (n > 0)
+                        sentBytes[i] += n;
+                    if (sentBytes[i] == totalBytes)
+                        pfds[i].events = POLLIN;
+                }
+                if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR))
+                {
+                    const ssize_t n = ::recv(fds[i], buffer.data(), static_cast<size_t>(buffer.size()), MSG_DONTWAIT);
+                    if (n > 0)
+                    {
+                        clientReceivedBytes[i] += n;
+                        receivedBytes.fetch_add(n, std::memory_order_relaxed);
+                    }
+                    if ((n == 0) || ((n < 0) && (errno != EAGAIN) && (errno != EINTR)) || (clientReceivedBytes[i] >= totalBytes))
+                    {
+                        pfds[i].fd = -1; // poll() skips negative descriptors
+                        ++doneCount;
+                    }
+                }
+            }
+        }
+        for (int fd : fds)
+            ::close(fd);
+    });
+}
+
+qint64 threadCpuTimeNs()
+{
+    timespec ts{};
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<qint64>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Same echo load on TcpServer (QTcpSocket per client) and EpollTcpServer (raw descriptors in one epoll set), both unsharded in one NetThread.
+// Server CPU time is taken in server's own thread, so client threads don't count
+void benchBackends(QStringList const& backends, int clientCount, int clientThreadCount, int messageCount, int payloadSize)
+{
+    // Both ends of every connection are in this process
+    rlimit fileLimit{};
+    if (::getrlimit(RLIMIT_NOFILE, &fileLimit) == 0)
+    {
+        fileLimit.rlim_cur = fileLimit.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &fileLimit);
+    }
+    for (QString const& backend : backends)
+    {
+        NetServer* pServer = nullptr;
+        if (backend == QStringLiteral("qt"))
+            pServer = std::get<0>(Net::instantiateWaitThreadedConnection<TcpServer>());
+#if defined(NET_HAS_EPOLL)
+        else if (backend == QStringLiteral("epoll"))
+            pServer = std::get<0>(Net::instantiateWaitThreadedConnection<EpollTcpServer>());
+#endif
+#if defined(NET_HAS_IO_URING)
+        else if (backend == QStringLiteral("uring"))
+            pServer = std::get<0>(Net::instantiateWaitThreadedConnection<UringTcpServer>());
+#endif
+        if (pServer == nullptr)
+        {
+            f_logStderr(QString("backends: backend %1 is not available").arg(backend));
+            continue;
+        }
+        pServer->setLoggingFunctions(f_logNone, f_logStderr);
+        pServer->setCallbackFunction([pServer](QByteArray msg, NetConnection* const, Net::AddressPort addrPort) {
+            pServer->sendMessageTo(msg, addrPort); // callback runs in server's thread, so reply is sent right away
+        });
+        std::atomic<int> serverConnectedCount{0};
+        QObject::connect(pServer, &NetServer::clientConnected, pServer, [&serverConnectedCount]() {
+            serverConnectedCount.fetch_add(1, std::memory_order_relaxed);
+        }, Qt::DirectConnection);
+        Net::ConnectionSettings serverSettings;
+        serverSettings.ipLocal = QHostAddress::LocalHost;
+        Net::openWaitThreadedConnection(pServer, serverSettings);
+        const quint16 serverPort = pServer->getConnectionSettingsActive().portIn;
+
+        std::atomic<int> connectedCount{0};
+        std::atomic<bool> isStarted{false};
+        std::atomic<qint64> receivedBytes{0};
+        std::vector<std::thread> clientThreads;
+        for (int i = 0; i < clientThreadCount; ++i)
+        {
+            const int threadClientCount = clientCount / clientThreadCount + ((i < clientCount % clientThreadCount) ? 1 : 0);
+            clientThreads.push_back(startEchoClients(serverPort, threadClientCount, messageCount, payloadSize, connectedCount, isStarted, receivedBytes));
+        }
+        Bench::waitFor([&]() { return (connectedCount.load() >= clientCount) && (serverConnectedCount.load() >= clientCount); }, g_timeoutMs);
+
+        qint64 serverCpuStartNs = 0;
+        Net::IoStats ioStatsStart;
+        QMetaObject::invokeMethod(pServer, [&]() {
+            serverCpuStartNs = threadCpuTimeNs();
+            ioStatsStart = pServer->getIoStats();
+        }, Qt::BlockingQueuedConnection);
+        const qint64 frameSize = Net::SendQueue::s_headerSize + payloadSize;
+        const qint64 expectedBytes = static_cast<qint64>(connectedCount.load()) * messageCount * frameSize;
+        QElapsedTimer timer;
+        timer.start();
+        isStarted.store(true);
+        const bool isComplete = Bench::waitFor([&receivedBytes, expectedBytes]() { return receivedBytes.load() >= expectedBytes; }, g_timeoutMs);
+        const qint64 elapsedNs = timer.nsecsElapsed();
+        qint64 serverCpuNs = 0;
+        Net::IoStats ioStats;
+        QMetaObject::invokeMethod(pServer, [&]() {
+            serverCpuNs = threadCpuTimeNs() - serverCpuStartNs;
+            ioStats = pServer->getIoStats();
+        }, Qt::BlockingQueuedConnection);
+        const quint64 syscallCount = ioStats.syscalls - ioStatsStart.syscalls;
+        for (std::thread& thread : clientThreads)
+            thread.join();
+
+        const qint64 echoedCount = receivedBytes.load() / frameSize;
+        QJsonObject params{{"backend", backend}, {"clients", connectedCount.load()}, {"client_threads", clientThreadCount}, {"messages_per_client", messageCount}, {"payload_bytes", payloadSize}};
+        QJsonObject metrics{{"complete", isComplete},
+                            {"elapsed_ms", elapsedNs / 1e6},
+                            {"msgs_per_sec", echoedCount * 1e9 / elapsedNs},
+                            {"server_cpu_ms", serverCpuNs / 1e6},
+                            {"server_cpu_us_per_msg", (echoedCount > 0) ? serverCpuNs / 1e3 / echoedCount : 0.0},
+                            // per echoed message, i.e. one received and one sent; TcpServer leaves syscalls to Qt and reports none
+                            {"server_syscalls_per_msg", (echoedCount > 0) ? static_cast<double>(syscallCount) / echoedCount : 0.0}};
+        Bench::report(g_benchName, QStringLiteral("backends"), params, metrics);
+
+        Net::destroyWaitThreadedConnection(pServer);
+    }
+}
+
+// Time to instantiate and open connectionCount clients in clientThreadCount NetThreads: one wait per step against firing all async steps and waiting on their futures
+void benchStartup(int connectionCount, int clientThreadCount)
+{
+    TcpServer* pServer = std::get<0>(Net::instantiateWaitThreadedConnection<TcpServer>());
+    pServer->setLoggingFunctions(f_logNone, f_logStderr);
+    Net::ConnectionSettings serverSettings;
+    serverSettings.ipLocal = QHostAddress::LocalHost;
+    Net::openWaitThreadedConnection(pServer, serverSettings);
+    Net::ConnectionSettings clientSettings;
+    clientSettings.ipDestination = QHostAddress::LocalHost;
+    clientSettings.portOut = pServer->getConnectionSettingsActive().portIn;
+
+    for (const QString mode : {QStringLiteral("wait"), QStringLiteral("async")})
+    {
+        QVector<NetThread*> threads;
+        for (int i = 0; i < clientThreadCount; ++i)
+        {
+            threads.append(new NetThread);
+            threads.last()->start();
+        }
+        QVector<TcpClient*> clients;
+        QElapsedTimer timer;
+        timer.start();
+        if (mode == QStringLiteral("wait"))
+        {
+            for (int i = 0; i < connectionCount; ++i)
+                clients.append(std::get<0>(Net::instantiateWaitThreadedConnection<TcpClient>(threads.at(i % clientThreadCount))));
+        }
+        else
+        {
+            std::vector<std::future<std::tuple<TcpClient*, NetThread*>>> futures;
+            for (int i = 0; i < connectionCount; ++i)
+                futures.push_back(Net::instantiateThreadedConnectionAsync<TcpClient>(threads.at(i % clientThreadCount)));
+            for (auto& future : futures)
+                clients.append(std::get<0>(future.get()));
+        }
+        const qint64 instantiateNs = timer.nsecsElapsed();
+        // Clients are idle and not open yet, so they can be configured from here
+        std::atomic<int> openedCount{0};
+        for (TcpClient* pClient : qAsConst(clients))
+        {
+            pClient->setLoggingFunctions(f_logNone, f_logStderr);
+            pClient->setEnableReconnect(false);
+            pClient->setCallbackFunction([](QByteArray, NetConnection* const, Net::AddressPort) {});
+            QObject::connect(pClient, &NetConnection::openedConnection, pClient, [&openedCount](bool isOpened) {
+                if (isOpened)
+                    openedCount.fetch_add(1, std::memory_order_relaxed);
+            }, Qt::DirectConnection);
+        }
+        timer.restart();
+        if (mode == QStringLiteral("wait"))
+        {
+            for (TcpClient* pClient : qAsConst(clients))
+                Net::openWaitThreadedConnection(pClient, clientSettings);
+        }
+        else
+        {
+            std::vector<std::future<Net::ConnectionState>> futures;
+            for (TcpClient* pClient : qAsConst(clients))
+                futures.push_back(Net::openThreadedConnectionAsync(pClient, clientSettings));
+            for (auto& future : futures)
+                future.wait();
+        }
+        Bench::waitFor([&openedCount, connectionCount]() { return openedCount.load() >= connectionCount; }, g_timeoutMs); // TcpClient connects asynchronously
+        const qint64 openNs = timer.nsecsElapsed();
+
+        QJsonObject params{{"mode", mode}, {"connections", connectionCount}, {"client_threads", clientThreadCount}};
+        QJsonObject metrics{{"opened", openedCount.load()},
+                            {"instantiate_ms", instantiateNs / 1e6},
+                            {"open_ms", openNs / 1e6},
+                            {"us_per_connection", (instantiateNs + openNs) / 1e3 / qMax(1, connectionCount)}};
+        Bench::report(g_benchName, QStringLiteral("startup"), params, metrics);
+
+        // NetThreads quit and delete themselves once their last connection is gone
+        std::vector<std::future<void>> futures;
+        for (TcpClient* pClient : qAsConst(clients))
+            futures.push_back(Net::destroyThreadedConnectionAsync(pClient));
+        for (auto& future : futures)
+            future.wait();
+    }
+    Net::destroyWaitThreadedConnection(pServer);
+}
+
+// Connected clients lose the server for downtimeMs and reconnect on their own once it's back on the same port.
+// Reported are the time from server's return until every client is connected again, and clients' own reconnect latencies (which include the downtime)
+void benchReconnect(int clientCount, int clientThreadCount, int downtimeMs)
+{
+    TcpServer* pServer = std::get<0>(Net::instantiateWaitThreadedConnection<TcpServer>());
+    pServer->setLoggingFunctions(f_logNone, f_logStderr);
+    pServer->setCallbackFunction([](QByteArray, NetConnection* const, Net::AddressPort) {});
+    std::atomic<int> connectedCount{0};
+    QObject::connect(pServer, &TcpServer::clientConnected, pServer, [&connectedCount]() {
+        connectedCount.fetch_add(1, std::memory_order_relaxed);
+    }, Qt::DirectConnection);
+    Net::ConnectionSettings serverSettings;
+    serverSettings.ipLocal = QHostAddress::LocalHost;
+    Net::openWaitThreadedConnection(pServer, serverSettings);
+    serverSettings.portIn = pServer->getConnectionSettingsActive().portIn;
+
+    std::atomic<qint64> receivedCount{0};
+    const QVector<TcpClient*> clients = makeClients(clientCount, clientThreadCount, serverSettings.portIn, receivedCount);
+    Bench::waitFor([&connectedCount, clientCount]() { return connectedCount.load() >= clientCount; }, g_timeoutMs);
+
+    Net::closeWaitThreadedConnection(pServer);
+    QThread::msleep(static_cast<unsigned long>(downtimeMs));
+    connectedCount.store(0);
+    QElapsedTimer timer;
+    timer.start();
+    Net::openWaitThreadedConnection(pServer, serverSettings);
+    const bool isComplete = Bench::waitFor([&connectedCount, clientCount]() { return connectedCount.load() >= clientCount; }, g_timeoutMs);
+    const qint64 elapsedNs = timer.nsecsElapsed();
+
+    qint64 maxLatency = 0;
+    qint64 totalLatency = 0;
+    quint64 attemptCount = 0;
+    for (TcpClient* pClient : clients)
+    {
+        Net::ReconnectStats stats;
+        QMetaObject::invokeMethod(pClient, [pClient, &stats]() { stats = pClient->getReconnectStats(); }, Qt::BlockingQueuedConnection);
+        maxLatency = qMax(maxLatency, stats.maxReconnectLatency);
+        totalLatency += stats.totalReconnectLatency;
+        attemptCount += stats.attemptCount;
+    }
+
+    QJsonObject params{{"clients", clientCount}, {"client_threads", clientThreadCount}, {"downtime_ms", downtimeMs}};
+    QJsonObject metrics{{"complete", isComplete},
+                        {"all_reconnected_ms", elapsedNs / 1e6},
+                        {"client_reconnect_avg_ms", static_cast<double>(totalLatency) / qMax(1, clientCount)},
+                        {"client_reconnect_max_ms", static_cast<double>(maxLatency)},
+                        {"attempts_per_client", static_cast<double>(attemptCount) / qMax(1, clientCount)}};
+    Bench::report(g_benchName, QStringLiteral("reconnect"), params, metrics);
+
+    for (TcpClient* pClient : clients)
+        Net::destroyWaitThreadedConnection(pClient);
+    Net::destroyWaitThreadedConnection(pServer);
+}
+
+// Cost of moving a message from producer threads to a consumer thread's event loop: an invokeMethod() event per message against Net::MessageChannel woken once per batch
+void benchHandoff(int producerCount, int messageCount, int payloadSize)
+{
+    const QByteArray payload = Bench::makePayload(payloadSize);
+    const qint64 expectedCount = static_cast<qint64>(producerCount) * messageCount;
+    for (const QString mode : {QStringLiteral("invoke"), QStringLiteral("channel")})
+    {
+        QObject consumer; // lives in main thread, which is the consuming one
+        QEventLoop loop;
+        qint64 consumedCount = 0;
+        auto f_onMessage = [&](const QByteArray&) {
+            if (++consumedCount == expectedCount)
+                loop.quit();
+        };
+        const bool isChannel = (mode == QStringLiteral("channel"));
+        auto pChannel = std::make_shared<Net::MessageChannel<QByteArray>>();
+        pChannel->setConsumer(&consumer, [&f_onMessage](QByteArray& msg) { f_onMessage(msg); });
+
+        QElapsedTimer timer;
+        timer.start();
+        std::atomic<int> finishedCount{0};
+        std::vector<std::thread> producers;
+        for (int i = 0; i < producerCount; ++i)
+        {
+            producers.emplace_back([&, isChannel]() {
+                for (int j = 0; j < messageCount; ++j)
+                {
+                    if (isChannel)
+                        pChannel->push(QByteArray(payload));
+                    else
+                        QMetaObject::invokeMethod(&consumer, [&f_onMessage, msg = payload]() { f_onMessage(msg); }, Qt::QueuedConnection);
+                }
+                ++finishedCount;
+            });
+        }
+        QTimer::singleShot(g_timeoutMs, &loop, &QEventLoop::quit);
+        loop.exec();
+        const qint64 elapsedNs = timer.nsecsElapsed();
+        // Incomplete run: producers may wait on a full channel, and their leftovers must not outlive consumer
+        while (finishedCount.load() < producerCount)
+            QCoreApplication::processEvents();
+        for (std::thread& producer : producers)
+            producer.join();
+        QCoreApplication::processEvents();
+        const quint64 wakeCount = isChannel ? pChannel->wakeCount() : static_cast<quint64>(expectedCount);
+
+        QJsonObject params{{"mode", mode}, {"producers", producerCount}, {"messages_per_producer", messageCount}, {"payload_bytes", payloadSize}};
+        QJsonObject metrics{{"complete", consumedCount == expectedCount},
+                            {"elapsed_ms", elapsedNs / 1e6},
+                            {"msgs_per_sec", consumedCount * 1e9 / elapsedNs},
+                            {"ns_per_msg", (consumedCount > 0) ? static_cast<double>(elapsedNs) / consumedCount : 0.0},
+                            {"msgs_per_wake", (wakeCount > 0) ? static_cast<double>(consumedCount) / wakeCount : 0.0}};
+        Bench::report(g_benchName, QStringLiteral("handoff"), params, metrics);
+    }
+}
+// SortArray requests and results as the example app sends them: random numbers before sorting, ascending ones after, in both message formats
+QVector<std::pair<QString, QByteArray>> makeTypicalPayloads(int elementCount)
+{
+    std::mt19937 gen{42};
+    std::uniform_int_distribution<int> dist(-1000000, 1000000);
+    Protocol::Request_SortArray request;
+    request.numbers.reserve(elementCount);
+    for (int i = 0; i < elementCount; ++i)
+        request.numbers.append(dist(gen));
+    Protocol::Request_SortArray result = request;
+    std::sort(result.numbers.begin(), result.numbers.end());
+
+    QVector<std::pair<QString, QByteArray>> payloads;
+    for (auto const& pair : {std::make_pair(QStringLiteral("request"), &request), std::make_pair(QStringLiteral("result"), &result)})
+    {
+        QByteArray binary;
+        MAKE_QDATASTREAM_NET(stream, &binary, QIODevice::WriteOnly);
+        stream << *pair.second;
+        payloads.append({pair.first + QStringLiteral("_binary"), binary});
+        QJsonObject jsonObject;
+        pair.second->serialize(jsonObject);
+        payloads.append({pair.first + QStringLiteral("_json"), QJsonDocument(jsonObject).toJson(QJsonDocument::Compact)});
+    }
+    return payloads;
+}
+
+// CPU cost of each codec against bytes it saves. Every payload is processed repeatedly, about 64 MiB in total, so that small ones are measurable too
+void benchCompression(QList<int> const& elementCounts)
+{
+    for (int elementCount : elementCounts)
+    {
+        for (auto const& payload : makeTypicalPayloads(elementCount))
+        {
+            const QByteArray& raw = payload.second;
+            const int repeatCount = qMax(1, (64 * 1024 * 1024) / qMax(1, raw.size()));
+            for (Net::Codec codec : {Net::Codec::Zlib, Net::Codec::Lz})
+            {
+                QElapsedTimer timer;
+                timer.start();
+                QByteArray encoded;
+                for (int i = 0; i < repeatCount; ++i)
+                    encoded = Net::compressPayload(raw, codec);
+                const qint64 compressNs = timer.nsecsElapsed() / repeatCount;
+                if (encoded.isNull()) // no smaller than raw, would be sent as is
+                {
+                    Bench::report(g_benchName, QStringLiteral("compression"),
+                                  QJsonObject{{"codec", Net::toQString(codec)}, {"payload", payload.first}, {"elements", elementCount}},
+                                  QJsonObject{{"raw_bytes", raw.size()}, {"compressed", false}, {"compress_us", compressNs / 1e3}});
+                    continue;
+                }
+                timer.restart();
+                QByteArray decoded;
+                bool isOk = true;
+                for (int i = 0; i < repeatCount; ++i)
+                    isOk = Net::decompressPayload(encoded, decoded, std::numeric_limits<int>::max()) && isOk;
+                const qint64 decompressNs = timer.nsecsElapsed() / repeatCount;
+
+                QJsonObject params{{"codec", Net::toQString(codec)}, {"payload", payload.first}, {"elements", elementCount}};
+                QJsonObject metrics{{"raw_bytes", raw.size()},
+                                    {"encoded_bytes", encoded.size()},
+                                    {"compressed", true},
+                                    {"round_trip_ok", isOk && (decoded == raw)},
+                                    {"ratio", static_cast<double>(raw.size()) / encoded.size()},
+                                    {"saved_percent", 100.0 * (raw.size() - encoded.size()) / raw.size()},
+                                    {"compress_us", compressNs / 1e3},
+                                    {"decompress_us", decompressNs / 1e3},
+                                    {"compress_mb_per_sec", raw.size() * 1e3 / qMax<qint64>(1, compressNs)},
+                                    {"decompress_mb_per_sec", raw.size() * 1e3 / qMax<qint64>(1, decompressNs)},
+                                    // CPU spent per byte kept off the wire, both ends together
+                                    {"ns_per_saved_byte", static_cast<double>(compressNs + decompressNs) / qMax(1, raw.size() - encoded.size())}};
+                Bench::report(g_benchName, QStringLiteral("compression"), params, metrics);
+            }
+        }
+    }
+}
+
+// One client ping-pongs messageCount messages with an echo server, over TCP loopback, over local socket and in memory, timing every round trip.
+// Both ends are single Net connections, so the difference is the transport stack and not framing or threading; memory is the floor of the other two
+void benchLocal(QStringList const& transports, QList<int> const& payloadSizes, int messageCount)
+{
+    for (QString const& transport : transports)
+    {
+        for (int payloadSize : payloadSizes)
+        {
+            NetServer* pServer = nullptr;
+            NetClient* pClient = nullptr;
+            Net::ConnectionSettings serverSettings;
+            if (transport == QStringLiteral("tcp"))
+            {
+                pServer = std::get<0>(Net::instantiateWaitThreadedConnection<TcpServer>());
+                pClient = std::get<0>(Net::instantiateWaitThreadedConnection<TcpClient>());
+                serverSettings.ipLocal = QHostAddress::LocalHost;
+            }
+            else if (transport == QStringLiteral("local"))
+            {
+                pServer = std::get<0>(Net::instantiateWaitThreadedConnection<LocalServer>());
+                pClient = std::get<0>(Net::instantiateWaitThreadedConnection<LocalClient>());
+                serverSettings.localServerName = QString("bench_net-%1").arg(QCoreApplication::applicationPid());
+            }
+            else if (transport == QStringLiteral("memory"))
+            {
+                pServer = std::get<0>(Net::instantiateWaitThreadedConnection<MemoryServer>());
+                pClient = std::get<0>(Net::instantiateWaitThreadedConnection<MemoryClient>());
+                serverSettings.localServerName = QStringLiteral("bench_net");
+            }
+            else
+            {
+                f_logStderr(QString("local: transport %1 is not available").arg(transport));
+                break;
+            }
+            pServer->setLoggingFunctions(f_logNone, f_logStderr);
+            pServer->setCallbackFunction([pServer](QByteArray msg, NetConnection* const, Net::AddressPort addrPort) {
+                pServer->sendMessageTo(msg, addrPort); // callback runs in server's thread, so reply is sent right away
+            });
+            std::atomic<int> serverConnectedCount{0};
+            QObject::connect(pServer, &NetServer::clientConnected, pServer, [&serverConnectedCount]() {
+                serverConnectedCount.fetch_add(1, std::memory_order_relaxed);
+            }, Qt::DirectConnection);
+            Net::openWaitThreadedConnection(pServer, serverSettings);
+
+            // Next ping is sent right from the callback in client's thread, so nothing but the transport sits between two round trips
+            const QByteArray payload = Bench::makePayload(payloadSize);
+            std::vector<qint64> roundTripNs;
+            roundTripNs.reserve(messageCount);
+            QElapsedTimer roundTripTimer;
+            std::atomic<bool> isDone{false};
+            std::atomic<bool> isClientConnected{false};
+            pClient->setLoggingFunctions(f_logNone, f_logStderr);
+            pClient->setEnableReconnect(false);
+            pClient->setCallbackFunction([&, messageCount](QByteArray msg, NetConnection* const pConnection, Net::AddressPort) {
+                roundTripNs.push_back(roundTripTimer.nsecsElapsed());
+                if (static_cast<int>(roundTripNs.size()) >= messageCount)
+                {
+                    isDone.store(true, std::memory_order_release);
+                    return;
+                }
+                roundTripTimer.start();
+                pConnection->sendMessage(msg);
+            });
+            QObject::connect(pClient, &NetConnection::openedConnection, pClient, [&isClientConnected](bool isOpened) {
+                if (isOpened)
+                    isClientConnected.store(true);
+            }, Qt::DirectConnection);
+            Net::ConnectionSettings clientSettings;
+            clientSettings.ipDestination = QHostAddress::LocalHost;
+            clientSettings.portOut = pServer->getConnectionSettingsActive().portIn;
+            clientSettings.localServerName = serverSettings.localServerName;
+            Net::openWaitThreadedConnection(pClient, clientSettings);
+            Bench::waitFor([&]() { return isClientConnected.load() && (serverConnectedCount.load() >= 1); }, g_timeoutMs);
+
+            QElapsedTimer timer;
+            timer.start();
+            QMetaObject::invokeMethod(pClient, [&]() {
+                roundTripTimer.start();
+                pClient->sendMessage(payload);
+            }, Qt::QueuedConnection);
+            const bool isComplete = Bench::waitFor([&isDone]() { return isDone.load(std::memory_order_acquire); }, g_timeoutMs);
+            const qint64 elapsedNs = timer.nsecsElapsed();
+            Net::destroyWaitThreadedConnection(pClient); // callback may not touch roundTripNs past this point
+            Net::destroyWaitThreadedConnection(pServer);
+
+            std::sort(roundTripNs.begin(), roundTripNs.end());
+            auto lambda_percentileUs = [&roundTripNs](double fraction) {
+                if (roundTripNs.empty())
+                    return 0.0;
+                return roundTripNs[static_cast<size_t>(fraction * (roundTripNs.size() - 1))] / 1e3;
+            };
+            qint64 totalRoundTripNs = 0;
+            for (qint64 ns : roundTripNs)
+                totalRoundTripNs += ns;
+            const qint64 roundTripCount = static_cast<qint64>(roundTripNs.size());
+            QJsonObject params{{"transport", transport}, {"messages", messageCount}, {"payload_bytes", payloadSize}};
+            QJsonObject metrics{{"complete", isComplete},
+                                {"elapsed_ms", elapsedNs / 1e6},
+                                {"round_trips_per_sec", roundTripCount * 1e9 / elapsedNs},
+                                {"rtt_mean_us", (roundTripCount > 0) ? totalRoundTripNs / 1e3 / roundTripCount : 0.0},
+                                {"rtt_p50_us", lambda_percentileUs(0.5)},
+                                {"rtt_p99_us", lambda_percentileUs(0.99)},
+                                {"rtt_max_us", lambda_percentileUs(1.0)}};
+            Bench::report(g_benchName, QStringLiteral("local"), params, metrics);
+        }
+    }
+}
+
+// TcpServer echo and one TcpClient keeping window messages in flight: window 1 is ping-pong latency, larger windows show pipelined framing throughput.
+// Each payload carries its send time, so latency of every message is known regardless of how replies interleave
+void benchLoopback(QList<int> const& payloadSizes, QList<int> const& windows, int messageCount)
+{
+    for (int window : windows)
+    {
+        for (int payloadSize : payloadSizes)
+        {
+            payloadSize = qMax<int>(payloadSize, sizeof(qint64));
+            TcpServer* pServer = std::get<0>(Net::instantiateWaitThreadedConnection<TcpServer>());
+            TcpClient* pClient = std::get<0>(Net::instantiateWaitThreadedConnection<TcpClient>());
+            pServer->setLoggingFunctions(f_logNone, f_logStderr);
+            pServer->setCallbackFunction([pServer](QByteArray msg, NetConnection* const, Net::AddressPort addrPort) {
+                pServer->sendMessageTo(msg, addrPort); // callback runs in server's thread, so reply is sent right away
+            });
+            std::atomic<int> serverConnectedCount{0};
+            QObject::connect(pServer, &NetServer::clientConnected, pServer, [&serverConnectedCount]() {
+                serverConnectedCount.fetch_add(1, std::memory_order_relaxed);
+            }, Qt::DirectConnection);
+            Net::ConnectionSettings serverSettings;
+            serverSettings.ipLocal = QHostAddress::LocalHost;
+            Net::openWaitThreadedConnection(pServer, serverSettings);
+
+            QByteArray payload = Bench::makePayload(payloadSize);
+            QElapsedTimer clock;
+            clock.start();
+            Metrics::Histogram latencyNs;
+            int sentCount = 0;
+            std::atomic<int> receivedCount{0};
+            std::atomic<bool> isClientConnected{false};
+            auto lambda_send = [&](NetConnection* const pConnection) {
+                const qint64 sentAtNs = clock.nsecsElapsed();
+                std::memcpy(payload.data(), &sentAtNs, sizeof(sentAtNs));
+                pConnection->sendMessage(payload);
+                ++sentCount;
+            };
+            pClient->setLoggingFunctions(f_logNone, f_logStderr);
+            pClient->setEnableReconnect(false);
+            // Runs in client's thread, same as lambda_send after the first window, so sentCount and payload need no locking
+            pClient->setCallbackFunction([&, messageCount](QByteArray msg, NetConnection* const pConnection, Net::AddressPort) {
+                qint64 sentAtNs = 0;
+                std::memcpy(&sentAtNs, msg.constData(), qMin<size_t>(sizeof(sentAtNs), msg.size()));
+                latencyNs.record(clock.nsecsElapsed() - sentAtNs);
+                receivedCount.fetch_add(1, std::memory_order_release);
+                if (sentCount < messageCount)
+                    lambda_send(pConnection);
+            });
+            QObject::connect(pClient, &NetConnection::openedConnection, pClient, [&isClientConnected](bool isOpened) {
+                if (isOpened)
+                    isClientConnected.store(true);
+            }, Qt::DirectConnection);
+            Net::ConnectionSettings clientSettings;
+            clientSettings.ipDestination = QHostAddress::LocalHost;
+            clientSettings.portOut = pServer->getConnectionSettingsActive().portIn;
+            Net::openWaitThreadedConnection(pClient, clientSettings);
+            Bench::waitFor([&]() { return isClientConnected.load() && (serverConnectedCount.load() >= 1); }, g_timeoutMs);
+
+            QElapsedTimer timer;
+            timer.start();
+            QMetaObject::invokeMethod(pClient, [&]() {
+                for (int i = 0; (i < window) && (sentCount < messageCount); ++i)
+                    lambda_send(pClient);
+            }, Qt::QueuedConnection);
+            const bool isComplete = Bench::waitFor([&receivedCount, messageCount]() { return receivedCount.load(std::memory_order_acquire) >= messageCount; }, g_timeoutMs);
+            const qint64 elapsedNs = timer.nsecsElapsed();
+            Net::destroyWaitThreadedConnection(pClient); // callback may not touch latencyNs past this point
+            Net::destroyWaitThreadedConnection(pServer);
+
+            const qint64 echoedCount = receivedCount.load();
+            QJsonObject params{{"window", window}, {"messages", messageCount}, {"payload_bytes", payloadSize}};
+            QJsonObject metrics{{"complete", isComplete},
+                                {"elapsed_ms", elapsedNs / 1e6},
+                                {"msgs_per_sec", echoedCount * 1e9 / elapsedNs},
+                                {"mb_per_sec", echoedCount * payloadSize * 1e3 / elapsedNs}, // one way
+                                {"latency_mean_us", (echoedCount > 0) ? latencyNs.sum() / 1e3 / echoedCount : 0.0},
+                                {"latency_p50_us", latencyNs.quantile(0.5) / 1e3},
+                                {"latency_p99_us", latencyNs.quantile(0.99) / 1e3},
+                                {"latency_p999_us", latencyNs.quantile(0.999) / 1e3},
+                                {"latency_max_us", latencyNs.max() / 1e3}};
+            Bench::report(g_benchName, QStringLiteral("loopback"), params, metrics);
+        }
+    }
+}
+
+// Authorization deadlines of a reconnect storm: every accepted socket arms one and cancels it once authorized.
+// "qtimer" is a QTimer per socket in an ordered map, as servers did before Net::TimerWheel
+void benchDeadlines(int socketCount)
+{
+    QVector<quintptr> sockets(socketCount);
+    for (int i = 0; i < socketCount; ++i)
+        sockets[i] = static_cast<quintptr>(i + 1) * 64; // stand-in for socket pointers
+    for (const QString mode : {QStringLiteral("qtimer"), QStringLiteral("wheel")})
+    {
+        QObject owner;
+        QMap<quintptr, std::shared_ptr<QTimer>> timerBySocket;
+        QHash<quintptr, Net::TimerWheel::Handle> handleBySocket;
+        Net::TimerWheel* pWheel = Net::TimerWheel::forCurrentThread();
+        const bool isWheel = (mode == QStringLiteral("wheel"));
+
+        QElapsedTimer timer;
+        timer.start();
+        for (quintptr socket : qAsConst(sockets))
+        {
+            if (isWheel)
+            {
+                handleBySocket.insert(socket, pWheel->schedule(3000, [] {}));
+                continue;
+            }
+            auto pTimer = std::make_shared<QTimer>(&owner);
+            pTimer->setInterval(3000);
+            pTimer->setSingleShot(true);
+            pTimer->start();
+            timerBySocket.insert(socket, pTimer);
+        }
+        const qint64 armNs = timer.nsecsElapsed();
+        timer.restart();
+        for (quintptr socket : qAsConst(sockets))
+        {
+            if (isWheel)
+            {
+                auto iter = handleBySocket.find(socket);
+                pWheel->cancel(iter.value());
+                handleBySocket.erase(iter);
+                continue;
+            }
+            auto iter = timerBySocket.find(socket);
+            iter.value()->stop();
+            timerBySocket.erase(iter);
+        }
+        const qint64 cancelNs = timer.nsecsElapsed();
+
+        QJsonObject params{{"mode", mode}, {"sockets", socketCount}};
+        QJsonObject metrics{{"arm_ns_per_socket", static_cast<double>(armNs) / qMax(1, socketCount)},
+                            {"cancel_ns_per_socket", static_cast<double>(cancelNs) / qMax(1, socketCount)}};
+        Bench::report(g_benchName, QStringLiteral("deadlines"), params, metrics);
+    }
+}
+
+// Server pushes messageCount messages to all clientCount clients: one sendMessageToQueued() per recipient versus one broadcastMessageQueued()
+void benchFanout(int clientCount, int clientThreadCount, int messageCount, int payloadSize)
+{
+    const QByteArray payload = Bench::makePayload(payloadSize);
+    for (const QString mode : {QStringLiteral("unicast"), QStringLiteral("broadcast")})
+    {
+        TcpServer* pServer = std::get<0>(Net::instantiateWaitThreadedConnection<TcpServer>());
+        pServer->setLoggingFunctions(f_logNone, f_logStderr);
+        QMutex peersMutex;
+        QVector<Net::AddressPort> peers;
+        QObject::connect(pServer, &TcpServer::clientConnected, pServer, [&peersMutex, &peers](Net::AddressPort addrPort) {
+            QMutexLocker locker(&peersMutex);
+            peers.append(addrPort);
+        }, Qt::DirectConnection);
+        Net::ConnectionSettings serverSettings;
+        serverSettings.ipLocal = QHostAddress::LocalHost;
+        Net::openWaitThreadedConnection(pServer, serverSettings);
+
+        std::atomic<qint64> receivedCount{0};
+        const QVector<TcpClient*> clients = makeClients(clientCount, clientThreadCount, pServer->getConnectionSettingsActive().portIn, receivedCount);
+        Bench::waitFor([&peersMutex, &peers, clientCount]() { QMutexLocker locker(&peersMutex); return peers.size() >= clientCount; }, g_timeoutMs);
+
+        const qint64 expectedCount = static_cast<qint64>(clientCount) * messageCount;
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < messageCount; ++i)
+        {
+            if (mode == QStringLiteral("broadcast"))
+            {
+                emit pServer->broadcastMessageQueued(payload);
+                continue;
+            }
+            for (Net::AddressPort const& addrPort : qAsConst(peers))
+                emit pServer->sendMessageToQueued(payload, addrPort);
+        }
+        const bool isComplete = Bench::waitFor([&receivedCount, expectedCount]() { return receivedCount.load() >= expectedCount; }, g_timeoutMs);
+        const qint64 elapsedNs = timer.nsecsElapsed();
+
+        QJsonObject params{{"mode", mode}, {"clients", clientCount}, {"client_threads", clientThreadCount}, {"messages", messageCount}, {"payload_bytes", payloadSize}};
+        QJsonObject metrics{{"complete", isComplete}, {"elapsed_ms", elapsedNs / 1e6}, {"deliveries_per_sec", receivedCount.load() * 1e9 / elapsedNs}};
+        Bench::report(g_benchName, QStringLiteral("fanout"), params, metrics);
+
+        for (TcpClient* pClient : clients)
+            Net::destroyWaitThreadedConnection(pClient);
+        Net::destroyWaitThreadedConnection(pServer);
+    }
+}
+
+qint64 residentBytes()
+{
+    QFile statm(QStringLiteral("/proc/self/statm"));
+    if (!statm.open(QIODevice::ReadOnly))
+        return 0;
+    const QList<QByteArray> fields = statm.readAll().split(' ');
+    return (fields.size() > 1) ? fields.at(1).toLongLong() * ::sysconf(_SC_PAGESIZE) : 0;
+}
+
+// AddressPort hashed as before: by toIPv4Address() only
+struct LegacyAddressPort
+{
+    Net::AddressPort addrPort;
+};
+bool operator==(const LegacyAddressPort& lhv, const LegacyAddressPort& rhv) { return lhv.addrPort == rhv.addrPort; }
+uint qHash(const LegacyAddressPort& key, uint seed) { return ::qHash(key.addrPort.addr.toIPv4Address(), seed) ^ key.addrPort.port; }
+
+// Server side memory of idle connections (raw sockets connect and stay silent; RSS growth of the process divided by their count),
+// then cost of finding a client: by peer with IPv4 and IPv6 peers, under the old and the fixed hash, and by ClientTable handle
+void benchClients(int clientCount)
+{
+    TcpServer* pServer = std::get<0>(Net::instantiateWaitThreadedConnection<TcpServer>());
+    pServer->setLoggingFunctions(f_logNone, f_logStderr);
+    Net::ConnectionSettings serverSettings;
+    serverSettings.ipLocal = QHostAddress::LocalHost;
+    Net::openWaitThreadedConnection(pServer, serverSettings);
+    sockaddr_in serverAddr{};
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = htons(pServer->getConnectionSettingsActive().portIn);
+    serverAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    const qint64 rssBefore = residentBytes();
+    std::vector<int> fds;
+    for (int i = 0; i < clientCount; ++i)
+    {
+        const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if ((fd < 0) || (::connect(fd, reinterpret_cast<sockaddr*>(&serverAddr), sizeof(serverAddr)) != 0))
+        {
+            qWarning("connect failed after %d clients: %s", i, std::strerror(errno));
+            if (fd >= 0)
+                ::close(fd);
+            break;
+        }
+        fds.push_back(fd);
+    }
+    const int connectedCount = static_cast<int>(fds.size());
+    Bench::waitFor([pServer, connectedCount]() { return static_cast<int>(pServer->getConnectionCount()) >= connectedCount; }, g_timeoutMs);
+    const qint64 rssGrowth = residentBytes() - rssBefore;
+    QJsonObject memoryParams{{"mode", "memory"}, {"clients", connectedCount}};
+    QJsonObject memoryMetrics{{"server_connections", static_cast<int>(pServer->getConnectionCount())},
+                              {"rss_growth_kb", rssGrowth / 1024},
+                              {"bytes_per_connection", static_cast<double>(rssGrowth) / qMax(1, connectedCount)}};
+    Bench::report(g_benchName, QStringLiteral("clients"), memoryParams, memoryMetrics);
+    for (int fd : fds)
+        ::close(fd);
+    Net::destroyWaitThreadedConnection(pServer);
+
+    for (const QString family : {QStringLiteral("ipv4"), QStringLiteral("ipv6")})
+    {
+        QVector<Net::AddressPort> peers;
+        peers.reserve(clientCount);
+        for (int i = 0; i < clientCount; ++i)
+        {
+            const QHostAddress addr = (family == QStringLiteral("ipv4"))
+                    ? QHostAddress(quint32(0x0A000000u + static_cast<quint32>(i)))
+                    : QHostAddress(QStringLiteral("2001:db8::%1:%2").arg(i >> 16, 0, 16).arg(i & 0xFFFF, 0, 16));
+            peers.append(Net::AddressPort{addr, static_cast<quint16>(40000 + i % 20000)});
+        }
+        Net::ClientTable<Net::AddressPort> table;
+        QVector<Net::ClientHandle> handles;
+        QHash<Net::AddressPort, Net::ClientHandle> handleByPeer;
+        QHash<LegacyAddressPort, Net::ClientHandle> handleByLegacyPeer;
+        for (Net::AddressPort const& peer : qAsConst(peers))
+        {
+            const Net::ClientHandle handle = table.insert();
+            *table.find(handle) = peer;
+            handles.append(handle);
+            handleByPeer.insert(peer, handle);
+            handleByLegacyPeer.insert(LegacyAddressPort{peer}, handle);
+        }
+        for (const QString mode : {QStringLiteral("legacy_hash"), QStringLiteral("hash"), QStringLiteral("handle")})
+        {
+            quint64 checksum = 0;
+            QElapsedTimer timer;
+            timer.start();
+            for (int i = 0; i < clientCount; ++i)
+            {
+                Net::ClientHandle handle = handles.at(i);
+                if (mode == QStringLiteral("legacy_hash"))
+                    handle = handleByLegacyPeer.value(LegacyAddressPort{peers.at(i)});
+                else if (mode == QStringLiteral("hash"))
+                    handle = handleByPeer.value(peers.at(i));
+                checksum += table.find(handle)->port;
+            }
+            const qint64 lookupNs = timer.nsecsElapsed();
+            QJsonObject params{{"mode", mode}, {"family", family}, {"clients", clientCount}};
+            QJsonObject metrics{{"ns_per_lookup", static_cast<double>(lookupNs) / qMax(1, clientCount)},
+                                {"checksum", static_cast<qint64>(checksum)}};
+            Bench::report(g_benchName, QStringLiteral("clients"), params, metrics);
+        }
+    }
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser cmdParser;
+    cmdParser.setApplicationDescription("Loopback benchmarks of Net library. Prints one JSON object per result line.");
+    cmdParser.addHelpOption();
+    QCommandLineOption scenarioOption("scenario", "Scenario to run: shards, framing, recv, backends, handoff, startup, reconnect, compression, local, loopback, deadlines, clients, fanout.", "name", "shards");
+    QCommandLineOption shardsOption("shards", "Comma-separated list of TcpServer shard counts.", "list", "0,1,2,4");
+    QCommandLineOption backendsOption("backends", "Comma-separated list of server backends: qt, epoll, uring.", "list", "qt,epoll");
+    QCommandLineOption clientsOption("clients", "Number of connected clients (sockets for deadlines and clients).", "count", "64");
+    QCommandLineOption clientThreadsOption("client-threads", "Number of NetThreads serving the clients (producer threads for handoff).", "count", "4");
+    QCommandLineOption messagesOption("messages", "Number of messages sent by each client.", "count", "2000");
+    QCommandLineOption sizeOption("size", "Payload size in bytes.", "bytes", "64");
+    QCommandLineOption downtimeOption("downtime", "Time in msec the server stays closed (reconnect).", "msec", "2000");
+    QCommandLineOption sizesOption("sizes", "Comma-separated list of payload sizes in bytes (framing, recv, local, loopback).", "list", "64,4096,65536,1048576");
+    QCommandLineOption transportsOption("transports", "Comma-separated list of client/server transports: tcp, local, memory.", "list", "tcp,local,memory");
+    QCommandLineOption windowsOption("windows", "Comma-separated list of message counts kept in flight (loopback).", "list", "1,16,256");
+    QCommandLineOption elementsOption("elements", "Comma-separated list of SortArray lengths (compression).", "list", "1000,100000,1000000");
+    cmdParser.addOptions({scenarioOption, shardsOption, backendsOption, clientsOption, clientThreadsOption, messagesOption, sizeOption, sizesOption, downtimeOption, elementsOption, transportsOption, windowsOption});
+    cmdParser.process(a);
+
+    const QString scenario = cmdParser.value(scenarioOption);
+    const int clientCount = cmdParser.value(clientsOption).toInt();
+    const int clientThreadCount = qMax(1, cmdParser.value(clientThreadsOption).toInt());
+    const int messageCount = cmdParser.value(messagesOption).toInt();
+    const int payloadSize = cmdParser.value(sizeOption).toInt();
+
+    if (scenario == QStringLiteral("shards"))
+        benchShards(Bench::toIntList(cmdParser.value(shardsOption)), clientCount, clientThreadCount, messageCount, payloadSize);
+    else if (scenario == QStringLiteral("framing"))
+        benchFraming(Bench::toIntList(cmdParser.value(sizesOption)), messageCount);
+    else if (scenario == QStringLiteral("recv"))
+        benchRecv(Bench::toIntList(cmdParser.value(sizesOption)), messageCount);
+    else if (scenario == QStringLiteral("backends"))
+        benchBackends(cmdParser.value(backendsOption).split(',', Qt::SkipEmptyParts), clientCount, clientThreadCount, messageCount, payloadSize);
+    else if (scenario == QStringLiteral("reconnect"))
+        benchReconnect(clientCount, clientThreadCount, cmdParser.value(downtimeOption).toInt());
+    else if (scenario == QStringLiteral("startup"))
+        benchStartup(clientCount, clientThreadCount);
+    else if (scenario == QStringLiteral("handoff"))
+        benchHandoff(clientThreadCount, messageCount, payloadSize);
+    else if (scenario == QStringLiteral("compression"))
+        benchCompression(Bench::toIntList(cmdParser.value(elementsOption)));
+    else if (scenario == QStringLiteral("local"))
+        benchLocal(cmdParser.value(transportsOption).split(',', Qt::SkipEmptyParts), Bench::toIntList(cmdParser.value(sizesOption)), messageCount);
+    else if (scenario == QStringLiteral("loopback"))
+        benchLoopback(Bench::toIntList(cmdParser.value(sizesOption)), Bench::toIntList(cmdParser.value(windowsOption)), messageCount);
+    else if (scenario == QStringLiteral("deadlines"))
+        benchDeadlines(clientCount);
+    else if (scenario == QStringLiteral("clients"))
+        benchClients(clientCount);
+    else if (scenario == QStringLiteral("fanout"))
+        benchFanout(clientCount, clientThreadCount, messageCount, payloadSize);
+    else
+        cmdParser.showHelp(1);
+    return 0;
+}
@@ -0,0 +1,179 @@
+#include <memory>
+#include <random>
+
+#include <QtCore/QCommandLineOption>
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+
+#include "Common/Protocol.hpp"
+#include "Net/NetUtils.hpp"
+
+#include "BenchUtils.hpp"
+
+using namespace Protocol;
+
+namespace
+{
+const QString g_benchName{"bench_protocol"};
+
+// Replies carry task's input and result, so elementCount goes to both where there are both
+std::unique_ptr<Request> makeRequest(RequestType type, int elementCount, std::mt19937& rng)
+{
+    std::uniform_int_distribution<int> distribution(-1000000, 1000000);
+    switch (type)
+    {
+    case RequestType::SortArray:
+    {
+        auto req = std::make_unique<Request_SortArray>();
+        req->numbers.reserve(elementCount);
+        for (int i = 0; i < elementCount; ++i)
+            req->numbers.append(distribution(rng));
+        return req;
+    }
+    case RequestType::FindPrimeNumbers:
+    {
+        auto req = std::make_unique<Request_FindPrimeNumbers>();
+        req->x_from = 0;
+        req->x_to = elementCount * 16;
+        req->primeNumbers.reserve(elementCount);
+        for (int i = 0; i < elementCount; ++i)
+            req->primeNumbers.append(2 * i + 1);
+        return req;
+    }
+    case RequestType::CalculateFunction:
+    {
+        auto req = std::make_unique<Request_CalculateFunction>();
+        req->equationType = EquationType::Linear;
+        req->x_from = -elementCount / 2;
+        req->x_to = req->x_from + elementCount - 1;
+        req->x_step = 1;
+        req->a = 3;
+        req->b = -2;
+        req->c = 1;
+        req->points.reserve(elementCount);
+        for (int x = req->x_from; x <= req->x_to; ++x)
+            req->points.append(QPoint{x, req->a * x + req->b});
+        return req;
+    }
+    case RequestType::ProgressValue:
+    {
+        auto req = std::make_unique<Request_ProgressValue>();
+        req->value = elementCount;
+        return req;
+    }
+    default: { return nullptr; }
+    }
+}
+
+std::unique_ptr<Request> makeEmptyRequest(RequestType type)
+{
+    switch (type)
+    {
+    case RequestType::SortArray: { return std::make_unique<Request_SortArray>(); }
+    case RequestType::FindPrimeNumbers: { return std::make_unique<Request_FindPrimeNumbers>(); }
+    case RequestType::CalculateFunction: { return std::make_unique<Request_CalculateFunction>(); }
+    case RequestType::ProgressValue: { return std::make_unique<Request_ProgressValue>(); }
+    default: { return nullptr; }
+    }
+}
+
+// Same steps as ExampleServer::sendRequestToClient()
+QByteArray encodeRequest(const Request& req, bool isJson)
+{
+    QByteArray msg;
+    if (isJson)
+    {
+        QJsonObject jsonObject;
+        req.serialize(jsonObject);
+        msg = QJsonDocument(jsonObject).toJson(QJsonDocument::Compact);
+    }
+    else
+    {
+        MAKE_QDATASTREAM_NET(stream, &msg, QIODevice::WriteOnly);
+        stream << req;
+    }
+    return msg;
+}
+
+// Same steps as ExampleServer::parseRequest(): header first, to learn the type, then the whole request
+bool decodeRequest(QByteArray msg, Request& req, bool isJson)
+{
+    Request header;
+    if (isJson)
+    {
+        QJsonParseError jsonError;
+        const QJsonDocument msgJsonDoc = QJsonDocument::fromJson(msg, &jsonError);
+        if (msgJsonDoc.isNull())
+            return false;
+        QJsonObject msgJsonObject = msgJsonDoc.object();
+        return header.deserialize(msgJsonObject) && req.deserialize(msgJsonObject);
+    }
+    MAKE_QDATASTREAM_NET(stream, &msg, QIODevice::ReadOnly);
+    stream >> header;
+    if (stream.status() != QDataStream::Ok)
+        return false;
+    stream.device()->seek(0);
+    stream >> req;
+    return stream.status() == QDataStream::Ok;
+}
+
+// Encode and decode time of requests of each type carrying elementCount elements, in both message formats
+void benchCodec(QStringList const& formats, QList<int> const& elementCounts, int minTimeMs)
+{
+    std::mt19937 rng(42);
+    for (RequestType type : {RequestType::SortArray, RequestType::FindPrimeNumbers, RequestType::CalculateFunction, RequestType::ProgressValue})
+    {
+        for (int elementCount : elementCounts)
+        {
+            const std::unique_ptr<Request> req = makeRequest(type, elementCount, rng);
+            req->requestId = 1;
+            for (QString const& format : formats)
+            {
+                const bool isJson = (format == QStringLiteral("json"));
+                const QByteArray msg = encodeRequest(*req, isJson);
+                std::unique_ptr<Request> decoded = makeEmptyRequest(type);
+                const bool isValid = decodeRequest(msg, *decoded, isJson) && (encodeRequest(*decoded, isJson) == msg);
+
+                const double encodeNs = Bench::measureNsPerCall([&req, isJson]() { encodeRequest(*req, isJson); }, minTimeMs);
+                const double decodeNs = Bench::measureNsPerCall([&msg, &decoded, isJson]() { decodeRequest(msg, *decoded, isJson); }, minTimeMs);
+
+                QJsonObject params{{"type", toQString(type)}, {"format", format}, {"elements", elementCount}};
+                QJsonObject metrics{{"valid", isValid},
+                                    {"message_bytes", msg.size()},
+                                    {"bytes_per_element", (elementCount > 0) ? static_cast<double>(msg.size()) / elementCount : 0.0},
+                                    {"encode_us", encodeNs / 1e3},
+                                    {"decode_us", decodeNs / 1e3},
+                                    {"encode_mb_per_sec", msg.size() * 1e3 / encodeNs},
+                                    {"decode_mb_per_sec", msg.size() * 1e3 / decodeNs}};
+                Bench::report(g_benchName, QStringLiteral("codec"), params, metrics);
+            }
+            if (type == RequestType::ProgressValue) // carries no elements
+                break;
+        }
+    }
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser cmdParser;
+    cmdParser.setApplicationDescription("Benchmarks of Protocol message encoding. Prints one JSON object per result line.");
+    cmdParser.addHelpOption();
+    QCommandLineOption scenarioOption("scenario", "Scenario to run: codec.", "name", "codec");
+    QCommandLineOption formatsOption("formats", "Comma-separated list of message formats: json, binary.", "list", "json,binary");
+    QCommandLineOption elementsOption("elements", "Comma-separated list of element counts carried by a request.", "list", "10,1000,100000,1000000");
+    QCommandLineOption minTimeOption("min-time", "Minimum time in msec each measurement runs for.", "msec", "200");
+    cmdParser.addOptions({scenarioOption, formatsOption, elementsOption, minTimeOption});
+    cmdParser.process(a);
+
+    const QString scenario = cmdParser.value(scenarioOption);
+    if (scenario == QStringLiteral("codec"))
+        benchCodec(cmdParser.value(formatsOption).split(',', Qt::SkipEmptyParts), Bench::toIntList(cmdParser.value(elementsOption)), cmdParser.value(minTimeOption).toInt());
+    else
+        cmdParser.showHelp(1);
+    return 0;
+}
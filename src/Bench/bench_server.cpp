@@ -0,0 +1,320 @@
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <random>
+
+#include <QtCore/QCommandLineOption>
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QSettings>
+#include <QtCore/QTemporaryDir>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+
+#include "Common/Metrics.hpp"
+#include "Common/Protocol.hpp"
+#include "Net/NetHeaders.hpp"
+#include "Server/ExampleServer.hpp"
+
+#include "BenchUtils.hpp"
+
+using namespace Protocol;
+
+namespace
+{
+const QString g_benchName{"bench_server"};
+constexpr int g_timeoutMs = 600000;
+
+const std::function<void(QString)> f_logNone = [](QString) {};
+const std::function<void(QString)> f_logStderr = [](QString msg) { std::fprintf(stderr, "%s\n", qUtf8Printable(msg)); }; // past messageHandler()
+
+bool g_isVerbose = false;
+
+// ExampleServer logs every task it starts and finishes, which would bury the results; errors of the benchmark itself still get through
+void messageHandler(QtMsgType type, const QMessageLogContext&, const QString& msg)
+{
+    if ((type == QtCriticalMsg) || (type == QtFatalMsg) || g_isVerbose)
+        std::fprintf(stderr, "%s\n", qUtf8Printable(msg));
+}
+
+// Inputs of the same seed are the same request to the server's cache, as it ignores requestId
+std::unique_ptr<Request> makeRequest(RequestType type, int size, quint64 seed)
+{
+    std::mt19937 inputRng(static_cast<std::mt19937::result_type>(seed * 4 + static_cast<quint64>(type)));
+    switch (type)
+    {
+    case RequestType::SortArray:
+    {
+        auto req = std::make_unique<Request_SortArray>();
+        std::uniform_int_distribution<int> distribution(-1000000, 1000000);
+        req->numbers.reserve(size);
+        for (int i = 0; i < size; ++i)
+            req->numbers.append(distribution(inputRng));
+        return req;
+    }
+    case RequestType::FindPrimeNumbers:
+    {
+        auto req = std::make_unique<Request_FindPrimeNumbers>();
+        req->x_from = std::uniform_int_distribution<int>(0, 10000000)(inputRng);
+        req->x_to = req->x_from + qMax(1, size) - 1;
+        return req;
+    }
+    case RequestType::CalculateFunction:
+    {
+        auto req = std::make_unique<Request_CalculateFunction>();
+        std::uniform_int_distribution<int> constDistribution(1, 10);
+        req->equationType = (inputRng() % 2 == 0) ? EquationType::Linear : EquationType::Quadratic;
+        req->x_from = -size / 2 + std::uniform_int_distribution<int>(-1000, 1000)(inputRng);
+        req->x_to = req->x_from + qMax(1, size) - 1;
+        req->x_step = 1;
+        req->a = constDistribution(inputRng);
+        req->b = constDistribution(inputRng);
+        req->c = constDistribution(inputRng);
+        return req;
+    }
+    default: { return nullptr; }
+    }
+}
+
+QByteArray encodeRequest(const Request& req)
+{
+    QByteArray msg;
+#if defined(MESSAGE_FORMAT_BINARY)
+    MAKE_QDATASTREAM_NET(stream, &msg, QIODevice::WriteOnly);
+    stream << req;
+#elif defined(MESSAGE_FORMAT_JSON)
+    QJsonObject jsonObject;
+    req.serialize(jsonObject);
+    msg = QJsonDocument(jsonObject).toJson(QJsonDocument::Compact);
+#endif
+    return msg;
+}
+
+// Only the header is decoded, so that client's share of the round trip stays small next to server's
+bool decodeHeader(QByteArray msg, Request& header)
+{
+#if defined(MESSAGE_FORMAT_BINARY)
+    MAKE_QDATASTREAM_NET(stream, &msg, QIODevice::ReadOnly);
+    stream >> header;
+    return (stream.status() == QDataStream::Ok);
+#elif defined(MESSAGE_FORMAT_JSON)
+    QJsonObject msgJsonObject = QJsonDocument::fromJson(msg).object();
+    return header.deserialize(msgJsonObject);
+#endif
+}
+
+// Server's own settings, except for whatever would make it reachable from outside or clash with a Server running from the same directory
+bool writeSettings(QString const& sourcePath, QString const& targetPath)
+{
+    if (QFile::exists(sourcePath) && !QFile::copy(sourcePath, targetPath))
+        return false;
+    QSettings settingsFile(targetPath, QSettings::IniFormat);
+    settingsFile.remove(QStringLiteral("Network/localServerName"));
+    settingsFile.setValue(QStringLiteral("Metrics/port"), 0);
+    settingsFile.setValue(QStringLiteral("Tracing/enabled"), 0);
+    settingsFile.sync();
+    return (settingsFile.status() == QSettings::NoError);
+}
+
+// One client sends requestCount requests one after another, next one going out from the callback of the previous reply.
+// "unique" inputs all miss the cache, so round trip includes computation; "repeat" is one input over and over, which is answered from cache
+// after the warm-up, so round trip is decoding, cache lookup, encoding and whatever the transport adds (nothing much for memory)
+void benchRequests(QString const& serverName, QStringList const& types, QList<int> const& sizes, QStringList const& inputModes, int requestCount)
+{
+    MemoryClient* pClient = std::get<0>(Net::instantiateWaitThreadedConnection<MemoryClient>());
+    pClient->setLoggingFunctions(f_logNone, f_logStderr);
+    pClient->setEnableReconnect(false);
+    pClient->setAuthorizationEnabled(true);
+    pClient->setLoginData(Net::LoginData{QStringLiteral("bench"), QStringLiteral("bench")});
+    std::atomic<bool> isClientConnected{false};
+    QObject::connect(pClient, &NetConnection::openedConnection, pClient, [&isClientConnected](bool isOpened) {
+        if (isOpened)
+            isClientConnected.store(true);
+    }, Qt::DirectConnection);
+
+    // Current run, touched by callback in client's thread only while isRunning is set
+    RequestType type = RequestType::SortArray;
+    int size = 0;
+    bool isRepeat = false;
+    int sentCount = 0;
+    int targetCount = 0; // warm-up included
+    quint32 pendingRequestId = 0;
+    QElapsedTimer requestTimer;
+    std::unique_ptr<Metrics::Histogram> pLatencyNs;
+    quint64 progressCount = 0;
+    quint64 failedCount = 0;
+    std::atomic<bool> isRunning{false};
+
+    auto lambda_send = [&](NetConnection* const pConnection) {
+        std::unique_ptr<Request> req = makeRequest(type, size, isRepeat ? 0 : static_cast<quint64>(sentCount) + 1);
+        req->requestId = ++pendingRequestId;
+        const QByteArray msg = encodeRequest(*req); // encoding is client's cost, it's left out of round trip
+        ++sentCount;
+        requestTimer.start();
+        pConnection->sendMessage(msg);
+    };
+    pClient->setCallbackFunction([&](QByteArray msg, NetConnection* const pConnection, Net::AddressPort) {
+        const qint64 elapsedNs = requestTimer.nsecsElapsed();
+        Request header;
+        if (!decodeHeader(msg, header))
+        {
+            ++failedCount;
+            return;
+        }
+        if (header.type == RequestType::InvalidRequest) // errors don't always carry requestId, and end the request either way
+        {
+            ++failedCount;
+        }
+        else if (header.requestId != pendingRequestId)
+        {
+            ++failedCount;
+            return;
+        }
+        else if ((header.type == RequestType::ProgressRange) || (header.type == RequestType::ProgressValue))
+        {
+            ++progressCount;
+            return;
+        }
+        else if (header.type != type)
+        {
+            ++failedCount;
+        }
+        else if (sentCount > 1) // first one is warm-up
+        {
+            pLatencyNs->record(elapsedNs);
+        }
+        if (sentCount < targetCount)
+            lambda_send(pConnection);
+        else
+            isRunning.store(false, std::memory_order_release);
+    });
+
+    Net::ConnectionSettings clientSettings;
+    clientSettings.localServerName = serverName;
+    Net::openWaitThreadedConnection(pClient, clientSettings); // memory connect is over by the time openConnection() returns
+    if (!isClientConnected.load())
+    {
+        f_logStderr(QString("Can't connect to memory server %1").arg(serverName));
+        Net::destroyWaitThreadedConnection(pClient);
+        return;
+    }
+
+    for (QString const& typeName : types)
+    {
+        const RequestType runType = (typeName == QStringLiteral("sort")) ? RequestType::SortArray
+                                  : (typeName == QStringLiteral("primes")) ? RequestType::FindPrimeNumbers
+                                  : (typeName == QStringLiteral("function")) ? RequestType::CalculateFunction
+                                  : RequestType::InvalidRequest;
+        if (runType == RequestType::InvalidRequest)
+        {
+            f_logStderr(QString("Unknown request type %1").arg(typeName));
+            continue;
+        }
+        for (int runSize : sizes)
+        {
+            for (QString const& inputMode : inputModes)
+            {
+                // Run state is set in client's thread, so callback never sees it half-written
+                QMetaObject::invokeMethod(pClient, [&, runType, runSize, inputMode]() {
+                    type = runType;
+                    size = runSize;
+                    isRepeat = (inputMode == QStringLiteral("repeat"));
+                    sentCount = 0;
+                    targetCount = requestCount + 1;
+                    pLatencyNs = std::make_unique<Metrics::Histogram>();
+                    progressCount = 0;
+                    failedCount = 0;
+                    isRunning.store(true, std::memory_order_release);
+                }, Qt::BlockingQueuedConnection);
+
+                QElapsedTimer timer;
+                timer.start();
+                QMetaObject::invokeMethod(pClient, [&]() { lambda_send(pClient); }, Qt::QueuedConnection);
+                const bool isComplete = Bench::waitFor([&isRunning]() { return !isRunning.load(std::memory_order_acquire); }, g_timeoutMs);
+                const qint64 elapsedNs = timer.nsecsElapsed();
+                if (!isComplete)
+                {
+                    f_logStderr(QString("%1/%2/%3 timed out, stopping").arg(typeName).arg(runSize).arg(inputMode));
+                    Net::destroyWaitThreadedConnection(pClient); // callback may not touch run state past this point
+                    return;
+                }
+
+                const Metrics::Histogram& latencyNs = *pLatencyNs;
+                const quint64 measuredCount = latencyNs.count();
+                QJsonObject params{{"type", typeName}, {"size", runSize}, {"inputs", inputMode}, {"requests", requestCount}};
+                QJsonObject metrics{{"elapsed_ms", elapsedNs / 1e6},
+                                    {"requests_per_sec", (measuredCount > 0) ? measuredCount * 1e9 / latencyNs.sum() : 0.0}, // one at a time, so it's 1 / mean latency
+                                    {"failed", static_cast<qint64>(failedCount)},
+                                    {"progress_messages", static_cast<qint64>(progressCount)},
+                                    {"latency_mean_us", (measuredCount > 0) ? latencyNs.sum() / 1e3 / measuredCount : 0.0},
+                                    {"latency_p50_us", latencyNs.quantile(0.5) / 1e3},
+                                    {"latency_p99_us", latencyNs.quantile(0.99) / 1e3},
+                                    {"latency_max_us", latencyNs.max() / 1e3}};
+                Bench::report(g_benchName, QStringLiteral("requests"), params, metrics);
+            }
+        }
+    }
+    Net::destroyWaitThreadedConnection(pClient);
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser cmdParser;
+    cmdParser.setApplicationDescription("ExampleServer over in-memory transport (MemoryServer), so that request path is measured without sockets. Prints one JSON object per result line.");
+    cmdParser.addHelpOption();
+    QCommandLineOption typesOption("types", "Comma-separated list of request types: sort, primes, function.", "list", "sort,primes,function");
+    QCommandLineOption sizesOption("sizes", "Comma-separated list of input sizes: array length, prime range width, function points.", "list", "1000,100000");
+    QCommandLineOption inputsOption("inputs", "Comma-separated list of input modes: unique - every request misses the cache, repeat - every request after the first one hits it.", "list", "unique,repeat");
+    QCommandLineOption requestsOption("requests", "Number of measured requests per run, one warm-up request comes on top.", "count", "200");
+    QCommandLineOption settingsOption("settings", "ServerSettings.ini to run the server with; local server, metrics endpoint and tracing are turned off.", "path", QDir(QCoreApplication::applicationDirPath()).filePath("ServerSettings.ini"));
+    QCommandLineOption verboseOption("verbose", "Print server's log to stderr.");
+    cmdParser.addOptions({typesOption, sizesOption, inputsOption, requestsOption, settingsOption, verboseOption});
+    cmdParser.process(a);
+
+    g_isVerbose = cmdParser.isSet(verboseOption);
+    qInstallMessageHandler(messageHandler);
+    QThreadPool::globalInstance()->setMaxThreadCount(QThread::idealThreadCount());
+
+    // ExampleServer reads ./ServerSettings.ini, so it's run from a directory of its own
+    QTemporaryDir settingsDir;
+    if (!settingsDir.isValid() || !writeSettings(cmdParser.value(settingsOption), settingsDir.filePath("ServerSettings.ini")))
+    {
+        qCritical("Can't prepare server settings in a temporary directory");
+        return 1;
+    }
+    QDir::setCurrent(settingsDir.path());
+
+    const QString serverName = QString("bench_server-%1").arg(QCoreApplication::applicationPid());
+    MemoryServer* pServer = std::get<0>(Net::instantiateWaitThreadedConnection<MemoryServer>());
+    emit pServer->addLoginDataQueued(Net::LoginData{QStringLiteral("bench"), QStringLiteral("bench")});
+
+    // ExampleServer gets a thread of its own, so that main thread can wait for results without holding up parseRequests()
+    QThread serverThread;
+    serverThread.start();
+    QObject serverContext;
+    serverContext.moveToThread(&serverThread);
+    ExampleServer* pExampleServer = nullptr;
+    QMetaObject::invokeMethod(&serverContext, [&]() {
+        Net::ConnectionSettings serverSettings;
+        serverSettings.localServerName = serverName;
+        pExampleServer = new ExampleServer(pServer, serverSettings);
+    }, Qt::BlockingQueuedConnection);
+
+    benchRequests(serverName, cmdParser.value(typesOption).split(',', Qt::SkipEmptyParts), Bench::toIntList(cmdParser.value(sizesOption)),
+                  cmdParser.value(inputsOption).split(',', Qt::SkipEmptyParts), qMax(1, cmdParser.value(requestsOption).toInt()));
+
+    // Server goes first, as its batch callback is delivered to ExampleServer
+    Net::destroyWaitThreadedConnection(pServer);
+    QMetaObject::invokeMethod(&serverContext, [&]() { delete pExampleServer; }, Qt::BlockingQueuedConnection);
+    serverThread.quit();
+    serverThread.wait();
+    return 0;
+}
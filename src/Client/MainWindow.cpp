@@ -89,13 +89,9 @@ MainWindow::MainWindow(Net::LoginData loginData, QWidget* parent)
     ui->comboBox_funcGraph_equation->addItem("Quadratic", QVariant::fromValue(EquationType::Quadratic));
 
     using namespace placeholders;
-    m_client = std::get<0>(Net::instantiateWaitThreadedConnection<TcpClient>());
+    m_client = instantiateClient();
     // All GUI stuff must be done in GUI thread, so we either split response parsing and rendering, or do everything in one function in GUI thread
-    m_client->setCallbackFunction([this](QByteArray arg1, NetConnection* const arg2, Net::AddressPort arg3) {
-        QMetaObject::invokeMethod(this, [=](){
-            parseResponse(arg1, arg2, arg3);
-        }, Qt::QueuedConnection);
-    });
+    m_client->setCallbackFunction(std::bind(&MainWindow::parseResponse, this, _1, _2, _3), this);
     m_client->setAuthorizationEnabled(true);
     m_client->setLoginData(loginData);
     m_client->setLoggingFunctions(f_logGeneral, f_logError);
@@ -123,6 +119,18 @@ MainWindow::~MainWindow()
     delete ui;
 }
 
+// Transport has to be known before anything else is configured, so it's read separately from the rest of settings
+NetClient* MainWindow::instantiateClient()
+{
+    QSettings settingsFile(g_settingsPath, QSettings::IniFormat);
+    const QString transport = settingsFile.value("Network/transport", QStringLiteral("Tcp")).toString();
+    if (transport == QStringLiteral("Local")) // server on the same host, reached by Network/localServerName
+        return std::get<0>(Net::instantiateWaitThreadedConnection<LocalClient>());
+    if (transport != QStringLiteral("Tcp"))
+        f_logError(QString("Network transport %1 is not available, using Tcp").arg(transport));
+    return std::get<0>(Net::instantiateWaitThreadedConnection<TcpClient>());
+}
+
 void MainWindow::loadSettings()
 {
     QSettings settingsFile(g_settingsPath, QSettings::IniFormat, this);
@@ -141,7 +149,23 @@ void MainWindow::loadSettings()
     ns.ipDestination = QHostAddress(settingsFile.value("ipDestination").toString());
     ns.portIn = settingsFile.value("portIn").toUInt();
     ns.portOut = settingsFile.value("portOut").toUInt();
+    ns.localServerName = settingsFile.value("localServerName").toString();
+    settingsFile.endGroup();
+    settingsFile.beginGroup("Socket");
+    ns.socketOptions = Net::socketOptionsFromSettings(settingsFile);
+    settingsFile.endGroup();
     m_client->setConnectionSettings(ns);
+
+    settingsFile.beginGroup("Compression");
+    Net::CompressionSettings compressionSettings;
+    compressionSettings.codecMask = Net::codecMaskFromQStringList(settingsFile.value("codecs").toStringList());
+    compressionSettings.threshold = settingsFile.value("threshold", compressionSettings.threshold).toInt();
+    compressionSettings.zlibLevel = settingsFile.value("zlibLevel", compressionSettings.zlibLevel).toInt();
+    m_client->setCompressionSettings(compressionSettings);
+    settingsFile.endGroup();
+
+    settingsFile.beginGroup("SharedMemory");
+    m_sharedMemoryThreshold = qMax(0, settingsFile.value("threshold", m_sharedMemoryThreshold).toInt());
     settingsFile.endGroup();
 }
 
@@ -162,6 +186,11 @@ void MainWindow::saveSettings()
     settingsFile.setValue("ipDestination", ns.ipDestination.toString());
     settingsFile.setValue("portIn", ns.portIn);
     settingsFile.setValue("portOut", ns.portOut);
+    settingsFile.setValue("localServerName", ns.localServerName);
+    settingsFile.endGroup();
+
+    settingsFile.beginGroup("Socket");
+    Net::socketOptionsToSettings(ns.socketOptions, settingsFile);
     settingsFile.endGroup();
 }
 
@@ -255,7 +284,23 @@ void MainWindow::onSendRequest()
 
         request = make_unique<Request_SortArray>();
         auto req = static_cast<Request_SortArray*>(request.get());
-        req->numbers = std::move(targetArray);
+        // server on the same host reads large array from shared memory, only its descriptor is sent
+        const qint64 arrayByteSize = static_cast<qint64>(targetArray.size()) * static_cast<qint64>(sizeof(int));
+        if ((m_client->getConnectionType() == Net::ConnectionType::LocalClient) && (m_sharedMemoryThreshold > 0) && (arrayByteSize >= m_sharedMemoryThreshold))
+        {
+            auto sharedArray = make_unique<SharedArray>();
+            if (sharedArray->create(targetArray))
+            {
+                req->sharedBlock = sharedArray->block();
+                m_sharedArray = std::move(sharedArray);
+            }
+            else
+            {
+                f_logError(QStringLiteral("Can't create shared memory, sending array inline: %1").arg(sharedArray->errorString()));
+            }
+        }
+        if (!req->sharedBlock.isValid())
+            req->numbers = std::move(targetArray);
         break;
     }
     case TaskIndex::PrimeNumbers:
@@ -298,6 +343,9 @@ void MainWindow::onSendRequest()
         return;
     }
     }
+    if (++m_lastRequestId == 0) // 0 is reserved for "all tasks" in cancel
+        ++m_lastRequestId;
+    request->requestId = m_lastRequestId;
     sendRequestToServer(request.get());
 
     // Block button while awaiting Task completion
@@ -317,6 +365,7 @@ void MainWindow::onSendCancel()
 
     m_isAwaitingCancel = true;
     Request_CancelCurrentTask req;
+    req.requestId = m_lastRequestId;
     sendRequestToServer(&req);
 }
 
@@ -407,6 +456,9 @@ void MainWindow::parseResponse(QByteArray msg, NetConnection* const, Net::Addres
     };
 #endif
 
+    if (request.requestId != 0 && request.requestId != m_lastRequestId)
+        return; // late answer to a request that was already replaced
+
     // There's gonna be a lot of progress updates, no need to mention them
     if (request.type != RequestType::ProgressRange && request.type != RequestType::ProgressValue)
         f_logGeneral(QStringLiteral("Received %1 response").arg(toQString(request.type)));
@@ -418,6 +470,17 @@ void MainWindow::parseResponse(QByteArray msg, NetConnection* const, Net::Addres
         Request_InvalidRequest req;
         if (!lambda_unpackRequest(&req)) return;
 
+        if ((req.errorCode == Protocol::ErrorCode::SharedMemoryUnavailable) && (m_sharedArray != nullptr))
+        {
+            f_logGeneral(QStringLiteral("Server can't attach shared memory, resending array inline"));
+            Request_SortArray retry;
+            retry.requestId = req.requestId;
+            retry.numbers = m_sharedArray->read();
+            m_sharedArray.reset();
+            sendRequestToServer(&retry);
+            break;
+        }
+
         // Should be a better way to determine if reset should be called. Maybe prompt user and then force cancel or restart connection?
         if (req.errorCode != Protocol::ErrorCode::AlreadyRunningTask)
             resetAwaitingState();
@@ -429,6 +492,14 @@ void MainWindow::parseResponse(QByteArray msg, NetConnection* const, Net::Addres
     {
         Request_SortArray req;
         if (!lambda_unpackRequest(&req)) return;
+        if (req.sharedBlock.isValid())
+        {
+            // server wrote result over the array, in segment this client still holds
+            if ((m_sharedArray != nullptr) && (m_sharedArray->block().key == req.sharedBlock.key))
+                req.numbers = m_sharedArray->read();
+            else
+                f_logError(QStringLiteral("Received SortArray result in unknown shared memory %1").arg(req.sharedBlock.key));
+        }
 
         QString text;
         text.reserve(6 * req.numbers.size());
@@ -589,4 +660,5 @@ void MainWindow::resetAwaitingState()
     ui->pushButton_sendRequest->setEnabled(true);
     m_isAwaitingCancel = false;
     m_isAwaitingTask = false;
+    m_sharedArray.reset(); // segment is gone once server has detached too
 }
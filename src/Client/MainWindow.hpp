@@ -1,11 +1,14 @@
 #pragma once
 
+#include <memory>
+
 #include <QtCore/QString>
 #include <QtWidgets/QMainWindow>
 #include <QtWidgets/QProgressDialog>
 
 #include "Common/Protocol.hpp"
-#include "Net/TcpClient.hpp"
+#include "Common/SharedArray.hpp"
+#include "Net/NetClient.hpp"
 
 #include "PersistentProgressDialog.hpp"
 
@@ -21,12 +24,16 @@ public:
     ~MainWindow();
 
 private:
-    TcpClient* m_client;
+    NetClient* m_client;
 
     bool m_isAwaitingCancel = false;
+    quint32 m_lastRequestId = 0; // responses to earlier requests are ignored
     bool m_isAwaitingTask = false;
     PersistentProgressDialog* m_progressDialog = nullptr;
 
+    int m_sharedMemoryThreshold = 0; // arrays of at least that many bytes are sorted in shared memory if server is local, 0 disables
+    std::unique_ptr<SharedArray> m_sharedArray; // segment of pending SortArray request, held until it's answered
+
     const QString m_datetimeFormat{"[yyyy.MM.dd-hh:mm:ss.zzz]"};
 
     uint m_regId_general = 0;
@@ -34,6 +41,7 @@ private:
     std::function<void(QString)> f_logError = [](QString msg) { qWarning(qUtf8Printable(QDateTime::currentDateTimeUtc().toString(QStringLiteral("[yyyy.MM.dd-hh:mm:ss.zzz]")) + msg)); };
 
 private:
+    NetClient* instantiateClient();
     void loadSettings();
     void saveSettings();
     void showErrorMessage(QString errorText);
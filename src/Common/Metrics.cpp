@@ -0,0 +1,183 @@
+#include "Metrics.hpp"
+
+#include <cmath>
+
+#include <QtCore/QMutexLocker>
+#include <QtCore/QStringList>
+#include <QtCore/QtAlgorithms>
+
+using namespace Metrics;
+
+namespace
+{
+QString escapeLabelValue(QString value)
+{
+    value.replace(QLatin1Char('\\'), QLatin1String("\\\\"));
+    value.replace(QLatin1Char('"'), QLatin1String("\\\""));
+    value.replace(QLatin1Char('\n'), QLatin1String("\\n"));
+    return value;
+}
+
+// Labels of a series with one more appended, e.g. quantile of a summary
+QString withLabel(const QString& renderedLabels, const QString& name, const QString& value)
+{
+    const QString label = QStringLiteral("%1=\"%2\"").arg(name, value);
+    if (renderedLabels.isEmpty())
+        return QLatin1Char('{') + label + QLatin1Char('}');
+    return renderedLabels.left(renderedLabels.size() - 1) + QLatin1Char(',') + label + QLatin1Char('}');
+}
+} // namespace
+
+int Histogram::bucketOf(quint64 value)
+{
+    if (value < static_cast<quint64>(s_subBucketCount))
+        return static_cast<int>(value);
+    const int msb = 63 - qCountLeadingZeroBits(value);
+    if (msb >= s_maxBits)
+        return s_bucketCount - 1;
+    const int shift = msb - (s_subBucketBits - 1); // leaves s_subBucketBits top bits, the highest of which is always set
+    return s_subBucketCount + (shift - 1) * s_subBucketHalf + static_cast<int>((value >> shift) - s_subBucketHalf);
+}
+
+quint64 Histogram::bucketUpperBound(int index)
+{
+    if (index < s_subBucketCount)
+        return static_cast<quint64>(index);
+    const int shift = (index - s_subBucketCount) / s_subBucketHalf + 1;
+    const quint64 mantissa = static_cast<quint64>((index - s_subBucketCount) % s_subBucketHalf + s_subBucketHalf);
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void Histogram::record(qint64 value)
+{
+    value = qMax<qint64>(0, value);
+    m_buckets[bucketOf(static_cast<quint64>(value))].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(static_cast<quint64>(value), std::memory_order_relaxed);
+    qint64 prevMax = m_max.load(std::memory_order_relaxed);
+    while ((value > prevMax) && !m_max.compare_exchange_weak(prevMax, value, std::memory_order_relaxed))
+        ;
+}
+
+// Buckets are read one by one while others may be recording, which is fine for monitoring: result is off by at most the values recorded meanwhile
+qint64 Histogram::quantile(double q) const
+{
+    const quint64 total = count();
+    if (total == 0)
+        return 0;
+    const quint64 rank = qMax<quint64>(1, static_cast<quint64>(std::ceil(qBound(0.0, q, 1.0) * total)));
+    quint64 seen = 0;
+    for (int i = 0; i < s_bucketCount; ++i)
+    {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank)
+            return qMin(static_cast<qint64>(bucketUpperBound(i)), max());
+    }
+    return max();
+}
+
+QString Registry::renderLabels(const Labels& labels)
+{
+    if (labels.isEmpty())
+        return QString{};
+    QStringList parts;
+    parts.reserve(labels.size());
+    for (auto const& label : labels)
+        parts.append(QStringLiteral("%1=\"%2\"").arg(label.first, escapeLabelValue(label.second)));
+    return QLatin1Char('{') + parts.join(QLatin1Char(',')) + QLatin1Char('}');
+}
+
+Registry::Family& Registry::family(const QString& name, Type type, const QString& help)
+{
+    auto iter = m_families.find(name);
+    if (iter == m_families.end())
+    {
+        iter = m_families.emplace(name, Family{}).first;
+        iter->second.type = type;
+        iter->second.help = help;
+    }
+    Q_ASSERT(iter->second.type == type);
+    return iter->second;
+}
+
+Counter& Registry::counter(const QString& name, const QString& help, const Labels& labels)
+{
+    QMutexLocker locker(&m_mutex);
+    auto& series = family(name, Type::Counter, help).counters[renderLabels(labels)];
+    if (!series)
+        series = std::make_unique<Counter>();
+    return *series;
+}
+
+Gauge& Registry::gauge(const QString& name, const QString& help, const Labels& labels)
+{
+    QMutexLocker locker(&m_mutex);
+    auto& series = family(name, Type::Gauge, help).gauges[renderLabels(labels)];
+    if (!series)
+        series = std::make_unique<Gauge>();
+    return *series;
+}
+
+Histogram& Registry::histogram(const QString& name, const QString& help, const Labels& labels, double scale)
+{
+    QMutexLocker locker(&m_mutex);
+    Family& f = family(name, Type::Summary, help);
+    f.scale = scale;
+    auto& series = f.histograms[renderLabels(labels)];
+    if (!series)
+        series = std::make_unique<Histogram>();
+    return *series;
+}
+
+void Registry::removeSeries(const QString& labelName, const QString& labelValue)
+{
+    const QString label = QStringLiteral("%1=\"%2\"").arg(labelName, escapeLabelValue(labelValue));
+    auto f_hasLabel = [&label](const QString& renderedLabels) {
+        const int pos = renderedLabels.indexOf(label);
+        if (pos < 1)
+            return false;
+        const QChar before = renderedLabels.at(pos - 1);
+        const QChar after = renderedLabels.at(pos + label.size());
+        return ((before == QLatin1Char('{')) || (before == QLatin1Char(','))) && ((after == QLatin1Char('}')) || (after == QLatin1Char(',')));
+    };
+    auto f_erase = [&f_hasLabel](auto& seriesMap) {
+        for (auto iter = seriesMap.begin(); iter != seriesMap.end();)
+            iter = f_hasLabel(iter->first) ? seriesMap.erase(iter) : std::next(iter);
+    };
+    QMutexLocker locker(&m_mutex);
+    for (auto& entry : m_families)
+    {
+        f_erase(entry.second.counters);
+        f_erase(entry.second.gauges);
+        f_erase(entry.second.histograms);
+    }
+}
+
+QByteArray Registry::toPrometheusText() const
+{
+    static const double s_quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    QString text;
+    QMutexLocker locker(&m_mutex);
+    for (auto const& entry : m_families)
+    {
+        const QString& name = entry.first;
+        const Family& f = entry.second;
+        if (f.counters.empty() && f.gauges.empty() && f.histograms.empty())
+            continue; // every series was removed
+        const char* typeName = (f.type == Type::Counter) ? "counter" : (f.type == Type::Gauge) ? "gauge" : "summary";
+        text += QStringLiteral("# HELP %1 %2\n# TYPE %1 %3\n").arg(name, f.help, QLatin1String(typeName));
+        for (auto const& series : f.counters)
+            text += QStringLiteral("%1%2 %3\n").arg(name, series.first).arg(series.second->value());
+        for (auto const& series : f.gauges)
+            text += QStringLiteral("%1%2 %3\n").arg(name, series.first).arg(series.second->value());
+        for (auto const& series : f.histograms)
+        {
+            const Histogram& h = *series.second;
+            for (double q : s_quantiles)
+                text += QStringLiteral("%1%2 %3\n").arg(name, withLabel(series.first, QStringLiteral("quantile"), QString::number(q))).arg(h.quantile(q) * f.scale);
+            text += QStringLiteral("%1_sum%2 %3\n").arg(name, series.first).arg(h.sum() * f.scale);
+            text += QStringLiteral("%1_count%2 %3\n").arg(name, series.first).arg(h.count());
+        }
+    }
+    return text.toUtf8();
+}
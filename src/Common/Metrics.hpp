@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QMutex>
+#include <QtCore/QPair>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+// Counters, gauges and latency histograms rendered in Prometheus text format.
+// Recording is lock-free and can be done from any thread; only creating, removing and rendering series take the registry's lock,
+// so owners look a series up once and keep the reference for as long as the series lives
+namespace Metrics
+{
+using Labels = QVector<QPair<QString, QString>>;
+
+class Counter
+{
+public:
+    void add(quint64 n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+    quint64 value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<quint64> m_value{0};
+};
+
+class Gauge
+{
+public:
+    void set(qint64 value) { m_value.store(value, std::memory_order_relaxed); }
+    void add(qint64 n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+    void sub(qint64 n = 1) { m_value.fetch_sub(n, std::memory_order_relaxed); }
+    qint64 value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<qint64> m_value{0};
+};
+
+// HDR-style log-linear histogram of non-negative integers (nanoseconds, bytes): every power of two is split into s_subBucketHalf linear buckets,
+// so any recorded value is known within ~3% whatever its magnitude, in a fixed set of counters. Values up to 2^s_maxBits - 1 are exact to bucket, larger ones land in the last bucket
+class Histogram
+{
+public:
+    static constexpr int s_subBucketBits = 6;
+    static constexpr int s_subBucketCount = 1 << s_subBucketBits; // values below that have a bucket each
+    static constexpr int s_subBucketHalf = s_subBucketCount / 2;
+    static constexpr int s_maxBits = 40; // ~18 minutes in nanoseconds
+    static constexpr int s_bucketCount = s_subBucketCount + (s_maxBits - s_subBucketBits) * s_subBucketHalf;
+
+    void record(qint64 value);
+
+    quint64 count() const { return m_count.load(std::memory_order_relaxed); }
+    quint64 sum() const { return m_sum.load(std::memory_order_relaxed); }
+    qint64 max() const { return m_max.load(std::memory_order_relaxed); }
+    qint64 quantile(double q) const; // highest value of the bucket q-th recorded value fell into, 0 if nothing was recorded
+
+    static int bucketOf(quint64 value);
+    static quint64 bucketUpperBound(int index);
+
+private:
+    std::atomic<quint64> m_buckets[s_bucketCount] = {};
+    std::atomic<quint64> m_count{0};
+    std::atomic<quint64> m_sum{0};
+    std::atomic<qint64> m_max{0};
+};
+
+class Registry
+{
+public:
+    Registry() = default;
+    Registry(const Registry&) = delete;            // Copy constructor
+    Registry(Registry&&) = delete;                 // Move constructor
+    Registry& operator=(const Registry&) = delete; // Copy assignment
+    Registry& operator=(Registry&&) = delete;      // Move assignment
+
+private:
+    enum class Type
+    {
+        Counter,
+        Gauge,
+        Summary // Histogram is exposed as summary: quantiles, sum and count, which is what alerting on p99 needs
+    };
+
+    struct Family
+    {
+        Type type = Type::Counter;
+        QString help;
+        double scale = 1.0; // histogram's recorded unit in exposed unit, e.g. 1e-9 for nanoseconds exposed as seconds
+        std::map<QString, std::unique_ptr<Counter>> counters; // by rendered labels
+        std::map<QString, std::unique_ptr<Gauge>> gauges;
+        std::map<QString, std::unique_ptr<Histogram>> histograms;
+    };
+
+    mutable QMutex m_mutex;
+    std::map<QString, Family> m_families; // ordered, so that output is stable between scrapes
+
+    Family& family(const QString& name, Type type, const QString& help);
+
+public:
+    // Existing series is returned if it's already there. Name must be unique across types
+    Counter& counter(const QString& name, const QString& help, const Labels& labels = {});
+    Gauge& gauge(const QString& name, const QString& help, const Labels& labels = {});
+    Histogram& histogram(const QString& name, const QString& help, const Labels& labels = {}, double scale = 1e-9);
+
+    // Removes every series which has the label, e.g. all series of a disconnected peer. References to them must not be used afterwards
+    void removeSeries(const QString& labelName, const QString& labelValue);
+
+    QByteArray toPrometheusText() const; // text exposition format 0.0.4
+
+    static QString renderLabels(const Labels& labels); // {name="value",...}, empty for no labels
+};
+} // namespace Metrics
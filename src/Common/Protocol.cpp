@@ -9,27 +9,31 @@ namespace Protocol {
 QDataStream& Request::serialize(QDataStream& stream) const
 {
     stream << type;
+    stream << requestId;
     return stream;
 }
 QDataStream& Request::deserialize(QDataStream& stream)
 {
     stream >> type;
+    stream >> requestId;
     return stream;
 }
 void Request::serialize(QJsonObject& target) const
 {
     target.insert("type", under_cast(type));
+    target.insert("requestId", static_cast<qint64>(requestId));
 }
 bool Request::deserialize(QJsonObject& target, QString* errorText)
 {
     if (!parseJsonVar(target, "type", type, errorText)) goto goto_parseError;
+    if (!parseJsonVar(target, "requestId", requestId, errorText)) goto goto_parseError;
     return true;
 goto_parseError:;
     return false;
 }
 int Request::byteSize()
 {
-    return sizeof(type);
+    return sizeof(type) + sizeof(requestId);
 }
 
 QDataStream& Request_InvalidRequest::serialize(QDataStream& stream) const
@@ -66,23 +70,35 @@ QDataStream& Request_SortArray::serialize(QDataStream& stream) const
 {
     Request::serialize(stream);
     stream << numbers;
+    stream << sharedBlock;
     return stream;
 }
 QDataStream& Request_SortArray::deserialize(QDataStream& stream)
 {
     Request::deserialize(stream);
     stream >> numbers;
+    stream >> sharedBlock;
     return stream;
 }
 void Request_SortArray::serialize(QJsonObject& target) const
 {
     Request::serialize(target);
     target.insert("numbers", QJsonArray::fromVariantList(QVariantList(numbers.cbegin(), numbers.cend())));
+    if (sharedBlock.isValid())
+    {
+        target.insert("sharedKey", sharedBlock.key);
+        target.insert("sharedCount", sharedBlock.count);
+    }
 }
 bool Request_SortArray::deserialize(QJsonObject& target, QString* errorText)
 {
     if (!Request::deserialize(target, errorText)) goto goto_parseError;
     if (!parseJsonVar(target, "numbers", numbers)) goto goto_parseError;
+    if (target.contains("sharedKey"))
+    {
+        sharedBlock.key = target.value("sharedKey").toString(); // parseJsonVar() would take QString for an array
+        if (!parseJsonVar(target, "sharedCount", sharedBlock.count, errorText)) goto goto_parseError;
+    }
     return true;
 goto_parseError:;
     return false;
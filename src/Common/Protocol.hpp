@@ -33,6 +33,8 @@ enum class ErrorCode : quint8
     InvalidRequestType,
     AlreadyRunningTask,
     NotRunningAnyTask,
+    TaskLimitReached,
+    SharedMemoryUnavailable,
 };
 inline QString toQString(ErrorCode code)
 {
@@ -40,8 +42,10 @@ inline QString toQString(ErrorCode code)
     {
     case ErrorCode::CorruptedData: { return QStringLiteral("Received message with corrupted data"); }
     case ErrorCode::InvalidRequestType: { return QStringLiteral("Received message with invalid request type"); }
-    case ErrorCode::AlreadyRunningTask: { return QStringLiteral("Received task request while already running task"); }
-    case ErrorCode::NotRunningAnyTask: { return QStringLiteral("Received CancelCurrentTask while not running any task"); }
+    case ErrorCode::AlreadyRunningTask: { return QStringLiteral("Received task request with requestId of already running task"); }
+    case ErrorCode::NotRunningAnyTask: { return QStringLiteral("Received CancelCurrentTask while not running task with such requestId"); }
+    case ErrorCode::TaskLimitReached: { return QStringLiteral("Received task request while running as many tasks as allowed per client"); }
+    case ErrorCode::SharedMemoryUnavailable: { return QStringLiteral("Received task request with data in shared memory which can't be attached"); }
     case ErrorCode::Unspecified: [[fallthrough]];
     default: { return {}; }
     }
@@ -74,9 +78,23 @@ inline QString toQString(RequestType data)
     }
 }
 
+// Names a SharedArray segment holding data of the message instead of the message itself; only valid between peers on the same host
+struct SharedBlock
+{
+    QString key;
+    qint32 count{0}; // number of elements
+
+    bool isValid() const { return !key.isEmpty() && (count >= 0); }
+};
+inline QDataStream& operator<<(QDataStream& stream, const SharedBlock& data) { return stream << data.key << data.count; }
+inline QDataStream& operator>>(QDataStream& stream, SharedBlock& data) { return stream >> data.key >> data.count; }
+
 struct Request
 {
     RequestType type{RequestType::InvalidRequest};
+    quint32 requestId{0}; // chosen by client, echoed in every message about the task: progress, result, cancel and errors
+
+    static constexpr int s_binaryHeaderSize = sizeof(RequestType) + sizeof(quint32); // type and requestId, as written to QDataStream
 
     explicit Request(RequestType a_reqType = RequestType::InvalidRequest) : type(a_reqType) {}
     virtual ~Request() = default;
@@ -110,6 +128,8 @@ struct Request_InvalidRequest : public Request
 struct Request_SortArray : public Request
 {
     QVector<int> numbers;
+    SharedBlock sharedBlock; // if valid, numbers are empty and travel in shared memory, both ways
+
 
     Request_SortArray() : Request(RequestType::SortArray) {}
     virtual ~Request_SortArray() = default;
@@ -158,6 +178,7 @@ struct Request_CalculateFunction : public Request
     virtual int byteSize() final;
 };
 
+// Cancels the task with the same requestId, or all tasks of the client if requestId is 0
 struct Request_CancelCurrentTask : public Request
 {
     Request_CancelCurrentTask() : Request(RequestType::CancelCurrentTask) {}
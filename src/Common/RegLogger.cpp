@@ -1,5 +1,7 @@
 #include "RegLogger.hpp"
 
+#include <QtCore/QSemaphore>
+
 bool RegLoggerThreadWorker::isRegLoggerInstantiated = false;
 
 RegLogger::~RegLogger()
@@ -98,11 +100,10 @@ void RegLoggerThreadWorker::instantiateRegLogger(QString a_registryDirPath)
     // connects for &RegLogger::destroyed are done in RegLoggerThreadWorker::process since they require instance of RegLogger
     QObject::connect(pLoggerThread, &QThread::finished, pLoggerThread, &QThread::deleteLater);
 
-    bool isCreated = false;
-    connect(pLoggerWorker, &RegLoggerThreadWorker::created, pLoggerWorker, [&isCreated](){ isCreated = true; });
+    QSemaphore createdSemaphore;
+    connect(pLoggerWorker, &RegLoggerThreadWorker::created, pLoggerWorker, [&createdSemaphore](){ createdSemaphore.release(); });
     pLoggerThread->start();
-    while (!isCreated)
-        QThread::msleep(5);
+    createdSemaphore.acquire();
 
     isRegLoggerInstantiated = true;
     return;
@@ -115,8 +116,7 @@ void RegLoggerThreadWorker::deleteRegLogger()
 
     QThread* pLoggerThread = RegLogger::instance().thread();
     RegLogger::instance().deleteLater();
-    while (pLoggerThread->isFinished() == false) // According to docs, deleteLater() will perform deletion in the thread that created it, that is main thread, so calling it like this should be safe
-        QThread::currentThread()->msleep(5);
+    pLoggerThread->wait(); // According to docs, deleteLater() will perform deletion in the thread that created it, that is main thread, so calling it like this should be safe
 
     return;
 }
@@ -0,0 +1,65 @@
+#include "SharedArray.hpp"
+
+#include <cstring>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QRandomGenerator>
+
+bool SharedArray::create(const QVector<int>& numbers)
+{
+    detach();
+    // pid alone would be reused by later processes, while segment of a crashed one may still linger (SysV segments outlive processes)
+    const QString key = QStringLiteral("ClientServerExample-%1-%2")
+                        .arg(QCoreApplication::applicationPid())
+                        .arg(QRandomGenerator::global()->generate64(), 16, 16, QLatin1Char('0'));
+    m_shm.setKey(key);
+    // zero-size segment can't be created, empty array still takes one element
+    const int byteSize = qMax(1, numbers.size()) * static_cast<int>(sizeof(int));
+    if (!m_shm.create(byteSize, QSharedMemory::ReadWrite))
+        return false;
+    m_count = numbers.size();
+    std::memcpy(m_shm.data(), numbers.constData(), m_count * sizeof(int));
+    return true;
+}
+
+bool SharedArray::attach(const Protocol::SharedBlock& block)
+{
+    detach();
+    if (!block.isValid())
+        return false;
+    m_shm.setKey(block.key);
+    if (!m_shm.attach(QSharedMemory::ReadWrite))
+        return false;
+    if (m_shm.size() < static_cast<qint64>(block.count) * static_cast<qint64>(sizeof(int)))
+    {
+        m_shm.detach();
+        return false;
+    }
+    m_count = block.count;
+    return true;
+}
+
+void SharedArray::detach()
+{
+    if (m_shm.isAttached())
+        m_shm.detach();
+    m_count = 0;
+}
+
+QVector<int> SharedArray::read() const
+{
+    if (!m_shm.isAttached())
+        return {};
+    QVector<int> numbers(m_count);
+    std::memcpy(numbers.data(), m_shm.constData(), m_count * sizeof(int));
+    return numbers;
+}
+
+bool SharedArray::write(const QVector<int>& numbers)
+{
+    if (!m_shm.isAttached() || (static_cast<qint64>(numbers.size()) * static_cast<qint64>(sizeof(int)) > m_shm.size()))
+        return false;
+    std::memcpy(m_shm.data(), numbers.constData(), numbers.size() * sizeof(int));
+    m_count = numbers.size();
+    return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QtCore/QSharedMemory>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+#include "Protocol.hpp"
+
+// Array of ints in a QSharedMemory segment, so that peers on the same host pass bulk data by Protocol::SharedBlock instead of copying it through socket.
+// Segment is created by the side which sends the request and is removed by the last detach (or destruction), so either side may exit first.
+// A holder killed while attached doesn't detach: on Unix SysV segment then outlives both processes until removed by hand (ipcs/ipcrm), on Windows it goes with the last handle.
+// Peers take turns instead of locking - client doesn't touch the segment until server answers
+class SharedArray
+{
+public:
+    SharedArray() = default;
+    ~SharedArray() { detach(); }
+    SharedArray(const SharedArray&) = delete;            // Copy constructor
+    SharedArray(SharedArray&&) = delete;                 // Move constructor
+    SharedArray& operator=(const SharedArray&) = delete; // Copy assignment
+    SharedArray& operator=(SharedArray&&) = delete;      // Move assignment
+
+private:
+    QSharedMemory m_shm;
+    qint32 m_count = 0;
+
+public:
+    bool create(const QVector<int>& numbers); // new segment under unique key, filled with numbers
+    bool attach(const Protocol::SharedBlock& block); // fails if segment is missing or smaller than block.count
+    void detach();
+
+    bool isAttached() const { return m_shm.isAttached(); }
+    Protocol::SharedBlock block() const { return Protocol::SharedBlock{m_shm.key(), m_count}; }
+    QString errorString() const { return m_shm.errorString(); }
+
+    QVector<int> read() const;
+    bool write(const QVector<int>& numbers); // fails if numbers don't fit into segment
+};
@@ -0,0 +1,154 @@
+#include "Tracing.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFile>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+
+using namespace Tracing;
+
+namespace
+{
+constexpr int g_defaultCapacity = 1 << 16; // spans
+
+quint64& currentTraceIdRef()
+{
+    thread_local quint64 t_traceId = 0;
+    return t_traceId;
+}
+} // namespace
+
+qint64 Tracing::nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+quint64 Tracing::currentTraceId()
+{
+    return currentTraceIdRef();
+}
+
+Tracer::Tracer()
+{
+    m_spans.resize(g_defaultCapacity);
+}
+
+Tracer& Tracer::instance()
+{
+    static Tracer s_tracer;
+    return s_tracer;
+}
+
+void Tracer::setCapacity(int spanCount)
+{
+    QMutexLocker locker(&m_mutex);
+    m_spans = QVector<Span>(qMax(1, spanCount));
+    m_nextSpan = 0;
+    m_isFull = false;
+}
+
+int Tracer::threadIndex()
+{
+    thread_local int t_threadIndex = -1;
+    if (t_threadIndex < 0)
+    {
+        const QString threadName = QThread::currentThread()->objectName();
+        QMutexLocker locker(&m_mutex);
+        t_threadIndex = m_threadNames.size();
+        m_threadNames.append(threadName.isEmpty() ? QStringLiteral("Thread %1").arg(t_threadIndex) : threadName);
+    }
+    return t_threadIndex;
+}
+
+void Tracer::record(const char* name, quint64 traceId, qint64 startNs, qint64 endNs)
+{
+    if (!isEnabled())
+        return;
+    const int index = threadIndex();
+    QMutexLocker locker(&m_mutex);
+    m_spans[m_nextSpan] = Span{name, traceId, startNs, endNs, index};
+    if (++m_nextSpan == m_spans.size())
+    {
+        m_nextSpan = 0;
+        m_isFull = true;
+    }
+}
+
+QVector<Span> Tracer::spansOf(quint64 traceId) const
+{
+    QVector<Span> spans;
+    {
+        QMutexLocker locker(&m_mutex);
+        const int spanCount = m_isFull ? m_spans.size() : m_nextSpan;
+        for (int i = 0; i < spanCount; ++i)
+        {
+            if (m_spans[i].traceId == traceId)
+                spans.append(m_spans[i]);
+        }
+    }
+    std::sort(spans.begin(), spans.end(), [](const Span& lhv, const Span& rhv) { return lhv.startNs < rhv.startNs; });
+    return spans;
+}
+
+// Complete ("X") events, timestamps in microseconds; thread names go as metadata ("M") events
+QByteArray Tracer::toChromeTraceJson() const
+{
+    const qint64 pid = QCoreApplication::applicationPid();
+    QJsonArray events;
+    QMutexLocker locker(&m_mutex);
+    for (int i = 0; i < m_threadNames.size(); ++i)
+    {
+        events.append(QJsonObject{{QStringLiteral("name"), QStringLiteral("thread_name")},
+                                  {QStringLiteral("ph"), QStringLiteral("M")},
+                                  {QStringLiteral("pid"), pid},
+                                  {QStringLiteral("tid"), i},
+                                  {QStringLiteral("args"), QJsonObject{{QStringLiteral("name"), m_threadNames[i]}}}});
+    }
+    const int spanCount = m_isFull ? m_spans.size() : m_nextSpan;
+    const int firstSpan = m_isFull ? m_nextSpan : 0;
+    for (int n = 0; n < spanCount; ++n)
+    {
+        const Span& span = m_spans[(firstSpan + n) % m_spans.size()];
+        events.append(QJsonObject{{QStringLiteral("name"), QLatin1String(span.name)},
+                                  {QStringLiteral("cat"), (span.traceId != 0) ? QStringLiteral("request") : QStringLiteral("other")},
+                                  {QStringLiteral("ph"), QStringLiteral("X")},
+                                  {QStringLiteral("ts"), span.startNs / 1000.0},
+                                  {QStringLiteral("dur"), (span.endNs - span.startNs) / 1000.0},
+                                  {QStringLiteral("pid"), pid},
+                                  {QStringLiteral("tid"), span.threadIndex},
+                                  {QStringLiteral("args"), QJsonObject{{QStringLiteral("traceId"), QString::number(span.traceId)}}}});
+    }
+    locker.unlock();
+    return QJsonDocument(QJsonObject{{QStringLiteral("traceEvents"), events}, {QStringLiteral("displayTimeUnit"), QStringLiteral("ms")}}).toJson(QJsonDocument::Compact);
+}
+
+bool Tracer::writeChromeTrace(const QString& filePath) const
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    return file.write(toChromeTraceJson()) >= 0;
+}
+
+ScopedSpan::ScopedSpan(const char* name, quint64 traceId)
+    : m_name{name}
+    , m_traceId{traceId}
+    , m_outerTraceId{currentTraceIdRef()}
+{
+    currentTraceIdRef() = traceId;
+    if (Tracer::instance().isEnabled())
+        m_startNs = nowNs();
+}
+
+ScopedSpan::~ScopedSpan()
+{
+    currentTraceIdRef() = m_outerTraceId;
+    if (m_startNs >= 0)
+        Tracer::instance().record(m_name, m_traceId, m_startNs, nowNs());
+}
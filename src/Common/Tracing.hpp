@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+// Span-based tracing of requests across threads, exported as Chrome trace event JSON (chrome://tracing, Perfetto).
+// Disabled by default, in which case ScopedSpan costs a load of an atomic flag
+namespace Tracing
+{
+qint64 nowNs(); // steady clock, same as Net::CallbackExecutor::nowNs(), so that timestamps taken by network layer can be recorded as spans
+
+struct Span
+{
+    const char* name = nullptr; // string literal, spans don't own it
+    quint64 traceId = 0; // 0 - span of no particular request
+    qint64 startNs = 0;
+    qint64 endNs = 0;
+    int threadIndex = 0;
+};
+
+// Process-wide collector of spans. Spans go to a ring buffer, so that tracing can stay on for a long run: oldest ones are overwritten once it's full
+class Tracer
+{
+public:
+    static Tracer& instance();
+
+    void setEnabled(bool isEnabled) { m_isEnabled.store(isEnabled, std::memory_order_relaxed); }
+    bool isEnabled() const { return m_isEnabled.load(std::memory_order_relaxed); }
+    void setCapacity(int spanCount); // drops spans recorded so far
+
+    quint64 newTraceId() { return m_nextTraceId.fetch_add(1, std::memory_order_relaxed); }
+    void record(const char* name, quint64 traceId, qint64 startNs, qint64 endNs); // no-op if disabled; thread-safe
+
+    QVector<Span> spansOf(quint64 traceId) const; // ordered by start
+    QByteArray toChromeTraceJson() const;
+    bool writeChromeTrace(const QString& filePath) const;
+
+private:
+    Tracer();
+    int threadIndex(); // of current thread, which is registered with its name on first span
+
+    std::atomic<bool> m_isEnabled{false};
+    std::atomic<quint64> m_nextTraceId{1};
+    mutable QMutex m_mutex;
+    QVector<Span> m_spans; // ring buffer
+    int m_nextSpan = 0;
+    bool m_isFull = false;
+    QVector<QString> m_threadNames; // by Span::threadIndex
+};
+
+quint64 currentTraceId(); // of the innermost ScopedSpan of this thread, 0 if none
+
+// Records its scope as a span. Spans nested on the same thread belong to the enclosing span's trace unless given one explicitly
+class ScopedSpan
+{
+public:
+    explicit ScopedSpan(const char* name, quint64 traceId = currentTraceId());
+    ~ScopedSpan();
+    ScopedSpan(const ScopedSpan&) = delete;            // Copy constructor
+    ScopedSpan& operator=(const ScopedSpan&) = delete; // Copy assignment
+
+private:
+    const char* m_name;
+    quint64 m_traceId;
+    quint64 m_outerTraceId;
+    qint64 m_startNs = -1; // -1 - tracing was disabled when scope was entered
+};
+} // namespace Tracing
@@ -103,19 +103,22 @@ template<typename T>
 inline constexpr bool is_non_associative_container_v = is_non_associative_container<T>::value;
 
 
-inline quint64 hash64_FNV1a(const QByteArray& data)
+constexpr quint64 g_FNV_offset = 1'469'598'103'934'665'603ull;
+// Pass hash of the previous part as seed to hash data in several parts
+inline quint64 hash64_FNV1a(const char* data, qint64 size, quint64 seed = g_FNV_offset)
 {
-    constexpr quint64 FNV_offset = 1'469'598'103'934'665'603ull;
     constexpr quint64 FNV_prime = 1'099'511'628'211ull;
-    quint64 hash = FNV_offset;
-    for (auto byte : data)
+    quint64 hash = seed;
+    for (qint64 i = 0; i < size; ++i)
     {
-        hash ^= static_cast<quint8>(byte);
+        hash ^= static_cast<quint8>(data[i]);
         hash *= FNV_prime;
     }
     return hash;
-
-    QString s;
+}
+inline quint64 hash64_FNV1a(const QByteArray& data)
+{
+    return hash64_FNV1a(data.constData(), data.size());
 }
 
 class TString : public std::string {};
@@ -0,0 +1,443 @@
+#include "LoadGenerator.hpp"
+
+#include <cstdio>
+#include <future>
+
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+
+#include "Net/NetHeaders.hpp"
+
+using namespace std;
+using namespace Protocol;
+
+namespace
+{
+constexpr int g_connectTimeout = 30000; // msec for all connections to open
+constexpr int g_progressInterval = 1000; // msec
+constexpr int g_drainPollInterval = 50; // msec
+
+const std::function<void(QString)> f_logNone = [](QString) {};
+} // namespace
+
+LoadGenerator::LoadGenerator(LoadGen::Settings settings, QObject* parent)
+    : QObject(parent)
+    , m_settings{settings}
+{
+    m_clock.start();
+    m_progressTimer.setInterval(g_progressInterval);
+    connect(&m_progressTimer, &QTimer::timeout, this, &LoadGenerator::logProgress);
+    m_drainTimer.setInterval(g_drainPollInterval);
+}
+
+LoadGenerator::~LoadGenerator()
+{
+    destroyConnections();
+}
+
+void LoadGenerator::start()
+{
+    if (m_settings.weightSortArray + m_settings.weightFindPrimeNumbers + m_settings.weightCalculateFunction <= 0)
+    {
+        f_logError(QStringLiteral("Request mix is empty"));
+        emit finished();
+        return;
+    }
+    if ((m_settings.mode == LoadGen::Mode::OpenLoop) && (m_settings.rate <= 0))
+    {
+        f_logError(QStringLiteral("Open loop needs a positive rate"));
+        emit finished();
+        return;
+    }
+    openConnections();
+    waitForConnections(nowNs() + g_connectTimeout * 1000000LL);
+}
+
+// Connections are instantiated and opened asynchronously, since waiting for each of thousands one by one takes a while
+void LoadGenerator::openConnections()
+{
+    QVector<NetThread*> threads;
+    for (int i = 0; i < qMax(1, m_settings.threadCount); ++i)
+    {
+        threads.append(new NetThread);
+        threads.last()->start();
+    }
+    std::vector<std::future<std::tuple<TcpClient*, NetThread*>>> instantiateFutures;
+    for (int i = 0; i < m_settings.connectionCount; ++i)
+        instantiateFutures.push_back(Net::instantiateThreadedConnectionAsync<TcpClient>(threads.at(i % threads.size())));
+
+    Net::ConnectionSettings clientSettings;
+    clientSettings.ipDestination = m_settings.host;
+    clientSettings.portOut = m_settings.port;
+    std::vector<std::future<Net::ConnectionState>> openFutures;
+    for (int i = 0; i < m_settings.connectionCount; ++i)
+    {
+        auto s = make_unique<Session>();
+        s->index = i;
+        s->rng.seed(static_cast<std::mt19937::result_type>(i) + 1);
+        s->client = std::get<0>(instantiateFutures[i].get());
+        Session* pSession = s.get();
+        m_sessions.push_back(std::move(s));
+
+        // Clients are idle and not open yet, so they can be configured from here
+        TcpClient* pClient = pSession->client;
+        pClient->setLoggingFunctions(f_logNone, f_logError); // thousands of connects aren't worth a line each
+        pClient->setEnableReconnect(false);
+        pClient->setAuthorizationEnabled(true);
+        pClient->setLoginData(Net::LoginData{m_settings.userPrefix + QString::number(i), m_settings.password});
+        pClient->setCallbackFunction([this, pSession](QByteArray msg, NetConnection* const, Net::AddressPort) {
+            sessionReceived(pSession, msg);
+        });
+        connect(pClient, &NetConnection::openedConnection, pClient, [pSession](bool isOpened) {
+            if (isOpened)
+                pSession->isConnected.store(true);
+        }, Qt::DirectConnection);
+        connect(pClient, &NetConnection::socketStateChanged, pClient, [this, pSession](QAbstractSocket::SocketState socketState) {
+            if ((socketState == QAbstractSocket::UnconnectedState) && pSession->isConnected.exchange(false))
+                sessionDisconnected(pSession);
+        }, Qt::DirectConnection);
+        openFutures.push_back(Net::openThreadedConnectionAsync(pClient, clientSettings));
+    }
+    for (auto& future : openFutures)
+        future.wait();
+}
+
+// TcpClient connects asynchronously, and server drops those it doesn't authorize right after they connect, so run starts once count is settled
+void LoadGenerator::waitForConnections(qint64 deadlineNs)
+{
+    int connectedCount = 0;
+    for (auto const& s : m_sessions)
+        connectedCount += s->isConnected.load() ? 1 : 0;
+    if ((connectedCount < m_settings.connectionCount) && (nowNs() < deadlineNs))
+    {
+        QTimer::singleShot(100, this, [this, deadlineNs]() { waitForConnections(deadlineNs); });
+        return;
+    }
+    if (connectedCount < m_settings.connectionCount)
+        f_logError(QStringLiteral("Only %1 of %2 connections are open, check server's address and [GeneratedUsers]").arg(connectedCount).arg(m_settings.connectionCount));
+    if (connectedCount == 0)
+    {
+        destroyConnections();
+        emit finished();
+        return;
+    }
+    beginRun();
+}
+
+void LoadGenerator::beginRun()
+{
+    f_logGeneral(QStringLiteral("Running %1 for %2 msec").arg((m_settings.mode == LoadGen::Mode::OpenLoop) ? QStringLiteral("open loop") : QStringLiteral("closed loop")).arg(m_settings.duration));
+    m_runStartedAtNs = nowNs();
+    m_isRunning.store(true);
+    for (auto const& s : m_sessions)
+    {
+        Session* pSession = s.get();
+        if (pSession->isConnected.load())
+            QMetaObject::invokeMethod(pSession->client, [this, pSession]() { sessionStart(pSession); }, Qt::QueuedConnection);
+    }
+    m_progressTimer.start();
+    QTimer::singleShot(m_settings.duration, this, &LoadGenerator::endRun);
+}
+
+void LoadGenerator::endRun()
+{
+    m_isRunning.store(false);
+    const qint64 drainDeadlineNs = nowNs() + m_settings.drainTimeout * 1000000LL;
+    connect(&m_drainTimer, &QTimer::timeout, this, [this, drainDeadlineNs]() {
+        if ((m_pendingCount.load() > 0) && (nowNs() < drainDeadlineNs))
+            return;
+        m_drainTimer.stop();
+        m_progressTimer.stop();
+        m_runFinishedAtNs = nowNs();
+        destroyConnections();
+        report();
+        emit finished();
+    });
+    m_drainTimer.start();
+}
+
+// Requests still in flight once connections are gone never got an answer
+void LoadGenerator::destroyConnections()
+{
+    m_isShuttingDown.store(true);
+    std::vector<std::future<void>> futures;
+    for (auto const& s : m_sessions)
+    {
+        if (s->client != nullptr)
+            futures.push_back(Net::destroyThreadedConnectionAsync(s->client));
+        s->client = nullptr;
+    }
+    for (auto& future : futures)
+        future.wait();
+    for (auto const& s : m_sessions)
+    {
+        for (auto const& p : qAsConst(s->pending))
+        {
+            m_stats[statsIndex(p.type)].lost.fetch_add(1, std::memory_order_relaxed);
+            m_stats[s_totalStatsIndex].lost.fetch_add(1, std::memory_order_relaxed);
+        }
+        s->pending.clear();
+    }
+}
+
+void LoadGenerator::logProgress()
+{
+    const quint64 completed = m_stats[s_totalStatsIndex].completed.load(std::memory_order_relaxed);
+    f_logGeneral(QStringLiteral("%1 completed/sec, %2 in flight, %3 sent in total")
+                 .arg((completed - m_lastLoggedCompleted) * 1000.0 / g_progressInterval, 0, 'f', 1)
+                 .arg(m_pendingCount.load())
+                 .arg(m_stats[s_totalStatsIndex].sent.load(std::memory_order_relaxed)));
+    m_lastLoggedCompleted = completed;
+}
+
+// One JSON object per line and request type, the last one for all types together
+void LoadGenerator::report()
+{
+    const double elapsedSec = (m_runFinishedAtNs - m_runStartedAtNs) / 1e9;
+    const QString modeName = (m_settings.mode == LoadGen::Mode::OpenLoop) ? QStringLiteral("open") : QStringLiteral("closed");
+    for (int i = 0; i <= s_totalStatsIndex; ++i)
+    {
+        const LoadGen::TypeStats& stats = m_stats[i];
+        const quint64 sent = stats.sent.load();
+        if ((sent == 0) && (i != s_totalStatsIndex))
+            continue;
+        const quint64 completed = stats.completed.load();
+        QJsonObject line{{"type", (i == s_totalStatsIndex) ? QStringLiteral("All") : toQString(static_cast<RequestType>(i + static_cast<int>(RequestType::SortArray)))},
+                         {"mode", modeName},
+                         {"connections", m_settings.connectionCount},
+                         {"elapsed_sec", elapsedSec},
+                         {"sent", static_cast<qint64>(sent)},
+                         {"completed", static_cast<qint64>(completed)},
+                         {"canceled", static_cast<qint64>(stats.canceled.load())},
+                         {"rejected", static_cast<qint64>(stats.rejected.load())},
+                         {"failed", static_cast<qint64>(stats.failed.load())},
+                         {"lost", static_cast<qint64>(stats.lost.load())},
+                         {"progress_messages", static_cast<qint64>(stats.progressMessages.load())},
+                         {"offered_per_sec", sent * 1000.0 / qMax(1, m_settings.duration)},
+                         {"throughput_per_sec", (elapsedSec > 0) ? completed / elapsedSec : 0.0},
+                         {"latency_mean_ms", (completed > 0) ? stats.latencyNs.sum() / 1e6 / completed : 0.0},
+                         {"latency_p50_ms", stats.latencyNs.quantile(0.5) / 1e6},
+                         {"latency_p90_ms", stats.latencyNs.quantile(0.9) / 1e6},
+                         {"latency_p99_ms", stats.latencyNs.quantile(0.99) / 1e6},
+                         {"latency_p999_ms", stats.latencyNs.quantile(0.999) / 1e6},
+                         {"latency_max_ms", stats.latencyNs.max() / 1e6}};
+        std::fputs(QJsonDocument(line).toJson(QJsonDocument::Compact).append('\n').constData(), stdout);
+    }
+    std::fflush(stdout);
+    if (m_disconnectCount.load() > 0)
+        f_logError(QStringLiteral("%1 connections were lost during the run").arg(m_disconnectCount.load()));
+}
+
+// Inputs are drawn from a generator seeded per input, so that with distinctInputs the same seed gives the same request, which server has cached
+unique_ptr<Request> LoadGenerator::makeRequest(Session* s)
+{
+    const int weightTotal = m_settings.weightSortArray + m_settings.weightFindPrimeNumbers + m_settings.weightCalculateFunction;
+    const int pick = std::uniform_int_distribution<int>(0, weightTotal - 1)(s->rng);
+    const RequestType type = (pick < m_settings.weightSortArray) ? RequestType::SortArray
+                           : (pick < m_settings.weightSortArray + m_settings.weightFindPrimeNumbers) ? RequestType::FindPrimeNumbers
+                           : RequestType::CalculateFunction;
+    const quint64 seed = (m_settings.distinctInputs > 0) ? std::uniform_int_distribution<int>(0, m_settings.distinctInputs - 1)(s->rng) : s->rng();
+    std::mt19937 inputRng(static_cast<std::mt19937::result_type>(seed * 4 + static_cast<quint64>(type)));
+
+    switch (type)
+    {
+    case RequestType::SortArray:
+    {
+        auto req = make_unique<Request_SortArray>();
+        std::uniform_int_distribution<int> distribution(-1000000, 1000000);
+        req->numbers.reserve(m_settings.arraySize);
+        for (int i = 0; i < m_settings.arraySize; ++i)
+            req->numbers.append(distribution(inputRng));
+        return req;
+    }
+    case RequestType::FindPrimeNumbers:
+    {
+        auto req = make_unique<Request_FindPrimeNumbers>();
+        req->x_from = std::uniform_int_distribution<int>(0, 10000000)(inputRng);
+        req->x_to = req->x_from + qMax(1, m_settings.primeRange) - 1;
+        return req;
+    }
+    case RequestType::CalculateFunction:
+    {
+        // x stays within a few thousands of functionPoints / 2 around 0, so that default sizes don't overflow int in the quadratic
+        auto req = make_unique<Request_CalculateFunction>();
+        std::uniform_int_distribution<int> constDistribution(1, 10);
+        req->equationType = (inputRng() % 2 == 0) ? EquationType::Linear : EquationType::Quadratic;
+        req->x_from = -m_settings.functionPoints / 2 + std::uniform_int_distribution<int>(-1000, 1000)(inputRng);
+        req->x_to = req->x_from + qMax(1, m_settings.functionPoints) - 1;
+        req->x_step = 1;
+        req->a = constDistribution(inputRng);
+        req->b = constDistribution(inputRng);
+        req->c = constDistribution(inputRng);
+        return req;
+    }
+    default: { return nullptr; }
+    }
+}
+
+QByteArray LoadGenerator::encodeRequest(const Request& req) const
+{
+    QByteArray msg;
+#if defined(MESSAGE_FORMAT_BINARY)
+    MAKE_QDATASTREAM_NET(stream, &msg, QIODevice::WriteOnly);
+    stream << req;
+#elif defined(MESSAGE_FORMAT_JSON)
+    QJsonObject jsonObject;
+    req.serialize(jsonObject);
+    msg = QJsonDocument(jsonObject).toJson(QJsonDocument::Compact);
+#endif
+    return msg;
+}
+
+void LoadGenerator::sessionStart(Session* s)
+{
+    if (m_settings.mode == LoadGen::Mode::OpenLoop)
+    {
+        s->nextDueAtNs = nowNs();
+        sessionScheduleNext(s);
+        return;
+    }
+    for (int i = 0; i < m_settings.concurrency; ++i)
+        sessionSend(s, nowNs());
+}
+
+void LoadGenerator::sessionSend(Session* s, qint64 dueAtNs)
+{
+    if (!m_isRunning.load(std::memory_order_relaxed) || !s->isConnected.load(std::memory_order_relaxed))
+        return;
+    unique_ptr<Request> req = makeRequest(s);
+    if (++s->lastRequestId == 0) // 0 is reserved for "all tasks" in cancel
+        ++s->lastRequestId;
+    req->requestId = s->lastRequestId;
+    s->pending.insert(req->requestId, Session::Pending{req->type, dueAtNs});
+    m_pendingCount.fetch_add(1, std::memory_order_relaxed);
+    for (int i : {statsIndex(req->type), s_totalStatsIndex})
+        m_stats[i].sent.fetch_add(1, std::memory_order_relaxed);
+    s->client->sendMessage(encodeRequest(*req));
+
+    if ((m_settings.cancelRatio > 0) && (std::uniform_real_distribution<double>(0.0, 1.0)(s->rng) < m_settings.cancelRatio))
+    {
+        const quint32 requestId = req->requestId;
+        QTimer::singleShot(m_settings.cancelAfter, s->client, [this, s, requestId]() { sessionCancel(s, requestId); });
+    }
+}
+
+// Arrivals of each connection are a Poisson process of rate / connectionCount, which sums up to a Poisson process of the whole rate
+void LoadGenerator::sessionScheduleNext(Session* s)
+{
+    if (!m_isRunning.load(std::memory_order_relaxed))
+        return;
+    const double connectionRate = m_settings.rate / qMax(1, m_settings.connectionCount); // per second
+    s->nextDueAtNs += static_cast<qint64>(std::exponential_distribution<double>(connectionRate)(s->rng) * 1e9);
+    const qint64 dueAtNs = s->nextDueAtNs;
+    const int delayMs = static_cast<int>(qMax<qint64>(0, dueAtNs - nowNs()) / 1000000);
+    QTimer::singleShot(delayMs, Qt::PreciseTimer, s->client, [this, s, dueAtNs]() {
+        sessionSend(s, dueAtNs);
+        sessionScheduleNext(s);
+    });
+}
+
+void LoadGenerator::sessionCancel(Session* s, quint32 requestId)
+{
+    auto iter = s->pending.find(requestId);
+    if ((iter == s->pending.end()) || iter->isCancelSent || !s->isConnected.load(std::memory_order_relaxed))
+        return; // answered already
+    iter->isCancelSent = true;
+    Request_CancelCurrentTask req;
+    req.requestId = requestId;
+    s->client->sendMessage(encodeRequest(req));
+}
+
+// Only header is decoded: what matters is which request is answered and how, results themselves are left to the server's own checks
+void LoadGenerator::sessionReceived(Session* s, QByteArray msg)
+{
+    Request header;
+    Request_InvalidRequest error;
+#if defined(MESSAGE_FORMAT_BINARY)
+    MAKE_QDATASTREAM_NET(stream, &msg, QIODevice::ReadOnly);
+    stream >> header;
+    if ((stream.status() == QDataStream::Ok) && (header.type == RequestType::InvalidRequest))
+    {
+        stream.device()->seek(0);
+        stream >> error;
+    }
+    const bool isValid = (stream.status() == QDataStream::Ok);
+#elif defined(MESSAGE_FORMAT_JSON)
+    QJsonObject msgJsonObject = QJsonDocument::fromJson(msg).object();
+    const bool isValid = header.deserialize(msgJsonObject) && ((header.type != RequestType::InvalidRequest) || error.deserialize(msgJsonObject));
+#endif
+    if (!isValid)
+    {
+        f_logError(QStringLiteral("Connection %1 received message with corrupted data: %2").arg(s->index).arg(QString::fromLatin1(msg.left(64).toHex())));
+        return;
+    }
+
+    auto iter = s->pending.constFind(header.requestId);
+    if (iter == s->pending.constEnd())
+        return; // answer to cancel of a task which had finished already
+    const int index = statsIndex(iter->type);
+    auto lambda_count = [this, index](std::atomic<quint64> LoadGen::TypeStats::* counter) {
+        (m_stats[index].*counter).fetch_add(1, std::memory_order_relaxed);
+        (m_stats[s_totalStatsIndex].*counter).fetch_add(1, std::memory_order_relaxed);
+    };
+    switch (header.type)
+    {
+    case RequestType::ProgressRange: [[fallthrough]];
+    case RequestType::ProgressValue:
+    {
+        lambda_count(&LoadGen::TypeStats::progressMessages);
+        return;
+    }
+    case RequestType::CancelCurrentTask:
+    {
+        lambda_count(&LoadGen::TypeStats::canceled);
+        break;
+    }
+    case RequestType::InvalidRequest:
+    {
+        lambda_count((error.errorCode == ErrorCode::TaskLimitReached) ? &LoadGen::TypeStats::rejected : &LoadGen::TypeStats::failed);
+        break;
+    }
+    default:
+    {
+        if (header.type != iter->type)
+        {
+            f_logError(QStringLiteral("Connection %1 received %2 in reply to %3 #%4").arg(s->index).arg(toQString(header.type)).arg(toQString(iter->type)).arg(header.requestId));
+            lambda_count(&LoadGen::TypeStats::failed);
+            break;
+        }
+        const qint64 latencyNs = nowNs() - iter->dueAtNs;
+        m_stats[index].latencyNs.record(latencyNs);
+        m_stats[s_totalStatsIndex].latencyNs.record(latencyNs);
+        lambda_count(&LoadGen::TypeStats::completed);
+        break;
+    }
+    }
+    sessionFinishRequest(s, header.requestId);
+}
+
+void LoadGenerator::sessionFinishRequest(Session* s, quint32 requestId)
+{
+    if (s->pending.remove(requestId) == 0)
+        return;
+    m_pendingCount.fetch_sub(1, std::memory_order_relaxed);
+    if (m_settings.mode != LoadGen::Mode::ClosedLoop)
+        return;
+    if (m_settings.thinkTime > 0)
+        QTimer::singleShot(m_settings.thinkTime, s->client, [this, s]() { sessionSend(s, nowNs()); });
+    else
+        sessionSend(s, nowNs());
+}
+
+void LoadGenerator::sessionDisconnected(Session* s)
+{
+    if (!m_isShuttingDown.load())
+        m_disconnectCount.fetch_add(1, std::memory_order_relaxed);
+    for (auto const& p : qAsConst(s->pending))
+    {
+        m_stats[statsIndex(p.type)].lost.fetch_add(1, std::memory_order_relaxed);
+        m_stats[s_totalStatsIndex].lost.fetch_add(1, std::memory_order_relaxed);
+    }
+    m_pendingCount.fetch_sub(s->pending.size(), std::memory_order_relaxed);
+    s->pending.clear();
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <QtCore/QDateTime>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QTimer>
+#include <QtNetwork/QHostAddress>
+
+#include "Common/Metrics.hpp"
+#include "Common/Protocol.hpp"
+
+class TcpClient;
+
+namespace LoadGen
+{
+enum class Mode
+{
+    OpenLoop,   // requests arrive at a fixed rate regardless of replies, as from many independent users
+    ClosedLoop, // every connection keeps a fixed number of requests in flight, as from users waiting on each answer
+};
+
+struct Settings
+{
+    QHostAddress host{QHostAddress::LocalHost};
+    quint16 port = 0;
+    int connectionCount = 100;
+    int threadCount = 4; // NetThreads connections are spread over
+    QString userPrefix{"loadgen"}; // connection i logs in as userPrefix + i, server only admits one connection per username
+    QString password{"loadgen"};
+
+    Mode mode = Mode::ClosedLoop;
+    double rate = 100.0; // requests per second over all connections, open loop
+    int concurrency = 1; // requests in flight per connection, closed loop
+    int thinkTime = 0; // msec between reply and next request, closed loop
+    int duration = 10000; // msec
+    int drainTimeout = 5000; // msec to wait for replies to requests in flight once duration is over
+
+    // Relative weights of request types
+    int weightSortArray = 1;
+    int weightFindPrimeNumbers = 1;
+    int weightCalculateFunction = 1;
+    int arraySize = 10000; // SortArray elements
+    int primeRange = 100000; // width of FindPrimeNumbers range
+    int functionPoints = 10000; // CalculateFunction points
+    int distinctInputs = 0; // per type; requests repeat inputs from a pool of that size, which server answers from cache, 0 - every input is unique
+
+    double cancelRatio = 0.0; // fraction of requests canceled cancelAfter msec after being sent
+    int cancelAfter = 50; // msec
+};
+
+// Outcome counters of one request type; updated from connection threads
+struct TypeStats
+{
+    std::atomic<quint64> sent{0};
+    std::atomic<quint64> completed{0};
+    std::atomic<quint64> canceled{0};
+    std::atomic<quint64> rejected{0}; // TaskLimitReached, request was never started
+    std::atomic<quint64> failed{0}; // any other error
+    std::atomic<quint64> lost{0}; // in flight when connection was lost or drain timed out
+    std::atomic<quint64> progressMessages{0};
+    Metrics::Histogram latencyNs; // of completed requests, from the moment request was due to be sent
+};
+} // namespace LoadGen
+
+// Opens Settings::connectionCount authorized TcpClients and replays a mix of task requests over them for Settings::duration,
+// then prints throughput and latency percentiles per request type as JSON lines and emits finished()
+class LoadGenerator : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LoadGenerator(LoadGen::Settings settings, QObject* parent = nullptr);
+    ~LoadGenerator();
+
+    void start();
+
+signals:
+    void finished();
+
+private:
+    // Client side of one connection. Touched only from its client's thread, except for the atomic flags
+    struct Session
+    {
+        int index = 0;
+        TcpClient* client = nullptr;
+        std::mt19937 rng;
+        quint32 lastRequestId = 0;
+        struct Pending
+        {
+            Protocol::RequestType type;
+            qint64 dueAtNs; // latency is measured from here, so that a late send isn't hidden by the server being slow (coordinated omission)
+            bool isCancelSent = false;
+        };
+        QHash<quint32, Pending> pending;
+        qint64 nextDueAtNs = 0; // open loop
+        std::atomic<bool> isConnected{false};
+    };
+
+    LoadGen::Settings m_settings;
+    std::vector<std::unique_ptr<Session>> m_sessions;
+    LoadGen::TypeStats m_stats[4]; // SortArray, FindPrimeNumbers, CalculateFunction and all of them together
+    std::atomic<bool> m_isRunning{false}; // new requests are only sent while set
+    std::atomic<bool> m_isShuttingDown{false}; // connections are being destroyed, their disconnects are expected
+    std::atomic<int> m_pendingCount{0};
+    std::atomic<quint64> m_disconnectCount{0};
+    QElapsedTimer m_clock; // time base of Session::Pending::dueAtNs
+    qint64 m_runStartedAtNs = 0;
+    qint64 m_runFinishedAtNs = 0;
+    QTimer m_progressTimer;
+    QTimer m_drainTimer;
+    quint64 m_lastLoggedCompleted = 0;
+
+    std::function<void(QString)> f_logGeneral = [](QString msg) { qInfo("%s", qUtf8Printable(QDateTime::currentDateTimeUtc().toString(QStringLiteral("[yyyy.MM.dd-hh:mm:ss.zzz]")) + msg)); };
+    std::function<void(QString)> f_logError = [](QString msg) { qWarning("%s", qUtf8Printable(QDateTime::currentDateTimeUtc().toString(QStringLiteral("[yyyy.MM.dd-hh:mm:ss.zzz]")) + msg)); };
+
+private:
+    static constexpr int s_totalStatsIndex = 3;
+    static int statsIndex(Protocol::RequestType type) { return static_cast<int>(type) - static_cast<int>(Protocol::RequestType::SortArray); }
+    qint64 nowNs() const { return m_clock.nsecsElapsed(); }
+
+    void openConnections();
+    void waitForConnections(qint64 deadlineNs);
+    void beginRun();
+    void endRun();
+    void destroyConnections();
+    void report();
+    void logProgress();
+
+    std::unique_ptr<Protocol::Request> makeRequest(Session* s);
+    QByteArray encodeRequest(const Protocol::Request& req) const;
+
+    void sessionStart(Session* s); // these run in session's client thread
+    void sessionSend(Session* s, qint64 dueAtNs);
+    void sessionScheduleNext(Session* s);
+    void sessionCancel(Session* s, quint32 requestId);
+    void sessionReceived(Session* s, QByteArray msg);
+    void sessionFinishRequest(Session* s, quint32 requestId);
+    void sessionDisconnected(Session* s);
+};
@@ -0,0 +1,86 @@
+#include <QtCore/QCommandLineOption>
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QTimer>
+
+#include "LoadGenerator.hpp"
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser cmdParser;
+    cmdParser.setApplicationDescription("Headless load generator for Server. Prints one JSON object per request type once the run is over.");
+    cmdParser.addHelpOption();
+    cmdParser.addPositionalArgument("host", "Server address.");
+    cmdParser.addPositionalArgument("port", "Server port.");
+    QCommandLineOption connectionsOption("connections", "Number of connections, each authorized as its own user.", "count", "100");
+    QCommandLineOption threadsOption("threads", "Number of NetThreads serving the connections.", "count", "4");
+    QCommandLineOption userPrefixOption("user-prefix", "Connection i logs in as <prefix><i>, see [GeneratedUsers] of ServerSettings.ini.", "prefix", "loadgen");
+    QCommandLineOption passwordOption("password", "Password of every user.", "password", "loadgen");
+    QCommandLineOption modeOption("mode", "open - requests arrive at --rate regardless of replies; closed - every connection keeps --concurrency requests in flight.", "mode", "closed");
+    QCommandLineOption rateOption("rate", "Requests per second over all connections (open loop).", "count", "100");
+    QCommandLineOption concurrencyOption("concurrency", "Requests in flight per connection (closed loop), should not exceed server's maxTasksPerClient.", "count", "1");
+    QCommandLineOption thinkTimeOption("think-time", "Time in msec between reply and next request (closed loop).", "msec", "0");
+    QCommandLineOption durationOption("duration", "Time in msec requests are sent for.", "msec", "10000");
+    QCommandLineOption drainOption("drain", "Time in msec to wait for replies once duration is over.", "msec", "5000");
+    QCommandLineOption mixOption("mix", "Relative weights of request types: sort, primes, function.", "list", "sort=1,primes=1,function=1");
+    QCommandLineOption arraySizeOption("array-size", "SortArray elements.", "count", "10000");
+    QCommandLineOption primeRangeOption("prime-range", "Width of FindPrimeNumbers range.", "count", "100000");
+    QCommandLineOption functionPointsOption("function-points", "CalculateFunction points.", "count", "10000");
+    QCommandLineOption distinctOption("distinct", "Number of distinct inputs per request type, so that server answers repeats from cache; 0 - every input is unique.", "count", "0");
+    QCommandLineOption cancelRatioOption("cancel-ratio", "Fraction of requests canceled after --cancel-after.", "fraction", "0");
+    QCommandLineOption cancelAfterOption("cancel-after", "Time in msec after which a request picked for cancel is canceled.", "msec", "50");
+    cmdParser.addOptions({connectionsOption, threadsOption, userPrefixOption, passwordOption, modeOption, rateOption, concurrencyOption, thinkTimeOption, durationOption, drainOption,
+                          mixOption, arraySizeOption, primeRangeOption, functionPointsOption, distinctOption, cancelRatioOption, cancelAfterOption});
+    cmdParser.process(a);
+
+    const QStringList posArgs = cmdParser.positionalArguments();
+    if (posArgs.size() < 2)
+    {
+        cmdParser.showHelp();
+        return 1;
+    }
+
+    LoadGen::Settings settings;
+    settings.host.setAddress(posArgs.at(0));
+    settings.port = posArgs.at(1).toUInt();
+    settings.connectionCount = cmdParser.value(connectionsOption).toInt();
+    settings.threadCount = cmdParser.value(threadsOption).toInt();
+    settings.userPrefix = cmdParser.value(userPrefixOption);
+    settings.password = cmdParser.value(passwordOption);
+    settings.mode = (cmdParser.value(modeOption) == QStringLiteral("open")) ? LoadGen::Mode::OpenLoop : LoadGen::Mode::ClosedLoop;
+    settings.rate = cmdParser.value(rateOption).toDouble();
+    settings.concurrency = qMax(1, cmdParser.value(concurrencyOption).toInt());
+    settings.thinkTime = cmdParser.value(thinkTimeOption).toInt();
+    settings.duration = cmdParser.value(durationOption).toInt();
+    settings.drainTimeout = cmdParser.value(drainOption).toInt();
+    settings.weightSortArray = 0;
+    settings.weightFindPrimeNumbers = 0;
+    settings.weightCalculateFunction = 0;
+    for (QString const& item : cmdParser.value(mixOption).split(',', Qt::SkipEmptyParts))
+    {
+        const QString name = item.section('=', 0, 0).trimmed();
+        const int weight = qMax(0, item.section('=', 1, 1).toInt());
+        if (name == QStringLiteral("sort"))
+            settings.weightSortArray = weight;
+        else if (name == QStringLiteral("primes"))
+            settings.weightFindPrimeNumbers = weight;
+        else if (name == QStringLiteral("function"))
+            settings.weightCalculateFunction = weight;
+        else
+            qWarning("Unknown request type in --mix: %s", qUtf8Printable(name));
+    }
+    settings.arraySize = cmdParser.value(arraySizeOption).toInt();
+    settings.primeRange = cmdParser.value(primeRangeOption).toInt();
+    settings.functionPoints = cmdParser.value(functionPointsOption).toInt();
+    settings.distinctInputs = qMax(0, cmdParser.value(distinctOption).toInt());
+    settings.cancelRatio = cmdParser.value(cancelRatioOption).toDouble();
+    settings.cancelAfter = cmdParser.value(cancelAfterOption).toInt();
+
+    LoadGenerator loadGenerator(settings);
+    QObject::connect(&loadGenerator, &LoadGenerator::finished, &a, &QCoreApplication::quit, Qt::QueuedConnection);
+    QTimer::singleShot(0, &loadGenerator, &LoadGenerator::start);
+
+    return a.exec();
+}
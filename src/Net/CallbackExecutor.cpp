@@ -0,0 +1,83 @@
+#include "CallbackExecutor.hpp"
+
+using namespace Net;
+
+CallbackExecutor::CallbackExecutor(int threadCount)
+{
+    if (threadCount <= 0)
+        threadCount = qMax(1, QThread::idealThreadCount());
+    m_threads.reserve(threadCount);
+    m_contextCountByThread.fill(0, threadCount);
+    for (int i = 0; i < threadCount; ++i)
+    {
+        QThread* pThread = new QThread;
+        pThread->setObjectName(QString("CallbackExecutor-%1").arg(i));
+        pThread->start();
+        m_threads.append(pThread);
+    }
+}
+
+CallbackExecutor::~CallbackExecutor()
+{
+    for (QThread* pThread : qAsConst(m_threads))
+    {
+        pThread->quit();
+        pThread->wait();
+        delete pThread;
+    }
+}
+
+QObject* CallbackExecutor::acquireContext()
+{
+    QMutexLocker locker(&m_mutex);
+    int threadIndex = 0;
+    for (int i = 1; i < m_contextCountByThread.size(); ++i)
+    {
+        if (m_contextCountByThread.at(i) < m_contextCountByThread.at(threadIndex))
+            threadIndex = i;
+    }
+    ++m_contextCountByThread[threadIndex];
+    QObject* pContext = new QObject;
+    m_threadIndexByContext.insert(pContext, threadIndex);
+    pContext->moveToThread(m_threads.at(threadIndex));
+    return pContext;
+}
+
+void CallbackExecutor::releaseContext(QObject* pContext)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        auto iterContext = m_threadIndexByContext.find(pContext);
+        if (iterContext == m_threadIndexByContext.end())
+            return;
+        --m_contextCountByThread[iterContext.value()];
+        m_threadIndexByContext.erase(iterContext);
+    }
+    pContext->deleteLater(); // goes after whatever is already queued to it
+}
+
+void CallbackExecutor::noteDispatched(qint64 enqueuedAtNs, int count)
+{
+    const qint64 latencyNs = nowNs() - enqueuedAtNs;
+    m_queueDepth.fetch_sub(count, std::memory_order_relaxed);
+    m_dispatchedCount.fetch_add(static_cast<quint64>(count), std::memory_order_relaxed);
+    m_totalDispatchLatencyNs.fetch_add(latencyNs * count, std::memory_order_relaxed);
+    qint64 maxLatencyNs = m_maxDispatchLatencyNs.load(std::memory_order_relaxed);
+    while ((latencyNs > maxLatencyNs) && !m_maxDispatchLatencyNs.compare_exchange_weak(maxLatencyNs, latencyNs, std::memory_order_relaxed)) {}
+}
+
+CallbackExecutorStats CallbackExecutor::stats() const
+{
+    CallbackExecutorStats ret;
+    ret.threadCount = m_threads.size();
+    {
+        QMutexLocker locker(&m_mutex);
+        ret.contextCount = m_threadIndexByContext.size();
+    }
+    ret.queueDepth = m_queueDepth.load(std::memory_order_relaxed);
+    ret.dispatchedCount = m_dispatchedCount.load(std::memory_order_relaxed);
+    if (ret.dispatchedCount > 0)
+        ret.averageDispatchLatencyNs = static_cast<double>(m_totalDispatchLatencyNs.load(std::memory_order_relaxed)) / ret.dispatchedCount;
+    ret.maxDispatchLatencyNs = m_maxDispatchLatencyNs.load(std::memory_order_relaxed);
+    return ret;
+}
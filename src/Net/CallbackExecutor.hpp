@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+
+namespace Net
+{
+struct CallbackExecutorStats
+{
+    int threadCount = 0;
+    int contextCount = 0; // connections using the executor
+    qint64 queueDepth = 0; // items handed to callbacks' threads but not dispatched yet
+    quint64 dispatchedCount = 0;
+    double averageDispatchLatencyNs = 0; // from hand-over in connection's thread to callback call
+    qint64 maxDispatchLatencyNs = 0;
+};
+
+// Pool of callback threads shared by many connections, instead of a QThread per connection (see NetConnection::setCallbackExecutor).
+// Each connection gets its own context pinned to one of the threads, least loaded at the time, so its callbacks stay in order.
+// Executor must outlive connections using it
+class CallbackExecutor
+{
+public:
+    explicit CallbackExecutor(int threadCount = 0); // 0 - QThread::idealThreadCount()
+    ~CallbackExecutor();
+    CallbackExecutor(const CallbackExecutor&) = delete;
+    CallbackExecutor& operator=(const CallbackExecutor&) = delete;
+
+    QObject* acquireContext(); // thread-safe
+    void releaseContext(QObject* pContext); // thread-safe; callbacks already handed to context's thread still run
+
+    static qint64 nowNs() { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+    void noteEnqueued(int count = 1) { m_queueDepth.fetch_add(count, std::memory_order_relaxed); }
+    void noteDispatched(qint64 enqueuedAtNs, int count = 1);
+
+    int threadCount() const { return m_threads.size(); }
+    CallbackExecutorStats stats() const; // thread-safe
+
+private:
+    QVector<QThread*> m_threads;
+    QVector<int> m_contextCountByThread;
+    QHash<QObject*, int> m_threadIndexByContext;
+    mutable QMutex m_mutex; // guards the two above
+
+    std::atomic<qint64> m_queueDepth{0};
+    std::atomic<quint64> m_dispatchedCount{0};
+    std::atomic<qint64> m_totalDispatchLatencyNs{0};
+    std::atomic<qint64> m_maxDispatchLatencyNs{0};
+};
+} // namespace Net
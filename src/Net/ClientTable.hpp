@@ -0,0 +1,116 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <QtCore/QtGlobal>
+
+namespace Net
+{
+// Compact reference to a client of ClientTable. Generation tells a reused slot from the one handle was made for,
+// so a stale handle (client already gone) is simply not found instead of reaching whoever took its slot
+struct ClientHandle
+{
+    quint32 index = 0xFFFFFFFF;
+    quint32 generation = 0;
+    bool isValid() const { return index != 0xFFFFFFFF; }
+};
+inline bool operator==(const ClientHandle& lhv, const ClientHandle& rhv) { return (lhv.index == rhv.index) && (lhv.generation == rhv.generation); }
+inline bool operator!=(const ClientHandle& lhv, const ClientHandle& rhv) { return !(lhv == rhv); }
+inline uint qHash(const ClientHandle& key, uint seed = 0) { return key.index ^ seed; }
+
+// Slab-allocated table of per-client data: slots live in fixed-size chunks, so data never moves once inserted
+// and pointers stay valid while client is in the table, even as the table grows. Freed slots are reused before new chunks are allocated.
+// Lookup by handle is an index and a generation check, no hashing. Not thread-safe
+template <typename T>
+class ClientTable
+{
+public:
+    static constexpr int s_chunkSize = 64; // slots
+
+    ClientTable() = default;
+    ClientTable(const ClientTable&) = delete;
+    ClientTable& operator=(const ClientTable&) = delete;
+
+    // New default-constructed T; pointer to it is find(handle)
+    ClientHandle insert()
+    {
+        quint32 index = m_freeHead;
+        if (index != s_noSlot)
+        {
+            m_freeHead = slot(index).nextFree;
+        }
+        else
+        {
+            if (m_chunks.empty() || (m_chunkFill == s_chunkSize))
+            {
+                m_chunks.emplace_back(new Slot[s_chunkSize]);
+                m_chunkFill = 0;
+            }
+            index = static_cast<quint32>(m_chunks.size() - 1) * s_chunkSize + static_cast<quint32>(m_chunkFill++);
+        }
+        Slot& s = slot(index);
+        s.value.emplace();
+        ++m_size;
+        return ClientHandle{index, s.generation};
+    }
+
+    T* find(ClientHandle const& handle)
+    {
+        if (handle.index >= capacity())
+            return nullptr;
+        Slot& s = slot(handle.index);
+        return (s.value && (s.generation == handle.generation)) ? &*s.value : nullptr;
+    }
+    const T* find(ClientHandle const& handle) const { return const_cast<ClientTable*>(this)->find(handle); }
+
+    // Destroys T right away; no-op for stale handle
+    void remove(ClientHandle const& handle)
+    {
+        if (find(handle) == nullptr)
+            return;
+        Slot& s = slot(handle.index);
+        s.value.reset();
+        ++s.generation; // outstanding handles of this slot go stale
+        s.nextFree = m_freeHead;
+        m_freeHead = handle.index;
+        --m_size;
+    }
+
+    // f(ClientHandle, T&) for every client; f must not insert or remove
+    template <typename F>
+    void forEach(F f)
+    {
+        const quint32 slotCount = capacity();
+        for (quint32 index = 0; index < slotCount; ++index)
+        {
+            Slot& s = slot(index);
+            if (s.value)
+                f(ClientHandle{index, s.generation}, *s.value);
+        }
+    }
+
+    int size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+    quint32 capacity() const { return m_chunks.empty() ? 0 : static_cast<quint32>(m_chunks.size() - 1) * s_chunkSize + m_chunkFill; } // slots handed out so far
+    qint64 allocatedBytes() const { return static_cast<qint64>(m_chunks.size()) * s_chunkSize * static_cast<qint64>(sizeof(Slot)); }
+
+private:
+    static constexpr quint32 s_noSlot = 0xFFFFFFFF;
+
+    struct Slot
+    {
+        std::optional<T> value;
+        quint32 generation = 1;
+        quint32 nextFree = s_noSlot;
+    };
+
+    Slot& slot(quint32 index) { return m_chunks[index / s_chunkSize][index % s_chunkSize]; }
+
+    std::vector<std::unique_ptr<Slot[]>> m_chunks;
+    int m_chunkFill = 0; // slots handed out of the last chunk
+    quint32 m_freeHead = s_noSlot;
+    int m_size = 0;
+};
+} // namespace Net
@@ -0,0 +1,427 @@
+#include "Compression.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+
+#include <QtCore/QtEndian>
+
+using namespace Net;
+
+namespace
+{
+constexpr int s_lzMinMatch = 4;
+constexpr int s_lzHashLog = 12;
+constexpr int s_lzLastLiterals = 5; // LZ4 block rules: last 5 bytes are always literals...
+constexpr int s_lzMatchFindLimit = 12; // ...and no match starts within last 12 bytes
+constexpr int s_lzMaxOffset = 65535;
+
+void writeRawSize(char* pDst, quint32 rawSize)
+{
+    if (Net::g_endianness == QDataStream::BigEndian)
+        qToBigEndian(rawSize, pDst);
+    else
+        qToLittleEndian(rawSize, pDst);
+}
+
+quint32 readRawSize(const char* pSrc)
+{
+    return (Net::g_endianness == QDataStream::BigEndian) ? qFromBigEndian<quint32>(pSrc) : qFromLittleEndian<quint32>(pSrc);
+}
+
+uchar* writeLzLength(uchar* op, int length)
+{
+    while (length >= 255)
+    {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = static_cast<uchar>(length);
+    return op;
+}
+
+bool readLzLength(const uchar*& ip, const uchar* iend, size_t& length)
+{
+    uchar byte;
+    do
+    {
+        if (ip >= iend)
+            return false;
+        byte = *ip++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+} // namespace
+
+QString Net::toQString(Codec codec)
+{
+    switch (codec)
+    {
+    case Codec::None: { return QStringLiteral("none"); }
+    case Codec::Zlib: { return QStringLiteral("zlib"); }
+    case Codec::Lz: { return QStringLiteral("lz"); }
+    default: { return {}; }
+    }
+}
+
+quint8 Net::codecMaskFromQStringList(QStringList const& names)
+{
+    quint8 codecMask = 0;
+    for (QString const& name : names)
+    {
+        for (Codec codec : {Codec::Zlib, Codec::Lz})
+        {
+            if (name.trimmed().compare(toQString(codec), Qt::CaseInsensitive) == 0)
+                codecMask |= codecBit(codec);
+        }
+    }
+    return codecMask;
+}
+
+int Net::lzCompressBound(int size)
+{
+    return size + (size / 255) + 16;
+}
+
+// Greedy single-pass matcher over a hash of 4-byte sequences, same as LZ4's fast mode without acceleration
+int Net::lzCompress(const char* src, int srcSize, char* dst)
+{
+    const uchar* const base = reinterpret_cast<const uchar*>(src);
+    const uchar* const iend = base + srcSize;
+    const uchar* ip = base;
+    const uchar* anchor = base;
+    uchar* op = reinterpret_cast<uchar*>(dst);
+
+    if (srcSize > s_lzMatchFindLimit)
+    {
+        const uchar* const mflimit = iend - s_lzMatchFindLimit;
+        const uchar* const matchlimit = iend - s_lzLastLiterals;
+        std::array<qint32, 1 << s_lzHashLog> table{}; // positions relative to base, 0 for empty slots is verified like any other candidate
+        while (ip < mflimit)
+        {
+            quint32 sequence;
+            std::memcpy(&sequence, ip, sizeof(sequence));
+            const quint32 hash = (sequence * 2654435761u) >> (32 - s_lzHashLog);
+            const uchar* pRef = base + table[hash];
+            table[hash] = static_cast<qint32>(ip - base);
+            if ((pRef >= ip) || (ip - pRef > s_lzMaxOffset) || (std::memcmp(pRef, ip, s_lzMinMatch) != 0))
+            {
+                ++ip;
+                continue;
+            }
+
+            const uchar* pMatchEnd = ip + s_lzMinMatch;
+            pRef += s_lzMinMatch;
+            while ((pMatchEnd < matchlimit) && (*pMatchEnd == *pRef))
+            {
+                ++pMatchEnd;
+                ++pRef;
+            }
+            const int literalLength = static_cast<int>(ip - anchor);
+            const int matchLength = static_cast<int>(pMatchEnd - ip) - s_lzMinMatch;
+            const int offset = static_cast<int>(pMatchEnd - pRef);
+
+            uchar* pToken = op++;
+            *pToken = static_cast<uchar>((qMin(literalLength, 15) << 4) | qMin(matchLength, 15));
+            if (literalLength >= 15)
+                op = writeLzLength(op, literalLength - 15);
+            std::memcpy(op, anchor, static_cast<size_t>(literalLength));
+            op += literalLength;
+            *op++ = static_cast<uchar>(offset & 0xFF);
+            *op++ = static_cast<uchar>(offset >> 8);
+            if (matchLength >= 15)
+                op = writeLzLength(op, matchLength - 15);
+            ip = anchor = pMatchEnd;
+        }
+    }
+
+    const int literalLength = static_cast<int>(iend - anchor);
+    *op++ = static_cast<uchar>(qMin(literalLength, 15) << 4);
+    if (literalLength >= 15)
+        op = writeLzLength(op, literalLength - 15);
+    std::memcpy(op, anchor, static_cast<size_t>(literalLength));
+    op += literalLength;
+    return static_cast<int>(op - reinterpret_cast<uchar*>(dst));
+}
+
+bool Net::lzDecompress(const char* src, int srcSize, char* dst, int dstSize)
+{
+    const uchar* ip = reinterpret_cast<const uchar*>(src);
+    const uchar* const iend = ip + srcSize;
+    uchar* const ostart = reinterpret_cast<uchar*>(dst);
+    uchar* op = ostart;
+    uchar* const oend = ostart + dstSize;
+    while (ip < iend)
+    {
+        const uchar token = *ip++;
+        size_t literalLength = token >> 4;
+        if ((literalLength == 15) && !readLzLength(ip, iend, literalLength))
+            return false;
+        if ((literalLength > static_cast<size_t>(iend - ip)) || (literalLength > static_cast<size_t>(oend - op)))
+            return false;
+        std::memcpy(op, ip, literalLength);
+        op += literalLength;
+        ip += literalLength;
+        if (ip == iend) // last sequence has literals only
+            break;
+
+        if (iend - ip < 2)
+            return false;
+        const size_t offset = static_cast<size_t>(ip[0]) | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        if ((offset == 0) || (offset > static_cast<size_t>(op - ostart)))
+            return false;
+        size_t matchLength = token & 15;
+        if ((matchLength == 15) && !readLzLength(ip, iend, matchLength))
+            return false;
+        matchLength += s_lzMinMatch;
+        if (matchLength > static_cast<size_t>(oend - op))
+            return false;
+        const uchar* pMatch = op - offset;
+        if (offset >= matchLength)
+        {
+            std::memcpy(op, pMatch, matchLength);
+            op += matchLength;
+        }
+        else // overlapping match repeats the last offset bytes
+        {
+            for (size_t i = 0; i < matchLength; ++i)
+                *op++ = *pMatch++;
+        }
+    }
+    return (op == oend);
+}
+
+QByteArray Net::compressPayload(const QByteArray& raw, Codec codec, int zlibLevel)
+{
+    QByteArray encoded;
+    switch (codec)
+    {
+    case Codec::Zlib:
+    {
+        // qCompress() prepends its own big-endian size, which decompressPayload() checks against rawSize
+        const QByteArray compressed = qCompress(raw, zlibLevel);
+        encoded = QByteArray(g_encodedHeaderSize + compressed.size(), Qt::Uninitialized);
+        std::memcpy(encoded.data() + g_encodedHeaderSize, compressed.constData(), static_cast<size_t>(compressed.size()));
+        break;
+    }
+    case Codec::Lz:
+    {
+        encoded = QByteArray(g_encodedHeaderSize + lzCompressBound(raw.size()), Qt::Uninitialized);
+        const int compressedSize = lzCompress(raw.constData(), raw.size(), encoded.data() + g_encodedHeaderSize);
+        encoded.resize(g_encodedHeaderSize + compressedSize);
+        break;
+    }
+    case Codec::None: [[fallthrough]];
+    default: { return {}; }
+    }
+    if (encoded.size() >= raw.size())
+        return {};
+    encoded[0] = static_cast<char>(codec);
+    writeRawSize(encoded.data() + 1, static_cast<quint32>(raw.size()));
+    return encoded;
+}
+
+qint64 Net::decodedSizeOf(const QByteArray& encoded)
+{
+    if (encoded.size() < g_encodedHeaderSize)
+        return -1;
+    return readRawSize(encoded.constData() + 1);
+}
+
+bool Net::decompressPayload(const QByteArray& encoded, QByteArray& raw, qint64 maxDecodedSize)
+{
+    if (encoded.size() < g_encodedHeaderSize)
+        return false;
+    const Codec codec = static_cast<Codec>(encoded.at(0));
+    const quint32 rawSize = readRawSize(encoded.constData() + 1);
+    if ((rawSize > static_cast<quint64>(maxDecodedSize)) || (rawSize > static_cast<quint32>(std::numeric_limits<int>::max())))
+        return false;
+    const char* pData = encoded.constData() + g_encodedHeaderSize;
+    const int dataSize = encoded.size() - g_encodedHeaderSize;
+    switch (codec)
+    {
+    case Codec::Zlib:
+    {
+        if ((dataSize < static_cast<int>(sizeof(quint32))) || (qFromBigEndian<quint32>(pData) != rawSize))
+            return false; // qUncompress() would trust that size for allocation
+        raw = qUncompress(reinterpret_cast<const uchar*>(pData), dataSize);
+        return (static_cast<quint32>(raw.size()) == rawSize) && ((rawSize == 0) || !raw.isNull());
+    }
+    case Codec::Lz:
+    {
+        raw = QByteArray(static_cast<int>(rawSize), Qt::Uninitialized);
+        return lzDecompress(pData, dataSize, raw.data(), raw.size());
+    }
+    case Codec::None: [[fallthrough]];
+    default: { return false; }
+    }
+}
+
+QByteArray Net::makeCodecOffer(quint8 codecMask)
+{
+    QByteArray offer(g_encodedHeaderSize + 1, '\0');
+    offer[0] = static_cast<char>(Codec::None);
+    offer[g_encodedHeaderSize] = static_cast<char>(codecMask);
+    return offer;
+}
+
+bool Net::parseCodecOffer(const QByteArray& encoded, quint8& codecMask)
+{
+    if ((encoded.size() != g_encodedHeaderSize + 1) || (static_cast<Codec>(encoded.at(0)) != Codec::None))
+        return false;
+    codecMask = static_cast<quint8>(encoded.at(g_encodedHeaderSize));
+    return true;
+}
+
+Codec Net::chooseCodec(quint8 localMask, quint8 peerMask)
+{
+    const quint8 commonMask = localMask & peerMask;
+    for (Codec codec : {Codec::Lz, Codec::Zlib})
+    {
+        if (commonMask & codecBit(codec))
+            return codec;
+    }
+    return Codec::None;
+}
+
+Codec CompressionContext::peerCodec(AddressPort const& addrPort) const
+{
+    if (m_hasPeerCodecs.load(std::memory_order_acquire) == false)
+        return Codec::None;
+    QReadLocker locker(&m_lock);
+    return m_peerCodecs.value(addrPort, Codec::None);
+}
+
+void CompressionContext::setPeerCodec(AddressPort const& addrPort, Codec codec)
+{
+    QWriteLocker locker(&m_lock);
+    if (codec == Codec::None)
+    {
+        m_peerCodecs.remove(addrPort);
+        return;
+    }
+    m_peerCodecs.insert(addrPort, codec);
+    m_hasPeerCodecs.store(true, std::memory_order_release);
+}
+
+void CompressionContext::removePeer(AddressPort const& addrPort)
+{
+    QWriteLocker locker(&m_lock);
+    m_peerCodecs.remove(addrPort);
+}
+
+void CompressionContext::clearPeers()
+{
+    QWriteLocker locker(&m_lock);
+    m_peerCodecs.clear();
+    m_hasPeerCodecs.store(false, std::memory_order_release);
+}
+
+bool CompressionContext::encode(QByteArray& msg, AddressPort const& addrPort)
+{
+    if ((m_settings.codecMask == 0) || (msg.size() < m_settings.threshold))
+        return false;
+    return encode(msg, peerCodec(addrPort));
+}
+
+bool CompressionContext::encode(QByteArray& msg, Codec codec)
+{
+    if ((m_settings.codecMask == 0) || (msg.size() < m_settings.threshold) || (codec == Codec::None))
+        return false;
+    QByteArray encoded = compressPayload(msg, codec, m_settings.zlibLevel);
+    if (encoded.isNull())
+    {
+        m_skippedFrames.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    m_encodedFrames.fetch_add(1, std::memory_order_relaxed);
+    m_rawBytes.fetch_add(static_cast<quint64>(msg.size()), std::memory_order_relaxed);
+    m_encodedBytes.fetch_add(static_cast<quint64>(encoded.size()), std::memory_order_relaxed);
+    msg = std::move(encoded);
+    return true;
+}
+
+bool CompressionContext::decode(QByteArray& msg)
+{
+    qint64 maxDecodedSize = m_settings.maxDecodedSize;
+    qint64 reservedSize = 0;
+    if (m_pReceiveBudget != nullptr)
+    {
+        // Declared size is allocated before a byte of it is checked, so it's held to the same limits as a frame of that size
+        maxDecodedSize = std::min(maxDecodedSize, static_cast<qint64>(m_pReceiveBudget->limits.maxFrameSize));
+        const qint64 decodedSize = decodedSizeOf(msg);
+        if ((decodedSize > 0) && (decodedSize <= maxDecodedSize))
+        {
+            if (!m_pReceiveBudget->tryReserve(decodedSize))
+            {
+                m_decodeRejected.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            reservedSize = decodedSize;
+        }
+    }
+    QByteArray raw;
+    const bool isDecoded = decompressPayload(msg, raw, maxDecodedSize);
+    if (reservedSize > 0)
+        m_pReceiveBudget->release(reservedSize); // decoded message is the receiver's from now on, same as a frame read as is
+    if (!isDecoded)
+    {
+        m_decodeErrors.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    m_decodedFrames.fetch_add(1, std::memory_order_relaxed);
+    msg = std::move(raw);
+    return true;
+}
+
+void CompressionContext::decode(QVector<QByteArray>& msgs, QVector<int> const& encodedIndices)
+{
+    for (auto iter = encodedIndices.crbegin(); iter != encodedIndices.crend(); ++iter) // backwards, so that removal doesn't shift indices yet to come
+    {
+        if (!decode(msgs[*iter]))
+            msgs.removeAt(*iter);
+    }
+}
+
+CompressionStats CompressionContext::stats() const
+{
+    CompressionStats stats;
+    stats.encodedFrames = m_encodedFrames.load(std::memory_order_relaxed);
+    stats.skippedFrames = m_skippedFrames.load(std::memory_order_relaxed);
+    stats.rawBytes = m_rawBytes.load(std::memory_order_relaxed);
+    stats.encodedBytes = m_encodedBytes.load(std::memory_order_relaxed);
+    stats.decodedFrames = m_decodedFrames.load(std::memory_order_relaxed);
+    stats.decodeErrors = m_decodeErrors.load(std::memory_order_relaxed);
+    stats.decodeRejected = m_decodeRejected.load(std::memory_order_relaxed);
+    return stats;
+}
+
+QByteArray const& FanoutPayload::payloadFor(AddressPort const& addrPort, bool& isEncoded)
+{
+    isEncoded = false;
+    CompressionSettings const& settings = m_context.settings();
+    if ((settings.codecMask == 0) || (m_raw.size() < settings.threshold))
+        return m_raw;
+    const Codec codec = m_context.peerCodec(addrPort);
+    const int index = static_cast<int>(codec);
+    if ((codec == Codec::None) || (index >= s_codecCount))
+        return m_raw;
+    const quint8 bit = codecBit(codec);
+    if ((m_triedMask & bit) == 0)
+    {
+        m_triedMask |= bit;
+        QByteArray encoded = m_raw;
+        if (m_context.encode(encoded, codec))
+        {
+            m_encoded[index] = std::move(encoded);
+            m_encodedMask |= bit;
+        }
+    }
+    if ((m_encodedMask & bit) == 0) // didn't get smaller, goes as is
+        return m_raw;
+    isEncoded = true;
+    return m_encoded[index];
+}
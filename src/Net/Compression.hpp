@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QReadWriteLock>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+#include "NetUtils.hpp"
+#include "ReceiveBudget.hpp"
+
+namespace Net
+{
+// Payload of a frame flagged with g_encodedFrameFlag starts with codec and size of the original message, both in Net::g_endianness:
+//  [quint8 codec][quint32 rawSize][compressed data]
+// Codec::None marks a codec offer instead, [quint8 codec=None][quint32 0][quint8 codecMask], which is never delivered to callbacks
+enum class Codec : quint8
+{
+    None = 0,
+    Zlib = 1, // qCompress()
+    Lz = 2, // LZ4 block format, several times faster than zlib at level 1 for a worse ratio
+};
+constexpr quint8 codecBit(Codec codec) { return static_cast<quint8>(1 << static_cast<int>(codec)); }
+QString toQString(Codec codec);
+quint8 codecMaskFromQStringList(QStringList const& names); // unknown names are skipped
+
+struct CompressionSettings
+{
+    quint8 codecMask = 0; // codecBit() of codecs offered to peers, 0 - compression is off and nothing is offered
+    int threshold = 4 * 1024; // smaller messages are sent as is
+    int zlibLevel = 1;
+    qint64 maxDecodedSize = 64 * 1024 * 1024; // encoded frame announcing more than that is dropped as corrupted, same as ReceiveLimits::maxFrameSize
+};
+
+struct CompressionStats
+{
+    quint64 encodedFrames = 0;
+    quint64 skippedFrames = 0; // above threshold, but compressed data came out no smaller
+    quint64 rawBytes = 0; // before compression, encoded frames only
+    quint64 encodedBytes = 0;
+    quint64 decodedFrames = 0;
+    quint64 decodeErrors = 0;
+    quint64 decodeRejected = 0; // dropped because server's ReceiveBudget couldn't hold the decoded size; connection is kept
+};
+
+constexpr int g_encodedHeaderSize = sizeof(quint8) + sizeof(quint32);
+
+// Returns [codec][rawSize][data], or null QByteArray if codec is None or the result isn't smaller than raw
+QByteArray compressPayload(const QByteArray& raw, Codec codec, int zlibLevel = 1);
+// Returns false if encoded is corrupted or announces more than maxDecodedSize bytes
+bool decompressPayload(const QByteArray& encoded, QByteArray& raw, qint64 maxDecodedSize);
+qint64 decodedSizeOf(const QByteArray& encoded); // size encoded announces, -1 if it's too short to announce any
+QByteArray makeCodecOffer(quint8 codecMask);
+bool parseCodecOffer(const QByteArray& encoded, quint8& codecMask); // false if encoded isn't an offer
+Codec chooseCodec(quint8 localMask, quint8 peerMask); // faster codec offered by both sides wins
+
+// Plain LZ4 block, no frame header. lzCompress() output is at most lzCompressBound(size) bytes; lzDecompress() never writes past dstSize and fails unless it's filled exactly
+int lzCompressBound(int size);
+int lzCompress(const char* src, int srcSize, char* dst);
+bool lzDecompress(const char* src, int srcSize, char* dst, int dstSize);
+
+// Negotiated codec of every peer of a connection, shared by a server with its shards, hence the lock and atomics.
+// Encoding is done by whoever queues the message, decoding by whoever runs the receive callback, so both stay off network thread when those are distinct threads
+class CompressionContext
+{
+public:
+    CompressionContext() = default;
+    CompressionContext(const CompressionContext&) = delete;
+    CompressionContext& operator=(const CompressionContext&) = delete;
+
+    // Client connections keep their only peer under AddressPort{}, which no server peer can have
+    static AddressPort solePeer() { return AddressPort{}; }
+
+    void setSettings(CompressionSettings const& settings) { m_settings = settings; } // not thread-safe, only while connection is closed
+    CompressionSettings const& settings() const { return m_settings; }
+    // Receivers of a server: decoded size is capped by budget's maxFrameSize too, and reserved from it while decoding. Not thread-safe, only while connection is closed
+    void setReceiveBudget(std::shared_ptr<ReceiveBudget> pBudget) { m_pReceiveBudget = std::move(pBudget); }
+
+    Codec peerCodec(AddressPort const& addrPort) const;
+    void setPeerCodec(AddressPort const& addrPort, Codec codec);
+    void removePeer(AddressPort const& addrPort);
+    void clearPeers();
+
+    bool encode(QByteArray& msg, AddressPort const& addrPort); // replaces msg and returns true if it was compressed for the peer
+    bool encode(QByteArray& msg, Codec codec); // same with given codec
+    bool decode(QByteArray& msg); // replaces encoded msg with the original one, false if it's corrupted
+    void decode(QVector<QByteArray>& msgs, QVector<int> const& encodedIndices); // corrupted ones are removed from msgs
+
+    CompressionStats stats() const;
+
+private:
+    CompressionSettings m_settings;
+    std::shared_ptr<ReceiveBudget> m_pReceiveBudget;
+    QHash<AddressPort, Codec> m_peerCodecs;
+    std::atomic<bool> m_hasPeerCodecs{false}; // lets encode() skip the lock while nobody has negotiated anything
+    mutable QReadWriteLock m_lock; // guards m_peerCodecs
+
+    std::atomic<quint64> m_encodedFrames{0};
+    std::atomic<quint64> m_skippedFrames{0};
+    std::atomic<quint64> m_rawBytes{0};
+    std::atomic<quint64> m_encodedBytes{0};
+    std::atomic<quint64> m_decodedFrames{0};
+    std::atomic<quint64> m_decodeErrors{0};
+    std::atomic<quint64> m_decodeRejected{0};
+};
+
+// One message for many peers of a server: compressed at most once per codec negotiated among them, instead of once per peer.
+// Payloads handed out are shared (implicitly) by all send queues they are enqueued to
+class FanoutPayload
+{
+public:
+    FanoutPayload(CompressionContext& context, QByteArray msg) : m_context(context), m_raw(std::move(msg)) {}
+    FanoutPayload(const FanoutPayload&) = delete;
+    FanoutPayload& operator=(const FanoutPayload&) = delete;
+
+    QByteArray const& payloadFor(AddressPort const& addrPort, bool& isEncoded);
+    QByteArray const& raw() const { return m_raw; }
+
+private:
+    static constexpr int s_codecCount = 3; // including Codec::None
+
+    CompressionContext& m_context;
+    QByteArray m_raw;
+    QByteArray m_encoded[s_codecCount];
+    quint8 m_triedMask = 0; // codecBit() of codecs which were tried on m_raw
+    quint8 m_encodedMask = 0; // of those, codecs which made it smaller
+};
+} // namespace Net
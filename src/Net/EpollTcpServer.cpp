@@ -0,0 +1,700 @@
+#include "EpollTcpServer.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <QtCore/QMetaMethod>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace Net;
+using namespace std;
+
+namespace
+{
+socklen_t toSockAddr(const QHostAddress& address, quint16 port, sockaddr_storage* pAddr)
+{
+    memset(pAddr, 0, sizeof(sockaddr_storage));
+    if (address.protocol() == QAbstractSocket::IPv4Protocol)
+    {
+        sockaddr_in* pAddr4 = reinterpret_cast<sockaddr_in*>(pAddr);
+        pAddr4->sin_family = AF_INET;
+        pAddr4->sin_port = htons(port);
+        pAddr4->sin_addr.s_addr = htonl(address.toIPv4Address());
+        return sizeof(sockaddr_in);
+    }
+    // IPv6 and Any, the latter is bound dual-stack
+    sockaddr_in6* pAddr6 = reinterpret_cast<sockaddr_in6*>(pAddr);
+    pAddr6->sin6_family = AF_INET6;
+    pAddr6->sin6_port = htons(port);
+    const Q_IPV6ADDR address6 = address.toIPv6Address();
+    memcpy(&pAddr6->sin6_addr, &address6, sizeof(address6));
+    return sizeof(sockaddr_in6);
+}
+
+// IPv4 peers of dual-stack socket come as ::ffff:a.b.c.d, which has to match plain a.b.c.d in allowlist and routing, same as with QTcpSocket
+Net::AddressPort fromSockAddr(const sockaddr_storage& addr)
+{
+    QHostAddress address(reinterpret_cast<const sockaddr*>(&addr));
+    bool isIPv4 = false;
+    const quint32 address4 = address.toIPv4Address(&isIPv4);
+    if (isIPv4)
+        address.setAddress(address4);
+    const quint16 port = (addr.ss_family == AF_INET) ? ntohs(reinterpret_cast<const sockaddr_in*>(&addr)->sin_port)
+                                                     : ntohs(reinterpret_cast<const sockaddr_in6*>(&addr)->sin6_port);
+    return Net::AddressPort{address, port};
+}
+
+Net::AddressPort localAddressPort(int fd)
+{
+    sockaddr_storage addr{};
+    socklen_t addrLen = sizeof(addr);
+    if (::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &addrLen) != 0)
+        return {};
+    return fromSockAddr(addr);
+}
+} // namespace
+
+EpollTcpServer::EpollTcpServer(const quint8 _connType, const QString _connTypeName, QObject* parent)
+    : NetServer(_connType, _connTypeName, parent)
+{
+    m_sweepTimer = new QTimer(this);
+    connect(m_sweepTimer, &QTimer::timeout, this, &EpollTcpServer::sweepDeadlines);
+}
+
+EpollTcpServer::~EpollTcpServer()
+{
+    EpollTcpServer::closeConnection();
+}
+
+Net::ConnectionState EpollTcpServer::openConnection(ConnectionSettings const& a_connectionSettings)
+{
+    if (m_connectionState == ConnectionState::Created)
+        return m_connectionState;
+    m_connectionSettings = a_connectionSettings;
+    if ((openListenSocket() == false) || (startWatching() == false))
+    {
+        stopWatching();
+        closeListenSocket();
+        m_connectionState = ConnectionState::NotCreated;
+        f_logError(QString("%1: Unable to open connection - %2").arg(nameId()).arg(m_lastErrorString));
+        emit openedConnection(false);
+        return m_connectionState;
+    }
+    m_connectionState = ConnectionState::Created;
+    f_logGeneral(QString("%1: Opened connection").arg(nameId()));
+    printConnectionInfo();
+    emit openedConnection(true);
+    return m_connectionState;
+}
+
+void EpollTcpServer::closeConnection()
+{
+    if (m_connectionState == ConnectionState::Created)
+        f_logGeneral(QString("%1: Closed connection").arg(nameId()));
+    m_connectionState = ConnectionState::NotCreated;
+    m_sweepTimer->stop();
+    while (!m_clientByFd.isEmpty())
+    {
+        auto keepAlive = m_clientByFd.begin().value();
+        closeClient(keepAlive.get());
+    }
+    stopWatching();
+    closeListenSocket();
+    emit closedConnection();
+}
+
+bool EpollTcpServer::openListenSocket()
+{
+    // Null means "any interface" for QTcpServer::listen() as well
+    const QHostAddress address = m_connectionSettings.ipLocal.isNull() ? QHostAddress(QHostAddress::Any) : m_connectionSettings.ipLocal;
+    sockaddr_storage addr;
+    const socklen_t addrLen = toSockAddr(address, m_connectionSettings.portIn, &addr);
+
+    m_listenFd = ::socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_listenFd < 0)
+    {
+        setLastErrorFromErrno(QStringLiteral("socket"));
+        return false;
+    }
+    const int isEnabled = 1;
+    ::setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &isEnabled, sizeof(isEnabled));
+    if (address == QHostAddress::Any)
+    {
+        const int isV6Only = 0;
+        ::setsockopt(m_listenFd, IPPROTO_IPV6, IPV6_V6ONLY, &isV6Only, sizeof(isV6Only));
+    }
+    applySocketOptions(m_listenFd); // before listen(), so that receive buffer size counts for window scale of accepted sockets
+    if (::bind(m_listenFd, reinterpret_cast<const sockaddr*>(&addr), addrLen) != 0)
+    {
+        setLastErrorFromErrno(QStringLiteral("bind"));
+        return false;
+    }
+    if (::listen(m_listenFd, SOMAXCONN) != 0)
+    {
+        setLastErrorFromErrno(QStringLiteral("listen"));
+        return false;
+    }
+    m_listenAddrPort = localAddressPort(m_listenFd);
+    return true;
+}
+
+void EpollTcpServer::closeListenSocket()
+{
+    if (m_listenFd >= 0)
+        ::close(m_listenFd);
+    m_listenFd = -1;
+    m_listenAddrPort = Net::AddressPort{};
+}
+
+bool EpollTcpServer::startWatching()
+{
+    m_epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (m_epollFd < 0)
+    {
+        setLastErrorFromErrno(QStringLiteral("epoll_create1"));
+        return false;
+    }
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLET;
+    event.data.fd = m_listenFd;
+    if (::epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_listenFd, &event) != 0)
+    {
+        setLastErrorFromErrno(QStringLiteral("epoll_ctl"));
+        return false;
+    }
+    m_pEpollNotifier = new QSocketNotifier(m_epollFd, QSocketNotifier::Read, this);
+    connect(m_pEpollNotifier, qOverload<QSocketDescriptor, QSocketNotifier::Type>(&QSocketNotifier::activated), this, &EpollTcpServer::readReceived);
+    return true;
+}
+
+void EpollTcpServer::stopWatching()
+{
+    delete m_pEpollNotifier;
+    m_pEpollNotifier = nullptr;
+    if (m_epollFd >= 0)
+        ::close(m_epollFd);
+    m_epollFd = -1;
+}
+
+bool EpollTcpServer::watchClient(ClientData* d)
+{
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.fd = d->fd;
+    ++m_ioStats.syscalls;
+    if (::epoll_ctl(m_epollFd, EPOLL_CTL_ADD, d->fd, &event) != 0)
+    {
+        setLastErrorFromErrno(QStringLiteral("epoll_ctl"));
+        return false;
+    }
+    return true;
+}
+
+void EpollTcpServer::setLastErrorFromErrno(const QString& operation)
+{
+    m_lastErrorString = QString("%1() failed: %2").arg(operation).arg(QString::fromLocal8Bit(strerror(errno)));
+}
+
+// Edge-triggered set reports each descriptor once per change of its state, so every reported descriptor has to be read/written until EAGAIN
+void EpollTcpServer::readReceived()
+{
+    epoll_event events[s_maxEventsPerWait];
+    while (m_epollFd >= 0)
+    {
+        const int eventCount = ::epoll_wait(m_epollFd, events, s_maxEventsPerWait, 0);
+        ++m_ioStats.syscalls;
+        if (eventCount < 0 && errno == EINTR)
+            continue;
+        if (eventCount <= 0)
+            break;
+        for (int i = 0; i < eventCount; ++i)
+        {
+            const int fd = events[i].data.fd;
+            if (fd == m_listenFd)
+            {
+                acceptClients();
+                continue;
+            }
+            auto iterClient = m_clientByFd.find(fd);
+            if (iterClient == m_clientByFd.end()) // closed while handling earlier event of this batch
+                continue;
+            ClientData* d = iterClient.value().get();
+            if (events[i].events & EPOLLOUT)
+                drainSendQueue(d);
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) // readClient() finds out about closed or failed connection itself
+                readClient(d);
+        }
+        if (eventCount < s_maxEventsPerWait)
+            break;
+    }
+}
+
+void EpollTcpServer::acceptClients()
+{
+    while (m_listenFd >= 0)
+    {
+        sockaddr_storage peerAddr{};
+        socklen_t peerAddrLen = sizeof(peerAddr);
+        const int fd = ::accept4(m_listenFd, reinterpret_cast<sockaddr*>(&peerAddr), &peerAddrLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        ++m_ioStats.syscalls;
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) // e.g. EMFILE, the rest of backlog is accepted with the next connection
+            {
+                setLastErrorFromErrno(QStringLiteral("accept4"));
+                printError();
+            }
+            return;
+        }
+        addClient(fd, peerAddr);
+    }
+}
+
+// Takes ownership of accepted descriptor: either serves it or closes it
+EpollTcpServer::ClientData* EpollTcpServer::addClient(int fd, const sockaddr_storage& peerAddr)
+{
+    const Net::AddressPort peerAddrPort = fromSockAddr(peerAddr);
+    if (m_isAllowAllAdresses == false)
+    {
+        if (m_allowedAddresses.contains(peerAddrPort.addr) == false)
+        {
+            f_logGeneral(QString("%1: rejected client %3:%4 - client not in allowed list")
+                         .arg(nameId())
+                         .arg(peerAddrPort.addr.toString())
+                         .arg(peerAddrPort.port));
+            ::close(fd);
+            ++m_ioStats.syscalls;
+            return nullptr;
+        }
+    }
+    applySocketOptions(fd);
+
+    std::shared_ptr<ClientData> ptr = makeClientData();
+    ClientData* d = ptr.get();
+    d->fd = fd;
+    d->peerAddrPort = peerAddrPort;
+    d->localAddrPort = localAddressPort(fd);
+    ++m_ioStats.syscalls;
+    d->isAuthorized = !m_isAuthorizationEnabled;
+    d->frameReader.setBudget(m_pReceiveBudget.get());
+    m_clientByFd.insert(fd, ptr);
+    if (watchClient(d) == false)
+    {
+        printError();
+        m_clientByFd.remove(fd);
+        ::close(fd);
+        ++m_ioStats.syscalls;
+        return nullptr;
+    }
+    if (d->isAuthorized)
+    {
+        m_clientByPeerAddressPort.insert(peerAddrPort, d);
+        armIdleDeadline(d);
+    }
+    else
+    {
+        d->deadline = Net::TimerWheel::forCurrentThread()->schedule(m_authTimeoutTime, [this, fd]() {
+            auto keepAlive = m_clientByFd.value(fd);
+            if (keepAlive)
+                closeClient(keepAlive.get(), QStringLiteral("authorization timed out"));
+        });
+    }
+    if ((m_receiveLimits.partialFrameTimeout > 0) && !m_sweepTimer->isActive())
+        m_sweepTimer->start(s_sweepInterval);
+    f_logGeneral(QString("%1: client %2:%3 (local %4:%5) sockd:%6 connected")
+                 .arg(nameId())
+                 .arg(d->peerAddrPort.addr.toString())
+                 .arg(d->peerAddrPort.port)
+                 .arg(d->localAddrPort.addr.toString())
+                 .arg(d->localAddrPort.port)
+                 .arg(fd));
+    emit clientConnected(peerAddrPort);
+    return d;
+}
+
+void EpollTcpServer::readClient(ClientData* d)
+{
+    const std::shared_ptr<ClientData> keepAlive = m_clientByFd.value(d->fd);
+    markReadStarted();
+    const quint64 readCallCount = d->frameReader.readCallCount();
+    pushIdleDeadline(d);
+    bool isPeerClosed = false;
+    QByteArray msg;
+    bool isOpen = true;
+    while (isOpen && d->frameReader.readFrame(d->fd, msg, isPeerClosed))
+        isOpen = processFrame(d, msg);
+    m_ioStats.syscalls += d->frameReader.readCallCount() - readCallCount;
+    flushReceivedBatch(d->peerAddrPort);
+    if ((isOpen == false) || (d->fd < 0)) // batch callback may close client as well
+        return;
+    if (d->frameReader.shedReason() != Net::ShedReason::None)
+        shedClient(d, d->frameReader.shedReason());
+    else if (isPeerClosed)
+        closeClient(d);
+}
+
+// Returns false if client was closed while processing, either for failed authorization or by callback. Caller must keep d alive
+bool EpollTcpServer::processFrame(ClientData* d, const QByteArray& msg)
+{
+    static const QMetaMethod s_readDoneSignal = QMetaMethod::fromSignal(&NetConnection::readDone);
+    if (isSignalConnected(s_readDoneSignal))
+        emit readDone(msg);
+    if (d->isAuthorized == false)
+        return authorizeClient(d, msg);
+    ++m_ioStats.receivedMessages;
+    deliverReceivedMessage(msg, d->peerAddrPort, d->frameReader.isFrameEncoded());
+    return (d->fd >= 0);
+}
+
+bool EpollTcpServer::authorizeClient(ClientData* d, QByteArray msg)
+{
+    MAKE_QDATASTREAM_NET(stream, &msg, QIODevice::ReadOnly);
+    Net::LoginData loginData;
+    stream >> loginData;
+    QString rejectReason;
+    if (stream.status() != QDataStream::Ok)
+        rejectReason = QStringLiteral("received corrupted data from unauthorized client");
+    else if (m_clientsByLoginUsername.contains(loginData.username))
+        rejectReason = QStringLiteral("received login data from unauthorized client for already authorized client");
+    else if (!m_loginData.contains(loginData))
+        rejectReason = QStringLiteral("received invalid login data from unauthorized client");
+    if (!rejectReason.isEmpty())
+    {
+        f_logGeneral(QString("%1: %2(%3:%4)")
+                     .arg(nameId())
+                     .arg(rejectReason)
+                     .arg(d->peerAddrPort.addr.toString())
+                     .arg(d->peerAddrPort.port));
+        closeClient(d);
+        return false;
+    }
+
+    Net::TimerWheel::forCurrentThread()->cancel(d->deadline);
+    d->isAuthorized = true;
+    armIdleDeadline(d);
+    d->loginData = loginData;
+    m_clientByPeerAddressPort.insert(d->peerAddrPort, d);
+    m_clientsByLoginUsername.insert(d->loginData.username, d);
+    emit clientAuthorized(d->loginData.username, d->peerAddrPort);
+    f_logGeneral(QString("%1: client %2:%3 (local %4:%5) sockd:%6 authorized as username=%7")
+                 .arg(nameId())
+                 .arg(d->peerAddrPort.addr.toString())
+                 .arg(d->peerAddrPort.port)
+                 .arg(d->localAddrPort.addr.toString())
+                 .arg(d->localAddrPort.port)
+                 .arg(d->fd)
+                 .arg(d->loginData.username));
+    return true;
+}
+
+// Closing descriptor also removes it from epoll set. ClientData is freed right away unless caller holds it
+void EpollTcpServer::closeClient(ClientData* d, const QString& reason)
+{
+    if (d->fd < 0)
+        return;
+    const int fd = d->fd;
+    unwatchClient(d);
+    ::close(fd);
+    ++m_ioStats.syscalls;
+    d->fd = -1;
+    d->frameReader.clear();
+    d->sendQueue.clear();
+    Net::TimerWheel::forCurrentThread()->cancel(d->deadline);
+
+    QString logText;
+    if (d->isAuthorized)
+    {
+        logText = (getConnectionState() == Net::ConnectionState::Created)
+                ? QString("%1: client %2:%3 (local %4:%5)%6 disconnected%7")
+                : QString("%1: disconnected client %2:%3 (local %4:%5)%6%7");
+        logText = logText
+                  .arg(nameId())
+                  .arg(d->peerAddrPort.addr.toString())
+                  .arg(d->peerAddrPort.port)
+                  .arg(d->localAddrPort.addr.toString())
+                  .arg(d->localAddrPort.port)
+                  .arg(m_isAuthorizationEnabled ? QStringLiteral(" (username=%1)").arg(d->loginData.username) : QString{})
+                  .arg(reason.isEmpty() ? QString{} : QStringLiteral(" - %1").arg(reason));
+        m_clientByPeerAddressPort.remove(d->peerAddrPort);
+        if (m_isAuthorizationEnabled)
+            m_clientsByLoginUsername.remove(d->loginData.username);
+    }
+    else
+    {
+        logText = QString("%1: unauthorized client(%2:%3) disconnected%4")
+                  .arg(nameId())
+                  .arg(d->peerAddrPort.addr.toString())
+                  .arg(d->peerAddrPort.port)
+                  .arg(reason.isEmpty() ? QString{} : QStringLiteral(" - %1").arg(reason));
+    }
+    f_logGeneral(logText);
+    const Net::AddressPort peerAddrPort = d->peerAddrPort;
+    m_clientByFd.remove(fd);
+    emit clientDisconnected(peerAddrPort);
+}
+
+void EpollTcpServer::shedClient(ClientData* d, Net::ShedReason reason)
+{
+    m_pReceiveBudget->countShed(reason);
+    closeClient(d, Net::toQString(reason));
+}
+
+void EpollTcpServer::armIdleDeadline(ClientData* d)
+{
+    if (m_idleTimeout <= 0)
+        return;
+    const int fd = d->fd;
+    d->deadline = Net::TimerWheel::forCurrentThread()->schedule(m_idleTimeout, [this, fd]() {
+        auto keepAlive = m_clientByFd.value(fd);
+        if (keepAlive)
+            closeClient(keepAlive.get(), QStringLiteral("idle for %1 msec").arg(m_idleTimeout));
+    });
+}
+
+void EpollTcpServer::sweepDeadlines()
+{
+    if (m_clientByFd.isEmpty())
+    {
+        m_sweepTimer->stop();
+        return;
+    }
+    QList<std::shared_ptr<ClientData>> toShed;
+    for (auto iter = m_clientByFd.cbegin(); iter != m_clientByFd.cend(); ++iter)
+    {
+        const ClientData& d = *(iter.value());
+        if ((m_receiveLimits.partialFrameTimeout > 0) && (d.frameReader.partialFrameAge() > m_receiveLimits.partialFrameTimeout))
+            toShed.append(iter.value());
+    }
+    for (auto const& d : qAsConst(toShed))
+        shedClient(d.get(), Net::ShedReason::PartialFrameTimeout);
+}
+
+qint64 EpollTcpServer::sendMessage(const QByteArray& msg)
+{
+    return broadcastMessage(msg);
+}
+
+qint64 EpollTcpServer::broadcastMessage(QByteArray msg)
+{
+    ++m_fanoutStats.messages;
+    Net::FanoutPayload payload(*m_pCompression, msg);
+    QList<std::shared_ptr<ClientData>> toDisconnect;
+    qint64 ret = 0;
+    for (auto iter = m_clientByPeerAddressPort.cbegin(); iter != m_clientByPeerAddressPort.cend(); ++iter)
+        ret += fanoutTo(payload, iter.value(), toDisconnect);
+    disconnectSlowRecipients(toDisconnect);
+    return ret;
+}
+
+qint64 EpollTcpServer::multicastMessage(QByteArray msg, QVector<Net::AddressPort> recipients)
+{
+    ++m_fanoutStats.messages;
+    Net::FanoutPayload payload(*m_pCompression, msg);
+    QList<std::shared_ptr<ClientData>> toDisconnect;
+    qint64 ret = 0;
+    for (Net::AddressPort const& addrPort : qAsConst(recipients))
+    {
+        auto iter = m_clientByPeerAddressPort.constFind(addrPort);
+        if (iter != m_clientByPeerAddressPort.constEnd())
+            ret += fanoutTo(payload, iter.value(), toDisconnect);
+    }
+    disconnectSlowRecipients(toDisconnect);
+    return ret;
+}
+
+qint64 EpollTcpServer::fanoutTo(Net::FanoutPayload& payload, ClientData* d, QList<std::shared_ptr<ClientData>>& toDisconnect)
+{
+    bool shouldDisconnect = false;
+    if (!admitFanoutRecipient(d->sendQueue, shouldDisconnect))
+    {
+        if (shouldDisconnect)
+            toDisconnect.append(m_clientByFd.value(d->fd));
+        return 0;
+    }
+    bool isEncoded = false;
+    const QByteArray& msg = payload.payloadFor(d->peerAddrPort, isEncoded);
+    return sendMessageTo(msg, d, isEncoded);
+}
+
+// After the fan-out loop, since closeClient() removes client from the tables being iterated
+void EpollTcpServer::disconnectSlowRecipients(QList<std::shared_ptr<ClientData>> const& toDisconnect)
+{
+    for (auto const& d : toDisconnect)
+        closeClient(d.get(), QStringLiteral("too slow for fan-out, %1 bytes pending").arg(d->sendQueue.stats().pendingBytes));
+}
+
+// No validity check for d since this method is protected and all its calls are guaranteed to be safe.
+// What kernel doesn't take right away stays queued until EPOLLOUT, so the return value is the size of queued frame
+qint64 EpollTcpServer::sendMessageTo(QByteArray msg, ClientData* d, bool isEncoded)
+{
+    static const QMetaMethod s_writeDoneSignal = QMetaMethod::fromSignal(&NetConnection::writeDone);
+    const qint64 frameSize = d->sendQueue.enqueueFrame(msg, isEncoded);
+    ++m_ioStats.sentMessages;
+    drainSendQueue(d);
+    if (isSignalConnected(s_writeDoneSignal))
+        emit writeDone(msg);
+    return frameSize;
+}
+
+// Write errors are not handled here - failed connection is reported as readable and closed by readClient()
+void EpollTcpServer::drainSendQueue(ClientData* d)
+{
+    if (d->sendQueue.isEmpty() && !d->sendQueue.isCongested())
+        return;
+    const quint64 writeCallCount = d->sendQueue.stats().writeCalls;
+    d->sendQueue.drain(static_cast<qintptr>(d->fd));
+    m_ioStats.syscalls += d->sendQueue.stats().writeCalls - writeCallCount;
+    if (d->sendQueue.updateCongestion(0, m_sendWatermarks))
+    {
+        const Net::SendQueueStats& stats = d->sendQueue.stats();
+        emit clientCongestionChanged(d->peerAddrPort, stats.isCongested, stats.pendingBytes);
+    }
+}
+
+qint64 EpollTcpServer::sendMessageTo(QByteArray msg, QHostAddress address, quint16 port)
+{
+    return sendMessageTo(msg, Net::AddressPort{address, port});
+}
+
+qint64 EpollTcpServer::sendMessageTo(QByteArray msg, Net::AddressPort addressPort)
+{
+    auto iter = m_clientByPeerAddressPort.find(addressPort);
+    if (iter == m_clientByPeerAddressPort.end())
+    {
+        f_logError(QString("%1: can't send message to unconnected host %2:%3.")
+                     .arg(nameId())
+                     .arg(addressPort.addr.toString())
+                     .arg(addressPort.port));
+        return -1;
+    }
+    return sendMessageTo(msg, iter.value());
+}
+
+qint64 EpollTcpServer::sendEncodedMessageTo(QByteArray payload, Net::AddressPort addressPort)
+{
+    auto iter = m_clientByPeerAddressPort.find(addressPort);
+    if (iter == m_clientByPeerAddressPort.end())
+    {
+        f_logError(QString("%1: can't send message to unconnected host %2:%3.")
+                     .arg(nameId())
+                     .arg(addressPort.addr.toString())
+                     .arg(addressPort.port));
+        return -1;
+    }
+    return sendMessageTo(payload, iter.value(), true);
+}
+
+qint64 EpollTcpServer::sendMessageTo(QByteArray msg, QHostAddress address)
+{
+    QList<ClientData*> clientsAtAddress;
+    for (auto iter = m_clientByPeerAddressPort.cbegin(); iter != m_clientByPeerAddressPort.cend(); ++iter)
+    {
+        if (iter.key().addr == address)
+            clientsAtAddress.append(iter.value());
+    }
+    if (clientsAtAddress.isEmpty())
+    {
+        f_logError(QString("%1: can't send message to address %2 with no connections to it.")
+                     .arg(nameId())
+                     .arg(address.toString()));
+        return -1;
+    }
+    ++m_fanoutStats.messages;
+    Net::FanoutPayload payload(*m_pCompression, msg);
+    QList<std::shared_ptr<ClientData>> toDisconnect;
+    qint64 ret = 0;
+    for (ClientData* d : qAsConst(clientsAtAddress))
+        ret += fanoutTo(payload, d, toDisconnect);
+    disconnectSlowRecipients(toDisconnect);
+    return ret;
+}
+
+qint64 EpollTcpServer::sendMessageTo(QByteArray msg, QString loginUsername)
+{
+    auto iter = m_clientsByLoginUsername.find(loginUsername);
+    if (iter == m_clientsByLoginUsername.end())
+    {
+        f_logError(QString("%1: can't send message to unauthorized client username=%2.")
+                     .arg(nameId())
+                     .arg(loginUsername));
+        return -1;
+    }
+    return sendMessageTo(msg, iter.value());
+}
+
+void EpollTcpServer::removeAllowedAddress(QHostAddress addr)
+{
+    m_allowedAddresses.remove(addr);
+    QList<std::shared_ptr<ClientData>> toClose;
+    for (auto iter = m_clientByFd.cbegin(); iter != m_clientByFd.cend(); ++iter)
+    {
+        if (iter.value()->peerAddrPort.addr == addr)
+            toClose.append(iter.value());
+    }
+    for (auto const& d : qAsConst(toClose))
+        closeClient(d.get(), QStringLiteral("address removed from allowed list"));
+}
+
+void EpollTcpServer::removeLoginData(Net::LoginData loginData)
+{
+    m_loginData.remove(loginData);
+    auto iter = m_clientsByLoginUsername.find(loginData.username);
+    if (iter != m_clientsByLoginUsername.end())
+    {
+        const std::shared_ptr<ClientData> keepAlive = m_clientByFd.value(iter.value()->fd);
+        closeClient(keepAlive.get(), QStringLiteral("login data removed"));
+    }
+}
+
+Net::SendQueueStats EpollTcpServer::getSendQueueStats(const Net::AddressPort addrPort) const
+{
+    auto iter = m_clientByPeerAddressPort.constFind(addrPort);
+    if (iter == m_clientByPeerAddressPort.constEnd())
+        return Net::SendQueueStats{};
+    return iter.value()->sendQueue.stats();
+}
+
+Net::ConnectionSettings EpollTcpServer::getConnectionSettingsActive() const
+{
+    Net::ConnectionSettings netSettings = getConnectionSettings();
+    netSettings.ipLocal = m_listenAddrPort.addr;
+    netSettings.portIn = m_listenAddrPort.port;
+    return netSettings;
+}
+
+void EpollTcpServer::printConnectionInfo() const
+{
+    if (m_connectionState != ConnectionState::Created)
+    {
+        f_logGeneral(QString("%1: connection is not created.").arg(nameId()));
+        return;
+    }
+    QString msg;
+    msg = QString("------------- Connection Info --------------\n"
+                  "Connection type: %1\n"
+                  "Connection ID: %2\n"
+                  "Object name: %3\n"
+                  "Port In: %4\n"
+                  "Local IP: %5\n"
+                  "--------------------------------------------")
+          .arg(m_connectionTypeName)
+          .arg(m_connectionId)
+          .arg(objectName())
+          .arg(m_listenAddrPort.port)
+          .arg(m_listenAddrPort.addr.toString());
+    f_logGeneral(msg);
+    return;
+}
+
+void EpollTcpServer::printError() const
+{
+    f_logError(QString("%1: errorOccured: %2").arg(nameId()).arg(m_lastErrorString));
+    return;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <memory>
+
+#include <QtCore/QHash>
+#include <QtCore/QSocketNotifier>
+#include <QtCore/QTimer>
+
+#include "FrameReader.hpp"
+#include "NetServer.hpp"
+#include "SendQueue.hpp"
+
+struct sockaddr_storage;
+
+// Linux-only server which drives client sockets itself: all descriptors are in one edge-triggered epoll set, and the event loop only watches that set's descriptor.
+// Reads and writes are non-blocking recv()/sendmsg() on raw descriptors, so there is no QTcpSocket, no per-socket signals and no QIODevice buffering per client.
+// Callback contract and sendMessageTo() overloads are the same as TcpServer's. No sharding - several instances in their own NetThreads can share the port with SocketOptions::reusePort
+class EpollTcpServer : public NetServer
+{
+    Q_OBJECT
+public:
+    struct ClientData
+    {
+        int fd = -1; // -1 once client is closed
+        Net::AddressPort peerAddrPort;
+        Net::AddressPort localAddrPort;
+        Net::LoginData loginData;
+        bool isAuthorized = false;
+        Net::TimerWheel::Handle deadline; // authorization deadline until client is authorized, idle deadline after that
+        Net::FrameReader frameReader;
+        Net::SendQueue sendQueue;
+    };
+
+protected:
+    EpollTcpServer(const quint8 _connType, const QString _connTypeName, QObject* parent = nullptr);
+
+public:
+    EpollTcpServer(QObject* parent = nullptr) : EpollTcpServer(Net::ConnectionType::EpollTcpServer, "EpollTcpServer", parent) {}
+    virtual ~EpollTcpServer();
+    EpollTcpServer(const EpollTcpServer&) = delete;            // Copy constructor
+    EpollTcpServer(EpollTcpServer&&) = delete;                 // Move constructor
+    EpollTcpServer& operator=(const EpollTcpServer&) = delete; // Copy assignment
+    EpollTcpServer& operator=(EpollTcpServer&&) = delete;      // Move assignment
+
+    static constexpr int s_maxEventsPerWait = 256;
+    static constexpr int s_sweepInterval = 500; // msec, partial frame deadlines are checked that often
+
+protected: // members
+    int m_epollFd = -1;
+    int m_listenFd = -1;
+    QSocketNotifier* m_pEpollNotifier = nullptr;
+    Net::AddressPort m_listenAddrPort; // actually bound, port differs from settings if portIn is 0
+    QString m_lastErrorString;
+
+    QHash<int, std::shared_ptr<ClientData>> m_clientByFd; // shared_ptr keeps client alive while it's being processed, even if callback closes it
+    QHash<Net::AddressPort, ClientData*> m_clientByPeerAddressPort; // authorized only
+    QHash<QString, ClientData*> m_clientsByLoginUsername;
+
+    QTimer* m_sweepTimer = nullptr;
+    Net::IoStats m_ioStats;
+
+public: // methods
+    void printConnectionInfo() const override;
+
+    QString getLastErrorString() const final { return m_lastErrorString; }
+    Net::ConnectionSettings getConnectionSettingsActive() const final;
+    inline uint getConnectionCount() const override { return m_clientByFd.size(); }
+    bool getIsClientConnected(const Net::AddressPort addrPort) override { return m_clientByPeerAddressPort.contains(addrPort); }
+
+    Net::SendQueueStats getSendQueueStats(const Net::AddressPort addrPort) const; // must be called from <this>'s thread
+    Net::IoStats getIoStats() const override { return m_ioStats; }
+
+protected:
+    bool openListenSocket();
+    void closeListenSocket();
+    // Event source of clients' descriptors. Epoll set by default, subclasses can drive descriptors differently and reuse the rest
+    virtual bool startWatching();
+    virtual void stopWatching();
+    virtual bool watchClient(ClientData* d);
+    virtual void unwatchClient(ClientData*) {} // closing descriptor removes it from epoll set
+    virtual std::shared_ptr<ClientData> makeClientData() { return std::make_shared<ClientData>(); }
+
+    void acceptClients();
+    ClientData* addClient(int fd, const sockaddr_storage& peerAddr);
+    void readClient(ClientData* d);
+    bool processFrame(ClientData* d, const QByteArray& msg);
+    bool authorizeClient(ClientData* d, QByteArray msg); // returns false if client was dropped
+    void closeClient(ClientData* d, const QString& reason = QString{});
+    void shedClient(ClientData* d, Net::ShedReason reason);
+    void armIdleDeadline(ClientData* d);
+    inline void pushIdleDeadline(ClientData* d) // on every read of authorized client
+    {
+        if (d->isAuthorized && (m_idleTimeout > 0))
+            Net::TimerWheel::forCurrentThread()->reschedule(d->deadline, m_idleTimeout);
+    }
+    virtual qint64 sendMessageTo(QByteArray msg, ClientData* d, bool isEncoded = false);
+    qint64 sendEncodedMessageTo(QByteArray payload, Net::AddressPort addressPort) override;
+    void drainSendQueue(ClientData* d);
+    qint64 fanoutTo(Net::FanoutPayload& payload, ClientData* d, QList<std::shared_ptr<ClientData>>& toDisconnect);
+    void disconnectSlowRecipients(QList<std::shared_ptr<ClientData>> const& toDisconnect);
+    void setLastErrorFromErrno(const QString& operation);
+
+public slots:
+    Net::ConnectionState openConnection(Net::ConnectionSettings const& a_connectionSettings) override;
+    void closeConnection() override;
+    qint64 sendMessage(const QByteArray& msg) override;
+    qint64 sendMessageTo(QByteArray msg, QHostAddress address, quint16 port) override;
+    qint64 sendMessageTo(QByteArray msg, Net::AddressPort addressPort) override;
+    qint64 sendMessageTo(QByteArray msg, QHostAddress address) override;
+    qint64 sendMessageTo(QByteArray msg, QString loginUsername) override;
+    qint64 broadcastMessage(QByteArray msg) override;
+    qint64 multicastMessage(QByteArray msg, QVector<Net::AddressPort> recipients) override;
+
+    void removeAllowedAddress(QHostAddress addr) override;
+    void removeLoginData(Net::LoginData loginData) override;
+
+protected slots:
+    void readReceived() override; // processes whatever epoll set has ready
+    void sweepDeadlines();
+    void printError() const final;
+};
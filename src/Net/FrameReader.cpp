@@ -0,0 +1,202 @@
+#include "FrameReader.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <limits>
+
+#include <QtCore/QtEndian>
+
+#if defined(Q_OS_UNIX)
+    #include <sys/socket.h>
+#endif
+
+using namespace Net;
+
+quint32 FrameReader::peekFrameHeader() const
+{
+    const uchar* pHeader = reinterpret_cast<const uchar*>(m_buffer.constData() + m_readPos);
+    return (Net::g_endianness == QDataStream::BigEndian) ? qFromBigEndian<quint32>(pHeader) : qFromLittleEndian<quint32>(pHeader);
+}
+
+bool FrameReader::reserve(qint64 byteCount)
+{
+    if (m_pBudget == nullptr)
+        return true;
+    if (m_reservedBytes + byteCount > m_pBudget->limits.maxConnectionBytes)
+    {
+        m_shedReason = ShedReason::ConnectionBufferExceeded;
+        return false;
+    }
+    if (!m_pBudget->tryReserve(byteCount))
+    {
+        m_shedReason = ShedReason::TotalMemoryExceeded;
+        return false;
+    }
+    m_reservedBytes += byteCount;
+    return true;
+}
+
+void FrameReader::release(qint64 byteCount)
+{
+    if (m_pBudget == nullptr)
+        return;
+    m_pBudget->release(byteCount);
+    m_reservedBytes -= byteCount;
+}
+
+// read(data, maxSize) returns number of bytes read, 0 if source has nothing right now, or -1 if it's closed or failed
+template<typename ReadFunction>
+bool FrameReader::readFrameWith(ReadFunction read, QByteArray& frame)
+{
+    if (m_shedReason != ShedReason::None) // connection is about to be dropped, nothing it sends matters anymore
+        return false;
+    // Frames piling up in front of a slow callback are charged to the budget as well, past its limit if need be, so the limit is checked even if nothing is reserved here.
+    // Connections which keep sending meanwhile are the ones shed
+    if ((m_pBudget != nullptr) && (m_pBudget->usedBytes() > m_pBudget->limits.maxTotalBytes))
+    {
+        m_shedReason = ShedReason::TotalMemoryExceeded;
+        return false;
+    }
+    if (m_buffer.isEmpty())
+    {
+        if (!reserve(s_bufferSize))
+            return false;
+        m_buffer.resize(s_bufferSize);
+    }
+    for (;;)
+    {
+        if (!m_largeFrame.isNull())
+        {
+            if (m_largeFramePos < m_largeFrame.size())
+            {
+                const qint64 bytesRead = read(m_largeFrame.data() + m_largeFramePos, m_largeFrame.size() - m_largeFramePos);
+                if (bytesRead <= 0)
+                {
+                    if (!m_partialFrameTimer.isValid())
+                        m_partialFrameTimer.start();
+                    return false;
+                }
+                if (f_onChunk)
+                    f_onChunk(m_largeFrame.constData() + m_largeFramePos, static_cast<int>(bytesRead));
+                m_largeFramePos += static_cast<int>(bytesRead);
+                continue;
+            }
+            frame = m_largeFrame;
+            m_isFrameEncoded = m_isLargeFrameEncoded;
+            release(m_largeFrame.size()); // it's consumer's memory from now on
+            m_largeFrame = QByteArray{};
+            m_largeFramePos = 0;
+            m_partialFrameTimer.invalidate();
+            return true;
+        }
+
+        const int unparsedSize = m_writePos - m_readPos;
+        if (unparsedSize >= s_headerSize)
+        {
+            const quint32 frameHeader = peekFrameHeader();
+            const quint32 frameSize = frameHeader & ~Net::g_encodedFrameFlag;
+            const bool isEncoded = (frameHeader & Net::g_encodedFrameFlag) != 0;
+            if ((m_pBudget != nullptr) && (frameSize > m_pBudget->limits.maxFrameSize))
+            {
+                m_shedReason = ShedReason::FrameTooLarge;
+                return false;
+            }
+            if (frameSize >= static_cast<quint32>(s_directReadThreshold))
+            {
+                if ((frameSize > static_cast<quint32>(std::numeric_limits<int>::max())) || !reserve(frameSize))
+                {
+                    if (m_shedReason == ShedReason::None) // QByteArray can't hold it anyway
+                        m_shedReason = ShedReason::FrameTooLarge;
+                    return false;
+                }
+                m_largeFrame = QByteArray(static_cast<int>(frameSize), Qt::Uninitialized);
+                m_isLargeFrameEncoded = isEncoded;
+                m_largeFramePos = qMin(unparsedSize - s_headerSize, static_cast<int>(frameSize));
+                std::memcpy(m_largeFrame.data(), m_buffer.constData() + m_readPos + s_headerSize, static_cast<size_t>(m_largeFramePos));
+                if (f_onChunk && (m_largeFramePos > 0))
+                    f_onChunk(m_largeFrame.constData(), m_largeFramePos);
+                m_readPos += s_headerSize + m_largeFramePos;
+                continue;
+            }
+            if (unparsedSize - s_headerSize >= static_cast<int>(frameSize))
+            {
+                frame = QByteArray(m_buffer.constData() + m_readPos + s_headerSize, static_cast<int>(frameSize));
+                m_isFrameEncoded = isEncoded;
+                if (f_onChunk)
+                    f_onChunk(frame.constData(), frame.size());
+                m_readPos += s_headerSize + static_cast<int>(frameSize);
+                if (m_readPos == m_writePos)
+                    m_readPos = m_writePos = 0;
+                m_partialFrameTimer.invalidate();
+                return true;
+            }
+        }
+
+        // Pending frame is smaller than s_directReadThreshold, so after compaction there is always room for the rest of it
+        if ((m_readPos > 0) && (m_buffer.size() - m_writePos < s_directReadThreshold + s_headerSize))
+        {
+            std::memmove(m_buffer.data(), m_buffer.constData() + m_readPos, static_cast<size_t>(unparsedSize));
+            m_readPos = 0;
+            m_writePos = unparsedSize;
+        }
+        const qint64 bytesRead = read(m_buffer.data() + m_writePos, m_buffer.size() - m_writePos);
+        if (bytesRead <= 0)
+        {
+            if (m_readPos == m_writePos)
+                m_partialFrameTimer.invalidate();
+            else if (!m_partialFrameTimer.isValid())
+                m_partialFrameTimer.start();
+            return false;
+        }
+        m_writePos += static_cast<int>(bytesRead);
+    }
+}
+
+bool FrameReader::readFrame(QIODevice* pDevice, QByteArray& frame)
+{
+    return readFrameWith([pDevice](char* data, qint64 maxSize) { return pDevice->read(data, maxSize); }, frame);
+}
+
+#if defined(Q_OS_UNIX)
+bool FrameReader::readFrame(qintptr socketDescriptor, QByteArray& frame, bool& isPeerClosed)
+{
+    return readFrameWith([this, socketDescriptor, &isPeerClosed](char* data, qint64 maxSize) -> qint64 {
+        for (;;)
+        {
+            ++m_readCallCount;
+            const ssize_t bytesRead = ::recv(static_cast<int>(socketDescriptor), data, static_cast<size_t>(maxSize), 0);
+            if (bytesRead > 0)
+                return bytesRead;
+            if ((bytesRead < 0) && (errno == EINTR))
+                continue;
+            if ((bytesRead < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+                return 0;
+            isPeerClosed = true; // orderly shutdown or socket error, either way nothing more will come
+            return -1;
+        }
+    }, frame);
+}
+#endif
+
+bool FrameReader::readFrame(const char*& pData, qint64& dataSize, QByteArray& frame)
+{
+    return readFrameWith([&pData, &dataSize](char* data, qint64 maxSize) -> qint64 {
+        const qint64 bytesRead = qMin(maxSize, dataSize);
+        memcpy(data, pData, static_cast<size_t>(bytesRead));
+        pData += bytesRead;
+        dataSize -= bytesRead;
+        return bytesRead;
+    }, frame);
+}
+
+void FrameReader::clear()
+{
+    m_readPos = m_writePos = 0;
+    release(m_largeFrame.size());
+    m_largeFrame = QByteArray{};
+    m_largeFramePos = 0;
+    release(m_buffer.size());
+    m_buffer = QByteArray{};
+    m_shedReason = ShedReason::None;
+    m_partialFrameTimer.invalidate();
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <functional>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QIODevice>
+
+#include "NetUtils.hpp"
+#include "ReceiveBudget.hpp"
+
+namespace Net
+{
+// Parses length-prefixed frames (see PendingMessage) of one connection.
+// Device is read in bulk into a reusable buffer, so one readyRead() yields every frame it carries without per-frame QDataStream and resize().
+// Frames of s_directReadThreshold bytes and more bypass the buffer: their final QByteArray is allocated once and the rest of the frame is read straight into it.
+// Qt5 QByteArray can't share a sub-range of another one's storage, so small frames are handed out as one copy from the buffer.
+// With ReceiveBudget set, memory is reserved before it's allocated, and a frame that would break the limits stops the reader with shedReason() set.
+// g_encodedFrameFlag is not part of the frame size, it's reported by isFrameEncoded() for the frame last returned
+class FrameReader
+{
+public:
+    FrameReader() = default;
+    FrameReader(const FrameReader& other) : f_onChunk(other.f_onChunk) {} // only for container requirements, reservations and data are never copied
+    FrameReader& operator=(const FrameReader&) = delete;
+    ~FrameReader() { clear(); }
+
+    static constexpr int s_headerSize = sizeof(decltype(PendingMessage::pendingSize));
+    static constexpr int s_bufferSize = 16 * 1024;
+    static constexpr int s_directReadThreshold = 4 * 1024;
+
+    // Returns true and sets frame if a complete frame is available, reading pDevice as needed. Returns false once pDevice has nothing more
+    bool readFrame(QIODevice* pDevice, QByteArray& frame);
+#if defined(Q_OS_UNIX)
+    // Same for non-blocking socket descriptor, reads until EAGAIN. isPeerClosed is set once peer has shut connection down or it failed
+    bool readFrame(qintptr socketDescriptor, QByteArray& frame, bool& isPeerClosed);
+#endif
+    // Same for data received by someone else (e.g. io_uring completion). pData and dataSize are advanced past consumed bytes; false means all of it is consumed
+    bool readFrame(const char*& pData, qint64& dataSize, QByteArray& frame);
+    void clear(); // drops received data and releases its reservation
+
+    void setBudget(ReceiveBudget* pBudget) { m_pBudget = pBudget; } // pBudget must outlive <this> or be reset before destruction
+    ShedReason shedReason() const { return m_shedReason; }
+    qint64 reservedBytes() const { return m_reservedBytes; }
+    bool isFrameEncoded() const { return m_isFrameEncoded; }
+    qint64 partialFrameAge() const { return m_partialFrameTimer.isValid() ? m_partialFrameTimer.elapsed() : 0; } // msec since partial frame started arriving
+
+    qint64 bufferedBytes() const { return (m_writePos - m_readPos) + m_largeFramePos; } // received, but not handed out as frames yet
+    bool hasPartialFrame() const { return (bufferedBytes() > 0); }
+    quint64 readCallCount() const { return m_readCallCount; } // recv() calls made by descriptor overload of readFrame()
+
+    // Called with every chunk of frame data as it's consumed, if set. Meant for diagnostics only
+    std::function<void(const char* data, int size)> f_onChunk;
+
+private:
+    template<typename ReadFunction>
+    bool readFrameWith(ReadFunction read, QByteArray& frame);
+    quint32 peekFrameHeader() const;
+    bool reserve(qint64 byteCount);
+    void release(qint64 byteCount);
+
+    QByteArray m_buffer; // [m_readPos, m_writePos) holds unparsed bytes, moved to the front when tail space runs short
+    int m_readPos = 0;
+    int m_writePos = 0;
+    QByteArray m_largeFrame; // frame assembled outside of m_buffer, null if none
+    int m_largeFramePos = 0; // bytes of m_largeFrame already filled
+    bool m_isLargeFrameEncoded = false;
+    bool m_isFrameEncoded = false;
+
+    ReceiveBudget* m_pBudget = nullptr;
+    qint64 m_reservedBytes = 0;
+    ShedReason m_shedReason = ShedReason::None;
+    QElapsedTimer m_partialFrameTimer; // valid while a partial frame is pending
+    quint64 m_readCallCount = 0;
+};
+} // namespace Net
@@ -0,0 +1,212 @@
+#include "LocalClient.hpp"
+
+#include <QtCore/QMetaMethod>
+
+using namespace Net;
+
+LocalClient::LocalClient(const quint8 _connType, const QString _connTypeName, QObject* parent)
+    : NetClient(_connType, _connTypeName, parent)
+    , m_pLocalSocket(new QLocalSocket(this))
+{
+    connect(m_pLocalSocket, &QLocalSocket::connected,    this, &LocalClient::onConnected);
+    connect(m_pLocalSocket, &QLocalSocket::disconnected, this, &LocalClient::onDisconnected);
+    connect(m_pLocalSocket, &QLocalSocket::readyRead,    this, &LocalClient::readReceived);
+    connect(m_pLocalSocket, &QLocalSocket::bytesWritten, this, &LocalClient::drainSendQueue);
+    connect(m_pLocalSocket, &QLocalSocket::stateChanged, this, [this](QLocalSocket::LocalSocketState state) {
+        emit socketStateChanged(static_cast<QAbstractSocket::SocketState>(state));
+    });
+    connect(m_pLocalSocket, qOverload<QLocalSocket::LocalSocketError>(&QLocalSocket::error), this, &LocalClient::onSocketError);
+}
+
+LocalClient::~LocalClient()
+{
+    m_isReconnectEnabled = false;
+    LocalClient::closeConnection();
+    delete m_pLocalSocket;
+}
+
+Net::ConnectionState LocalClient::openConnection(ConnectionSettings const& a_connectionSettings)
+{
+    if (m_connectionState == ConnectionState::Created)
+        return m_connectionState;
+    m_connectionSettings = a_connectionSettings;
+    if (m_connectionSettings.localServerName.isEmpty())
+    {
+        f_logError(QString("%1: Unable to open connection - no local server name!").arg(nameId()));
+        m_connectionState = ConnectionState::NotCreated;
+        emit openedConnection(false);
+        return m_connectionState;
+    }
+    m_connectionState = ConnectionState::Created;
+    startConnecting();
+    return m_connectionState;
+}
+
+void LocalClient::closeConnection()
+{
+    stopConnecting();
+    m_pLocalSocket->close();
+    clearSendQueue();
+    if (m_connectionState == ConnectionState::Created)
+        f_logGeneral(QString("%1: Closed connection").arg(nameId()));
+    m_connectionState = ConnectionState::NotCreated;
+    emit closedConnection();
+    return;
+}
+
+// Attempt ends in onConnected() or, through socket error, in onConnectFailed()
+void LocalClient::startConnectAttempt()
+{
+    abortConnectAttempt();
+    m_pLocalSocket->connectToServer(m_connectionSettings.localServerName, QIODevice::ReadWrite);
+}
+
+void LocalClient::abortConnectAttempt()
+{
+    if (m_pLocalSocket->state() != QLocalSocket::UnconnectedState)
+        m_pLocalSocket->abort();
+}
+
+QString LocalClient::describeServer() const
+{
+    return QString("local server %1").arg(m_connectionSettings.localServerName);
+}
+
+// Queue the message and return the size of queued frame, or -1 in case of error.
+// Frame is written asynchronously as socket drains, use congestionChanged() to throttle the producer
+qint64 LocalClient::sendMessage(const QByteArray& msg)
+{
+    return enqueueMessage(msg, false);
+}
+
+qint64 LocalClient::sendEncodedMessage(const QByteArray& payload)
+{
+    return enqueueMessage(payload, true);
+}
+
+qint64 LocalClient::enqueueMessage(const QByteArray& msg, bool isEncoded)
+{
+    if (m_pLocalSocket->state() != QLocalSocket::ConnectedState)
+        return -1;
+
+    static const QMetaMethod s_writeDoneSignal = QMetaMethod::fromSignal(&NetConnection::writeDone);
+    const qint64 frameSize = m_sendQueue.enqueueFrame(msg, isEncoded);
+    drainSendQueue();
+    if (isSignalConnected(s_writeDoneSignal))
+        emit writeDone(msg);
+    return frameSize;
+}
+
+void LocalClient::drainSendQueue()
+{
+    m_sendQueue.drain(m_pLocalSocket);
+    if (m_sendQueue.updateCongestion(m_pLocalSocket, m_sendWatermarks))
+        emit congestionChanged(m_sendQueue.isCongested(), m_sendQueue.stats().pendingBytes);
+}
+
+// Frames left in queue belong to the lost connection, they must not leak into the next one after reconnect
+void LocalClient::clearSendQueue()
+{
+    const bool wasCongested = m_sendQueue.isCongested();
+    m_sendQueue.clear();
+    if (wasCongested)
+        emit congestionChanged(false, 0);
+}
+
+void LocalClient::onConnected()
+{
+    onConnectSucceeded();
+    f_logGeneral(QString("%1: connected to local server %2").arg(nameId()).arg(m_pLocalSocket->fullServerName()));
+    emit openedConnection(true);
+    authorize();
+    offerCodecs();
+}
+
+void LocalClient::onDisconnected()
+{
+    f_logGeneral(QString("%1: disconnected from local server %2").arg(nameId()).arg(m_connectionSettings.localServerName));
+    clearSendQueue();
+    m_frameReader.clear(); // partial frame of the lost connection must not prefix the next one's data
+    m_pCompression->clearPeers(); // next server may not support compression
+    onConnectionLost();
+}
+
+void LocalClient::authorize()
+{
+    if (!m_isAuthorizationEnabled)
+        return;
+    QByteArray msg;
+    MAKE_QDATASTREAM_NET(stream, &msg, QIODevice::WriteOnly);
+    stream << m_loginData;
+    sendMessage(msg);
+}
+
+void LocalClient::offerCodecs()
+{
+    const quint8 codecMask = m_pCompression->settings().codecMask;
+    if (codecMask == 0)
+        return;
+    sendEncodedMessage(Net::makeCodecOffer(codecMask));
+}
+
+void LocalClient::readReceived()
+{
+    static const QMetaMethod s_readDoneSignal = QMetaMethod::fromSignal(&NetConnection::readDone);
+    static const QMetaMethod s_readPartialDoneSignal = QMetaMethod::fromSignal(&LocalClient::readPartialDone);
+    // Diagnostic signals copy data and take a timestamp, so they are emitted only when somebody listens
+    const bool isReadDoneObserved = isSignalConnected(s_readDoneSignal);
+    const bool isReadPartialDoneObserved = isSignalConnected(s_readPartialDoneSignal);
+    if (isReadPartialDoneObserved != static_cast<bool>(m_frameReader.f_onChunk))
+    {
+        if (isReadPartialDoneObserved)
+            m_frameReader.f_onChunk = [this](const char* data, int size) { emit readPartialDone(QByteArray(data, size)); };
+        else
+            m_frameReader.f_onChunk = nullptr;
+    }
+    const Net::AddressPort serverAddrPort{Net::localPeerAddress(), 0};
+    QByteArray msg;
+    while (m_frameReader.readFrame(m_pLocalSocket, msg))
+    {
+        if (isReadDoneObserved)
+            emit readDone(msg);
+        deliverReceivedMessage(msg, serverAddrPort, m_frameReader.isFrameEncoded());
+    }
+    flushReceivedBatch(serverAddrPort);
+    return;
+}
+
+Net::ConnectionSettings LocalClient::getConnectionSettingsActive() const
+{
+    Net::ConnectionSettings netSettings = getConnectionSettings();
+    if (m_pLocalSocket->state() == QLocalSocket::ConnectedState)
+        netSettings.localServerName = m_pLocalSocket->fullServerName();
+    return netSettings;
+}
+
+void LocalClient::printConnectionInfo() const
+{
+    if (m_connectionState != ConnectionState::Created)
+    {
+        f_logGeneral(QString("%1: connection is not created.").arg(nameId()));
+        return;
+    }
+    QString msg;
+    msg = QString("------------- Connection Info --------------\n"
+                  "Connection type: %1\n"
+                  "Connection ID: %2\n"
+                  "Object name: %3\n"
+                  "Server name: %4\n"
+                  "--------------------------------------------")
+          .arg(m_connectionTypeName)
+          .arg(m_connectionId)
+          .arg(objectName())
+          .arg(m_pLocalSocket->fullServerName());
+    f_logGeneral(msg);
+    return;
+}
+
+void LocalClient::printError() const
+{
+    f_logError(QString("%1: errorOccured: %2 (code %3)").arg(nameId()).arg(m_pLocalSocket->errorString()).arg(m_pLocalSocket->error()));
+    return;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QtNetwork/QLocalSocket>
+
+#include "FrameReader.hpp"
+#include "NetClient.hpp"
+#include "SendQueue.hpp"
+
+// TcpClient counterpart for a server on the same host: same framing, authorization, compression and reconnect policy over QLocalSocket
+// (Unix domain socket, or named pipe on Windows), which skips the whole TCP loopback stack.
+// Server is addressed by ConnectionSettings::localServerName, addresses and ports of settings are ignored
+class LocalClient : public NetClient
+{
+    Q_OBJECT
+protected:
+    LocalClient(const quint8 _connType, const QString _connTypeName, QObject* parent = nullptr);
+
+public:
+    LocalClient(QObject* parent = nullptr) : LocalClient(Net::ConnectionType::LocalClient, "LocalClient", parent) {}
+    ~LocalClient();
+    LocalClient(const LocalClient&) = delete;            // Copy constructor
+    LocalClient(LocalClient&&) = delete;                 // Move constructor
+    LocalClient& operator=(const LocalClient&) = delete; // Copy assignment
+    LocalClient& operator=(LocalClient&&) = delete;      // Move assignment
+
+protected: // members
+    QLocalSocket* m_pLocalSocket;
+
+    Net::FrameReader m_frameReader;
+
+    Net::SendQueue m_sendQueue;
+
+public: // methods
+    virtual void printConnectionInfo() const override;
+
+    QAbstractSocket::SocketState getSocketState() const override { return static_cast<QAbstractSocket::SocketState>(m_pLocalSocket->state()); }
+    QString getLastErrorString() const final { return m_pLocalSocket->errorString(); }
+    Net::ConnectionSettings getConnectionSettingsActive() const final; // localServerName is the full socket path once connected
+    Net::SendQueueStats getSendQueueStats() const override { return m_sendQueue.stats(); }
+
+protected:
+    void startConnectAttempt() override;
+    void abortConnectAttempt() override;
+    QString describeServer() const override;
+    qint64 enqueueMessage(const QByteArray& msg, bool isEncoded);
+    qint64 sendEncodedMessage(const QByteArray& payload) override;
+
+public slots:
+    virtual Net::ConnectionState openConnection(Net::ConnectionSettings const& a_connectionSettings) override;
+    virtual void closeConnection() override;
+    virtual qint64 sendMessage(const QByteArray& msg) override;
+
+protected slots:
+    virtual void readReceived() override;
+    void printError() const final;
+    void onConnected();
+    void onDisconnected();
+    void authorize();
+    void offerCodecs(); // right after authorize(), so that server sees login data first
+    void drainSendQueue();
+    void clearSendQueue();
+
+signals:
+    void readPartialDone(const QByteArray& msg, const QDateTime& dt = QDateTime::currentDateTimeUtc()) const;
+};
@@ -0,0 +1,581 @@
+#include "LocalServer.hpp"
+
+#include <limits>
+
+#include <QtCore/QMetaMethod>
+
+using namespace Net;
+using namespace std;
+
+LocalServer::LocalServer(const quint8 _connType, const QString _connTypeName, QObject* parent)
+    : NetServer(_connType, _connTypeName, parent)
+    , m_pServer(new QLocalServer(this))
+{
+    connect(m_pServer, &QLocalServer::newConnection, this, &LocalServer::onNewConnection);
+
+    m_partialFrameSweepTimer = new QTimer(this);
+    connect(m_partialFrameSweepTimer, &QTimer::timeout, this, &LocalServer::sweepPartialFrames);
+}
+
+LocalServer::~LocalServer()
+{
+    LocalServer::closeConnection();
+    delete m_pServer;
+}
+
+Net::ConnectionState LocalServer::openConnection(ConnectionSettings const& a_connectionSettings)
+{
+    if (m_connectionState == ConnectionState::Created)
+        return m_connectionState;
+    m_connectionSettings = a_connectionSettings;
+    bool isListenOk = m_pServer->listen(m_connectionSettings.localServerName);
+    if ((isListenOk == false) && (m_pServer->serverError() == QAbstractSocket::AddressInUseError))
+    {
+        // Socket file left over by a server which didn't close properly blocks the name until it's removed,
+        // but it's only left over if nobody answers on it - removing a live server's socket would take its name away
+        QLocalSocket probe;
+        probe.connectToServer(m_connectionSettings.localServerName);
+        if (probe.waitForConnected(s_stalePeerProbeTimeout))
+        {
+            probe.abort();
+            f_logError(QString("%1: local server name %2 is used by a running server").arg(nameId()).arg(m_connectionSettings.localServerName));
+        }
+        else
+        {
+            f_logGeneral(QString("%1: local server name %2 is in use, removing stale socket").arg(nameId()).arg(m_connectionSettings.localServerName));
+            QLocalServer::removeServer(m_connectionSettings.localServerName);
+            isListenOk = m_pServer->listen(m_connectionSettings.localServerName);
+        }
+    }
+    if (isListenOk == false)
+    {
+        m_connectionState = ConnectionState::NotCreated;
+        f_logError(QString("%1: Unable to open connection - %2").arg(nameId()).arg(m_pServer->errorString()));
+        emit openedConnection(false);
+        return m_connectionState;
+    }
+    m_connectionState = ConnectionState::Created;
+    f_logGeneral(QString("%1: Opened connection").arg(nameId()));
+    printConnectionInfo();
+    emit openedConnection(true);
+    return m_connectionState;
+}
+
+void LocalServer::closeConnection()
+{
+    m_pServer->close();
+    if (m_connectionState == ConnectionState::Created)
+        f_logGeneral(QString("%1: Closed connection").arg(nameId()));
+    m_connectionState = ConnectionState::NotCreated;
+    m_partialFrameSweepTimer->stop();
+
+    const auto sockets = m_peerAddrPortBySocket.keys();
+    for (QLocalSocket* pSocket : sockets)
+        pSocket->abort(); // onSocketDisconnected() forgets socket right away
+    emit closedConnection();
+}
+
+void LocalServer::setSocketOptions(QLocalServer::SocketOptions options)
+{
+    if (m_connectionState == Net::ConnectionState::Created)
+    {
+        f_logGeneral(QString("%1: called setSocketOptions() while connection is open - action forbidden").arg(nameId()));
+        return;
+    }
+    m_pServer->setSocketOptions(options);
+}
+
+void LocalServer::removeAllowedAddress(QHostAddress addr)
+{
+    m_allowedAddresses.remove(addr); // local clients have no address to match
+}
+
+void LocalServer::removeLoginData(Net::LoginData loginData)
+{
+    m_loginData.remove(loginData);
+    auto iter = m_clientsByLoginUsername.find(loginData.username);
+    if (iter != m_clientsByLoginUsername.end())
+    {
+        iter.value()->pSocket->abort();
+    }
+}
+
+void LocalServer::onNewConnection()
+{
+    while (m_pServer->hasPendingConnections())
+    {
+        QLocalSocket* pSocket = m_pServer->nextPendingConnection();
+        setupClientSocket(pSocket);
+    }
+    return;
+}
+
+quint16 LocalServer::takePeerPort()
+{
+    if (m_usedPeerPorts.size() >= std::numeric_limits<quint16>::max())
+        return 0;
+    while ((m_nextPeerPort == 0) || m_usedPeerPorts.contains(m_nextPeerPort))
+        ++m_nextPeerPort;
+    m_usedPeerPorts.insert(m_nextPeerPort);
+    return m_nextPeerPort++;
+}
+
+void LocalServer::setupClientSocket(QLocalSocket* pSocket)
+{
+    const quint16 peerPort = takePeerPort();
+    if (peerPort == 0)
+    {
+        f_logGeneral(QString("%1: rejected local client - too many clients").arg(nameId()));
+        pSocket->abort();
+        pSocket->deleteLater();
+        return;
+    }
+    const Net::AddressPort peerAddrPort{Net::localPeerAddress(), peerPort};
+    m_peerAddrPortBySocket.insert(pSocket, peerAddrPort);
+
+    if (m_isAuthorizationEnabled)
+    {
+        m_socketAuthMap.insert(pSocket, Net::TimerWheel::forCurrentThread()->schedule(m_authTimeoutTime, [pSocket]() { pSocket->close(); }));
+    }
+    else
+    {
+        auto ptr = make_shared<ClientData>();
+        ClientData* d = ptr.get();
+        d->pSocket = pSocket;
+        d->peerAddrPort = peerAddrPort;
+
+        m_clientMap.insert(pSocket, ptr);
+        m_clientByPeerAddressPort.insert(peerAddrPort, d);
+        armIdleDeadline(d);
+    }
+    pSocket->setReadBufferSize(s_socketReadBufferSize);
+    m_frameReaderBySocket[pSocket].setBudget(m_pReceiveBudget.get());
+    if ((m_receiveLimits.partialFrameTimeout > 0) && !m_partialFrameSweepTimer->isActive())
+        m_partialFrameSweepTimer->start(qBound(100, m_receiveLimits.partialFrameTimeout / 4, 1000));
+    connect(pSocket, &QLocalSocket::readyRead, this, &LocalServer::readReceived);
+    connect(pSocket, &QLocalSocket::disconnected, this, &LocalServer::onSocketDisconnected);
+    connect(pSocket, &QLocalSocket::bytesWritten, this, &LocalServer::onSocketBytesWritten);
+    connect(pSocket, qOverload<QLocalSocket::LocalSocketError>(&QLocalSocket::error), this, &LocalServer::printSocketError);
+    f_logGeneral(QString("%1: local client %2 sockd:%3 connected")
+                 .arg(nameId())
+                 .arg(Net::toQString(peerAddrPort))
+                 .arg(pSocket->socketDescriptor()));
+    emit clientConnected(peerAddrPort);
+}
+
+qint64 LocalServer::sendMessage(const QByteArray& msg)
+{
+    return broadcastMessage(msg);
+}
+
+qint64 LocalServer::broadcastMessage(QByteArray msg)
+{
+    ++m_fanoutStats.messages;
+    Net::FanoutPayload payload(*m_pCompression, msg);
+    QList<QLocalSocket*> toDisconnect;
+    qint64 ret = 0;
+    for (auto clientIter = m_clientMap.begin(); clientIter != m_clientMap.end(); ++clientIter)
+        ret += fanoutTo(payload, clientIter.value().get(), toDisconnect);
+    disconnectSlowRecipients(toDisconnect);
+    return ret;
+}
+
+qint64 LocalServer::multicastMessage(QByteArray msg, QVector<Net::AddressPort> recipients)
+{
+    ++m_fanoutStats.messages;
+    Net::FanoutPayload payload(*m_pCompression, msg);
+    QList<QLocalSocket*> toDisconnect;
+    qint64 ret = 0;
+    for (Net::AddressPort const& addrPort : qAsConst(recipients))
+    {
+        auto iter = m_clientByPeerAddressPort.constFind(addrPort);
+        if (iter != m_clientByPeerAddressPort.constEnd())
+            ret += fanoutTo(payload, iter.value(), toDisconnect);
+    }
+    disconnectSlowRecipients(toDisconnect);
+    return ret;
+}
+
+qint64 LocalServer::fanoutTo(Net::FanoutPayload& payload, ClientData* d, QList<QLocalSocket*>& toDisconnect)
+{
+    bool shouldDisconnect = false;
+    if (!admitFanoutRecipient(d->sendQueue, shouldDisconnect))
+    {
+        if (shouldDisconnect)
+            toDisconnect.append(d->pSocket);
+        return 0;
+    }
+    bool isEncoded = false;
+    const QByteArray& msg = payload.payloadFor(d->peerAddrPort, isEncoded);
+    return sendMessageTo(msg, d, isEncoded);
+}
+
+// After the fan-out loop, since aborted socket is removed from m_clientMap right away
+void LocalServer::disconnectSlowRecipients(QList<QLocalSocket*> const& toDisconnect)
+{
+    for (QLocalSocket* pSocket : toDisconnect)
+    {
+        auto iterClient = m_clientMap.constFind(pSocket);
+        if (iterClient == m_clientMap.constEnd())
+            continue;
+        f_logGeneral(QString("%1: dropped local client %2 - too slow for fan-out, %3 bytes pending")
+                     .arg(nameId())
+                     .arg(Net::toQString(iterClient.value()->peerAddrPort))
+                     .arg(iterClient.value()->sendQueue.stats().pendingBytes));
+        pSocket->abort();
+    }
+}
+
+// No validity check for d since this method is protected and all its calls are guaranteed to be safe
+// Message is only queued and written asynchronously as socket drains, so the return value is the size of queued frame
+qint64 LocalServer::sendMessageTo(QByteArray msg, ClientData* d, bool isEncoded)
+{
+    static const QMetaMethod s_writeDoneSignal = QMetaMethod::fromSignal(&NetConnection::writeDone);
+    const qint64 frameSize = d->sendQueue.enqueueFrame(msg, isEncoded);
+    drainSendQueue(d);
+    if (isSignalConnected(s_writeDoneSignal))
+        emit writeDone(msg);
+    return frameSize;
+}
+
+void LocalServer::drainSendQueue(ClientData* d)
+{
+    d->sendQueue.drain(d->pSocket);
+    if (d->sendQueue.updateCongestion(d->pSocket, m_sendWatermarks))
+    {
+        const Net::SendQueueStats& stats = d->sendQueue.stats();
+        emit clientCongestionChanged(d->peerAddrPort, stats.isCongested, stats.pendingBytes);
+    }
+}
+
+void LocalServer::onSocketBytesWritten()
+{
+    QLocalSocket* pSocket = qobject_cast<QLocalSocket*>(sender());
+    auto iterClient = m_clientMap.find(pSocket);
+    if (iterClient == m_clientMap.end()) // not authorized yet, nothing could have been queued
+        return;
+    drainSendQueue(iterClient.value().get());
+}
+
+qint64 LocalServer::sendMessageTo(QByteArray msg, QHostAddress address, quint16 port)
+{
+    return sendMessageTo(msg, Net::AddressPort{address, port});
+}
+
+qint64 LocalServer::sendMessageTo(QByteArray msg, Net::AddressPort addressPort)
+{
+    auto iter = m_clientByPeerAddressPort.find(addressPort);
+    if (iter == m_clientByPeerAddressPort.end())
+    {
+        f_logError(QString("%1: can't send message to unconnected local client %2.")
+                     .arg(nameId())
+                     .arg(Net::toQString(addressPort)));
+        return -1;
+    }
+    return sendMessageTo(msg, iter.value());
+}
+
+qint64 LocalServer::sendEncodedMessageTo(QByteArray payload, Net::AddressPort addressPort)
+{
+    auto iter = m_clientByPeerAddressPort.find(addressPort);
+    if (iter == m_clientByPeerAddressPort.end())
+    {
+        f_logError(QString("%1: can't send message to unconnected local client %2.")
+                     .arg(nameId())
+                     .arg(Net::toQString(addressPort)));
+        return -1;
+    }
+    return sendMessageTo(payload, iter.value(), true);
+}
+
+qint64 LocalServer::sendMessageTo(QByteArray msg, QHostAddress address)
+{
+    if ((address != Net::localPeerAddress()) || m_clientMap.isEmpty())
+    {
+        f_logError(QString("%1: can't send message to address %2 with no connections to it.")
+                     .arg(nameId())
+                     .arg(address.toString()));
+        return -1;
+    }
+    return sendMessage(msg);
+}
+
+qint64 LocalServer::sendMessageTo(QByteArray msg, QString loginUsername)
+{
+    auto iter = m_clientsByLoginUsername.find(loginUsername);
+    if (iter == m_clientsByLoginUsername.end())
+    {
+        f_logError(QString("%1: can't send message to unauthorized client username=%2.")
+                     .arg(nameId())
+                     .arg(loginUsername));
+        return -1;
+    }
+    return sendMessageTo(msg, iter.value());
+}
+
+void LocalServer::onSocketDisconnected()
+{
+    QLocalSocket* pSocket = qobject_cast<QLocalSocket*>(sender());
+    auto iterAddrPort = m_peerAddrPortBySocket.find(pSocket);
+    if (iterAddrPort == m_peerAddrPortBySocket.end()) // already forgotten
+        return;
+    const Net::AddressPort peerAddrPort = iterAddrPort.value();
+    m_peerAddrPortBySocket.erase(iterAddrPort);
+    m_usedPeerPorts.remove(peerAddrPort.port);
+    m_frameReaderBySocket.remove(pSocket);
+
+    auto iterClient = m_clientMap.find(pSocket);
+    if (iterClient != m_clientMap.end()) // socket was authorized
+    {
+        Net::TimerWheel::forCurrentThread()->cancel(iterClient.value()->idleDeadline);
+        const ClientData& d = *(iterClient.value());
+        emit clientDisconnected(d.peerAddrPort);
+        QString logText = (getConnectionState() == Net::ConnectionState::Created)
+                ? QString("%1: local client %2%3 disconnected") // server is open, disconnect was initiated by client
+                : QString("%1: disconnected local client %2%3"); // server is closed, disconnect was initiated by server
+        f_logGeneral(logText
+                     .arg(nameId())
+                     .arg(Net::toQString(d.peerAddrPort))
+                     .arg(m_isAuthorizationEnabled ? QStringLiteral(" (username=%1)").arg(d.loginData.username) : QString{}));
+        m_clientByPeerAddressPort.remove(d.peerAddrPort);
+        m_clientsByLoginUsername.remove(d.loginData.username);
+        m_clientMap.erase(iterClient);
+    }
+    else if (m_isAuthorizationEnabled) // socket was not authorized
+    {
+        auto iterTimer = m_socketAuthMap.find(pSocket);
+        Net::TimerWheel::forCurrentThread()->cancel(iterTimer.value());
+        m_socketAuthMap.erase(iterTimer);
+
+        QString logText = (getConnectionState() == Net::ConnectionState::Created)
+                ? QString("%1: disconnected unauthorized local client %2") // server is open, disconnect was initiated by client
+                : QString("%1: unauthorized local client %2 disconnected"); // server is closed, disconnect was initiated by server
+        f_logGeneral(logText
+                     .arg(nameId())
+                     .arg(Net::toQString(peerAddrPort)));
+        emit clientDisconnected(peerAddrPort); // clientConnected was emitted for it as well
+    }
+    pSocket->deleteLater();
+    return;
+}
+
+void LocalServer::readReceived()
+{
+    static const QMetaMethod s_readDoneSignal = QMetaMethod::fromSignal(&NetConnection::readDone);
+    static const QMetaMethod s_readPartialDoneSignal = QMetaMethod::fromSignal(&LocalServer::readPartialDone);
+    QLocalSocket* pSocket = qobject_cast<QLocalSocket*>(sender());
+    auto iterAddrPort = m_peerAddrPortBySocket.constFind(pSocket);
+    if (iterAddrPort == m_peerAddrPortBySocket.constEnd()) // readyRead() queued before socket was dropped
+        return;
+    markReadStarted();
+    const Net::AddressPort peerAddrPort = iterAddrPort.value();
+    // Callback run in this thread may drop the socket (removeLoginData(), fan-out to slow recipients), which forgets its reader right away,
+    // so the reader is looked up again after every call out of <this>
+    Net::FrameReader* pFrameReader = &m_frameReaderBySocket[pSocket];
+    auto lambda_isSocketKept = [this, pSocket, &pFrameReader]() {
+        if (!m_peerAddrPortBySocket.contains(pSocket))
+            return false;
+        pFrameReader = &m_frameReaderBySocket[pSocket];
+        return true;
+    };
+    // Diagnostic signals copy data and take a timestamp, so they are emitted only when somebody listens
+    const bool isReadDoneObserved = isSignalConnected(s_readDoneSignal);
+    const bool isReadPartialDoneObserved = isSignalConnected(s_readPartialDoneSignal);
+    if (isReadPartialDoneObserved != static_cast<bool>(pFrameReader->f_onChunk))
+    {
+        if (isReadPartialDoneObserved)
+            pFrameReader->f_onChunk = [this](const char* data, int size) { emit readPartialDone(QByteArray(data, size)); };
+        else
+            pFrameReader->f_onChunk = nullptr;
+    }
+    if (m_idleTimeout > 0)
+    {
+        auto iterClient = m_clientMap.constFind(pSocket);
+        if (iterClient != m_clientMap.constEnd())
+            Net::TimerWheel::forCurrentThread()->reschedule(iterClient.value()->idleDeadline, m_idleTimeout);
+    }
+    QByteArray msg;
+    while (pFrameReader->readFrame(pSocket, msg))
+    {
+        if (isReadDoneObserved)
+            emit readDone(msg);
+        if (m_isAuthorizationEnabled)
+        {
+            auto iterTimer = m_socketAuthMap.find(pSocket);
+            if (iterTimer != m_socketAuthMap.end()) // client is not authorized
+            {
+                MAKE_QDATASTREAM_NET(stream, &msg, QIODevice::ReadOnly);
+                Net::LoginData loginData;
+                stream >> loginData;
+                if (stream.status() != QDataStream::Ok)
+                {
+                    f_logGeneral(QString("%1: received corrupted data from unauthorized local client %2")
+                                 .arg(nameId())
+                                 .arg(Net::toQString(peerAddrPort)));
+                    pSocket->abort();
+                    return;
+                }
+
+                if (m_clientsByLoginUsername.contains(loginData.username))
+                {
+                    f_logGeneral(QString("%1: received login data from unauthorized local client %2 for already authorized client")
+                                 .arg(nameId())
+                                 .arg(Net::toQString(peerAddrPort)));
+                    pSocket->abort();
+                    return;
+                }
+
+                if (!m_loginData.contains(loginData))
+                {
+                    f_logGeneral(QString("%1: received invalid login data from unauthorized local client %2")
+                                 .arg(nameId())
+                                 .arg(Net::toQString(peerAddrPort)));
+                    pSocket->abort();
+                    return;
+                }
+
+                Net::TimerWheel::forCurrentThread()->cancel(iterTimer.value());
+                m_socketAuthMap.erase(iterTimer);
+
+                auto ptr = make_shared<ClientData>();
+                ClientData* d = ptr.get();
+                d->pSocket = pSocket;
+                d->peerAddrPort = peerAddrPort;
+                d->loginData = loginData;
+
+                m_clientMap.insert(pSocket, ptr);
+                m_clientByPeerAddressPort.insert(peerAddrPort, d);
+                m_clientsByLoginUsername.insert(d->loginData.username, d);
+                armIdleDeadline(d);
+
+                f_logGeneral(QString("%1: local client %2 sockd:%3 authorized as username=%4")
+                             .arg(nameId())
+                             .arg(Net::toQString(peerAddrPort))
+                             .arg(pSocket->socketDescriptor())
+                             .arg(d->loginData.username));
+                emit clientAuthorized(d->loginData.username, d->peerAddrPort);
+                if (!lambda_isSocketKept()) // directly connected slot may drop the socket too
+                    break;
+                continue;
+            }
+        }
+        deliverReceivedMessage(msg, peerAddrPort, pFrameReader->isFrameEncoded());
+        if (!lambda_isSocketKept())
+            break;
+    }
+    flushReceivedBatch(peerAddrPort); // frames read before the drop are delivered all the same
+    if (lambda_isSocketKept() && (pFrameReader->shedReason() != Net::ShedReason::None)) // batch callback may drop the socket as well
+        shedClient(pSocket, pFrameReader->shedReason());
+    return;
+}
+
+void LocalServer::shedClient(QLocalSocket* pSocket, Net::ShedReason reason)
+{
+    m_pReceiveBudget->countShed(reason);
+    f_logGeneral(QString("%1: dropped local client %2 - %3")
+                 .arg(nameId())
+                 .arg(Net::toQString(m_peerAddrPortBySocket.value(pSocket)))
+                 .arg(Net::toQString(reason)));
+    pSocket->abort(); // onSocketDisconnected() releases its receive memory
+}
+
+void LocalServer::armIdleDeadline(ClientData* d)
+{
+    if (m_idleTimeout <= 0)
+        return;
+    QLocalSocket* pSocket = d->pSocket;
+    const Net::AddressPort peerAddrPort = d->peerAddrPort;
+    d->idleDeadline = Net::TimerWheel::forCurrentThread()->schedule(m_idleTimeout, [this, pSocket, peerAddrPort]() {
+        f_logGeneral(QString("%1: dropped local client %2 - idle for %3 msec")
+                     .arg(nameId())
+                     .arg(Net::toQString(peerAddrPort))
+                     .arg(m_idleTimeout));
+        pSocket->close();
+    });
+}
+
+// Slow sender holding a half-received frame ties up its memory, so frame has to be completed within partialFrameTimeout
+void LocalServer::sweepPartialFrames()
+{
+    if (m_frameReaderBySocket.isEmpty())
+    {
+        m_partialFrameSweepTimer->stop();
+        return;
+    }
+    QList<QLocalSocket*> toShed;
+    for (auto iter = m_frameReaderBySocket.cbegin(); iter != m_frameReaderBySocket.cend(); ++iter)
+    {
+        if (iter.value().partialFrameAge() > m_receiveLimits.partialFrameTimeout)
+            toShed.append(iter.key());
+    }
+    for (QLocalSocket* pSocket : toShed)
+        shedClient(pSocket, Net::ShedReason::PartialFrameTimeout);
+}
+
+Net::ConnectionSettings LocalServer::getConnectionSettingsActive() const
+{
+    Net::ConnectionSettings netSettings = getConnectionSettings();
+    if (m_pServer->isListening())
+        netSettings.localServerName = m_pServer->fullServerName();
+    return netSettings;
+}
+
+Net::SendQueueStats LocalServer::getSendQueueStats(const Net::AddressPort addrPort) const
+{
+    auto iter = m_clientByPeerAddressPort.constFind(addrPort);
+    if (iter == m_clientByPeerAddressPort.constEnd())
+        return {};
+    return iter.value()->sendQueue.stats();
+}
+
+void LocalServer::printConnectionInfo() const
+{
+    if (m_connectionState != ConnectionState::Created)
+    {
+        f_logGeneral(QString("%1: connection is not created.").arg(nameId()));
+        return;
+    }
+    QString msg;
+    msg = QString("------------- Connection Info --------------\n"
+                  "Connection type: %1\n"
+                  "Connection ID: %2\n"
+                  "Object name: %3\n"
+                  "Server name: %4\n"
+                  "--------------------------------------------")
+          .arg(m_connectionTypeName)
+          .arg(m_connectionId)
+          .arg(objectName())
+          .arg(m_pServer->fullServerName());
+    f_logGeneral(msg);
+    return;
+}
+
+void LocalServer::printError() const
+{
+    f_logError(QString("%1: errorOccured: %2 (code %3)").arg(nameId()).arg(m_pServer->errorString()).arg(m_pServer->serverError()));
+    return;
+}
+
+void LocalServer::printSocketError() const
+{
+    QLocalSocket* clientSocket = qobject_cast<QLocalSocket*>(QObject::sender());
+    const Net::AddressPort peerAddrPort = m_peerAddrPortBySocket.value(clientSocket);
+    QLocalSocket::LocalSocketError err = clientSocket->error();
+    if (err == QLocalSocket::PeerClosedError)
+    {
+        f_logGeneral(QString("%1: local client %2: %3 (code %4)")
+                     .arg(nameId())
+                     .arg(Net::toQString(peerAddrPort))
+                     .arg(clientSocket->errorString())
+                     .arg(err));
+    }
+    else
+    {
+        f_logError(QString("%1: local client %2: errorOccured: %3 (code %4)")
+                   .arg(nameId())
+                   .arg(Net::toQString(peerAddrPort))
+                   .arg(clientSocket->errorString())
+                   .arg(err));
+    }
+    return;
+}
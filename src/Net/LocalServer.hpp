@@ -0,0 +1,106 @@
+#pragma once
+
+#include <memory>
+
+#include <QtCore/QTimer>
+#include <QtNetwork/QLocalServer>
+#include <QtNetwork/QLocalSocket>
+
+#include "FrameReader.hpp"
+#include "NetServer.hpp"
+#include "SendQueue.hpp"
+
+// NetServer for clients on the same host, listening on QLocalServer (Unix domain socket, or named pipe on Windows) named by ConnectionSettings::localServerName.
+// Framing, authorization, compression, send queues and receive limits are the same as in TcpServer, and so is sendMessageTo() routing:
+// local sockets have no peer address, so each client is known as AddressPort{Net::localPeerAddress(), n}.
+// Access is controlled by socket file permissions (see setSocketOptions()) instead of allowed addresses, which only apply to TCP peers
+class LocalServer : public NetServer
+{
+    Q_OBJECT
+public:
+    struct ClientData
+    {
+        QLocalSocket* pSocket = nullptr;
+        Net::AddressPort peerAddrPort;
+        Net::LoginData loginData;
+        Net::SendQueue sendQueue;
+        Net::TimerWheel::Handle idleDeadline;
+    };
+
+protected:
+    LocalServer(const quint8 _connType, const QString _connTypeName, QObject* parent = nullptr);
+
+public:
+    LocalServer(QObject* parent = nullptr) : LocalServer(Net::ConnectionType::LocalServer, "LocalServer", parent) {}
+    virtual ~LocalServer();
+    LocalServer(const LocalServer&) = delete;            // Copy constructor
+    LocalServer(LocalServer&&) = delete;                 // Move constructor
+    LocalServer& operator=(const LocalServer&) = delete; // Copy assignment
+    LocalServer& operator=(LocalServer&&) = delete;      // Move assignment
+
+protected: // members
+    QLocalServer* m_pServer;
+    QHash<QLocalSocket*, std::shared_ptr<ClientData>> m_clientMap; // authorized clients
+    QHash<Net::AddressPort, ClientData*> m_clientByPeerAddressPort;
+    QHash<QString, ClientData*> m_clientsByLoginUsername;
+    QHash<QLocalSocket*, Net::AddressPort> m_peerAddrPortBySocket; // every accepted socket, authorized or not
+    QSet<quint16> m_usedPeerPorts;
+    quint16 m_nextPeerPort = 1;
+
+    QHash<QLocalSocket*, Net::TimerWheel::Handle> m_socketAuthMap; // unauthorized sockets and their authorization deadlines
+
+    QHash<QLocalSocket*, Net::FrameReader> m_frameReaderBySocket;
+    QTimer* m_partialFrameSweepTimer = nullptr;
+    static constexpr qint64 s_socketReadBufferSize = 64 * 1024; // same as TcpServer, keeps receive limits in charge of buffering
+    static constexpr int s_stalePeerProbeTimeout = 200; // ms; a live server on the same host accepts well within it
+
+public: // methods
+    void printConnectionInfo() const override;
+
+    QString getLastErrorString() const final { return m_pServer->errorString(); }
+    Net::ConnectionSettings getConnectionSettingsActive() const final; // localServerName is the full socket path while listening
+    inline uint getConnectionCount() const override { return m_clientMap.size(); }
+
+    bool getIsClientConnected(const Net::AddressPort addrPort) override { return m_clientByPeerAddressPort.contains(addrPort); }
+
+    Net::SendQueueStats getSendQueueStats(const Net::AddressPort addrPort) const; // must be called from <this>'s thread
+
+    void setSocketOptions(QLocalServer::SocketOptions options); // must be called before openConnection()
+
+protected:
+    qint64 sendMessageTo(QByteArray msg, ClientData* d, bool isEncoded = false);
+    qint64 sendEncodedMessageTo(QByteArray payload, Net::AddressPort addressPort) override;
+    void drainSendQueue(ClientData* d);
+    qint64 fanoutTo(Net::FanoutPayload& payload, ClientData* d, QList<QLocalSocket*>& toDisconnect);
+    void disconnectSlowRecipients(QList<QLocalSocket*> const& toDisconnect);
+    void setupClientSocket(QLocalSocket* pSocket);
+    void shedClient(QLocalSocket* pSocket, Net::ShedReason reason);
+    void armIdleDeadline(ClientData* d); // pushed back by every read of the client
+    quint16 takePeerPort(); // 0 if all of them are in use
+
+public slots:
+    Net::ConnectionState openConnection(Net::ConnectionSettings const& a_connectionSettings) override;
+    void closeConnection() override;
+    qint64 sendMessage(const QByteArray& msg) override;
+    qint64 sendMessageTo(QByteArray msg, QHostAddress address, quint16 port) override;
+    qint64 sendMessageTo(QByteArray msg, Net::AddressPort addressPort) override;
+    qint64 sendMessageTo(QByteArray msg, QHostAddress address) override; // localPeerAddress() is every client
+    qint64 sendMessageTo(QByteArray msg, QString loginUsername) override;
+    qint64 broadcastMessage(QByteArray msg) override;
+    qint64 multicastMessage(QByteArray msg, QVector<Net::AddressPort> recipients) override;
+
+    void removeAllowedAddress(QHostAddress addr) override;
+    void removeLoginData(Net::LoginData loginData) override;
+
+protected slots:
+    void readReceived() override;
+    void onNewConnection();
+    void onSocketDisconnected();
+    void onSocketBytesWritten();
+    void sweepPartialFrames();
+    void printError() const final;
+    void printSocketError() const;
+
+signals:
+    void readPartialDone(QByteArray msg, QDateTime dt = QDateTime::currentDateTimeUtc()) const;
+};
@@ -0,0 +1,209 @@
+#include "MemoryClient.hpp"
+
+#include <QtCore/QMetaMethod>
+
+using namespace Net;
+
+MemoryClient::MemoryClient(const quint8 _connType, const QString _connTypeName, QObject* parent)
+    : NetClient(_connType, _connTypeName, parent)
+{
+}
+
+MemoryClient::~MemoryClient()
+{
+    m_isReconnectEnabled = false;
+    MemoryClient::closeConnection();
+}
+
+Net::ConnectionState MemoryClient::openConnection(ConnectionSettings const& a_connectionSettings)
+{
+    if (m_connectionState == ConnectionState::Created)
+        return m_connectionState;
+    m_connectionSettings = a_connectionSettings;
+    if (m_connectionSettings.localServerName.isEmpty())
+    {
+        f_logError(QString("%1: Unable to open connection - no server name!").arg(nameId()));
+        m_connectionState = ConnectionState::NotCreated;
+        emit openedConnection(false);
+        return m_connectionState;
+    }
+    m_connectionState = ConnectionState::Created;
+    startConnecting();
+    return m_connectionState;
+}
+
+void MemoryClient::closeConnection()
+{
+    stopConnecting();
+    disconnectFromServer();
+    if (m_connectionState == ConnectionState::Created)
+        f_logGeneral(QString("%1: Closed connection").arg(nameId()));
+    m_connectionState = ConnectionState::NotCreated;
+    emit closedConnection();
+    return;
+}
+
+// Unlike socket connect, it's over by the time this returns: server's endpoint is either there or not
+void MemoryClient::startConnectAttempt()
+{
+    if (m_pServerEndpoint != nullptr)
+        disconnectFromServer();
+    m_pServerEndpoint = Net::MemoryEndpoint::find(m_connectionSettings.localServerName);
+    if (m_pServerEndpoint != nullptr)
+    {
+        // Own endpoint goes first, so that server's reply to Connect has somewhere to go
+        m_pEndpoint = std::make_shared<Net::MemoryEndpoint>(this, [this](Net::MemoryFrame& frame) { onFrame(frame); });
+        if (!m_pServerEndpoint->post(Net::MemoryFrame{Net::MemoryFrame::Kind::Connect, QByteArray{}, false, m_pEndpoint.get(), m_pEndpoint}))
+        {
+            m_pEndpoint->close();
+            m_pEndpoint.reset();
+            m_pServerEndpoint.reset(); // closed between find() and post()
+        }
+    }
+    if (m_pServerEndpoint == nullptr)
+    {
+        m_lastErrorString = QStringLiteral("server not found");
+        onConnectFailed();
+        return;
+    }
+
+    onConnectSucceeded();
+    setSocketState(QAbstractSocket::ConnectedState);
+    f_logGeneral(QString("%1: connected to memory server %2").arg(nameId()).arg(m_connectionSettings.localServerName));
+    emit openedConnection(true);
+    authorize();
+    offerCodecs();
+}
+
+void MemoryClient::disconnectFromServer()
+{
+    if (m_pServerEndpoint != nullptr)
+    {
+        m_pServerEndpoint->post(Net::MemoryFrame{Net::MemoryFrame::Kind::Disconnect, QByteArray{}, false, m_pEndpoint.get()});
+        m_pServerEndpoint.reset();
+    }
+    if (m_pEndpoint != nullptr)
+    {
+        m_pEndpoint->close(); // server may still hold it, but won't wake <this> through it anymore
+        m_pEndpoint.reset();
+    }
+    m_pCompression->clearPeers(); // next server may not support compression
+    setSocketState(QAbstractSocket::UnconnectedState);
+}
+
+void MemoryClient::setSocketState(QAbstractSocket::SocketState state)
+{
+    if (m_socketState == state)
+        return;
+    m_socketState = state;
+    emit socketStateChanged(state);
+}
+
+QString MemoryClient::describeServer() const
+{
+    return QString("memory server %1").arg(m_connectionSettings.localServerName);
+}
+
+// Hand the message to server and return the size it would have as a frame on a socket, or -1 in case of error
+qint64 MemoryClient::sendMessage(const QByteArray& msg)
+{
+    return postMessage(msg, false);
+}
+
+qint64 MemoryClient::sendEncodedMessage(const QByteArray& payload)
+{
+    return postMessage(payload, true);
+}
+
+qint64 MemoryClient::postMessage(const QByteArray& msg, bool isEncoded)
+{
+    if (m_pServerEndpoint == nullptr)
+        return -1;
+
+    static const QMetaMethod s_writeDoneSignal = QMetaMethod::fromSignal(&NetConnection::writeDone);
+    const qint64 frameSize = Net::SendQueue::s_headerSize + msg.size();
+    if (!m_pServerEndpoint->post(Net::MemoryFrame{Net::MemoryFrame::Kind::Data, msg, isEncoded, m_pEndpoint.get()}))
+    {
+        // Server closed without a word only if it was destroyed before its thread got to closeConnection()
+        onDisconnected();
+        return -1;
+    }
+    if (isSignalConnected(s_writeDoneSignal))
+        emit writeDone(msg);
+    return frameSize;
+}
+
+void MemoryClient::onFrame(Net::MemoryFrame& frame)
+{
+    static const QMetaMethod s_readDoneSignal = QMetaMethod::fromSignal(&NetConnection::readDone);
+    if (frame.kind == Net::MemoryFrame::Kind::Disconnect)
+    {
+        onDisconnected();
+        return;
+    }
+    if (frame.kind != Net::MemoryFrame::Kind::Data)
+        return;
+    if (isSignalConnected(s_readDoneSignal))
+        emit readDone(frame.msg);
+    const Net::AddressPort serverAddrPort{Net::memoryPeerAddress(), 0};
+    markReadStarted();
+    deliverReceivedMessage(frame.msg, serverAddrPort, frame.isEncoded);
+    flushReceivedBatch(serverAddrPort);
+}
+
+// Server dropped <this>, so it's not told back
+void MemoryClient::onDisconnected()
+{
+    if (m_pServerEndpoint == nullptr)
+        return;
+    f_logGeneral(QString("%1: disconnected from memory server %2").arg(nameId()).arg(m_connectionSettings.localServerName));
+    m_pServerEndpoint.reset();
+    disconnectFromServer();
+    onConnectionLost();
+}
+
+void MemoryClient::authorize()
+{
+    if (!m_isAuthorizationEnabled)
+        return;
+    QByteArray msg;
+    MAKE_QDATASTREAM_NET(stream, &msg, QIODevice::WriteOnly);
+    stream << m_loginData;
+    sendMessage(msg);
+}
+
+void MemoryClient::offerCodecs()
+{
+    const quint8 codecMask = m_pCompression->settings().codecMask;
+    if (codecMask == 0)
+        return;
+    sendEncodedMessage(Net::makeCodecOffer(codecMask));
+}
+
+void MemoryClient::printConnectionInfo() const
+{
+    if (m_connectionState != ConnectionState::Created)
+    {
+        f_logGeneral(QString("%1: connection is not created.").arg(nameId()));
+        return;
+    }
+    QString msg;
+    msg = QString("------------- Connection Info --------------\n"
+                  "Connection type: %1\n"
+                  "Connection ID: %2\n"
+                  "Object name: %3\n"
+                  "Server name: %4\n"
+                  "--------------------------------------------")
+          .arg(m_connectionTypeName)
+          .arg(m_connectionId)
+          .arg(objectName())
+          .arg(m_connectionSettings.localServerName);
+    f_logGeneral(msg);
+    return;
+}
+
+void MemoryClient::printError() const
+{
+    f_logError(QString("%1: errorOccured: %2").arg(nameId()).arg(m_lastErrorString));
+    return;
+}
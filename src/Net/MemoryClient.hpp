@@ -0,0 +1,58 @@
+#pragma once
+
+#include <memory>
+
+#include "MemoryEndpoint.hpp"
+#include "NetClient.hpp"
+
+// Client of MemoryServer in the same process, found by ConnectionSettings::localServerName; addresses and ports of settings are ignored.
+// Authorization, compression and reconnect policy are the same as in LocalClient. Messages are handed to server's endpoint whole and are never queued here,
+// so send queue stays empty and congestionChanged() is never emitted; what server's endpoint can't take at once waits in its overflow list
+class MemoryClient : public NetClient
+{
+    Q_OBJECT
+protected:
+    MemoryClient(const quint8 _connType, const QString _connTypeName, QObject* parent = nullptr);
+
+public:
+    MemoryClient(QObject* parent = nullptr) : MemoryClient(Net::ConnectionType::MemoryClient, "MemoryClient", parent) {}
+    ~MemoryClient();
+    MemoryClient(const MemoryClient&) = delete;            // Copy constructor
+    MemoryClient(MemoryClient&&) = delete;                 // Move constructor
+    MemoryClient& operator=(const MemoryClient&) = delete; // Copy assignment
+    MemoryClient& operator=(MemoryClient&&) = delete;      // Move assignment
+
+protected: // members
+    std::shared_ptr<Net::MemoryEndpoint> m_pEndpoint; // own, made anew for every connection so that frames of the lost one are dropped with it
+    std::shared_ptr<Net::MemoryEndpoint> m_pServerEndpoint; // while connected
+    QAbstractSocket::SocketState m_socketState = QAbstractSocket::UnconnectedState;
+    QString m_lastErrorString;
+
+public: // methods
+    virtual void printConnectionInfo() const override;
+
+    QAbstractSocket::SocketState getSocketState() const override { return m_socketState; }
+    QString getLastErrorString() const final { return m_lastErrorString; }
+    Net::SendQueueStats getSendQueueStats() const override { return {}; }
+
+protected:
+    void startConnectAttempt() override;
+    QString describeServer() const override;
+    qint64 postMessage(const QByteArray& msg, bool isEncoded);
+    qint64 sendEncodedMessage(const QByteArray& payload) override;
+    void onFrame(Net::MemoryFrame& frame);
+    void setSocketState(QAbstractSocket::SocketState state);
+    void disconnectFromServer(); // tells server unless it's the one which disconnected
+
+public slots:
+    virtual Net::ConnectionState openConnection(Net::ConnectionSettings const& a_connectionSettings) override;
+    virtual void closeConnection() override;
+    virtual qint64 sendMessage(const QByteArray& msg) override;
+
+protected slots:
+    virtual void readReceived() override {} // frames are pushed to onFrame() by the endpoint
+    void printError() const final;
+    void onDisconnected();
+    void authorize();
+    void offerCodecs(); // right after authorize(), so that server sees login data first
+};
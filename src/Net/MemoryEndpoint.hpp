@@ -0,0 +1,102 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QString>
+
+#include "MessageChannel.hpp"
+
+namespace Net
+{
+class MemoryEndpoint;
+
+// Unit of MemoryServer/MemoryClient traffic: a whole message, or a change of the link, so that both keep their order
+struct MemoryFrame
+{
+    enum class Kind : quint8
+    {
+        Data,
+        Connect, // client -> server, pReplyTo is where server's frames go
+        Disconnect
+    };
+    Kind kind = Kind::Data;
+    QByteArray msg;
+    bool isEncoded = false; // compressed, same as Net::g_encodedFrameFlag of a socket frame
+    MemoryEndpoint* pSender = nullptr; // client's own endpoint, identifies the client to server
+    std::shared_ptr<MemoryEndpoint> pReplyTo;
+};
+
+// Receiving side of an in-memory link: frames from any thread are handed to consumer's thread through MessageChannel.
+// Producers hold it by shared_ptr and may outlive consumer: once consumer has called close(), post() fails instead of waking a deleted object
+class MemoryEndpoint
+{
+public:
+    static constexpr int s_capacity = 1 << 16; // frames; beyond it they go to the channel's overflow list, producer never waits
+
+    MemoryEndpoint(QObject* pConsumer, std::function<void(MemoryFrame&)> f_onFrame)
+        : m_pChannel{std::make_shared<Net::MessageChannel<MemoryFrame>>(s_capacity)}
+    {
+        m_pChannel->setConsumer(pConsumer, std::move(f_onFrame));
+    }
+    MemoryEndpoint(const MemoryEndpoint&) = delete;
+    MemoryEndpoint& operator=(const MemoryEndpoint&) = delete;
+
+    bool post(MemoryFrame&& frame) // false if consumer is gone; never waits, since client and server post to each other's endpoints
+    {
+        QMutexLocker locker(&m_mutex); // consumer is only woken while it's not closed
+        if (m_isClosed)
+            return false;
+        m_pChannel->push(std::move(frame));
+        return true;
+    }
+
+    void close() // consumer's thread, before consumer is destroyed; frames still queued are dropped
+    {
+        QMutexLocker locker(&m_mutex);
+        m_isClosed = true;
+    }
+
+    // Servers listen by name (ConnectionSettings::localServerName), which is unique within the process
+    static bool listen(const QString& name, std::shared_ptr<MemoryEndpoint> pEndpoint)
+    {
+        QMutexLocker locker(&registryMutex());
+        if (registry().contains(name))
+            return false;
+        registry().insert(name, std::move(pEndpoint));
+        return true;
+    }
+    static void unlisten(const QString& name, const MemoryEndpoint* pEndpoint)
+    {
+        QMutexLocker locker(&registryMutex());
+        auto iter = registry().find(name);
+        if ((iter != registry().end()) && (iter.value().get() == pEndpoint))
+            registry().erase(iter);
+    }
+    static std::shared_ptr<MemoryEndpoint> find(const QString& name)
+    {
+        QMutexLocker locker(&registryMutex());
+        return registry().value(name);
+    }
+
+private:
+    static QHash<QString, std::shared_ptr<MemoryEndpoint>>& registry()
+    {
+        static QHash<QString, std::shared_ptr<MemoryEndpoint>> s_registry;
+        return s_registry;
+    }
+    static QMutex& registryMutex()
+    {
+        static QMutex s_mutex;
+        return s_mutex;
+    }
+
+    std::shared_ptr<Net::MessageChannel<MemoryFrame>> m_pChannel;
+    QMutex m_mutex;
+    bool m_isClosed = false;
+};
+} // namespace Net
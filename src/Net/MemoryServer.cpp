@@ -0,0 +1,365 @@
+#include "MemoryServer.hpp"
+
+#include <limits>
+
+#include <QtCore/QMetaMethod>
+
+using namespace Net;
+using namespace std;
+
+MemoryServer::MemoryServer(const quint8 _connType, const QString _connTypeName, QObject* parent)
+    : NetServer(_connType, _connTypeName, parent)
+{
+}
+
+MemoryServer::~MemoryServer()
+{
+    MemoryServer::closeConnection();
+}
+
+// Endpoint is made here rather than in constructor, since it wakes the thread <this> lives in by then
+Net::ConnectionState MemoryServer::openConnection(ConnectionSettings const& a_connectionSettings)
+{
+    if (m_connectionState == ConnectionState::Created)
+        return m_connectionState;
+    m_connectionSettings = a_connectionSettings;
+    auto pEndpoint = make_shared<Net::MemoryEndpoint>(this, [this](Net::MemoryFrame& frame) { onFrame(frame); });
+    if (m_connectionSettings.localServerName.isEmpty())
+        m_lastErrorString = QStringLiteral("no server name");
+    else if (!Net::MemoryEndpoint::listen(m_connectionSettings.localServerName, pEndpoint))
+        m_lastErrorString = QString("server name %1 is in use").arg(m_connectionSettings.localServerName);
+    else
+        m_lastErrorString.clear();
+    if (!m_lastErrorString.isEmpty())
+    {
+        pEndpoint->close();
+        m_connectionState = ConnectionState::NotCreated;
+        f_logError(QString("%1: Unable to open connection - %2").arg(nameId()).arg(m_lastErrorString));
+        emit openedConnection(false);
+        return m_connectionState;
+    }
+    m_pEndpoint = std::move(pEndpoint);
+    m_connectionState = ConnectionState::Created;
+    f_logGeneral(QString("%1: Opened connection").arg(nameId()));
+    printConnectionInfo();
+    emit openedConnection(true);
+    return m_connectionState;
+}
+
+void MemoryServer::closeConnection()
+{
+    if (m_pEndpoint != nullptr)
+    {
+        Net::MemoryEndpoint::unlisten(m_connectionSettings.localServerName, m_pEndpoint.get());
+        m_pEndpoint->close(); // frames still queued, and ones clients send from now on, are dropped
+        m_pEndpoint.reset();
+    }
+    if (m_connectionState == ConnectionState::Created)
+        f_logGeneral(QString("%1: Closed connection").arg(nameId()));
+    m_connectionState = ConnectionState::NotCreated;
+
+    const auto endpoints = m_clientMap.keys();
+    for (const Net::MemoryEndpoint* pEndpoint : endpoints)
+        dropClient(pEndpoint, QStringLiteral("server closed"));
+    emit closedConnection();
+}
+
+void MemoryServer::removeAllowedAddress(QHostAddress addr)
+{
+    m_allowedAddresses.remove(addr); // memory clients have no address to match
+}
+
+void MemoryServer::removeLoginData(Net::LoginData loginData)
+{
+    m_loginData.remove(loginData);
+    auto iter = m_clientsByLoginUsername.find(loginData.username);
+    if (iter != m_clientsByLoginUsername.end())
+        dropClient(iter.value()->pEndpoint, QStringLiteral("login data removed"));
+}
+
+quint16 MemoryServer::takePeerPort()
+{
+    if (m_usedPeerPorts.size() >= std::numeric_limits<quint16>::max())
+        return 0;
+    while ((m_nextPeerPort == 0) || m_usedPeerPorts.contains(m_nextPeerPort))
+        ++m_nextPeerPort;
+    m_usedPeerPorts.insert(m_nextPeerPort);
+    return m_nextPeerPort++;
+}
+
+void MemoryServer::onFrame(Net::MemoryFrame& frame)
+{
+    static const QMetaMethod s_readDoneSignal = QMetaMethod::fromSignal(&NetConnection::readDone);
+    switch (frame.kind)
+    {
+    case Net::MemoryFrame::Kind::Connect:
+        onClientConnected(frame);
+        return;
+    case Net::MemoryFrame::Kind::Disconnect:
+        dropClient(frame.pSender, QString{});
+        return;
+    case Net::MemoryFrame::Kind::Data:
+        break;
+    }
+
+    auto iterClient = m_clientMap.constFind(frame.pSender);
+    if (iterClient == m_clientMap.constEnd()) // sent before client learned it was dropped
+        return;
+    ClientData* d = iterClient.value().get();
+    if (isSignalConnected(s_readDoneSignal))
+        emit readDone(frame.msg);
+    if (!d->isAuthorized)
+    {
+        authorizeClient(d, frame.msg);
+        return;
+    }
+    if (m_idleTimeout > 0)
+        Net::TimerWheel::forCurrentThread()->reschedule(d->idleDeadline, m_idleTimeout);
+    // Every frame is a read of its own, as if each message came in a separate segment
+    markReadStarted();
+    deliverReceivedMessage(frame.msg, d->peerAddrPort, frame.isEncoded);
+    flushReceivedBatch(d->peerAddrPort);
+}
+
+void MemoryServer::onClientConnected(Net::MemoryFrame& frame)
+{
+    const quint16 peerPort = takePeerPort();
+    if (peerPort == 0)
+    {
+        f_logGeneral(QString("%1: rejected memory client - too many clients").arg(nameId()));
+        frame.pReplyTo->post(Net::MemoryFrame{Net::MemoryFrame::Kind::Disconnect});
+        return;
+    }
+    auto ptr = make_shared<ClientData>();
+    ClientData* d = ptr.get();
+    d->pEndpoint = frame.pSender;
+    d->pReplyTo = std::move(frame.pReplyTo);
+    d->peerAddrPort = Net::AddressPort{Net::memoryPeerAddress(), peerPort};
+    m_clientMap.insert(d->pEndpoint, ptr);
+
+    if (m_isAuthorizationEnabled)
+    {
+        const Net::MemoryEndpoint* pEndpoint = d->pEndpoint;
+        d->authDeadline = Net::TimerWheel::forCurrentThread()->schedule(m_authTimeoutTime, [this, pEndpoint]() {
+            dropClient(pEndpoint, QStringLiteral("authorization timed out"));
+        });
+    }
+    else
+    {
+        d->isAuthorized = true;
+        m_clientByPeerAddressPort.insert(d->peerAddrPort, d);
+        armIdleDeadline(d);
+    }
+    f_logGeneral(QString("%1: memory client %2 connected").arg(nameId()).arg(Net::toQString(d->peerAddrPort)));
+    emit clientConnected(d->peerAddrPort);
+}
+
+bool MemoryServer::authorizeClient(ClientData* d, QByteArray msg)
+{
+    MAKE_QDATASTREAM_NET(stream, &msg, QIODevice::ReadOnly);
+    Net::LoginData loginData;
+    stream >> loginData;
+    if (stream.status() != QDataStream::Ok)
+    {
+        dropClient(d->pEndpoint, QStringLiteral("corrupted data from unauthorized client"));
+        return false;
+    }
+    if (m_clientsByLoginUsername.contains(loginData.username))
+    {
+        dropClient(d->pEndpoint, QStringLiteral("login data of already authorized client"));
+        return false;
+    }
+    if (!m_loginData.contains(loginData))
+    {
+        dropClient(d->pEndpoint, QStringLiteral("invalid login data"));
+        return false;
+    }
+
+    Net::TimerWheel::forCurrentThread()->cancel(d->authDeadline);
+    d->loginData = loginData;
+    d->isAuthorized = true;
+    m_clientByPeerAddressPort.insert(d->peerAddrPort, d);
+    m_clientsByLoginUsername.insert(d->loginData.username, d);
+    armIdleDeadline(d);
+
+    emit clientAuthorized(d->loginData.username, d->peerAddrPort);
+    f_logGeneral(QString("%1: memory client %2 authorized as username=%3")
+                 .arg(nameId())
+                 .arg(Net::toQString(d->peerAddrPort))
+                 .arg(d->loginData.username));
+    return true;
+}
+
+// Client is told with a Disconnect frame unless it's the one which disconnected
+void MemoryServer::dropClient(const Net::MemoryEndpoint* pEndpoint, QString reason)
+{
+    auto iterClient = m_clientMap.find(pEndpoint);
+    if (iterClient == m_clientMap.end()) // already forgotten
+        return;
+    const std::shared_ptr<ClientData> ptr = iterClient.value();
+    m_clientMap.erase(iterClient);
+    ClientData& d = *ptr;
+    Net::TimerWheel::forCurrentThread()->cancel(d.authDeadline);
+    Net::TimerWheel::forCurrentThread()->cancel(d.idleDeadline);
+    m_usedPeerPorts.remove(d.peerAddrPort.port);
+    if (d.isAuthorized)
+    {
+        m_clientByPeerAddressPort.remove(d.peerAddrPort);
+        if (m_clientsByLoginUsername.value(d.loginData.username) == &d)
+            m_clientsByLoginUsername.remove(d.loginData.username);
+    }
+    if (!reason.isEmpty())
+        d.pReplyTo->post(Net::MemoryFrame{Net::MemoryFrame::Kind::Disconnect});
+
+    const QString username = (m_isAuthorizationEnabled && d.isAuthorized) ? QStringLiteral(" (username=%1)").arg(d.loginData.username) : QString{};
+    if (reason.isEmpty())
+        f_logGeneral(QString("%1: memory client %2%3 disconnected").arg(nameId()).arg(Net::toQString(d.peerAddrPort)).arg(username));
+    else
+        f_logGeneral(QString("%1: dropped memory client %2%3 - %4").arg(nameId()).arg(Net::toQString(d.peerAddrPort)).arg(username).arg(reason));
+    emit clientDisconnected(d.peerAddrPort); // clientConnected was emitted for unauthorized client as well
+}
+
+void MemoryServer::armIdleDeadline(ClientData* d)
+{
+    if (m_idleTimeout <= 0)
+        return;
+    const Net::MemoryEndpoint* pEndpoint = d->pEndpoint;
+    d->idleDeadline = Net::TimerWheel::forCurrentThread()->schedule(m_idleTimeout, [this, pEndpoint]() {
+        dropClient(pEndpoint, QString("idle for %1 msec").arg(m_idleTimeout));
+    });
+}
+
+qint64 MemoryServer::sendMessage(const QByteArray& msg)
+{
+    return broadcastMessage(msg);
+}
+
+qint64 MemoryServer::broadcastMessage(QByteArray msg)
+{
+    ++m_fanoutStats.messages;
+    Net::FanoutPayload payload(*m_pCompression, msg);
+    qint64 ret = 0;
+    for (auto clientIter = m_clientByPeerAddressPort.begin(); clientIter != m_clientByPeerAddressPort.end(); ++clientIter)
+        ret += fanoutTo(payload, clientIter.value());
+    return ret;
+}
+
+qint64 MemoryServer::multicastMessage(QByteArray msg, QVector<Net::AddressPort> recipients)
+{
+    ++m_fanoutStats.messages;
+    Net::FanoutPayload payload(*m_pCompression, msg);
+    qint64 ret = 0;
+    for (Net::AddressPort const& addrPort : qAsConst(recipients))
+    {
+        auto iter = m_clientByPeerAddressPort.constFind(addrPort);
+        if (iter != m_clientByPeerAddressPort.constEnd())
+            ret += fanoutTo(payload, iter.value());
+    }
+    return ret;
+}
+
+// Recipients are never congested, so SlowRecipientPolicy has nothing to decide
+qint64 MemoryServer::fanoutTo(Net::FanoutPayload& payload, ClientData* d)
+{
+    ++m_fanoutStats.deliveries;
+    bool isEncoded = false;
+    const QByteArray& msg = payload.payloadFor(d->peerAddrPort, isEncoded);
+    return qMax<qint64>(0, sendMessageTo(msg, d, isEncoded));
+}
+
+// No validity check for d since this method is protected and all its calls are guaranteed to be safe
+// Returns the size frame would have on a socket, so that callers can't tell this transport from others
+qint64 MemoryServer::sendMessageTo(QByteArray msg, ClientData* d, bool isEncoded)
+{
+    static const QMetaMethod s_writeDoneSignal = QMetaMethod::fromSignal(&NetConnection::writeDone);
+    const qint64 frameSize = Net::SendQueue::s_headerSize + msg.size();
+    if (!d->pReplyTo->post(Net::MemoryFrame{Net::MemoryFrame::Kind::Data, msg, isEncoded}))
+        return -1; // client is gone, its Disconnect frame is on the way
+    if (isSignalConnected(s_writeDoneSignal))
+        emit writeDone(msg);
+    return frameSize;
+}
+
+qint64 MemoryServer::sendMessageTo(QByteArray msg, QHostAddress address, quint16 port)
+{
+    return sendMessageTo(msg, Net::AddressPort{address, port});
+}
+
+qint64 MemoryServer::sendMessageTo(QByteArray msg, Net::AddressPort addressPort)
+{
+    auto iter = m_clientByPeerAddressPort.find(addressPort);
+    if (iter == m_clientByPeerAddressPort.end())
+    {
+        f_logError(QString("%1: can't send message to unconnected memory client %2.")
+                     .arg(nameId())
+                     .arg(Net::toQString(addressPort)));
+        return -1;
+    }
+    return sendMessageTo(msg, iter.value());
+}
+
+qint64 MemoryServer::sendEncodedMessageTo(QByteArray payload, Net::AddressPort addressPort)
+{
+    auto iter = m_clientByPeerAddressPort.find(addressPort);
+    if (iter == m_clientByPeerAddressPort.end())
+    {
+        f_logError(QString("%1: can't send message to unconnected memory client %2.")
+                     .arg(nameId())
+                     .arg(Net::toQString(addressPort)));
+        return -1;
+    }
+    return sendMessageTo(payload, iter.value(), true);
+}
+
+qint64 MemoryServer::sendMessageTo(QByteArray msg, QHostAddress address)
+{
+    if ((address != Net::memoryPeerAddress()) || m_clientByPeerAddressPort.isEmpty())
+    {
+        f_logError(QString("%1: can't send message to address %2 with no connections to it.")
+                     .arg(nameId())
+                     .arg(address.toString()));
+        return -1;
+    }
+    return sendMessage(msg);
+}
+
+qint64 MemoryServer::sendMessageTo(QByteArray msg, QString loginUsername)
+{
+    auto iter = m_clientsByLoginUsername.find(loginUsername);
+    if (iter == m_clientsByLoginUsername.end())
+    {
+        f_logError(QString("%1: can't send message to unauthorized client username=%2.")
+                     .arg(nameId())
+                     .arg(loginUsername));
+        return -1;
+    }
+    return sendMessageTo(msg, iter.value());
+}
+
+void MemoryServer::printConnectionInfo() const
+{
+    if (m_connectionState != ConnectionState::Created)
+    {
+        f_logGeneral(QString("%1: connection is not created.").arg(nameId()));
+        return;
+    }
+    QString msg;
+    msg = QString("------------- Connection Info --------------\n"
+                  "Connection type: %1\n"
+                  "Connection ID: %2\n"
+                  "Object name: %3\n"
+                  "Server name: %4\n"
+                  "--------------------------------------------")
+          .arg(m_connectionTypeName)
+          .arg(m_connectionId)
+          .arg(objectName())
+          .arg(m_connectionSettings.localServerName);
+    f_logGeneral(msg);
+    return;
+}
+
+void MemoryServer::printError() const
+{
+    f_logError(QString("%1: errorOccured: %2").arg(nameId()).arg(m_lastErrorString));
+    return;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <memory>
+
+#include "MemoryEndpoint.hpp"
+#include "NetServer.hpp"
+
+// NetServer for MemoryClients of the same process: whole messages are handed over through Net::MemoryEndpoint instead of a socket,
+// so there is no framing, no syscalls and no copy of payload, and what's left to measure is everything above transport (decoding, caching, scheduling, encoding).
+// Listens on ConnectionSettings::localServerName within the process. Authorization, compression, idle timeout and batch delivery are the same as in LocalServer;
+// sends never get congested and receive limits don't apply, since nothing is buffered besides the endpoint's channel.
+// Each client is known as AddressPort{Net::memoryPeerAddress(), n}
+class MemoryServer : public NetServer
+{
+    Q_OBJECT
+public:
+    struct ClientData
+    {
+        const Net::MemoryEndpoint* pEndpoint = nullptr; // client's own, only used as its key
+        std::shared_ptr<Net::MemoryEndpoint> pReplyTo;
+        Net::AddressPort peerAddrPort;
+        Net::LoginData loginData;
+        bool isAuthorized = false;
+        Net::TimerWheel::Handle authDeadline;
+        Net::TimerWheel::Handle idleDeadline;
+    };
+
+protected:
+    MemoryServer(const quint8 _connType, const QString _connTypeName, QObject* parent = nullptr);
+
+public:
+    MemoryServer(QObject* parent = nullptr) : MemoryServer(Net::ConnectionType::MemoryServer, "MemoryServer", parent) {}
+    virtual ~MemoryServer();
+    MemoryServer(const MemoryServer&) = delete;            // Copy constructor
+    MemoryServer(MemoryServer&&) = delete;                 // Move constructor
+    MemoryServer& operator=(const MemoryServer&) = delete; // Copy assignment
+    MemoryServer& operator=(MemoryServer&&) = delete;      // Move assignment
+
+protected: // members
+    std::shared_ptr<Net::MemoryEndpoint> m_pEndpoint; // while listening
+    QHash<const Net::MemoryEndpoint*, std::shared_ptr<ClientData>> m_clientMap; // every connected client, authorized or not
+    QHash<Net::AddressPort, ClientData*> m_clientByPeerAddressPort; // authorized clients
+    QHash<QString, ClientData*> m_clientsByLoginUsername;
+    QSet<quint16> m_usedPeerPorts;
+    quint16 m_nextPeerPort = 1;
+    QString m_lastErrorString; // there is no device to ask
+
+public: // methods
+    void printConnectionInfo() const override;
+
+    QString getLastErrorString() const final { return m_lastErrorString; }
+    inline uint getConnectionCount() const override { return m_clientByPeerAddressPort.size(); }
+
+    bool getIsClientConnected(const Net::AddressPort addrPort) override { return m_clientByPeerAddressPort.contains(addrPort); }
+
+protected:
+    qint64 sendMessageTo(QByteArray msg, ClientData* d, bool isEncoded = false);
+    qint64 sendEncodedMessageTo(QByteArray payload, Net::AddressPort addressPort) override;
+    qint64 fanoutTo(Net::FanoutPayload& payload, ClientData* d);
+    void onFrame(Net::MemoryFrame& frame);
+    void onClientConnected(Net::MemoryFrame& frame);
+    bool authorizeClient(ClientData* d, QByteArray msg); // false if client was dropped
+    void dropClient(const Net::MemoryEndpoint* pEndpoint, QString reason); // reason is empty if client disconnected by itself
+    void armIdleDeadline(ClientData* d); // pushed back by every message of the client
+    quint16 takePeerPort(); // 0 if all of them are in use
+
+public slots:
+    Net::ConnectionState openConnection(Net::ConnectionSettings const& a_connectionSettings) override;
+    void closeConnection() override;
+    qint64 sendMessage(const QByteArray& msg) override;
+    qint64 sendMessageTo(QByteArray msg, QHostAddress address, quint16 port) override;
+    qint64 sendMessageTo(QByteArray msg, Net::AddressPort addressPort) override;
+    qint64 sendMessageTo(QByteArray msg, QHostAddress address) override; // memoryPeerAddress() is every client
+    qint64 sendMessageTo(QByteArray msg, QString loginUsername) override;
+    qint64 broadcastMessage(QByteArray msg) override;
+    qint64 multicastMessage(QByteArray msg, QVector<Net::AddressPort> recipients) override;
+
+    void removeAllowedAddress(QHostAddress addr) override;
+    void removeLoginData(Net::LoginData loginData) override;
+
+protected slots:
+    void readReceived() override {} // frames are pushed to onFrame() by the endpoint
+    void printError() const final;
+};
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QObject>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+
+#include "ReceiveBudget.hpp"
+
+namespace Net
+{
+// Lock-free queue handing items from any number of producer threads to one consumer QObject's thread (MPSC, SPSC being its special case).
+// Consumer is woken by one queued event per batch rather than per item: producer posts the event only if none is pending, and consumer drains everything it finds.
+// Ring is Vyukov's bounded MPMC queue with the dequeue side simplified for single consumer.
+// push() never waits: when the ring is full, items go to an overflow list instead. Producer and consumer are often each other's counterpart
+// on another channel (network thread -> callback thread -> send channel of the same network thread), so waiting for consumer could wait forever.
+// The list itself has no bound; channels of received data charge it to server's ReceiveBudget (setOverflowBudget()), so that readers shed connections once it's too big
+template<typename T>
+class MessageChannel : public std::enable_shared_from_this<MessageChannel<T>>
+{
+public:
+    static constexpr int s_defaultCapacity = 4096;
+
+    explicit MessageChannel(int capacity = s_defaultCapacity)
+    {
+        size_t cellCount = 2;
+        while (cellCount < static_cast<size_t>(capacity))
+            cellCount <<= 1;
+        m_mask = cellCount - 1;
+        m_cells.reset(new Cell[cellCount]);
+        for (size_t i = 0; i < cellCount; ++i)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    MessageChannel(const MessageChannel&) = delete;
+    MessageChannel& operator=(const MessageChannel&) = delete;
+
+    // Must be called before the first push(). f_onItem is called in pContext's thread for every item; items queued when pContext is destroyed are dropped
+    void setConsumer(QObject* pContext, std::function<void(T&)> f_onItem)
+    {
+        m_pContext = pContext;
+        f_onConsumeItem = std::move(f_onItem);
+    }
+
+    // Must be called before the first push(), or while nobody pushes. Bytes of overflowed items (f_sizeOf) stay reserved from pBudget until consumer takes them,
+    // beyond its limits if need be: push() can't fail, it's the next FrameReader::readFrame() which sheds. nullptr - overflow isn't charged
+    void setOverflowBudget(std::shared_ptr<ReceiveBudget> pBudget, std::function<qint64(const T&)> f_sizeOf)
+    {
+        QMutexLocker locker(&m_overflowMutex);
+        if (m_overflowBytes > 0) // list of the previous connection, not taken yet
+        {
+            m_pOverflowBudget->release(m_overflowBytes);
+            if (pBudget != nullptr)
+                pBudget->reserve(m_overflowBytes);
+            else
+                m_overflowBytes = 0;
+        }
+        m_pOverflowBudget = std::move(pBudget);
+        f_sizeOfItem = std::move(f_sizeOf);
+    }
+
+    bool tryPush(T&& item)
+    {
+        Cell* pCell = nullptr;
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            pCell = &m_cells[pos & m_mask];
+            const size_t sequence = pCell->sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0) // full
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        pCell->item = std::move(item);
+        pCell->sequence.store(pos + 1, std::memory_order_release);
+        wakeConsumer();
+        return true;
+    }
+
+    // Never fails nor waits. Once an item has gone to overflow list, later ones follow it there until consumer has taken the list, so that each producer's order is kept
+    void push(T&& item)
+    {
+        if (!m_isOverflowing.load(std::memory_order_acquire) && tryPush(std::move(item)))
+            return;
+        const qint64 byteCount = (m_pOverflowBudget != nullptr) ? f_sizeOfItem(item) : 0;
+        if (byteCount > 0)
+            m_pOverflowBudget->reserve(byteCount);
+        {
+            QMutexLocker locker(&m_overflowMutex);
+            m_overflowBytes += byteCount;
+            m_overflow.push_back(std::move(item));
+            m_isOverflowing.store(true, std::memory_order_release);
+            ++m_overflowedCount;
+        }
+        wakeConsumer();
+    }
+
+    bool tryPop(T& item) // consumer's thread only
+    {
+        const size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        Cell& cell = m_cells[pos & m_mask];
+        const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1) < 0) // empty
+            return false;
+        m_dequeuePos.store(pos + 1, std::memory_order_relaxed);
+        item = std::move(cell.item);
+        cell.item = T{}; // moved-from Qt containers may still hold data
+        cell.sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Pops at most one ring's worth, so that a busy producer can't keep consumer's event loop from other events; wakes itself again if anything is left.
+    // Overflow, if any, is taken whole along with the ring
+    void drain()
+    {
+        m_isWakePending.store(false, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst); // items pushed before producer saw the flag set are visible below
+        if (m_isOverflowing.load(std::memory_order_acquire))
+        {
+            drainOverflow();
+            return;
+        }
+        T item;
+        for (size_t i = 0; i <= m_mask; ++i)
+        {
+            if (!tryPop(item))
+                return;
+            ++m_consumedCount;
+            f_onConsumeItem(item);
+        }
+        wakeConsumer();
+    }
+
+    quint64 wakeCount() const { return m_wakeCount.load(std::memory_order_relaxed); } // batches, thread-safe
+    quint64 consumedCount() const { return m_consumedCount; } // consumer's thread only
+    quint64 overflowedCount() const { return m_overflowedCount.load(std::memory_order_relaxed); } // items which found the ring full, thread-safe
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T item;
+    };
+
+    // Ring is emptied under the lock before the list is taken, since producer's items in the ring precede its items in the list.
+    // Items are consumed after the lock is released, so that consumer may push to its own channel
+    void drainOverflow()
+    {
+        std::vector<T> items;
+        {
+            QMutexLocker locker(&m_overflowMutex);
+            items.reserve(m_mask + 1 + m_overflow.size());
+            T item;
+            while (tryPop(item))
+                items.push_back(std::move(item));
+            for (T& overflowItem : m_overflow)
+                items.push_back(std::move(overflowItem));
+            m_overflow.clear();
+            m_isOverflowing.store(false, std::memory_order_release);
+            if (m_overflowBytes > 0)
+                m_pOverflowBudget->release(m_overflowBytes); // it's consumer's memory from now on, same as a frame FrameReader hands out
+            m_overflowBytes = 0;
+        }
+        for (T& item : items)
+        {
+            ++m_consumedCount;
+            f_onConsumeItem(item);
+        }
+    }
+
+    void wakeConsumer()
+    {
+        if (m_isWakePending.exchange(true, std::memory_order_seq_cst))
+            return;
+        m_wakeCount.fetch_add(1, std::memory_order_relaxed);
+        // Event holds the channel, so it can't be destroyed under pending wake. Qt drops the event itself if context is gone
+        // NOTE: for QT version below 5.10, QTimer::singleShot is used, and that will not work if source thread (from which <this> called) doesn't have working QEventLoop
+        // See - https://bugreports.qt.io/browse/QTBUG-66458
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 10, 0))
+        QMetaObject::invokeMethod(m_pContext, [pChannel = this->shared_from_this()]() { pChannel->drain(); }, Qt::QueuedConnection);
+#else
+        QTimer::singleShot(0, m_pContext, [pChannel = this->shared_from_this()]() { pChannel->drain(); });
+#endif
+    }
+
+    std::unique_ptr<Cell[]> m_cells;
+    size_t m_mask = 0;
+    alignas(64) std::atomic<size_t> m_enqueuePos{0};
+    alignas(64) std::atomic<size_t> m_dequeuePos{0};
+    alignas(64) std::atomic<bool> m_isWakePending{false};
+    std::atomic<quint64> m_wakeCount{0};
+    quint64 m_consumedCount = 0;
+
+    QMutex m_overflowMutex;
+    std::vector<T> m_overflow;
+    std::atomic<bool> m_isOverflowing{false};
+    std::atomic<quint64> m_overflowedCount{0};
+    qint64 m_overflowBytes = 0; // reserved from m_pOverflowBudget, guarded by m_overflowMutex
+    std::shared_ptr<ReceiveBudget> m_pOverflowBudget;
+    std::function<qint64(const T&)> f_sizeOfItem;
+
+    QObject* m_pContext = nullptr;
+    std::function<void(T&)> f_onConsumeItem;
+};
+} // namespace Net
@@ -0,0 +1,178 @@
+#include "NetClient.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <QtCore/QRandomGenerator>
+
+using namespace Net;
+
+NetClient::NetClient(const quint8 _connType, const QString _connTypeName, QObject* parent)
+    : NetConnection(_connType, _connTypeName, parent)
+{
+    m_reconnectTimer = new QTimer(this);
+    m_reconnectTimer->setSingleShot(true);
+    connect(m_reconnectTimer, &QTimer::timeout, this, &NetClient::tryConnectToServer, Qt::QueuedConnection);
+    m_connectTimeoutTimer = new QTimer(this);
+    m_connectTimeoutTimer->setSingleShot(true);
+    connect(m_connectTimeoutTimer, &QTimer::timeout, this, &NetClient::onConnectTimeout);
+}
+
+void NetClient::setWaitTimes(int reconnectInterval, int waitForConnectedInterval)
+{
+    Net::ReconnectPolicy policy = m_reconnectPolicy;
+    policy.maxDelay = reconnectInterval;
+    policy.connectTimeout = waitForConnectedInterval;
+    setReconnectPolicy(policy);
+}
+
+void NetClient::setReconnectPolicy(Net::ReconnectPolicy policy)
+{
+    if (m_connectionState == Net::ConnectionState::Created)
+    {
+        f_logGeneral(QString("%1: called setReconnectPolicy() while connection is open - action forbidden").arg(nameId()));
+        return;
+    }
+    m_reconnectPolicy = policy;
+}
+
+void NetClient::setLoginData(Net::LoginData a_loginData)
+{
+    if (m_connectionState == Net::ConnectionState::Created)
+    {
+        f_logGeneral(QString("%1: called setLoginData() while connection is open - action forbidden").arg(nameId()));
+        return;
+    }
+    m_loginData = a_loginData;
+}
+
+void NetClient::setSendWatermarks(Net::SendWatermarks watermarks)
+{
+    if (m_connectionState == Net::ConnectionState::Created)
+    {
+        f_logGeneral(QString("%1: called setSendWatermarks() while connection is open - action forbidden").arg(nameId()));
+        return;
+    }
+    m_sendWatermarks = watermarks;
+}
+
+void NetClient::setAuthorizationEnabled(bool isEnabled)
+{
+    if (m_connectionState == Net::ConnectionState::Created)
+    {
+        f_logGeneral(QString("%1: called setAuthorizationEnabled() while connection is open - action forbidden").arg(nameId()));
+        return;
+    }
+    m_isAuthorizationEnabled = isEnabled;
+}
+
+void NetClient::setEnableReconnect(bool isEnabled)
+{
+    m_isReconnectEnabled = isEnabled;
+    QTimer::singleShot(0, this, [this](){
+        if (m_isReconnectEnabled == false)
+            m_reconnectTimer->stop();
+        else if ((getSocketState() != QAbstractSocket::ConnectedState) && (m_reconnectTimer->isActive() == false))
+            scheduleReconnect();
+    });
+    return;
+}
+
+void NetClient::startConnecting()
+{
+    m_isConnectRequested = true;
+    m_reconnectAttempt = 0;
+    m_outageTimer.invalidate();
+    tryConnectToServer();
+}
+
+void NetClient::stopConnecting()
+{
+    m_isConnectRequested = false; // nothing after this may schedule a reconnect
+    m_isConnecting = false;
+    m_reconnectTimer->stop();
+    m_connectTimeoutTimer->stop();
+}
+
+// Starts an attempt and returns, possibly before it's over
+void NetClient::tryConnectToServer()
+{
+    if (m_isConnectRequested == false)
+        return;
+    m_reconnectTimer->stop();
+    m_isConnecting = true;
+    ++m_reconnectStats.attemptCount;
+    m_connectTimeoutTimer->start(m_reconnectPolicy.connectTimeout);
+    startConnectAttempt();
+}
+
+void NetClient::onConnectSucceeded()
+{
+    m_isConnecting = false;
+    m_connectTimeoutTimer->stop();
+    m_reconnectAttempt = 0;
+    ++m_reconnectStats.connectCount;
+    if (m_outageTimer.isValid())
+    {
+        const qint64 latency = m_outageTimer.elapsed();
+        m_outageTimer.invalidate();
+        ++m_reconnectStats.reconnectCount;
+        m_reconnectStats.lastReconnectLatency = latency;
+        m_reconnectStats.maxReconnectLatency = std::max(m_reconnectStats.maxReconnectLatency, latency);
+        m_reconnectStats.totalReconnectLatency += latency;
+    }
+}
+
+void NetClient::onConnectFailed(QString reason)
+{
+    if (m_isConnecting == false)
+        return;
+    m_isConnecting = false;
+    m_connectTimeoutTimer->stop();
+    if (m_reconnectAttempt == 0)
+    {
+        f_logGeneral(QString("%1: Failed to connect to %2 - %3, retrying")
+                     .arg(nameId())
+                     .arg(describeServer())
+                     .arg(reason.isEmpty() ? getLastErrorString() : reason));
+    }
+    abortConnectAttempt();
+    if (m_outageTimer.isValid() == false)
+        m_outageTimer.start();
+    emit openedConnection(false);
+    scheduleReconnect();
+}
+
+void NetClient::onConnectTimeout()
+{
+    onConnectFailed(QStringLiteral("timed out")); // attempt is aborted there
+}
+
+void NetClient::onSocketError()
+{
+    if (m_isConnecting)
+        onConnectFailed(); // missing, refusing or unreachable server is reported there, once per outage
+    else if (m_isConnectRequested)
+        printError();
+}
+
+void NetClient::onConnectionLost()
+{
+    if (m_isConnectRequested == false)
+        return;
+    m_outageTimer.start();
+    m_reconnectAttempt = 0; // first retry comes quickly, server may have only dropped this one connection
+    scheduleReconnect();
+}
+
+void NetClient::scheduleReconnect()
+{
+    if ((m_isReconnectEnabled == false) || (m_isConnectRequested == false) || m_isConnecting || (getSocketState() == QAbstractSocket::ConnectedState))
+        return;
+    const Net::ReconnectPolicy& policy = m_reconnectPolicy;
+    double delay = std::min(policy.initialDelay * std::pow(policy.multiplier, m_reconnectAttempt), static_cast<double>(policy.maxDelay));
+    if (delay < policy.maxDelay)
+        ++m_reconnectAttempt; // no point growing it past the cap
+    delay *= 1.0 - std::clamp(policy.jitter, 0.0, 1.0) * QRandomGenerator::global()->generateDouble();
+    m_reconnectTimer->start(static_cast<int>(delay));
+}
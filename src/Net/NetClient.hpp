@@ -0,0 +1,95 @@
+#pragma once
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QTimer>
+#include <QtNetwork/QAbstractSocket>
+
+#include "NetConnection.hpp"
+#include "SendQueue.hpp"
+
+namespace Net
+{
+// Connect attempts never block the thread. Failed attempt is retried after initialDelay * multiplier^n, capped by maxDelay,
+// and then reduced by up to jitter fraction at random, so that a fleet of clients doesn't hit a restarted server all at once
+struct ReconnectPolicy
+{
+    int initialDelay = 50; // msec
+    int maxDelay = 1000; // msec, also the longest a client stays away from a server which is back up
+    double multiplier = 2.0;
+    double jitter = 0.5; // 0..1
+    int connectTimeout = 3000; // msec for one attempt
+};
+
+struct ReconnectStats
+{
+    quint64 attemptCount = 0;
+    quint64 connectCount = 0;
+    quint64 reconnectCount = 0; // connections restored after a loss or failed attempts, latencies below are for these
+    qint64 lastReconnectLatency = -1; // msec from losing connection (or first failed attempt) to being connected again
+    qint64 maxReconnectLatency = 0;
+    qint64 totalReconnectLatency = 0;
+};
+} // namespace Net
+
+// Common interface of client transports (TcpClient over TCP, LocalClient over local socket, MemoryClient within the process), so that users can switch between them by setting.
+// Holds reconnect, authorization and send settings, and runs reconnects: transports only start a connect attempt and report how it ended
+class NetClient : public NetConnection
+{
+    Q_OBJECT
+protected:
+    NetClient(const quint8 _connType, const QString _connTypeName, QObject* parent = nullptr);
+
+public:
+    virtual ~NetClient() = default;
+
+protected: // members
+    Net::SendWatermarks m_sendWatermarks;
+
+    bool m_isReconnectEnabled = true;
+    Net::ReconnectPolicy m_reconnectPolicy;
+    Net::ReconnectStats m_reconnectStats;
+    QTimer* m_reconnectTimer = nullptr;
+    QTimer* m_connectTimeoutTimer = nullptr;
+    bool m_isConnectRequested = false; // between openConnection() and closeConnection()
+    bool m_isConnecting = false; // attempt in progress
+    int m_reconnectAttempt = 0; // failed attempts since last connection, drives backoff
+    QElapsedTimer m_outageTimer; // valid while connection is lost
+
+    Net::LoginData m_loginData;
+    bool m_isAuthorizationEnabled = false;
+
+public: // methods
+    virtual QAbstractSocket::SocketState getSocketState() const = 0; // states of QLocalSocket have the same values as their QAbstractSocket counterparts
+    virtual Net::SendQueueStats getSendQueueStats() const = 0; // must be called from <this>'s thread
+
+    void setEnableReconnect(bool isEnabled);
+    void setWaitTimes(int reconnectInterval, int waitForConnectedInterval); // sets maxDelay and connectTimeout of reconnect policy
+    void setReconnectPolicy(Net::ReconnectPolicy policy); // must be called before openConnection()
+    Net::ReconnectPolicy getReconnectPolicy() const { return m_reconnectPolicy; }
+    Net::ReconnectStats getReconnectStats() const { return m_reconnectStats; } // must be called from <this>'s thread
+    void setLoginData(Net::LoginData a_loginData);
+    void setAuthorizationEnabled(bool isEnabled);
+    void setSendWatermarks(Net::SendWatermarks watermarks);
+    Net::SendWatermarks getSendWatermarks() const { return m_sendWatermarks; }
+
+protected:
+    // Transport's part of reconnects. Attempt ends in onConnectSucceeded() or onConnectFailed(), right away or later
+    virtual void startConnectAttempt() = 0;
+    virtual void abortConnectAttempt() {} // after timeout or failure, so that next attempt starts clean
+    virtual QString describeServer() const = 0; // for logs, e.g. "TCP server 127.0.0.1:5000"
+
+    void startConnecting(); // from openConnection()
+    void stopConnecting(); // from closeConnection(), before anything which may schedule a reconnect
+    void onConnectSucceeded(); // before connection is announced
+    void onConnectFailed(QString reason = QString{}); // reason defaults to getLastErrorString()
+    void onConnectionLost(); // from transport's disconnect handler, retries unless closeConnection() was called
+
+protected slots:
+    void tryConnectToServer();
+    void onConnectTimeout();
+    void onSocketError();
+    void scheduleReconnect();
+
+signals:
+    void congestionChanged(bool isCongested, qint64 pendingBytes); // see Net::SendWatermarks
+};
@@ -12,6 +12,7 @@ NetConnection::NetConnection(const quint8 _connType, const QString _connTypeName
     qRegisterMetaType<QAbstractSocket::SocketError>("QAbstractSocket::SocketError");
     qRegisterMetaType<Net::ConnectionState>("Net::ConnectionState");
     qRegisterMetaType<Net::AddressPort>("Net::AddressPort");
+    qRegisterMetaType<QVector<Net::AddressPort>>("QVector<Net::AddressPort>");
     qRegisterMetaType<Net::ConnectionSettings>("Net::ConnectionSettings");
     qRegisterMetaType<Net::LoginData>("Net::LoginData");
 
@@ -27,13 +28,35 @@ NetConnection::NetConnection(const quint8 _connType, const QString _connTypeName
     connect(this, qOverload<Net::ConnectionSettings const&>(&NetConnection::reopenConnectionQueued),
             this, qOverload<Net::ConnectionSettings const&>(&NetConnection::reopenConnection), Qt::QueuedConnection);
     connect(this, &NetConnection::closeConnectionQueued, this, &NetConnection::closeConnection, Qt::QueuedConnection);
-    connect(this, &NetConnection::sendMessageQueued, this, &NetConnection::sendMessage, Qt::QueuedConnection);
+    // DirectConnection - message is compressed in emitter's thread and handed over through m_pSendChannel, which wakes <this> once per batch.
+    // Servers never negotiate a codec for solePeer(), so their broadcasts go as is
+    m_pCompression = std::make_shared<Net::CompressionContext>();
+    m_pSendChannel = std::make_shared<Net::MessageChannel<Net::OutgoingMessage>>();
+    m_pSendChannel->setConsumer(this, [this](Net::OutgoingMessage& outgoing) {
+        if (outgoing.isEncoded)
+            sendEncodedMessage(outgoing.msg);
+        else
+            sendMessage(outgoing.msg);
+    });
+    connect(this, &NetConnection::sendMessageQueued, this, [pChannel = m_pSendChannel, pCompression = m_pCompression](const QByteArray& msg) {
+        Net::OutgoingMessage outgoing{msg};
+        outgoing.isEncoded = pCompression->encode(outgoing.msg, Net::CompressionContext::solePeer());
+        pChannel->push(std::move(outgoing));
+    }, Qt::DirectConnection);
 
     //f_logGeneral(QString("NetConnection: %1 constructed").arg(m_connectionTypeName));
 }
 
+Net::ReceiveTiming& NetConnection::receiveTiming()
+{
+    thread_local Net::ReceiveTiming t_receiveTiming;
+    return t_receiveTiming;
+}
+
 NetConnection::~NetConnection()
 {
+    if (m_pCallbackExecutor != nullptr)
+        m_pCallbackExecutor->releaseContext(m_pCallbackExecutorContext);
     delete m_pCallbackThreadContextHelper;
     //f_logGeneral(QString("NetConnection: %1 %2 destroyed").arg(m_connectionTypeName).arg(QString::number(m_connectionId));
 }
@@ -83,25 +106,143 @@ void NetConnection::setCallbackFunction(std::function<void(QByteArray, NetConnec
         return;
     }
 
-    if (m_pCallbackThread == nullptr)
+    f_onReceivedBatch = {};
+    f_onReceivedEncodedBatch = {};
+    m_pBatchCallbackChannel.reset();
+    if (getIsCallbackDistinctThread() == false)
     {
+        m_pCallbackChannel.reset();
         f_onReceivedMessage = a_onReceivedMessage;
+        // Nowhere else to decode but network thread
+        f_onReceivedEncodedMessage = [a_onReceivedMessage, pCompression = m_pCompression](QByteArray msg, NetConnection* const netConnection, Net::AddressPort addressPort) {
+            if (pCompression->decode(msg))
+                a_onReceivedMessage(msg, netConnection, addressPort);
+        };
     }
     else
     {
-        // NOTE: for QT version below 5.10, QTimer::singleShot is used, and that will not work if source thread (from which <this> called) doesn't have working QEventLoop
-        // See - https://stackoverflow.com/questions/21646467/how-to-execute-a-functor-or-a-lambda-in-a-given-thread-in-qt-gcd-style
-        // and for bug specifically - https://bugreports.qt.io/browse/QTBUG-66458
-#if (QT_VERSION >= QT_VERSION_CHECK(5, 10, 0))
-        auto f_callback = [ctx = m_pCallbackThreadContextHelper, a_onReceivedMessage](QByteArray msg, NetConnection* const netConnection, Net::AddressPort addressPort){
-            QMetaObject::invokeMethod(ctx, [a_onReceivedMessage, msg, netConnection, addressPort](){ a_onReceivedMessage(msg, netConnection, addressPort); }, Qt::QueuedConnection);
+        setCallbackFunction(a_onReceivedMessage, getCallbackThreadContext());
+    }
+}
+
+void NetConnection::setCallbackFunction(std::function<void(QByteArray, NetConnection* const, Net::AddressPort)> a_onReceivedMessage, QObject* pCallbackContext)
+{
+    if (m_connectionState == Net::ConnectionState::Created)
+    {
+        f_logGeneral(QString("%1: called setCallbackFunction() while connection is open - action forbidden").arg(nameId()));
+        return;
+    }
+
+    f_onReceivedBatch = {};
+    f_onReceivedEncodedBatch = {};
+    m_pBatchCallbackChannel.reset();
+    // Channel of the previous callback is left to its pending wake, if any
+    Net::CallbackExecutor* pExecutor = (pCallbackContext == m_pCallbackExecutorContext) ? m_pCallbackExecutor : nullptr;
+    m_pCallbackChannel = std::make_shared<Net::MessageChannel<Net::ReceivedMessage>>();
+    setCallbackBudget(m_pCallbackBudget);
+    // Compressed messages are decoded here, in callback's thread
+    m_pCallbackChannel->setConsumer(pCallbackContext, [a_onReceivedMessage, pExecutor, pCompression = m_pCompression](Net::ReceivedMessage& received) {
+        if (pExecutor != nullptr)
+            pExecutor->noteDispatched(received.enqueuedAtNs);
+        if (received.isEncoded && !pCompression->decode(received.msg))
+            return;
+        a_onReceivedMessage(received.msg, received.pConnection, received.addrPort);
+    });
+    auto lambda_makePush = [pChannel = m_pCallbackChannel, pExecutor](bool isEncoded) {
+        return [pChannel, pExecutor, isEncoded](QByteArray msg, NetConnection* const netConnection, Net::AddressPort addressPort) {
+            qint64 enqueuedAtNs = 0;
+            if (pExecutor != nullptr)
+            {
+                pExecutor->noteEnqueued();
+                enqueuedAtNs = Net::CallbackExecutor::nowNs();
+            }
+            pChannel->push(Net::ReceivedMessage{msg, netConnection, addressPort, enqueuedAtNs, isEncoded});
         };
-#else
-        auto f_callback = [ctx = m_pCallbackThreadContextHelper, a_onReceivedMessage](QByteArray msg, NetConnection* const netConnection, Net::AddressPort addressPort){
-            QTimer::singleShot(0, ctx, [a_onReceivedMessage, msg, netConnection, addressPort](){ a_onReceivedMessage(msg, netConnection, addressPort); });
+    };
+    f_onReceivedMessage = lambda_makePush(false);
+    f_onReceivedEncodedMessage = lambda_makePush(true);
+}
+
+void NetConnection::setBatchCallbackFunction(std::function<void(QVector<QByteArray>, NetConnection* const, Net::AddressPort)> a_onReceivedBatch)
+{
+    if (m_connectionState == Net::ConnectionState::Created)
+    {
+        f_logGeneral(QString("%1: called setBatchCallbackFunction() while connection is open - action forbidden").arg(nameId()));
+        return;
+    }
+
+    if (getIsCallbackDistinctThread() == false)
+    {
+        m_pCallbackChannel.reset();
+        m_pBatchCallbackChannel.reset();
+        f_onReceivedMessage = {};
+        f_onReceivedEncodedMessage = {};
+        f_onReceivedBatch = a_onReceivedBatch;
+        // Nowhere else to decode but network thread
+        f_onReceivedEncodedBatch = [a_onReceivedBatch, pCompression = m_pCompression](QVector<QByteArray> msgs, QVector<int> encodedIndices, NetConnection* const netConnection, Net::AddressPort addressPort) {
+            pCompression->decode(msgs, encodedIndices);
+            a_onReceivedBatch(std::move(msgs), netConnection, addressPort);
         };
-#endif
-        f_onReceivedMessage = f_callback;
+    }
+    else
+    {
+        setBatchCallbackFunction(a_onReceivedBatch, getCallbackThreadContext());
+    }
+}
+
+void NetConnection::setBatchCallbackFunction(std::function<void(QVector<QByteArray>, NetConnection* const, Net::AddressPort)> a_onReceivedBatch, QObject* pCallbackContext)
+{
+    if (m_connectionState == Net::ConnectionState::Created)
+    {
+        f_logGeneral(QString("%1: called setBatchCallbackFunction() while connection is open - action forbidden").arg(nameId()));
+        return;
+    }
+
+    m_pCallbackChannel.reset();
+    f_onReceivedMessage = {};
+    f_onReceivedEncodedMessage = {};
+    Net::CallbackExecutor* pExecutor = (pCallbackContext == m_pCallbackExecutorContext) ? m_pCallbackExecutor : nullptr;
+    m_pBatchCallbackChannel = std::make_shared<Net::MessageChannel<Net::ReceivedBatch>>();
+    setCallbackBudget(m_pCallbackBudget);
+    // Compressed messages are decoded here, in callback's thread
+    m_pBatchCallbackChannel->setConsumer(pCallbackContext, [a_onReceivedBatch, pExecutor, pCompression = m_pCompression](Net::ReceivedBatch& received) {
+        if (pExecutor != nullptr)
+            pExecutor->noteDispatched(received.enqueuedAtNs, received.msgs.size());
+        receiveTiming() = Net::ReceiveTiming{received.readStartedAtNs, received.enqueuedAtNs, Net::CallbackExecutor::nowNs()};
+        if (!received.encodedIndices.isEmpty())
+            pCompression->decode(received.msgs, received.encodedIndices);
+        a_onReceivedBatch(std::move(received.msgs), received.pConnection, received.addrPort);
+        receiveTiming() = Net::ReceiveTiming{};
+    });
+    // Pushed in the thread which read the frames, possibly a shard of <this>, so read start comes from that thread's timing
+    auto lambda_push = [pChannel = m_pBatchCallbackChannel, pExecutor](Net::ReceivedBatch&& received) {
+        if (pExecutor != nullptr)
+            pExecutor->noteEnqueued(received.msgs.size());
+        received.enqueuedAtNs = Net::CallbackExecutor::nowNs();
+        received.readStartedAtNs = receiveTiming().readStartedAtNs;
+        pChannel->push(std::move(received));
+    };
+    f_onReceivedBatch = [lambda_push](QVector<QByteArray> msgs, NetConnection* const netConnection, Net::AddressPort addressPort) {
+        lambda_push(Net::ReceivedBatch{std::move(msgs), netConnection, addressPort});
+    };
+    f_onReceivedEncodedBatch = [lambda_push](QVector<QByteArray> msgs, QVector<int> encodedIndices, NetConnection* const netConnection, Net::AddressPort addressPort) {
+        lambda_push(Net::ReceivedBatch{std::move(msgs), netConnection, addressPort, 0, std::move(encodedIndices)});
+    };
+}
+
+void NetConnection::setCallbackBudget(std::shared_ptr<Net::ReceiveBudget> pBudget)
+{
+    m_pCallbackBudget = std::move(pBudget);
+    if (m_pCallbackChannel != nullptr)
+        m_pCallbackChannel->setOverflowBudget(m_pCallbackBudget, [](const Net::ReceivedMessage& received) { return static_cast<qint64>(received.msg.size()); });
+    if (m_pBatchCallbackChannel != nullptr)
+    {
+        m_pBatchCallbackChannel->setOverflowBudget(m_pCallbackBudget, [](const Net::ReceivedBatch& received) {
+            qint64 byteCount = 0;
+            for (QByteArray const& msg : received.msgs)
+                byteCount += msg.size();
+            return byteCount;
+        });
     }
 }
 
@@ -128,6 +269,8 @@ bool NetConnection::setIsCallbackDistinctThread(const bool a_isCallbackDistinctT
 
     if (a_isCallbackDistinctThread == true)
     {
+        if (m_pCallbackExecutor != nullptr)
+            setCallbackExecutor(nullptr);
         if (m_pCallbackThread == nullptr)
         {
             m_pCallbackThread = new QThread;
@@ -137,6 +280,9 @@ bool NetConnection::setIsCallbackDistinctThread(const bool a_isCallbackDistinctT
             QObject::connect(m_pCallbackThread, &QThread::finished, m_pCallbackThread, &QThread::deleteLater);
             m_pCallbackThread->start();
             f_onReceivedMessage = {}; // empty function causing segfault is intended - you should always call setCallbackFunction after changing setIsCallbackDistinctThread
+            f_onReceivedBatch = {};
+            f_onReceivedEncodedMessage = {};
+            f_onReceivedEncodedBatch = {};
 
             if (QThread::currentThread() != m_pCallbackThreadContextHelper->thread())
             {
@@ -180,12 +326,88 @@ bool NetConnection::setIsCallbackDistinctThread(const bool a_isCallbackDistinctT
             m_pCallbackThread->exit(0);
             m_pCallbackThread = nullptr;
             f_onReceivedMessage = {}; // empty function causing segfault is intended - you should always call setCallbackFunction after changing setIsCallbackDistinctThread
+            f_onReceivedBatch = {};
+            f_onReceivedEncodedMessage = {};
+            f_onReceivedEncodedBatch = {};
             return true;
         }
     }
     return false;
 }
 
+bool NetConnection::setCallbackExecutor(Net::CallbackExecutor* pExecutor)
+{
+    if (m_connectionState == Net::ConnectionState::Created)
+    {
+        f_logGeneral(QString("%1: called setCallbackExecutor() while connection is open - action forbidden").arg(nameId()));
+        return false;
+    }
+    if (pExecutor == m_pCallbackExecutor)
+        return false;
+
+    setIsCallbackDistinctThread(false);
+    if (m_pCallbackExecutor != nullptr)
+        m_pCallbackExecutor->releaseContext(m_pCallbackExecutorContext);
+    m_pCallbackExecutor = pExecutor;
+    m_pCallbackExecutorContext = (pExecutor != nullptr) ? pExecutor->acquireContext() : nullptr;
+    m_pCallbackChannel.reset();
+    m_pBatchCallbackChannel.reset();
+    f_onReceivedMessage = {}; // empty function causing segfault is intended - you should always call setCallbackFunction after changing setCallbackExecutor
+    f_onReceivedBatch = {};
+    f_onReceivedEncodedMessage = {};
+    f_onReceivedEncodedBatch = {};
+    return true;
+}
+
+void NetConnection::setCompressionSettings(Net::CompressionSettings const& settings)
+{
+    if (m_connectionState == Net::ConnectionState::Created)
+    {
+        f_logGeneral(QString("%1: called setCompressionSettings() while connection is open - action forbidden").arg(nameId()));
+        return;
+    }
+    m_pCompression->setSettings(settings);
+}
+
+qint64 NetConnection::sendEncodedMessage(const QByteArray&)
+{
+    f_logError(QString("%1: %2 doesn't send compressed messages").arg(nameId()).arg(m_connectionTypeName));
+    return -1;
+}
+
+void NetConnection::deliverEncodedMessage(const QByteArray& msg, const Net::AddressPort& addrPort)
+{
+    quint8 peerCodecMask = 0;
+    if (Net::parseCodecOffer(msg, peerCodecMask))
+    {
+        onCodecOffer(peerCodecMask, addrPort);
+        return;
+    }
+    if (f_onReceivedBatch)
+    {
+        m_receivedBatchEncodedIndices.append(m_receivedBatch.size());
+        m_receivedBatch.append(msg);
+    }
+    else
+    {
+        f_onReceivedEncodedMessage(msg, this, addrPort);
+    }
+}
+
+void NetConnection::onCodecOffer(quint8 peerCodecMask, const Net::AddressPort&)
+{
+    const Net::Codec codec = Net::chooseCodec(m_pCompression->settings().codecMask, peerCodecMask);
+    m_pCompression->setPeerCodec(Net::CompressionContext::solePeer(), codec);
+    f_logGeneral(QString("%1: negotiated compression codec: %2").arg(nameId()).arg(Net::toQString(codec)));
+}
+
+void NetConnection::applySocketOptions(qintptr socketDescriptor) const
+{
+    const QStringList failed = Net::applySocketOptions(socketDescriptor, m_connectionSettings.socketOptions);
+    if (!failed.isEmpty())
+        f_logError(QString("%1: failed to set socket options of sockd:%2 - %3").arg(nameId()).arg(socketDescriptor).arg(failed.join(", ")));
+}
+
 void NetConnection::printConnectionSettings() const
 {
     QString msg;
@@ -197,6 +419,7 @@ void NetConnection::printConnectionSettings() const
                   "Port Out: %5\n"
                   "Local IP: %6\n"
                   "Destination IP: %7\n"
+                  "Socket options: %8\n"
                   "--------------------------------------------")
           .arg(m_connectionTypeName)
           .arg(m_connectionId)
@@ -204,7 +427,8 @@ void NetConnection::printConnectionSettings() const
           .arg(m_connectionSettings.portIn)
           .arg(m_connectionSettings.portOut)
           .arg(m_connectionSettings.ipLocal.toString())
-          .arg(m_connectionSettings.ipDestination.toString());
+          .arg(m_connectionSettings.ipDestination.toString())
+          .arg(Net::toQString(m_connectionSettings.socketOptions));
     f_logGeneral(msg);
     return;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <functional>
+#include <memory>
 
 #include <QtCore/QByteArray>
 #include <QtCore/QCoreApplication>
@@ -8,12 +9,55 @@
 #include <QtCore/QDateTime>
 #include <QtCore/QTextStream>
 #include <QtCore/QThread>
+#include <QtCore/QVector>
 #include <QtNetwork/QHostAddress>
 #include <QtNetwork/QNetworkInterface>
 #include <QtNetwork/QNetworkProxyFactory>
 
+#include "CallbackExecutor.hpp"
+#include "Compression.hpp"
+#include "MessageChannel.hpp"
 #include "NetUtils.hpp"
 
+class NetConnection;
+
+namespace Net
+{
+struct ReceivedMessage
+{
+    QByteArray msg;
+    NetConnection* pConnection = nullptr;
+    Net::AddressPort addrPort;
+    qint64 enqueuedAtNs = 0; // set only for CallbackExecutor, which measures dispatch latency
+    bool isEncoded = false; // compressed, decoded in callback's thread
+};
+
+struct ReceivedBatch
+{
+    QVector<QByteArray> msgs;
+    NetConnection* pConnection = nullptr;
+    Net::AddressPort addrPort;
+    qint64 enqueuedAtNs = 0;
+    QVector<int> encodedIndices; // msgs still compressed, decoded in callback's thread
+    qint64 readStartedAtNs = 0;
+};
+
+// Timestamps (CallbackExecutor::nowNs()) of the batch which batch callback is handling on this thread, so that callback can break its latency down.
+// Zero outside of batch callback and for stages which didn't happen, e.g. there is no hand-over if callback runs in connection's thread
+struct ReceiveTiming
+{
+    qint64 readStartedAtNs = 0; // backend started reading the socket
+    qint64 enqueuedAtNs = 0; // frames were parsed and handed over to callback's thread
+    qint64 dispatchedAtNs = 0; // callback's thread picked them up
+};
+
+struct OutgoingMessage
+{
+    QByteArray msg;
+    bool isEncoded = false;
+};
+} // namespace Net
+
 class NetConnection : public QObject
 {
     Q_OBJECT
@@ -35,8 +79,21 @@ protected: // members
     Net::ConnectionSettings m_connectionSettings;
     QThread* m_pCallbackThread = nullptr;
     QObject* m_pCallbackThreadContextHelper = nullptr;
+    Net::CallbackExecutor* m_pCallbackExecutor = nullptr;
+    QObject* m_pCallbackExecutorContext = nullptr; // pinned to one of executor's threads
+    std::shared_ptr<Net::MessageChannel<Net::ReceivedMessage>> m_pCallbackChannel; // carries received messages to callback's thread, if callback doesn't run in <this>'s thread
+    std::shared_ptr<Net::MessageChannel<Net::ReceivedBatch>> m_pBatchCallbackChannel; // same for batch callback
+    std::shared_ptr<Net::ReceiveBudget> m_pCallbackBudget; // overflow of both callback channels is charged to it, see setCallbackBudget()
+    std::shared_ptr<Net::MessageChannel<Net::OutgoingMessage>> m_pSendChannel; // carries sendMessageQueued() messages to <this>'s thread
+    std::shared_ptr<Net::CompressionContext> m_pCompression; // never replaced after construction except for TcpServer's shards, callbacks keep a pointer to it
 
     std::function<void(QByteArray, NetConnection* const, Net::AddressPort)> f_onReceivedMessage = {}; // empty function causing segfault is intended - if that happens, you're missing a setCallbackFunction() call
+    std::function<void(QVector<QByteArray>, NetConnection* const, Net::AddressPort)> f_onReceivedBatch = {}; // replaces f_onReceivedMessage if set
+    QVector<QByteArray> m_receivedBatch; // frames of the read in progress, for f_onReceivedBatch
+    QVector<int> m_receivedBatchEncodedIndices; // those of m_receivedBatch which are still compressed
+    // Same callbacks for compressed messages, which are decoded wherever the callback runs. Set by setCallbackFunction() and setBatchCallbackFunction()
+    std::function<void(QByteArray, NetConnection* const, Net::AddressPort)> f_onReceivedEncodedMessage = {};
+    std::function<void(QVector<QByteArray>, QVector<int>, NetConnection* const, Net::AddressPort)> f_onReceivedEncodedBatch = {};
     std::function<void(QString)> f_logGeneral = [](QString msg) { qWarning(qUtf8Printable(QDateTime::currentDateTimeUtc().toString(QStringLiteral("[yyyy.MM.dd-hh:mm:ss.zzz]")) + msg)); };
     std::function<void(QString)> f_logError = [](QString msg) { qWarning(qUtf8Printable(QDateTime::currentDateTimeUtc().toString(QStringLiteral("[yyyy.MM.dd-hh:mm:ss.zzz]")) + msg)); };
 
@@ -48,8 +105,18 @@ public: // methods
     void setConnectionSettings(Net::ConnectionSettings const& a_connectionSettings);
     void setConnectionId(uint new_id);
     void setCallbackFunction(std::function<void(QByteArray, NetConnection* const, Net::AddressPort)> a_OnRecvMessage);
+    // Callback runs in pCallbackContext's thread, with messages handed over in batches through lock-free channel instead of an event per message
+    void setCallbackFunction(std::function<void(QByteArray, NetConnection* const, Net::AddressPort)> a_OnRecvMessage, QObject* pCallbackContext);
+    // Alternative to setCallbackFunction(): all frames parsed from one read of one peer are delivered in a single call, so that per-message overhead is paid once per batch
+    void setBatchCallbackFunction(std::function<void(QVector<QByteArray>, NetConnection* const, Net::AddressPort)> a_onReceivedBatch);
+    void setBatchCallbackFunction(std::function<void(QVector<QByteArray>, NetConnection* const, Net::AddressPort)> a_onReceivedBatch, QObject* pCallbackContext);
     void setLoggingFunctions(std::function<void(QString)> a_logGeneral, std::function<void(QString)> a_logError);
     virtual bool setIsCallbackDistinctThread(const bool a_isCallbackDistinctThread); // returns true if calling setCallbackFunction is required, and false otherwise // you MUST call setCallbackFunction AFTER this to avoid undefined behavior
+    // Same as setIsCallbackDistinctThread(true), but callbacks run in a thread of pExecutor shared with other connections; nullptr - back to <this>'s thread. Same return value and setCallbackFunction requirement
+    bool setCallbackExecutor(Net::CallbackExecutor* pExecutor);
+    // Messages of settings.threshold bytes and more are compressed with a codec negotiated per peer: client offers its codecs once connected, server answers with its own.
+    // Only messages sent through sendMessageQueued()/sendMessageToQueued() are compressed, in emitter's thread
+    void setCompressionSettings(Net::CompressionSettings const& settings);
 
     // Getters
     decltype(f_logGeneral) get_f_logGeneral() const { return f_logGeneral; }
@@ -60,10 +127,55 @@ public: // methods
     Net::ConnectionSettings const& getConnectionSettings() const { return m_connectionSettings; }
     virtual Net::ConnectionSettings getConnectionSettingsActive() const { return getConnectionSettings(); } // should differ from m_connectionSettings if ip=Any or port=0, those being actually used ones
     virtual QString getLastErrorString() const = 0;
-    bool getIsCallbackDistinctThread() const { return (m_pCallbackThread == nullptr) ? false : true; }
-    QObject* getCallbackThreadContext() const { return m_pCallbackThreadContextHelper; } // only meant for signal/slot connections to specify thread of slot execution. Do NOT do anything else with it or woe be upon ye
+    bool getIsCallbackDistinctThread() const { return (m_pCallbackThread != nullptr) || (m_pCallbackExecutorContext != nullptr); }
+    Net::CallbackExecutor* getCallbackExecutor() const { return m_pCallbackExecutor; }
+    Net::CompressionSettings getCompressionSettings() const { return m_pCompression->settings(); }
+    Net::CompressionStats getCompressionStats() const { return m_pCompression->stats(); } // thread-safe
+    QObject* getCallbackThreadContext() const { return (m_pCallbackExecutorContext != nullptr) ? m_pCallbackExecutorContext : m_pCallbackThreadContextHelper; } // only meant for signal/slot connections to specify thread of slot execution. Do NOT do anything else with it or woe be upon ye
 
     QString nameId() const { return QString("%1 (id=%2)").arg(objectName()).arg(getConnectionId()); }
+    static const Net::ReceiveTiming& currentReceiveTiming() { return receiveTiming(); } // only meaningful inside batch callback
+
+private:
+    static Net::ReceiveTiming& receiveTiming();
+
+protected:
+    // Backends call it before reading a socket, the read is timed up to flushReceivedBatch()
+    static void markReadStarted() { receiveTiming().readStartedAtNs = Net::CallbackExecutor::nowNs(); }
+    // Backends pass every received frame here, and call flushReceivedBatch() once the read is over
+    inline void deliverReceivedMessage(const QByteArray& msg, const Net::AddressPort& addrPort, bool isEncoded)
+    {
+        if (isEncoded)
+            deliverEncodedMessage(msg, addrPort);
+        else if (f_onReceivedBatch)
+            m_receivedBatch.append(msg);
+        else
+            f_onReceivedMessage(msg, this, addrPort);
+    }
+    inline void flushReceivedBatch(const Net::AddressPort& addrPort)
+    {
+        if (m_receivedBatch.isEmpty())
+            return;
+        QVector<QByteArray> batch;
+        batch.swap(m_receivedBatch); // callback may read again through this connection
+        if (m_receivedBatchEncodedIndices.isEmpty())
+        {
+            f_onReceivedBatch(std::move(batch), this, addrPort);
+            return;
+        }
+        QVector<int> encodedIndices;
+        encodedIndices.swap(m_receivedBatchEncodedIndices);
+        f_onReceivedEncodedBatch(std::move(batch), std::move(encodedIndices), this, addrPort);
+    }
+    void deliverEncodedMessage(const QByteArray& msg, const Net::AddressPort& addrPort); // handles codec offers itself
+    // Peer's codec offer, which for client is the answer to its own. Servers override it to answer their clients
+    virtual void onCodecOffer(quint8 peerCodecMask, const Net::AddressPort& addrPort);
+    // Sends payload made by CompressionContext::encode() or makeCodecOffer() with g_encodedFrameFlag set. Connections which negotiate compression override it
+    virtual qint64 sendEncodedMessage(const QByteArray& payload);
+    // Servers pass their ReceiveBudget, so that received messages piling up in front of a slow callback count against ReceiveLimits::maxTotalBytes
+    void setCallbackBudget(std::shared_ptr<Net::ReceiveBudget> pBudget);
+    // Sets m_connectionSettings.socketOptions on TCP socket, logging those which failed. Connection keeps working either way
+    void applySocketOptions(qintptr socketDescriptor) const;
 
 public slots:
     Net::ConnectionState openConnection();
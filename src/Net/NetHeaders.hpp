@@ -1,5 +1,17 @@
 #pragma once
 
+#include "NetClient.hpp"
 #include "TcpClient.hpp"
+#include "LocalClient.hpp"
+#include "MemoryClient.hpp"
+#include "NetServer.hpp"
 #include "TcpServer.hpp"
+#include "LocalServer.hpp"
+#include "MemoryServer.hpp"
+#if defined(NET_HAS_EPOLL)
+    #include "EpollTcpServer.hpp"
+#endif
+#if defined(NET_HAS_IO_URING)
+    #include "UringTcpServer.hpp"
+#endif
 #include "NetThread.hpp"
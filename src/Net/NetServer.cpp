@@ -0,0 +1,130 @@
+#include "NetServer.hpp"
+
+using namespace Net;
+
+NetServer::NetServer(const quint8 _connType, const QString _connTypeName, QObject* parent)
+    : NetConnection(_connType, _connTypeName, parent)
+    , m_pReceiveBudget(std::make_shared<Net::ReceiveBudget>(m_receiveLimits))
+{
+    m_pCompression->setReceiveBudget(m_pReceiveBudget);
+    setCallbackBudget(m_pReceiveBudget);
+    m_pSendToChannel = std::make_shared<Net::MessageChannel<Net::AddressedMessage>>();
+    m_pSendToChannel->setConsumer(this, [this](Net::AddressedMessage& addressed) {
+        if (addressed.isEncoded)
+            sendEncodedMessageTo(addressed.msg, addressed.addrPort);
+        else
+            sendMessageTo(addressed.msg, addressed.addrPort);
+    });
+    connect(this, &NetServer::clientDisconnected, this, [this](Net::AddressPort addrPort) { m_pCompression->removePeer(addrPort); });
+
+    connect(this, qOverload<QByteArray, QHostAddress, quint16>(&NetServer::sendMessageToQueued), this, qOverload<QByteArray, QHostAddress, quint16>(&NetServer::sendMessageTo), Qt::QueuedConnection);
+    // DirectConnection - postMessageTo() decides how to get the message to the thread serving the client
+    connect(this, qOverload<QByteArray, Net::AddressPort>(&NetServer::sendMessageToQueued), this, [this](QByteArray msg, Net::AddressPort addressPort) {
+        postMessageTo(msg, addressPort);
+    }, Qt::DirectConnection);
+    connect(this, qOverload<QByteArray, QHostAddress>(&NetServer::sendMessageToQueued), this, qOverload<QByteArray, QHostAddress>(&NetServer::sendMessageTo), Qt::QueuedConnection);
+    connect(this, qOverload<QByteArray, QString>(&NetServer::sendMessageToQueued), this, qOverload<QByteArray, QString>(&NetServer::sendMessageTo), Qt::QueuedConnection);
+    connect(this, &NetServer::broadcastMessageQueued, this, &NetServer::broadcastMessage, Qt::QueuedConnection);
+    connect(this, &NetServer::multicastMessageQueued, this, &NetServer::multicastMessage, Qt::QueuedConnection);
+    connect(this, &NetServer::addAllowedAddressQueued, this, &NetServer::addAllowedAddress, Qt::QueuedConnection);
+    connect(this, &NetServer::removeAllowedAddressQueued, this, &NetServer::removeAllowedAddress, Qt::QueuedConnection);
+    connect(this, &NetServer::addLoginDataQueued, this, &NetServer::addLoginData, Qt::QueuedConnection);
+    connect(this, &NetServer::removeLoginDataQueued, this, &NetServer::removeLoginData, Qt::QueuedConnection);
+}
+
+void NetServer::postMessageTo(QByteArray msg, Net::AddressPort addressPort)
+{
+    Net::AddressedMessage addressed{msg, addressPort};
+    addressed.isEncoded = m_pCompression->encode(addressed.msg, addressPort);
+    m_pSendToChannel->push(std::move(addressed));
+}
+
+void NetServer::onCodecOffer(quint8 peerCodecMask, const Net::AddressPort& addrPort)
+{
+    const quint8 codecMask = m_pCompression->settings().codecMask;
+    const Net::Codec codec = Net::chooseCodec(codecMask, peerCodecMask);
+    m_pCompression->setPeerCodec(addrPort, codec);
+    sendEncodedMessageTo(Net::makeCodecOffer(codecMask), addrPort); // client waits for it even if there's nothing in common
+    f_logGeneral(QString("%1: negotiated compression codec with client %2: %3").arg(nameId()).arg(Net::toQString(addrPort)).arg(Net::toQString(codec)));
+}
+
+void NetServer::addAllowedAddress(QHostAddress addr)
+{
+    m_allowedAddresses.insert(addr);
+}
+
+void NetServer::addLoginData(Net::LoginData loginData)
+{
+    m_loginData.insert(loginData);
+}
+
+void NetServer::setAuthorizationEnabled(bool isEnabled)
+{
+    if (m_connectionState == Net::ConnectionState::Created)
+    {
+        f_logGeneral(QString("%1: called setAuthorizationEnabled() while connection is open - action forbidden").arg(nameId()));
+        return;
+    }
+    m_isAuthorizationEnabled = isEnabled;
+}
+
+void NetServer::setSendWatermarks(Net::SendWatermarks watermarks)
+{
+    if (m_connectionState == Net::ConnectionState::Created)
+    {
+        f_logGeneral(QString("%1: called setSendWatermarks() while connection is open - action forbidden").arg(nameId()));
+        return;
+    }
+    m_sendWatermarks = watermarks;
+}
+
+void NetServer::setSlowRecipientPolicy(Net::SlowRecipientPolicy policy)
+{
+    if (m_connectionState == Net::ConnectionState::Created)
+    {
+        f_logGeneral(QString("%1: called setSlowRecipientPolicy() while connection is open - action forbidden").arg(nameId()));
+        return;
+    }
+    m_slowRecipientPolicy = policy;
+}
+
+bool NetServer::admitFanoutRecipient(Net::SendQueue const& queue, bool& shouldDisconnect)
+{
+    shouldDisconnect = false;
+    if (!queue.isCongested() || (m_slowRecipientPolicy == Net::SlowRecipientPolicy::Queue))
+    {
+        ++m_fanoutStats.deliveries;
+        return true;
+    }
+    if (m_slowRecipientPolicy == Net::SlowRecipientPolicy::Skip)
+    {
+        ++m_fanoutStats.skipped;
+        return false;
+    }
+    ++m_fanoutStats.disconnected;
+    shouldDisconnect = true;
+    return false;
+}
+
+void NetServer::setIdleTimeout(int msec)
+{
+    if (m_connectionState == Net::ConnectionState::Created)
+    {
+        f_logGeneral(QString("%1: called setIdleTimeout() while connection is open - action forbidden").arg(nameId()));
+        return;
+    }
+    m_idleTimeout = qMax(0, msec);
+}
+
+void NetServer::setReceiveLimits(Net::ReceiveLimits limits)
+{
+    if (m_connectionState == Net::ConnectionState::Created)
+    {
+        f_logGeneral(QString("%1: called setReceiveLimits() while connection is open - action forbidden").arg(nameId()));
+        return;
+    }
+    m_receiveLimits = limits;
+    m_pReceiveBudget = std::make_shared<Net::ReceiveBudget>(m_receiveLimits);
+    m_pCompression->setReceiveBudget(m_pReceiveBudget);
+    setCallbackBudget(m_pReceiveBudget);
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <memory>
+
+#include <QtCore/QSet>
+#include <QtCore/QVector>
+
+#include "NetConnection.hpp"
+#include "ReceiveBudget.hpp"
+#include "SendQueue.hpp"
+#include "TimerWheel.hpp"
+
+namespace Net
+{
+// Kept by backends which make socket syscalls themselves, so that their cost per message can be compared
+struct IoStats
+{
+    quint64 syscalls = 0;
+    quint64 receivedMessages = 0;
+    quint64 sentMessages = 0;
+};
+
+struct AddressedMessage
+{
+    QByteArray msg;
+    Net::AddressPort addrPort;
+    bool isEncoded = false;
+};
+
+// What broadcastMessage()/multicastMessage() do with a recipient which is congested (see Net::SendWatermarks), so that one slow client doesn't hold the message for everyone
+enum class SlowRecipientPolicy
+{
+    Queue, // message is queued anyway, as by sendMessageTo()
+    Skip, // recipient misses the message
+    Disconnect // recipient is dropped
+};
+
+struct FanoutStats
+{
+    quint64 messages = 0; // broadcasts and multicasts served
+    quint64 deliveries = 0; // recipients message was queued to
+    quint64 skipped = 0;
+    quint64 disconnected = 0;
+};
+} // namespace Net
+
+// Common interface of server backends (TcpServer on QTcpSocket, EpollTcpServer on raw descriptors), so that users can switch between them by setting.
+// Holds client-facing signals, allowlist/authorization data and send/receive limits; backends only differ in how they move bytes
+class NetServer : public NetConnection
+{
+    Q_OBJECT
+protected:
+    NetServer(const quint8 _connType, const QString _connTypeName, QObject* parent = nullptr);
+
+public:
+    virtual ~NetServer() = default;
+
+protected: // members
+    QSet<QHostAddress> m_allowedAddresses;
+    bool m_isAllowAllAdresses = true;
+
+    QSet<Net::LoginData> m_loginData;
+    bool m_isAuthorizationEnabled = false;
+    const int m_authTimeoutTime = 3000;
+    int m_idleTimeout = 0; // msec without received data before authorized client is dropped, 0 - never
+
+    Net::SendWatermarks m_sendWatermarks;
+    Net::SlowRecipientPolicy m_slowRecipientPolicy = Net::SlowRecipientPolicy::Queue;
+    Net::FanoutStats m_fanoutStats;
+
+    // Budget is shared with all readers of the server, so that maxTotalBytes covers the whole server
+    Net::ReceiveLimits m_receiveLimits;
+    std::shared_ptr<Net::ReceiveBudget> m_pReceiveBudget;
+
+    std::shared_ptr<Net::MessageChannel<Net::AddressedMessage>> m_pSendToChannel; // carries postMessageTo() messages to <this>'s thread
+
+public: // methods
+    virtual uint getConnectionCount() const = 0;
+    virtual bool getIsClientConnected(const Net::AddressPort addrPort) = 0;
+    virtual Net::IoStats getIoStats() const { return {}; } // must be called from <this>'s thread; empty for backends which leave syscalls to Qt
+
+    void setAllowAllAddresses(bool isAllowed) { m_isAllowAllAdresses = isAllowed; }
+    void setAuthorizationEnabled(bool isEnabled); // must be called before openConnection()
+
+    void setSendWatermarks(Net::SendWatermarks watermarks); // must be called before openConnection()
+    Net::SendWatermarks getSendWatermarks() const { return m_sendWatermarks; }
+    void setSlowRecipientPolicy(Net::SlowRecipientPolicy policy); // must be called before openConnection()
+    Net::SlowRecipientPolicy getSlowRecipientPolicy() const { return m_slowRecipientPolicy; }
+    virtual Net::FanoutStats getFanoutStats() const { return m_fanoutStats; } // must be called from <this>'s thread
+
+    // Authorization and idle deadlines of all sockets are kept in Net::TimerWheel::forCurrentThread(), one per network thread
+    void setIdleTimeout(int msec); // must be called before openConnection()
+    int getIdleTimeout() const { return m_idleTimeout; }
+
+    void setReceiveLimits(Net::ReceiveLimits limits); // must be called before openConnection()
+    Net::ReceiveLimits getReceiveLimits() const { return m_receiveLimits; }
+    quint64 getShedCount(Net::ShedReason reason) const { return m_pReceiveBudget->shedCount(reason); } // thread-safe
+    qint64 getReceiveMemoryUsage() const { return m_pReceiveBudget->usedBytes(); } // thread-safe
+
+protected:
+    // Called by sendMessageToQueued(msg, addressPort) in emitter's thread. Compresses the message for the client and hands it to <this>'s thread through m_pSendToChannel by default
+    virtual void postMessageTo(QByteArray msg, Net::AddressPort addressPort);
+    // Same as sendMessageTo(msg, addressPort) for payload made by CompressionContext::encode() or makeCodecOffer()
+    virtual qint64 sendEncodedMessageTo(QByteArray payload, Net::AddressPort addressPort) = 0;
+    void onCodecOffer(quint8 peerCodecMask, const Net::AddressPort& addrPort) override; // answers with own offer
+    // Applies m_slowRecipientPolicy: true if fan-out message is to be queued to the recipient, otherwise it's skipped, and disconnected as well if shouldDisconnect is set
+    bool admitFanoutRecipient(Net::SendQueue const& queue, bool& shouldDisconnect);
+
+public slots:
+    virtual qint64 sendMessageTo(QByteArray msg, QHostAddress address, quint16 port) = 0;
+    virtual qint64 sendMessageTo(QByteArray msg, Net::AddressPort addressPort) = 0;
+    virtual qint64 sendMessageTo(QByteArray msg, QHostAddress address) = 0;
+    virtual qint64 sendMessageTo(QByteArray msg, QString loginUsername) = 0;
+    // Fan-out: message is compressed at most once per codec (Net::FanoutPayload) and the same buffer is queued to every recipient,
+    // congested ones are treated according to SlowRecipientPolicy. Returns total size of queued frames
+    virtual qint64 broadcastMessage(QByteArray msg) = 0; // every authorized client
+    virtual qint64 multicastMessage(QByteArray msg, QVector<Net::AddressPort> recipients) = 0; // unconnected recipients are skipped
+
+    virtual void addAllowedAddress(QHostAddress addr);
+    virtual void removeAllowedAddress(QHostAddress addr) = 0; // must drop clients from addr
+    virtual void addLoginData(Net::LoginData loginData);
+    virtual void removeLoginData(Net::LoginData loginData) = 0; // must drop client logged in with loginData
+
+signals:
+    void clientConnected(Net::AddressPort);
+    void clientDisconnected(Net::AddressPort);
+    void clientAuthorized(QString username, Net::AddressPort addrPort);
+    void clientCongestionChanged(Net::AddressPort addrPort, bool isCongested, qint64 pendingBytes); // see Net::SendWatermarks
+
+    void sendMessageToQueued(QByteArray msg, QHostAddress address, quint16 port);
+    void sendMessageToQueued(QByteArray msg, Net::AddressPort addressPort);
+    void sendMessageToQueued(QByteArray msg, QHostAddress address);
+    void sendMessageToQueued(QByteArray msg, QString loginUsername);
+    void broadcastMessageQueued(QByteArray msg);
+    void multicastMessageQueued(QByteArray msg, QVector<Net::AddressPort> recipients);
+
+    void addAllowedAddressQueued(QHostAddress addr);
+    void removeAllowedAddressQueued(QHostAddress addr);
+
+    void addLoginDataQueued(Net::LoginData loginData);
+    void removeLoginDataQueued(Net::LoginData loginData);
+};
@@ -1,7 +1,5 @@
 #include "NetThread.hpp"
 
-#include <atomic>
-
 NetThread::~NetThread()
 {
     while (!m_netConnectionsSet.isEmpty())
@@ -12,6 +10,7 @@ NetThread::NetThread(QObject* parent)
     : QThread(parent)
 {
     qRegisterMetaType<std::function<NetConnection*(void)>>("std::function<NetConnection*(void)>");
+    qRegisterMetaType<std::function<void(NetConnection*)>>("std::function<void(NetConnection*)>");
     // Calling moveToThread(targetThread) is valid even when such thread hasn't started yet
     m_contextHelper = new NetThreadContextHelper(this);
 }
@@ -25,12 +24,14 @@ NetThreadContextHelper::NetThreadContextHelper(NetThread* contextThread)
     connect(m_netThread, &QThread::finished, m_netThread, &QThread::deleteLater);
 }
 
-void NetThreadContextHelper::onMakeNetConnection(std::function<NetConnection*(void)> f_makeNetConnection)
+void NetThreadContextHelper::onMakeNetConnection(std::function<NetConnection*(void)> f_makeNetConnection, std::function<void(NetConnection*)> f_onMadeNetConnection)
 {
     NetConnection* pConnection = f_makeNetConnection();
     connect(pConnection, &QObject::destroyed, this, &NetThreadContextHelper::onNetConnectionDestroyed);
     m_netThread->m_netConnectionsSet.insert(pConnection);
     emit m_netThread->finishedMakeNetConnection(pConnection);
+    if (f_onMadeNetConnection)
+        f_onMadeNetConnection(pConnection);
 }
 
 void NetThreadContextHelper::onNetConnectionDestroyed(QObject* pNetConnection)
@@ -43,96 +44,98 @@ void NetThreadContextHelper::onNetConnectionDestroyed(QObject* pNetConnection)
 namespace Net
 {
 
-void reopenWaitThreadedConnection(NetConnection* pConnection, Net::ConnectionSettings netSettings)
+namespace
+{
+template<typename T>
+std::future<T> makeReadyFuture(T value)
+{
+    std::promise<T> promise;
+    promise.set_value(value);
+    return promise.get_future();
+}
+
+std::future<void> makeReadyFuture()
+{
+    std::promise<void> promise;
+    promise.set_value();
+    return promise.get_future();
+}
+} // namespace
+
+std::future<Net::ConnectionState> reopenThreadedConnectionAsync(NetConnection* pConnection, Net::ConnectionSettings netSettings)
 {
     if (pConnection == nullptr)
-        return;
-    QThread* pCurThread = QThread::currentThread();
-    if (pCurThread == pConnection->thread())
-    {
-        pConnection->reopenConnection(netSettings);
-        return;
-    }
-    std::atomic<bool> isDone(false);
-    auto tempConnectHandler = QObject::connect(pConnection, &NetConnection::openedConnection, pConnection, [&isDone]() { isDone.store(true, std::memory_order_relaxed); });
-    emit pConnection->reopenConnectionQueued(netSettings);
-    while (true)
-    {
-        if (isDone.load(std::memory_order_relaxed))
-            break;
-        pCurThread->msleep(5);
-    }
-    QObject::disconnect(tempConnectHandler);
-    return;
+        return makeReadyFuture(Net::ConnectionState::NotCreated);
+    if (QThread::currentThread() == pConnection->thread())
+        return makeReadyFuture(pConnection->reopenConnection(netSettings));
+    auto pPromise = std::make_shared<std::promise<Net::ConnectionState>>();
+    QMetaObject::invokeMethod(pConnection, [pConnection, netSettings, pPromise]() { pPromise->set_value(pConnection->reopenConnection(netSettings)); }, Qt::QueuedConnection);
+    return pPromise->get_future();
 }
 
-void openWaitThreadedConnection(NetConnection* pConnection, Net::ConnectionSettings netSettings)
+std::future<Net::ConnectionState> openThreadedConnectionAsync(NetConnection* pConnection, Net::ConnectionSettings netSettings)
 {
     if (pConnection == nullptr)
-        return;
-    QThread* pCurThread = QThread::currentThread();
-    if (pCurThread == pConnection->thread())
-    {
-        pConnection->openConnection(netSettings);
-        return;
-    }
-    std::atomic<bool> isDone(false);
-    auto tempConnectHandler = QObject::connect(pConnection, &NetConnection::openedConnection, pConnection, [&isDone]() { isDone.store(true, std::memory_order_relaxed); });
-    emit pConnection->openConnectionQueued(netSettings);
-    while (true)
-    {
-        if (isDone.load(std::memory_order_relaxed))
-            break;
-        pCurThread->msleep(5);
-    }
-    QObject::disconnect(tempConnectHandler);
-    return;
+        return makeReadyFuture(Net::ConnectionState::NotCreated);
+    if (QThread::currentThread() == pConnection->thread())
+        return makeReadyFuture(pConnection->openConnection(netSettings));
+    auto pPromise = std::make_shared<std::promise<Net::ConnectionState>>();
+    QMetaObject::invokeMethod(pConnection, [pConnection, netSettings, pPromise]() { pPromise->set_value(pConnection->openConnection(netSettings)); }, Qt::QueuedConnection);
+    return pPromise->get_future();
 }
 
-void closeWaitThreadedConnection(NetConnection* pConnection)
+std::future<void> closeThreadedConnectionAsync(NetConnection* pConnection)
 {
     if (pConnection == nullptr)
-        return;
-    QThread* pCurThread = QThread::currentThread();
-    if (pCurThread == pConnection->thread())
+        return makeReadyFuture();
+    if (QThread::currentThread() == pConnection->thread())
     {
         pConnection->closeConnection();
-        return;
-    }
-    std::atomic<bool> isDone(false);
-    auto tempConnectHandler = QObject::connect(pConnection, &NetConnection::closedConnection, pConnection, [&isDone]() { isDone.store(true, std::memory_order_relaxed); });
-    emit pConnection->closeConnectionQueued();
-    while (true)
-    {
-        if (isDone.load(std::memory_order_relaxed))
-            break;
-        pCurThread->msleep(5);
+        return makeReadyFuture();
     }
-    QObject::disconnect(tempConnectHandler);
-    return;
+    auto pPromise = std::make_shared<std::promise<void>>();
+    QMetaObject::invokeMethod(pConnection, [pConnection, pPromise]() {
+        pConnection->closeConnection();
+        pPromise->set_value();
+    }, Qt::QueuedConnection);
+    return pPromise->get_future();
 }
 
-void destroyWaitThreadedConnection(NetConnection* pConnection)
+// Deleting connection from inside of its own queued call is unsafe, so it's deleteLater() and the destroyed() signal which fulfils the promise
+std::future<void> destroyThreadedConnectionAsync(NetConnection* pConnection)
 {
     if (pConnection == nullptr)
-        return;
-    QThread* pCurThread = QThread::currentThread();
-    if (pCurThread == pConnection->thread())
+        return makeReadyFuture();
+    if (QThread::currentThread() == pConnection->thread())
     {
         delete pConnection;
-        return;
+        return makeReadyFuture();
     }
-    std::atomic<bool> isDone(false);
-    auto tempConnectHandler = QObject::connect(pConnection, &NetConnection::destroyed, pConnection, [&isDone]() { isDone.store(true, std::memory_order_relaxed); });
+    auto pPromise = std::make_shared<std::promise<void>>();
+    QObject::connect(pConnection, &QObject::destroyed, [pPromise]() { pPromise->set_value(); }); // no context - called right in connection's thread
     pConnection->deleteLater();
-    while (true)
-    {
-        if (isDone.load(std::memory_order_relaxed))
-            break;
-        pCurThread->msleep(5);
-    }
-    QObject::disconnect(tempConnectHandler);
-    return;
+    return pPromise->get_future();
+}
+
+// Waiting on a broken promise (connection destroyed before the action ran) simply returns
+void reopenWaitThreadedConnection(NetConnection* pConnection, Net::ConnectionSettings netSettings)
+{
+    reopenThreadedConnectionAsync(pConnection, netSettings).wait();
+}
+
+void openWaitThreadedConnection(NetConnection* pConnection, Net::ConnectionSettings netSettings)
+{
+    openThreadedConnectionAsync(pConnection, netSettings).wait();
+}
+
+void closeWaitThreadedConnection(NetConnection* pConnection)
+{
+    closeThreadedConnectionAsync(pConnection).wait();
+}
+
+void destroyWaitThreadedConnection(NetConnection* pConnection)
+{
+    destroyThreadedConnectionAsync(pConnection).wait();
 }
 
 }
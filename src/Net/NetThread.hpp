@@ -1,5 +1,8 @@
 #pragma once
 
+#include <future>
+#include <memory>
+
 #include <QtCore/QCoreApplication>
 #include <QtCore/QSet>
 #include <QtCore/QThread>
@@ -48,7 +51,7 @@ public:
 
 signals:
     void finishedMakeNetConnection(NetConnection* pManager);
-    void makeNetConnectionQueued(std::function<NetConnection*(void)>);
+    void makeNetConnectionQueued(std::function<NetConnection*(void)> f_makeNetConnection, std::function<void(NetConnection*)> f_onMadeNetConnection); // f_onMadeNetConnection is called in NetThread once connection is registered
 };
 
 class NetThreadContextHelper : public QObject
@@ -61,45 +64,45 @@ private:
     NetThread* m_netThread = nullptr;
 
 private slots:
-    void onMakeNetConnection(std::function<NetConnection*(void)> f_makeNetConnection);
+    void onMakeNetConnection(std::function<NetConnection*(void)> f_makeNetConnection, std::function<void(NetConnection*)> f_onMadeNetConnection);
     void onNetConnectionDestroyed(QObject* pNetConnection);
 };
 
 namespace Net
 {
-// NOTE: do not call this function simultaneously from different threads with the same NetThread arg as it relies on NetThread::created signal, so async calls may lead to different signals getting mixed ->
-// this function may wait for incorrect time and returned pointer may point to incorrect NetConnection
-// NOTE: for QT version below 5.10, QTimer::singleShot is used, and that will not work if source thread (from which <this> called) doesn't have working QEventLoop
-// See - https://stackoverflow.com/questions/21646467/how-to-execute-a-functor-or-a-lambda-in-a-given-thread-in-qt-gcd-style
-// and for bug specifically - https://bugreports.qt.io/browse/QTBUG-66458
-// Instantiate NetConnection in NetThread provided as arg or in a newly created NetThread if none is provided, and wait untill instantiation is finished
+// Instantiate NetConnection in NetThread provided as arg or in a newly created NetThread if none is provided. Future is ready once instantiation is finished
+// Must not be called from pThread itself if the future is going to be waited on
 template<typename ConnectionClass>
-std::tuple<ConnectionClass*, NetThread*> instantiateWaitThreadedConnection(NetThread* pThread = nullptr)
+std::future<std::tuple<ConnectionClass*, NetThread*>> instantiateThreadedConnectionAsync(NetThread* pThread = nullptr)
 {
     if (pThread == nullptr)
     {
         pThread = new NetThread;
         pThread->start();
     }
-
-    auto* contextHelper = pThread->contextHelper();
-
-    ConnectionClass* pConnection = nullptr;
-    QThread* pCurThread = QThread::currentThread();
-    auto connectionHandle = QObject::connect(pThread, &NetThread::finishedMakeNetConnection, contextHelper, [&pConnection](NetConnection* a_pConnection) {
-        pConnection = static_cast<ConnectionClass*>(a_pConnection); // safe to cast because NetConnectionThreadWorker is guaranteed to make instance of actual type and simply returns base class pointer
+    auto pPromise = std::make_shared<std::promise<std::tuple<ConnectionClass*, NetThread*>>>();
+    auto future = pPromise->get_future();
+    emit pThread->makeNetConnectionQueued(Net::makeConnectionInstance<ConnectionClass>, [pPromise, pThread](NetConnection* pConnection) {
+        pPromise->set_value(std::make_tuple(static_cast<ConnectionClass*>(pConnection), pThread)); // safe to cast because makeConnectionInstance is guaranteed to make instance of actual type and simply returns base class pointer
     });
-    emit pThread->makeNetConnectionQueued(Net::makeConnectionInstance<ConnectionClass>);
-    while (true)
-    {
-        if (pConnection != nullptr)
-            break;
-        pCurThread->msleep(5);
-    }
-    QObject::disconnect(connectionHandle);
+    return future;
+}
 
-    return std::make_tuple(pConnection, pThread);
+// Same as above, but waits until instantiation is finished
+template<typename ConnectionClass>
+std::tuple<ConnectionClass*, NetThread*> instantiateWaitThreadedConnection(NetThread* pThread = nullptr)
+{
+    return instantiateThreadedConnectionAsync<ConnectionClass>(pThread).get();
 }
+
+// Run the action in connection's thread. Futures are ready once it's done; if called from connection's own thread, action is done right away
+// Future of open/reopen holds the state returned by openConnection(), and is broken (get() throws std::future_error) if connection is destroyed before the action runs
+std::future<Net::ConnectionState> reopenThreadedConnectionAsync(NetConnection* pConnection, Net::ConnectionSettings netSettings);
+std::future<Net::ConnectionState> openThreadedConnectionAsync(NetConnection* pConnection, Net::ConnectionSettings netSettings);
+std::future<void> closeThreadedConnectionAsync(NetConnection* pConnection);
+std::future<void> destroyThreadedConnectionAsync(NetConnection* pConnection);
+
+// Same as above, but wait until the action is done
 void reopenWaitThreadedConnection(NetConnection* pConnection, Net::ConnectionSettings netSettings);
 void openWaitThreadedConnection(NetConnection* pConnection, Net::ConnectionSettings netSettings);
 void closeWaitThreadedConnection(NetConnection* pConnection);
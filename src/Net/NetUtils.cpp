@@ -1,7 +1,141 @@
 #include "NetUtils.hpp"
 
+#ifndef _WIN32
+    #include <unistd.h>
+#endif
+
+// Options the platform doesn't have are never set, and reported as failed if requested
+#ifndef TCP_CORK
+    #define TCP_CORK -1
+#endif
+#ifndef TCP_QUICKACK
+    #define TCP_QUICKACK -1
+#endif
+#ifndef TCP_KEEPIDLE
+    #define TCP_KEEPIDLE -1
+#endif
+#ifndef TCP_KEEPINTVL
+    #define TCP_KEEPINTVL -1
+#endif
+#ifndef TCP_KEEPCNT
+    #define TCP_KEEPCNT -1
+#endif
+#ifndef TCP_USER_TIMEOUT
+    #define TCP_USER_TIMEOUT -1
+#endif
+#ifndef SO_BUSY_POLL
+    #define SO_BUSY_POLL -1
+#endif
+#ifndef SO_REUSEPORT
+    #define SO_REUSEPORT -1
+#endif
+
 using namespace Net;
 
+namespace {
+struct SocketOptionInfo
+{
+    const char* key; // in settings file and logs
+    int SocketOptions::* member;
+    int level;
+    int optionName;
+};
+const SocketOptionInfo g_socketOptionInfos[] = {
+    {"noDelay",           &SocketOptions::noDelay,           IPPROTO_TCP, TCP_NODELAY},
+    {"cork",              &SocketOptions::cork,              IPPROTO_TCP, TCP_CORK},
+    {"quickAck",          &SocketOptions::quickAck,          IPPROTO_TCP, TCP_QUICKACK},
+    {"sendBufferSize",    &SocketOptions::sendBufferSize,    SOL_SOCKET,  SO_SNDBUF},
+    {"receiveBufferSize", &SocketOptions::receiveBufferSize, SOL_SOCKET,  SO_RCVBUF},
+    {"keepAlive",         &SocketOptions::keepAlive,         SOL_SOCKET,  SO_KEEPALIVE},
+    {"keepAliveIdle",     &SocketOptions::keepAliveIdle,     IPPROTO_TCP, TCP_KEEPIDLE},
+    {"keepAliveInterval", &SocketOptions::keepAliveInterval, IPPROTO_TCP, TCP_KEEPINTVL},
+    {"keepAliveCount",    &SocketOptions::keepAliveCount,    IPPROTO_TCP, TCP_KEEPCNT},
+    {"userTimeout",       &SocketOptions::userTimeout,       IPPROTO_TCP, TCP_USER_TIMEOUT},
+    {"busyPoll",          &SocketOptions::busyPoll,          SOL_SOCKET,  SO_BUSY_POLL},
+    {"reusePort",         &SocketOptions::reusePort,         SOL_SOCKET,  SO_REUSEPORT},
+};
+} // namespace
+
+bool Net::operator==(const SocketOptions& lhv, const SocketOptions& rhv)
+{
+    for (const SocketOptionInfo& info : g_socketOptionInfos)
+    {
+        if (lhv.*info.member != rhv.*info.member)
+            return false;
+    }
+    return true;
+}
+QDataStream& Net::operator<<(QDataStream& stream, const SocketOptions& data)
+{
+    for (const SocketOptionInfo& info : g_socketOptionInfos)
+        stream << static_cast<qint32>(data.*info.member);
+    return stream;
+}
+QDataStream& Net::operator>>(QDataStream& stream, SocketOptions& data)
+{
+    for (const SocketOptionInfo& info : g_socketOptionInfos)
+    {
+        qint32 value = -1;
+        stream >> value;
+        data.*info.member = value;
+    }
+    return stream;
+}
+
+QString Net::toQString(SocketOptions const& data)
+{
+    QStringList items;
+    for (const SocketOptionInfo& info : g_socketOptionInfos)
+    {
+        if (data.*info.member >= 0)
+            items << QString("%1=%2").arg(info.key).arg(data.*info.member);
+    }
+    return items.isEmpty() ? QStringLiteral("system defaults") : items.join(' ');
+}
+
+QStringList Net::applySocketOptions(qintptr socketDescriptor, SocketOptions const& options)
+{
+    QStringList failed;
+    for (const SocketOptionInfo& info : g_socketOptionInfos)
+    {
+        const int value = options.*info.member;
+        if (value < 0)
+            continue;
+        if (info.optionName < 0)
+        {
+            failed << info.key;
+            continue;
+        }
+#ifdef _WIN32
+        const int res = ::setsockopt(static_cast<SOCKET>(socketDescriptor), info.level, info.optionName, reinterpret_cast<const char*>(&value), sizeof(value));
+#else
+        const int res = ::setsockopt(static_cast<int>(socketDescriptor), info.level, info.optionName, &value, sizeof(value));
+#endif
+        if (res != 0)
+            failed << info.key;
+    }
+    return failed;
+}
+
+SocketOptions Net::socketOptionsFromSettings(const QSettings& settings)
+{
+    SocketOptions options;
+    for (const SocketOptionInfo& info : g_socketOptionInfos)
+        options.*info.member = settings.value(info.key, -1).toInt();
+    return options;
+}
+
+void Net::socketOptionsToSettings(SocketOptions const& options, QSettings& settings)
+{
+    for (const SocketOptionInfo& info : g_socketOptionInfos)
+    {
+        if (options.*info.member >= 0)
+            settings.setValue(info.key, options.*info.member);
+        else
+            settings.remove(info.key);
+    }
+}
+
 bool Net::operator==(const ConnectionSettings& lhv, const ConnectionSettings& rhv)
 {
     return (true // for prettier code alignment
@@ -9,6 +143,8 @@ bool Net::operator==(const ConnectionSettings& lhv, const ConnectionSettings& rh
             && (lhv.ipDestination == rhv.ipDestination)
             && (lhv.portIn == rhv.portIn)
             && (lhv.portOut == rhv.portOut)
+            && (lhv.localServerName == rhv.localServerName)
+            && (lhv.socketOptions == rhv.socketOptions)
             );
 }
 QDataStream& Net::operator<<(QDataStream& stream, const ConnectionSettings& data)
@@ -17,6 +153,8 @@ QDataStream& Net::operator<<(QDataStream& stream, const ConnectionSettings& data
     stream << data.ipDestination;
     stream << data.portIn;
     stream << data.portOut;
+    stream << data.localServerName;
+    stream << data.socketOptions;
     return stream;
 }
 QDataStream& Net::operator>>(QDataStream& stream, ConnectionSettings& data)
@@ -25,6 +163,8 @@ QDataStream& Net::operator>>(QDataStream& stream, ConnectionSettings& data)
     stream >> data.ipDestination;
     stream >> data.portIn;
     stream >> data.portOut;
+    stream >> data.localServerName;
+    stream >> data.socketOptions;
     return stream;
 }
 
@@ -43,3 +183,12 @@ QList<AddressPort> Net::addressPortListFromQString(const QString &s)
     }
     return result;
 }
+
+void Net::closeSocketDescriptor(qintptr socketDescriptor)
+{
+#ifdef _WIN32
+    ::closesocket(static_cast<SOCKET>(socketDescriptor));
+#else
+    ::close(static_cast<int>(socketDescriptor));
+#endif
+}
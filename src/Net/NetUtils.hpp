@@ -2,6 +2,7 @@
 
 #include <QtCore/QDataStream>
 #include <QtCore/QEventLoop>
+#include <QtCore/QSettings>
 #include <QtCore/QString>
 #include <QtCore/QThread>
 #include <QtCore/QTimer>
@@ -45,6 +46,12 @@ constexpr quint8 TcpServer            = 3;
 constexpr quint8 TcpClient            = 4;
 constexpr quint8 SslServer            = 5;
 constexpr quint8 SslClient            = 6;
+constexpr quint8 EpollTcpServer       = 7;
+constexpr quint8 UringTcpServer       = 8;
+constexpr quint8 LocalServer          = 9;
+constexpr quint8 LocalClient          = 10;
+constexpr quint8 MemoryServer         = 11;
+constexpr quint8 MemoryClient         = 12;
 }
 
 enum class ConnectionState
@@ -60,13 +67,20 @@ struct AddressPort
     quint16 port{0};
 };
 inline QString toQString(AddressPort const& data) { return data.addr.toString() + ':' + QString::number(data.port); }
+// Peers of LocalServer have no address of their own, so each one is given AddressPort{localPeerAddress(), n} with n unique among its connected clients.
+// "::" is never a peer address of TCP connection, so clients of TCP and local servers can share the same tables
+inline QHostAddress localPeerAddress() { return QHostAddress(QHostAddress::AnyIPv6); }
+// Same for peers of MemoryServer, which are in the same process: "0.0.0.0" is never a peer address of TCP connection either
+inline QHostAddress memoryPeerAddress() { return QHostAddress(QHostAddress::AnyIPv4); }
 inline bool operator==(const Net::AddressPort& lhv, const Net::AddressPort& rhv)
 {
     return (lhv.addr == rhv.addr) && (lhv.port == rhv.port);
 }
+// Whole 128 bits of address, IPv4 one in its IPv4-mapped form (as operator== treats them equal); hashing toIPv4Address() put every IPv6 peer into one bucket
 inline uint qHash(const Net::AddressPort& key, uint seed)
 {
-    return ::qHash(key.addr.toIPv4Address(), seed) ^ key.port;
+    const Q_IPV6ADDR addr = key.addr.toIPv6Address();
+    return qHashBits(addr.c, sizeof(addr.c), seed) ^ key.port;
 }
 inline QDataStream& operator<<(QDataStream& stream, const AddressPort& data)
 {
@@ -77,17 +91,48 @@ inline QDataStream& operator>>(QDataStream& stream, AddressPort& data)
     return (stream >> data.addr >> data.port);
 }
 
+// Options set on TCP sockets of connection, both listening and accepted ones (accepted sockets don't reliably inherit them).
+// -1 leaves system default. Options without support on the platform are reported as failed when set
+struct SocketOptions
+{
+    int noDelay = -1;           // TCP_NODELAY: 1 sends small frames like progress updates right away instead of waiting for ACK of the previous ones
+    int cork = -1;              // TCP_CORK (Linux): 1 holds partial segments for up to 200 ms, for bulk connections only
+    int quickAck = -1;          // TCP_QUICKACK (Linux): 1 disables delayed ACK; kernel may turn delayed ACK back on by itself
+    int sendBufferSize = -1;    // SO_SNDBUF, bytes (Linux doubles it)
+    int receiveBufferSize = -1; // SO_RCVBUF, bytes; on listening socket it's applied before window scale of accepted ones is negotiated
+    int keepAlive = -1;         // SO_KEEPALIVE
+    int keepAliveIdle = -1;     // TCP_KEEPIDLE, seconds of idling before the first probe
+    int keepAliveInterval = -1; // TCP_KEEPINTVL, seconds between probes
+    int keepAliveCount = -1;    // TCP_KEEPCNT, unanswered probes before connection is dropped
+    int userTimeout = -1;       // TCP_USER_TIMEOUT (Linux), ms that sent data may stay unacknowledged before connection is dropped
+    int busyPoll = -1;          // SO_BUSY_POLL (Linux), us of busy polling device queue on blocking reads; raising it needs CAP_NET_ADMIN
+    int reusePort = -1;         // SO_REUSEPORT: 1 lets several listening sockets bind the same port, so that kernel spreads connections among them
+};
+bool operator==(const SocketOptions& lhv, const SocketOptions& rhv);
+QDataStream& operator<<(QDataStream& stream, const SocketOptions& data);
+QDataStream& operator>>(QDataStream& stream, SocketOptions& data);
+QString toQString(SocketOptions const& data); // only those which are set
+QStringList applySocketOptions(qintptr socketDescriptor, SocketOptions const& options); // returns names of options which failed
+// Current group of settings file, key per SocketOptions member; absent keys are -1
+SocketOptions socketOptionsFromSettings(const QSettings& settings);
+void socketOptionsToSettings(SocketOptions const& options, QSettings& settings);
+
 struct ConnectionSettings // Contains data required to create a connection
 {
     QHostAddress ipLocal{QHostAddress::AnyIPv4};
     QHostAddress ipDestination;
     quint16 portIn = 0;
     quint16 portOut = 0;
+    QString localServerName; // QLocalServer name or socket path, only used by LocalServer and LocalClient; name within the process for MemoryServer and MemoryClient
+    SocketOptions socketOptions; // not used by LocalServer and LocalClient
 };
 bool operator==(const ConnectionSettings& lhv, const ConnectionSettings& rhv);
 QDataStream& operator<<(QDataStream& stream, const ConnectionSettings& data);
 QDataStream& operator>>(QDataStream& stream, ConnectionSettings& data);
 
+// Top bit of frame length prefix marks payload encoded by Net::CompressionContext. QByteArray can't hold 2 GiB anyway, so lengths never need it
+constexpr quint32 g_encodedFrameFlag = 0x80000000u;
+
 struct PendingMessage
 {
     QByteArray msg;
@@ -130,6 +175,8 @@ QString toQString(QList<T> const& a_list, QString const& delimiter)
 
 QList<AddressPort> addressPortListFromQString(const QString &s);
 
+void closeSocketDescriptor(qintptr socketDescriptor); // for descriptors which were never wrapped into QAbstractSocket
+
 } // namespace Net
 
 Q_DECLARE_METATYPE(Net::ConnectionState)
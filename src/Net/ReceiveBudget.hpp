@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+#include <QtCore/QString>
+
+namespace Net
+{
+struct ReceiveLimits
+{
+    quint32 maxFrameSize = 64 * 1024 * 1024; // length prefix announcing more than that is treated as hostile
+    qint64 maxConnectionBytes = 65 * 1024 * 1024; // bytes one connection may hold for frames it hasn't completed yet
+    qint64 maxTotalBytes = 1024LL * 1024 * 1024; // same, summed over all connections of a server including its shards, plus frames a slow callback hasn't taken yet
+    int partialFrameTimeout = 30000; // msec to complete a frame once part of it has arrived, 0 - no deadline
+};
+
+enum class ShedReason
+{
+    None,
+    FrameTooLarge,
+    ConnectionBufferExceeded,
+    TotalMemoryExceeded,
+    PartialFrameTimeout,
+};
+constexpr int g_shedReasonCount = static_cast<int>(ShedReason::PartialFrameTimeout) + 1;
+inline QString toQString(ShedReason reason)
+{
+    switch (reason)
+    {
+    case ShedReason::FrameTooLarge: { return QStringLiteral("frame too large"); }
+    case ShedReason::ConnectionBufferExceeded: { return QStringLiteral("connection receive buffer exceeded"); }
+    case ShedReason::TotalMemoryExceeded: { return QStringLiteral("total receive memory exceeded"); }
+    case ShedReason::PartialFrameTimeout: { return QStringLiteral("partial frame timed out"); }
+    case ShedReason::None: [[fallthrough]];
+    default: { return {}; }
+    }
+}
+
+// Receive memory accounting shared by all FrameReaders of a server, its shards included, hence atomics
+class ReceiveBudget
+{
+public:
+    explicit ReceiveBudget(ReceiveLimits const& a_limits) : limits(a_limits) {}
+
+    const ReceiveLimits limits;
+
+    // Returns false and reserves nothing if limits.maxTotalBytes would be exceeded
+    bool tryReserve(qint64 byteCount)
+    {
+        if (m_usedBytes.fetch_add(byteCount, std::memory_order_relaxed) + byteCount > limits.maxTotalBytes)
+        {
+            m_usedBytes.fetch_sub(byteCount, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+    // Reserves even beyond limits.maxTotalBytes, for memory which is taken already; tryReserve() fails until it's released
+    void reserve(qint64 byteCount) { m_usedBytes.fetch_add(byteCount, std::memory_order_relaxed); }
+    void release(qint64 byteCount) { m_usedBytes.fetch_sub(byteCount, std::memory_order_relaxed); }
+    qint64 usedBytes() const { return m_usedBytes.load(std::memory_order_relaxed); }
+
+    void countShed(ShedReason reason) { m_shedCounts[static_cast<int>(reason)].fetch_add(1, std::memory_order_relaxed); }
+    quint64 shedCount(ShedReason reason) const { return m_shedCounts[static_cast<int>(reason)].load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<qint64> m_usedBytes{0};
+    std::array<std::atomic<quint64>, g_shedReasonCount> m_shedCounts{};
+};
+} // namespace Net
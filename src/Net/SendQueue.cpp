@@ -0,0 +1,307 @@
+#include "SendQueue.hpp"
+
+#include <cerrno>
+
+#include <QtCore/QtEndian>
+
+#if defined(Q_OS_UNIX)
+    #include <sys/socket.h>
+    #include <sys/uio.h>
+#endif
+#if defined(NET_ZEROCOPY)
+    #include <linux/errqueue.h>
+    #include <netinet/in.h>
+#endif
+
+#include "NetUtils.hpp"
+
+using namespace Net;
+
+namespace
+{
+#if defined(MSG_NOSIGNAL)
+constexpr int s_sendFlags = MSG_NOSIGNAL | MSG_DONTWAIT; // peer may be gone already, that must surface as socket error, not SIGPIPE
+#elif defined(Q_OS_UNIX)
+constexpr int s_sendFlags = MSG_DONTWAIT; // platforms without MSG_NOSIGNAL get SO_NOSIGPIPE set by Qt
+#endif
+
+quint32 encodeFrameHeader(quint32 payloadSize)
+{
+    return (Net::g_endianness == QDataStream::BigEndian) ? qToBigEndian(payloadSize) : qToLittleEndian(payloadSize);
+}
+} // namespace
+
+qint64 SendQueue::enqueueFrame(const QByteArray& payload, bool isEncoded)
+{
+    m_frames.enqueue(Frame{encodeFrameHeader(static_cast<quint32>(payload.size()) | (isEncoded ? Net::g_encodedFrameFlag : 0)), payload});
+    const qint64 frameSize = s_headerSize + payload.size();
+    m_stats.queuedBytes += frameSize;
+    m_stats.totalQueuedBytes += frameSize;
+    return frameSize;
+}
+
+qint64 SendQueue::drain(QAbstractSocket* pSocket)
+{
+    qint64 totalWritten = 0;
+#if defined(Q_OS_UNIX)
+    // Kernel can be written to directly only while socket holds nothing, otherwise bytes would get reordered
+    if (!m_frames.isEmpty() && (pSocket->bytesToWrite() == 0) && (pSocket->state() == QAbstractSocket::ConnectedState))
+        totalWritten += writeToDescriptor(pSocket->socketDescriptor());
+#endif
+    totalWritten += writeToDevice(pSocket);
+    m_stats.queuedBytes -= totalWritten;
+    m_stats.totalWrittenBytes += totalWritten;
+    return totalWritten;
+}
+
+qint64 SendQueue::drain(QLocalSocket* pSocket)
+{
+    qint64 totalWritten = 0;
+#if defined(Q_OS_UNIX)
+    // Unix domain socket takes the same sendmsg(); on Windows local socket is a named pipe and goes through QIODevice only
+    if (!m_frames.isEmpty() && (pSocket->bytesToWrite() == 0) && (pSocket->state() == QLocalSocket::ConnectedState))
+        totalWritten += writeToDescriptor(pSocket->socketDescriptor());
+#endif
+    totalWritten += writeToDevice(pSocket);
+    m_stats.queuedBytes -= totalWritten;
+    m_stats.totalWrittenBytes += totalWritten;
+    return totalWritten;
+}
+
+#if defined(Q_OS_UNIX)
+qint64 SendQueue::drain(qintptr socketDescriptor)
+{
+    const qint64 totalWritten = writeToDescriptor(socketDescriptor);
+    m_stats.queuedBytes -= totalWritten;
+    m_stats.totalWrittenBytes += totalWritten;
+    return totalWritten;
+}
+#endif
+
+void SendQueue::clear()
+{
+    m_frames.clear();
+    m_headOffset = 0;
+    m_stats.queuedBytes = 0;
+    m_stats.pendingBytes = 0;
+    m_stats.isCongested = false;
+#if defined(NET_ZEROCOPY)
+    // Socket is gone or about to be, its completions will never be read. Kernel keeps payload pages pinned by itself
+    if (m_reapTimer)
+        m_reapTimer->stop();
+    m_pinnedPayloads.clear();
+    m_zeroCopyState = ZeroCopyState::Unknown;
+    m_zeroCopyDescriptor = -1;
+#endif
+}
+
+bool SendQueue::updateCongestion(qint64 deviceBufferedBytes, SendWatermarks const& watermarks)
+{
+    m_stats.pendingBytes = m_stats.queuedBytes + deviceBufferedBytes;
+    m_stats.peakPendingBytes = qMax(m_stats.peakPendingBytes, m_stats.pendingBytes);
+    const bool wasCongested = m_stats.isCongested;
+    if (!wasCongested && m_stats.pendingBytes >= watermarks.high)
+        m_stats.isCongested = true;
+    else if (wasCongested && m_stats.pendingBytes <= watermarks.low)
+        m_stats.isCongested = false;
+    return (wasCongested != m_stats.isCongested);
+}
+
+// Advances past byteCount sent bytes, dropping frames that were sent completely
+void SendQueue::consume(qint64 byteCount)
+{
+    while (byteCount > 0)
+    {
+        const qint64 frameLeft = s_headerSize + m_frames.head().payload.size() - m_headOffset;
+        if (byteCount < frameLeft)
+        {
+            m_headOffset += byteCount;
+            return;
+        }
+        byteCount -= frameLeft;
+        m_frames.dequeue();
+        m_headOffset = 0;
+    }
+}
+
+qint64 SendQueue::writeToDevice(QIODevice* pDevice)
+{
+    qint64 totalWritten = 0;
+    while (!m_frames.isEmpty())
+    {
+        const qint64 deviceSpace = s_deviceBufferLimit - pDevice->bytesToWrite();
+        if (deviceSpace <= 0)
+            break;
+        const Frame& frame = m_frames.head();
+        const char* pData = nullptr;
+        qint64 dataLeft = 0;
+        if (m_headOffset < s_headerSize)
+        {
+            pData = reinterpret_cast<const char*>(&frame.header) + m_headOffset;
+            dataLeft = s_headerSize - m_headOffset;
+        }
+        else
+        {
+            pData = frame.payload.constData() + (m_headOffset - s_headerSize);
+            dataLeft = frame.payload.size() - (m_headOffset - s_headerSize);
+        }
+        const qint64 written = pDevice->write(pData, qMin(deviceSpace, dataLeft));
+        if (written <= 0) // device is closed or failed, nothing to do until it's reopened
+            break;
+        consume(written);
+        totalWritten += written;
+    }
+    return totalWritten;
+}
+
+#if defined(Q_OS_UNIX)
+// Gathers header and payload of as many queued frames as fit into one sendmsg() call. Whatever kernel doesn't accept is left for writeToDevice()
+qint64 SendQueue::writeToDescriptor(qintptr socketDescriptor)
+{
+    qint64 totalWritten = 0;
+    while (!m_frames.isEmpty())
+    {
+#if defined(NET_ZEROCOPY)
+        reapZeroCopyCompletions();
+        if ((m_frames.head().payload.size() >= s_zeroCopyThreshold) && (m_zeroCopyState != ZeroCopyState::Unsupported))
+        {
+            const qint64 written = writeZeroCopy(socketDescriptor);
+            if (written > 0)
+            {
+                totalWritten += written;
+                continue;
+            }
+            if (written == 0) // kernel buffer is full
+                break;
+            // otherwise zerocopy is not available right now, send with copy
+        }
+#endif
+        iovec iov[s_maxIovecCount];
+        int iovCount = 0;
+        qint64 requestedSize = 0;
+        qint64 offset = m_headOffset;
+        for (auto iter = m_frames.cbegin(); (iter != m_frames.cend()) && (iovCount + 2 <= s_maxIovecCount); ++iter)
+        {
+            if (offset < s_headerSize)
+            {
+                iov[iovCount].iov_base = const_cast<char*>(reinterpret_cast<const char*>(&iter->header) + offset);
+                iov[iovCount].iov_len = static_cast<size_t>(s_headerSize - offset);
+                requestedSize += iov[iovCount].iov_len;
+                ++iovCount;
+                offset = s_headerSize;
+            }
+            const qint64 payloadOffset = offset - s_headerSize;
+            if (payloadOffset < iter->payload.size())
+            {
+                iov[iovCount].iov_base = const_cast<char*>(iter->payload.constData() + payloadOffset);
+                iov[iovCount].iov_len = static_cast<size_t>(iter->payload.size() - payloadOffset);
+                requestedSize += iov[iovCount].iov_len;
+                ++iovCount;
+            }
+            offset = 0;
+        }
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovCount;
+        ++m_stats.writeCalls;
+        const ssize_t written = ::sendmsg(static_cast<int>(socketDescriptor), &msg, s_sendFlags);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0) // EAGAIN or socket error - socket itself will buffer the rest and report the error
+            break;
+        ++m_stats.vectoredWrites;
+        consume(written);
+        totalWritten += written;
+        if (written < requestedSize) // kernel buffer is full
+            break;
+    }
+    return totalWritten;
+}
+#else
+qint64 SendQueue::writeToDescriptor(qintptr)
+{
+    return 0;
+}
+#endif
+
+#if defined(NET_ZEROCOPY)
+// Sends the rest of head frame. Header goes by plain copy with MSG_MORE, since Frame's memory is reused as soon as frame is dequeued.
+// Returns number of bytes sent, 0 if kernel buffer is full, -1 if frame has to be sent with copy
+qint64 SendQueue::writeZeroCopy(qintptr socketDescriptor)
+{
+    const int fd = static_cast<int>(socketDescriptor);
+    if (m_zeroCopyState == ZeroCopyState::Unknown)
+    {
+        const int isEnabled = 1;
+        m_zeroCopyState = (::setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &isEnabled, sizeof(isEnabled)) == 0) ? ZeroCopyState::Enabled : ZeroCopyState::Unsupported;
+        if (m_zeroCopyState == ZeroCopyState::Unsupported)
+            return -1;
+        m_zeroCopyDescriptor = socketDescriptor;
+    }
+
+    const Frame& frame = m_frames.head();
+    qint64 totalWritten = 0;
+    if (m_headOffset < s_headerSize)
+    {
+        ++m_stats.writeCalls;
+        const ssize_t written = ::send(fd, reinterpret_cast<const char*>(&frame.header) + m_headOffset, static_cast<size_t>(s_headerSize - m_headOffset), s_sendFlags | MSG_MORE);
+        if (written <= 0)
+            return 0;
+        consume(written);
+        if (m_headOffset < s_headerSize)
+            return written;
+        totalWritten += written;
+    }
+
+    const qint64 payloadOffset = m_headOffset - s_headerSize;
+    ++m_stats.writeCalls;
+    const ssize_t written = ::send(fd, frame.payload.constData() + payloadOffset, static_cast<size_t>(frame.payload.size() - payloadOffset), s_sendFlags | MSG_ZEROCOPY);
+    if (written < 0) // ENOBUFS means socket ran out of optmem for completion notifications, then frame is sent with copy
+        return ((errno == ENOBUFS) && (totalWritten == 0)) ? -1 : totalWritten;
+    ++m_stats.zeroCopyWrites;
+    m_pinnedPayloads.enqueue(PinnedPayload{m_nextZeroCopyId++, frame.payload});
+    consume(written);
+    totalWritten += written;
+
+    if (!m_reapTimer)
+    {
+        m_reapTimer.reset(new QTimer);
+        m_reapTimer->setInterval(1);
+        QObject::connect(m_reapTimer.get(), &QTimer::timeout, [this]() { reapZeroCopyCompletions(); });
+    }
+    if (!m_reapTimer->isActive())
+        m_reapTimer->start();
+    return totalWritten;
+}
+
+void SendQueue::reapZeroCopyCompletions()
+{
+    while (!m_pinnedPayloads.isEmpty())
+    {
+        char control[128];
+        msghdr msg{};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (::recvmsg(static_cast<int>(m_zeroCopyDescriptor), &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+            break;
+        for (cmsghdr* pCmsg = CMSG_FIRSTHDR(&msg); pCmsg != nullptr; pCmsg = CMSG_NXTHDR(&msg, pCmsg))
+        {
+            const bool isRecvErr = ((pCmsg->cmsg_level == SOL_IP) && (pCmsg->cmsg_type == IP_RECVERR))
+                                || ((pCmsg->cmsg_level == SOL_IPV6) && (pCmsg->cmsg_type == IPV6_RECVERR));
+            if (!isRecvErr)
+                continue;
+            const sock_extended_err* pErr = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(pCmsg));
+            if ((pErr->ee_errno != 0) || (pErr->ee_origin != SO_EE_ORIGIN_ZEROCOPY))
+                continue;
+            // Completion covers ids [ee_info, ee_data]; ids wrap around, hence signed difference
+            const quint32 completedCount = pErr->ee_data - pErr->ee_info + 1;
+            if (pErr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                m_stats.zeroCopyCopied += completedCount;
+            while (!m_pinnedPayloads.isEmpty() && (static_cast<qint32>(pErr->ee_data - m_pinnedPayloads.head().id) >= 0))
+                m_pinnedPayloads.dequeue();
+        }
+    }
+    if (m_pinnedPayloads.isEmpty() && m_reapTimer)
+        m_reapTimer->stop();
+}
+#endif
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <memory>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QQueue>
+#include <QtCore/QTimer>
+#include <QtNetwork/QAbstractSocket>
+#include <QtNetwork/QLocalSocket>
+
+namespace Net
+{
+// Pending bytes of a connection are those in its SendQueue plus those already handed to the socket but not yet written to the network.
+// Connection becomes congested when pending bytes reach high watermark and stays so until they drop to low watermark
+struct SendWatermarks
+{
+    qint64 low = 256 * 1024;
+    qint64 high = 1024 * 1024;
+};
+
+struct SendQueueStats
+{
+    qint64 queuedBytes = 0; // waiting in SendQueue
+    qint64 pendingBytes = 0; // queuedBytes + bytes buffered by socket
+    qint64 peakPendingBytes = 0;
+    quint64 totalQueuedBytes = 0;
+    quint64 totalWrittenBytes = 0; // handed over to socket or kernel
+    quint64 vectoredWrites = 0; // sendmsg() calls made directly on socket descriptor
+    quint64 writeCalls = 0; // all send()/sendmsg() calls on socket descriptor, including ones which failed with EAGAIN
+    quint64 zeroCopyWrites = 0; // MSG_ZEROCOPY sends, only with NET_ZEROCOPY
+    quint64 zeroCopyCopied = 0; // MSG_ZEROCOPY sends for which kernel fell back to copying
+    bool isCongested = false;
+};
+
+// Outbound frames of one connection. Frame is kept as length header plus payload shared with the caller, so payload is never copied to prepend the header.
+// While socket's own write buffer is empty, queued frames are written straight to the descriptor with one sendmsg() of header/payload iovecs,
+// the rest is handed to the socket in chunks only while its write buffer is small, and waits here to be drained on bytesWritten().
+// Nothing blocks network thread, and per-connection backlog stays visible to the owner
+class SendQueue
+{
+public:
+    static constexpr qint64 s_deviceBufferLimit = 64 * 1024; // don't let QIODevice buffer more than that, it has no notion of watermarks
+    static constexpr int s_headerSize = sizeof(quint32); // same as Net::PendingMessage::pendingSize
+    static constexpr int s_maxIovecCount = 64;
+    static constexpr int s_zeroCopyThreshold = 256 * 1024; // MSG_ZEROCOPY only pays off for large payloads, below that page pinning costs more than copying
+
+    SendQueue() = default;
+    SendQueue(const SendQueue&) = delete;
+    SendQueue& operator=(const SendQueue&) = delete;
+
+    qint64 enqueueFrame(const QByteArray& payload, bool isEncoded = false); // returns size of the frame on the wire; isEncoded sets g_encodedFrameFlag
+    qint64 drain(QAbstractSocket* pSocket); // returns number of bytes handed to pSocket or written to its descriptor
+    qint64 drain(QLocalSocket* pSocket); // same for local socket, whose descriptor is written directly only on Unix
+#if defined(Q_OS_UNIX)
+    qint64 drain(qintptr socketDescriptor); // same for non-blocking descriptor without QAbstractSocket, whatever kernel doesn't take stays queued
+#endif
+    void clear();
+
+    // Returns true if congestion state has changed
+    bool updateCongestion(const QIODevice* pDevice, SendWatermarks const& watermarks) { return updateCongestion(pDevice->bytesToWrite(), watermarks); }
+    bool updateCongestion(qint64 deviceBufferedBytes, SendWatermarks const& watermarks);
+
+    bool isEmpty() const { return m_frames.isEmpty(); }
+    bool isCongested() const { return m_stats.isCongested; }
+    qint64 queuedBytes() const { return m_stats.queuedBytes; }
+    SendQueueStats const& stats() const { return m_stats; }
+
+private:
+    struct Frame
+    {
+        quint32 header; // payload size with g_encodedFrameFlag, already encoded in Net::g_endianness
+        QByteArray payload;
+    };
+
+    qint64 writeToDescriptor(qintptr socketDescriptor);
+    qint64 writeToDevice(QIODevice* pDevice);
+    void consume(qint64 byteCount);
+
+#if defined(NET_ZEROCOPY)
+    struct PinnedPayload
+    {
+        quint32 id; // kernel counts MSG_ZEROCOPY sends per socket, completions report ranges of these ids
+        QByteArray payload;
+    };
+    enum class ZeroCopyState { Unknown, Enabled, Unsupported };
+
+    qint64 writeZeroCopy(qintptr socketDescriptor);
+    void reapZeroCopyCompletions();
+
+    ZeroCopyState m_zeroCopyState = ZeroCopyState::Unknown;
+    qintptr m_zeroCopyDescriptor = -1;
+    quint32 m_nextZeroCopyId = 0;
+    QQueue<PinnedPayload> m_pinnedPayloads; // kernel reads them after sendmsg() has returned, so they must outlive it
+    // Completions arrive on socket's error queue, which makes the descriptor readable for the event loop until drained, so they are reaped promptly by timer
+    std::unique_ptr<QTimer> m_reapTimer;
+#endif
+
+    QQueue<Frame> m_frames;
+    qint64 m_headOffset = 0; // bytes of m_frames.head() already sent, header included
+    SendQueueStats m_stats;
+};
+} // namespace Net
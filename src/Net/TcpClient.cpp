@@ -2,21 +2,21 @@
 
 #include <cstdlib> // std::wctombs
 
+#include <QtCore/QMetaMethod>
+
 using namespace Net;
 
 TcpClient::TcpClient(const quint8 _connType, const QString _connTypeName, QObject* parent)
-    : NetConnection(_connType, _connTypeName, parent)
+    : NetClient(_connType, _connTypeName, parent)
     , m_pTcpSocket(createSocket())
 {
     // m_pTcpSocket = a_socket ? a_socket : new QTcpSocket(this);
     connect(m_pTcpSocket, &QTcpSocket::connected,    this, &TcpClient::onConnected);
     connect(m_pTcpSocket, &QTcpSocket::disconnected, this, &TcpClient::onDisconnected);
     connect(m_pTcpSocket, &QTcpSocket::readyRead,    this, &TcpClient::readReceived);
+    connect(m_pTcpSocket, &QTcpSocket::bytesWritten, this, &TcpClient::drainSendQueue);
     connect(m_pTcpSocket, &QTcpSocket::stateChanged, this, &NetConnection::socketStateChanged);
-
-    m_reconnectTimer = new QTimer(this);
-    m_reconnectTimer->setSingleShot(true);
-    connect(m_reconnectTimer, &QTimer::timeout, this, &TcpClient::tryConnectToHost, Qt::QueuedConnection);
+    connect(m_pTcpSocket, qOverload<QAbstractSocket::SocketError>(&QAbstractSocket::error), this, &TcpClient::onSocketError);
 }
 
 TcpClient::~TcpClient()
@@ -40,9 +40,7 @@ Net::ConnectionState TcpClient::openConnection(ConnectionSettings const& a_conne
     }
     if ((m_connectionSettings.ipLocal != QHostAddress::Null))
     {
-        bool isBinded = m_pTcpSocket->bind(m_connectionSettings.ipLocal, m_connectionSettings.portIn,
-                                           QAbstractSocket::ShareAddress | QAbstractSocket::ReuseAddressHint);
-        if (isBinded == false)
+        if (bindLocal() == false)
         {
             m_connectionState = ConnectionState::NotCreated;
             f_logError(QString("%1: Failed to open connection - %2").arg(nameId()).arg(m_pTcpSocket->errorString()));
@@ -52,66 +50,107 @@ Net::ConnectionState TcpClient::openConnection(ConnectionSettings const& a_conne
 
         m_connectionState = ConnectionState::Created;
     }
-    connect(m_pTcpSocket, qOverload<QAbstractSocket::SocketError>(&QAbstractSocket::error), this, &TcpClient::printError);
-    tryConnectToHost();
+    startConnecting();
     return m_connectionState;
 }
 
 void TcpClient::closeConnection()
 {
-    m_reconnectTimer->stop();
+    stopConnecting();
     m_pTcpSocket->close();
+    clearSendQueue();
     if (m_connectionState == ConnectionState::Created)
         f_logGeneral(QString("%1: Closed connection").arg(nameId()));
     m_connectionState = ConnectionState::NotCreated;
-    disconnect(m_pTcpSocket, qOverload<QAbstractSocket::SocketError>(&QAbstractSocket::error), this, &TcpClient::printError);
     emit closedConnection();
     return;
 }
 
-void TcpClient::tryConnectToHost()
+bool TcpClient::bindLocal()
 {
-    m_pTcpSocket->connectToHost(m_connectionSettings.ipDestination, m_connectionSettings.portOut, QIODevice::ReadWrite);
-    bool isConnected = m_pTcpSocket->waitForConnected(m_waitForConnectedInterval);
-    if (isConnected)
-    {
-        emit openedConnection(true);
-        m_reconnectTimer->stop();
-        authorize();
-    }
-    else
+    return m_pTcpSocket->bind(m_connectionSettings.ipLocal, m_connectionSettings.portIn, QAbstractSocket::ShareAddress | QAbstractSocket::ReuseAddressHint);
+}
+
+// Attempt ends in onConnected() or, through socket error, in onConnectFailed()
+void TcpClient::startConnectAttempt()
+{
+    const QAbstractSocket::SocketState socketState = m_pTcpSocket->state();
+    if ((socketState != QAbstractSocket::UnconnectedState) && (socketState != QAbstractSocket::BoundState))
+        m_pTcpSocket->abort();
+    // Failed attempt leaves socket unbound
+    if ((m_connectionSettings.ipLocal != QHostAddress::Null) && (m_pTcpSocket->state() == QAbstractSocket::UnconnectedState) && (bindLocal() == false))
     {
-        emit openedConnection(false);
-        if (m_isReconnectEnabled)
-            m_reconnectTimer->start(m_reconnectInterval);
+        onConnectFailed();
+        return;
     }
-    return;
+    m_pTcpSocket->connectToHost(m_connectionSettings.ipDestination, m_connectionSettings.portOut, QIODevice::ReadWrite);
 }
 
-// Send the message and return the number of bytes that were actually sent, or -1 in case of error.
+void TcpClient::abortConnectAttempt()
+{
+    if (m_pTcpSocket->state() != QAbstractSocket::UnconnectedState)
+        m_pTcpSocket->abort();
+}
+
+QString TcpClient::describeServer() const
+{
+    return QString("TCP server %1:%2").arg(m_connectionSettings.ipDestination.toString()).arg(m_connectionSettings.portOut);
+}
+
+// Queue the message and return the size of queued frame, or -1 in case of error.
+// Frame is written asynchronously as socket drains, use congestionChanged() to throttle the producer
 qint64 TcpClient::sendMessage(const QByteArray& msg)
 {
-    qint64 bytesWritten = -1;
+    return enqueueMessage(msg, false);
+}
+
+qint64 TcpClient::sendEncodedMessage(const QByteArray& payload)
+{
+    return enqueueMessage(payload, true);
+}
+
+qint64 TcpClient::enqueueMessage(const QByteArray& msg, bool isEncoded)
+{
     if (m_pTcpSocket->state() != QAbstractSocket::ConnectedState)
         return -1;
 
-    const decltype(Net::PendingMessage::pendingSize) msgSize = static_cast<decltype(msgSize)>(msg.size());
-    QByteArray header(reinterpret_cast<const char*>(&msgSize), sizeof(msgSize));
-    bytesWritten = m_pTcpSocket->write(header + msg);
-    m_pTcpSocket->waitForBytesWritten(1000);
-    if (bytesWritten > 0)
-        emit writeDone((bytesWritten == msg.size()) ? msg : msg.mid(0, bytesWritten));
-    return bytesWritten;
+    static const QMetaMethod s_writeDoneSignal = QMetaMethod::fromSignal(&NetConnection::writeDone);
+    const qint64 frameSize = m_sendQueue.enqueueFrame(msg, isEncoded);
+    drainSendQueue();
+    if (isSignalConnected(s_writeDoneSignal))
+        emit writeDone(msg);
+    return frameSize;
+}
+
+void TcpClient::drainSendQueue()
+{
+    m_sendQueue.drain(m_pTcpSocket);
+    if (m_sendQueue.updateCongestion(m_pTcpSocket, m_sendWatermarks))
+        emit congestionChanged(m_sendQueue.isCongested(), m_sendQueue.stats().pendingBytes);
+}
+
+// Frames left in queue belong to the lost connection, they must not leak into the next one after reconnect
+void TcpClient::clearSendQueue()
+{
+    const bool wasCongested = m_sendQueue.isCongested();
+    m_sendQueue.clear();
+    if (wasCongested)
+        emit congestionChanged(false, 0);
 }
 
 void TcpClient::onConnected()
 {
+    onConnectSucceeded();
+    applySocketOptions(m_pTcpSocket->socketDescriptor()); // QTcpSocket has no descriptor until it connects, unless it was bound
     f_logGeneral(QString("%1: %2:%3 connected to TCP server %4:%5")
                  .arg(nameId())
                  .arg(m_pTcpSocket->localAddress().toString())
                  .arg(m_pTcpSocket->localPort())
                  .arg(m_pTcpSocket->peerAddress().toString())
                  .arg(m_pTcpSocket->peerPort()));
+    emit openedConnection(true);
+    authorize();
+    offerCodecs();
 }
 
 void TcpClient::onDisconnected()
@@ -122,8 +161,10 @@ void TcpClient::onDisconnected()
                  .arg(m_pTcpSocket->localPort())
                  .arg(m_pTcpSocket->peerAddress().toString())
                  .arg(m_pTcpSocket->peerPort()));
-    if (m_isReconnectEnabled && m_pTcpSocket->state() != QAbstractSocket::ConnectedState)
-        m_reconnectTimer->start(m_reconnectInterval);
+    clearSendQueue();
+    m_frameReader.clear(); // partial frame of the lost connection must not prefix the next one's data
+    m_pCompression->clearPeers(); // next server may not support compression
+    onConnectionLost();
 }
 
 void TcpClient::authorize()
@@ -136,76 +177,38 @@ void TcpClient::authorize()
     sendMessage(msg);
 }
 
-void TcpClient::readReceived()
-{
-    MAKE_QDATASTREAM_NET_D(streamSocket, m_pTcpSocket);
-    while (m_pTcpSocket->bytesAvailable() > 0)
-    {
-        if (m_pendingMsg.pendingSize == 0)
-        {
-            if (m_pTcpSocket->bytesAvailable() < m_headerSize)
-                break;
-            streamSocket >> m_pendingMsg.pendingSize;
-            m_pendingMsg.msg.resize(m_pendingMsg.pendingSize);
-            m_pendingMsg.curPos = 0;
-        }
-        const decltype(Net::PendingMessage::pendingSize) availableSize = static_cast<decltype(availableSize)>(m_pTcpSocket->bytesAvailable());
-        if (availableSize < m_pendingMsg.pendingSize)
-        {
-            streamSocket.readRawData((m_pendingMsg.msg.data() + m_pendingMsg.curPos), availableSize);
-            emit readPartialDone(m_pendingMsg.msg.mid(m_pendingMsg.curPos, availableSize));
-            m_pendingMsg.curPos += availableSize;
-            m_pendingMsg.pendingSize -= availableSize;
-            break;
-        }
-        streamSocket.readRawData((m_pendingMsg.msg.data() + m_pendingMsg.curPos), m_pendingMsg.pendingSize);
-        emit readPartialDone(m_pendingMsg.msg.mid(m_pendingMsg.curPos, m_pendingMsg.pendingSize));
-        emit readDone(m_pendingMsg.msg);
-        m_pendingMsg.curPos = 0;
-        m_pendingMsg.pendingSize = 0;
-        f_onReceivedMessage(m_pendingMsg.msg, this, {m_connectionSettings.ipDestination, m_connectionSettings.portOut});
-    }
-    return;
-}
-
-void TcpClient::setEnableReconnect(bool isEnabled)
+void TcpClient::offerCodecs()
 {
-    m_isReconnectEnabled = isEnabled;
-    QTimer::singleShot(0, this, [this](){
-        if (m_isReconnectEnabled == false)
-            m_reconnectTimer->stop();
-        else if ((m_isReconnectEnabled == true) && (m_pTcpSocket->state() != QAbstractSocket::ConnectedState))
-            m_reconnectTimer->start(m_reconnectInterval);
-    });
-    return;
-}
-
-void TcpClient::setWaitTimes(int reconnectInterval, int waitForConnectedInterval)
-{
-    m_reconnectInterval = reconnectInterval;
-    m_waitForConnectedInterval = waitForConnectedInterval;
-    // reconnectTimer is singleShot and calls start(m_reconnectInterval) each time, so calling QTimer::setInterval here is not required
-    // QTimer::singleShot(0, this, [this](){ m_reconnectTimer->setInterval(m_reconnectInterval); }); // queued call in case caller's thread != timer's thread
+    const quint8 codecMask = m_pCompression->settings().codecMask;
+    if (codecMask == 0)
+        return;
+    sendEncodedMessage(Net::makeCodecOffer(codecMask));
 }
 
-void TcpClient::setLoginData(Net::LoginData a_loginData)
+void TcpClient::readReceived()
 {
-    if (m_connectionState == Net::ConnectionState::Created)
+    static const QMetaMethod s_readDoneSignal = QMetaMethod::fromSignal(&NetConnection::readDone);
+    static const QMetaMethod s_readPartialDoneSignal = QMetaMethod::fromSignal(&TcpClient::readPartialDone);
+    markReadStarted();
+    // Diagnostic signals copy data and take a timestamp, so they are emitted only when somebody listens
+    const bool isReadDoneObserved = isSignalConnected(s_readDoneSignal);
+    const bool isReadPartialDoneObserved = isSignalConnected(s_readPartialDoneSignal);
+    if (isReadPartialDoneObserved != static_cast<bool>(m_frameReader.f_onChunk))
     {
-        f_logGeneral(QString("%1: called setLoginData() while connection is open - action forbidden").arg(nameId()));
-        return;
+        if (isReadPartialDoneObserved)
+            m_frameReader.f_onChunk = [this](const char* data, int size) { emit readPartialDone(QByteArray(data, size)); };
+        else
+            m_frameReader.f_onChunk = nullptr;
     }
-    m_loginData = a_loginData;
-}
-
-void TcpClient::setAuthorizationEnabled(bool isEnabled)
-{
-    if (m_connectionState == Net::ConnectionState::Created)
+    QByteArray msg;
+    while (m_frameReader.readFrame(m_pTcpSocket, msg))
     {
-        f_logGeneral(QString("%1: called setAuthorizationEnabled() while connection is open - action forbidden").arg(nameId()));
-        return;
+        if (isReadDoneObserved)
+            emit readDone(msg);
+        deliverReceivedMessage(msg, {m_connectionSettings.ipDestination, m_connectionSettings.portOut}, m_frameReader.isFrameEncoded());
     }
-    m_isAuthorizationEnabled = isEnabled;
+    flushReceivedBatch({m_connectionSettings.ipDestination, m_connectionSettings.portOut});
+    return;
 }
 
 Net::ConnectionSettings TcpClient::getConnectionSettingsActive() const
@@ -1,11 +1,12 @@
 #pragma once
 
-#include <QtCore/QTimer>
 #include <QtNetwork/QTcpSocket>
 
-#include "NetConnection.hpp"
+#include "FrameReader.hpp"
+#include "NetClient.hpp"
+#include "SendQueue.hpp"
 
-class TcpClient : public NetConnection
+class TcpClient : public NetClient
 {
     Q_OBJECT
 protected:
@@ -23,28 +24,25 @@ public:
 protected: // members
     QTcpSocket* m_pTcpSocket;
 
-    Net::PendingMessage m_pendingMsg;
-    decltype(Net::PendingMessage::pendingSize) m_headerSize = sizeof(m_headerSize);
+    Net::FrameReader m_frameReader;
 
-    QTimer* m_reconnectTimer = nullptr;
-    bool m_isReconnectEnabled = true;
-    int m_reconnectInterval = 60000; // msec
-    int m_waitForConnectedInterval = 10000; // msec
-
-    Net::LoginData m_loginData;
-    bool m_isAuthorizationEnabled = false;
+    Net::SendQueue m_sendQueue;
 
 public: // methods
     virtual void printConnectionInfo() const override;
 
-    QAbstractSocket::SocketState getSocketState() const { return m_pTcpSocket->state(); }
+    QAbstractSocket::SocketState getSocketState() const override { return m_pTcpSocket->state(); }
     QString getLastErrorString() const final { return m_pTcpSocket->errorString(); }
     Net::ConnectionSettings getConnectionSettingsActive() const final; // will differ from m_connectionSettings if ip=Any or port=0, those being actually used ones
+    Net::SendQueueStats getSendQueueStats() const override { return m_sendQueue.stats(); }
 
-    void setEnableReconnect(bool isEnabled);
-    void setWaitTimes(int reconnectInterval, int waitForConnectedInterval);
-    void setLoginData(Net::LoginData a_loginData);
-    void setAuthorizationEnabled(bool isEnabled);
+protected:
+    void startConnectAttempt() override;
+    void abortConnectAttempt() override;
+    QString describeServer() const override;
+    bool bindLocal(); // to ipLocal:portIn of settings
+    qint64 enqueueMessage(const QByteArray& msg, bool isEncoded);
+    qint64 sendEncodedMessage(const QByteArray& payload) override;
 
 public slots:
     virtual Net::ConnectionState openConnection(Net::ConnectionSettings const& a_connectionSettings) override;
@@ -54,10 +52,12 @@ public slots:
 protected slots:
     virtual void readReceived() override;
     void printError() const final;
-    virtual void tryConnectToHost();
     void onConnected();
     void onDisconnected();
     void authorize();
+    void offerCodecs(); // right after authorize(), so that server sees login data first
+    void drainSendQueue();
+    void clearSendQueue();
 
 signals:
     void readPartialDone(const QByteArray& msg, const QDateTime& dt = QDateTime::currentDateTimeUtc()) const;
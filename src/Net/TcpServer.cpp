@@ -2,22 +2,31 @@
 
 #include <type_traits>
 
+#include <QtCore/QMetaMethod>
+
+#include "NetThread.hpp"
+
 using namespace Net;
 using namespace std;
 
+void TcpListener::incomingConnection(qintptr socketDescriptor)
+{
+    if (f_onNewDescriptor)
+        f_onNewDescriptor(socketDescriptor);
+    else
+        QTcpServer::incomingConnection(socketDescriptor);
+}
+
 TcpServer::TcpServer(const quint8 _connType, const QString _connTypeName, QObject* parent)
-    : NetConnection(_connType, _connTypeName, parent)
-    , m_pServer(new QTcpServer(this))
-{
-    connect(this, qOverload<QByteArray, QHostAddress, quint16>(&TcpServer::sendMessageToQueued), this, qOverload<QByteArray, QHostAddress, quint16>(&TcpServer::sendMessageTo), Qt::QueuedConnection);
-    connect(this, qOverload<QByteArray, Net::AddressPort>(&TcpServer::sendMessageToQueued), this, qOverload<QByteArray, Net::AddressPort>(&TcpServer::sendMessageTo), Qt::QueuedConnection);
-    connect(this, qOverload<QByteArray, QHostAddress>(&TcpServer::sendMessageToQueued), this, qOverload<QByteArray, QHostAddress>(&TcpServer::sendMessageTo), Qt::QueuedConnection);
-    connect(this, qOverload<QByteArray, QString>(&TcpServer::sendMessageToQueued), this, qOverload<QByteArray, QString>(&TcpServer::sendMessageTo), Qt::QueuedConnection);
-    connect(this, &TcpServer::addAllowedAddressQueued, this, &TcpServer::addAllowedAddress, Qt::QueuedConnection);
-    connect(this, &TcpServer::removeAllowedAddressQueued, this, &TcpServer::removeAllowedAddress, Qt::QueuedConnection);
-    connect(this, &TcpServer::addLoginDataQueued, this, &TcpServer::addLoginData, Qt::QueuedConnection);
-    connect(this, &TcpServer::removeLoginDataQueued, this, &TcpServer::removeLoginData, Qt::QueuedConnection);
+    : NetServer(_connType, _connTypeName, parent)
+    , m_pServer(new TcpListener(this))
+{
+    qRegisterMetaType<qintptr>("qintptr");
+    connect(this, &TcpServer::adoptSocketDescriptorQueued, this, &TcpServer::adoptSocketDescriptor, Qt::QueuedConnection);
     connect(m_pServer, &QTcpServer::newConnection, this, &TcpServer::onNewConnection);
+
+    m_partialFrameSweepTimer = new QTimer(this);
+    connect(m_partialFrameSweepTimer, &QTimer::timeout, this, &TcpServer::sweepPartialFrames);
 }
 
 TcpServer::~TcpServer()
@@ -39,6 +48,16 @@ Net::ConnectionState TcpServer::openConnection(ConnectionSettings const& a_conne
         emit openedConnection(false);
         return m_connectionState;
     }
+    applySocketOptions(m_pServer->socketDescriptor());
+    if (m_shardCount > 0)
+    {
+        openShards();
+        m_pServer->f_onNewDescriptor = [this](qintptr socketDescriptor) { onNewDescriptor(socketDescriptor); };
+    }
+    else
+    {
+        m_pServer->f_onNewDescriptor = {};
+    }
     m_connectionState = ConnectionState::Created;
     f_logGeneral(QString("%1: Opened connection").arg(nameId()));
     printConnectionInfo();
@@ -54,46 +73,51 @@ void TcpServer::closeConnection()
         f_logGeneral(QString("%1: Closed connection").arg(nameId()));
     m_connectionState = ConnectionState::NotCreated;
     disconnect(m_pServer, &QTcpServer::acceptError, this, &TcpServer::printError);
-
-    while (!m_clientMap.empty()) // onSocketDisconnected() deletes socket right away after close()
-    {
-        auto socket = m_clientMap.begin().key();
-        socket->close();
-    }
+    m_partialFrameSweepTimer->stop();
+
+    closeShards();
+    // Unauthorized ones as well, since their deadlines are in thread's wheel, which may outlive <this>
+    QVector<QTcpSocket*> sockets;
+    sockets.reserve(m_clients.size());
+    m_clients.forEach([&sockets](Net::ClientHandle, ClientData& d) { sockets.append(d.pSocket); });
+    for (QTcpSocket* pSocket : qAsConst(sockets))
+        pSocket->close(); // onClientDisconnected() removes client from the table
     emit closedConnection();
 }
 
 void TcpServer::addAllowedAddress(QHostAddress addr)
 {
     m_allowedAddresses.insert(addr);
+    for (TcpServer* pShard : qAsConst(m_shards))
+        emit pShard->addAllowedAddressQueued(addr);
 }
 
 void TcpServer::removeAllowedAddress(QHostAddress addr)
 {
     m_allowedAddresses.remove(addr);
-    QList<QTcpSocket*> toClose;
-    for (auto iter = m_clientMap.begin(); iter != m_clientMap.end(); ++iter)
+    for (TcpServer* pShard : qAsConst(m_shards))
+        emit pShard->removeAllowedAddressQueued(addr);
+    for (Net::ClientHandle const& handle : m_clientsByPeerAddress.values(addr))
     {
-        if (iter.value()->peerAddrPort.addr == addr)
-            toClose.append(iter.key());
+        if (ClientData* d = m_clients.find(handle))
+            d->pSocket->close();
     }
-    for (QTcpSocket* pSocket : toClose)
-        pSocket->close();
 }
 
 void TcpServer::addLoginData(Net::LoginData loginData)
 {
     m_loginData.insert(loginData);
+    for (TcpServer* pShard : qAsConst(m_shards))
+        emit pShard->addLoginDataQueued(loginData);
 }
 
 void TcpServer::removeLoginData(Net::LoginData loginData)
 {
     m_loginData.remove(loginData);
-    auto iter = m_clientsByLoginUsername.find(loginData.username);
-    if (iter != m_clientsByLoginUsername.end())
-    {
-        iter.value()->pSocket->abort();
-    }
+    for (TcpServer* pShard : qAsConst(m_shards))
+        emit pShard->removeLoginDataQueued(loginData);
+    if (ClientData* d = m_clients.find(m_clientsByLoginUsername.value(loginData.username)))
+        d->pSocket->abort();
 }
 
 void TcpServer::onNewConnection()
@@ -101,75 +125,342 @@ void TcpServer::onNewConnection()
     while (m_pServer->hasPendingConnections())
     {
         QTcpSocket* pSocket = m_pServer->nextPendingConnection();
-        if (m_isAllowAllAdresses == false)
+        m_socketCount.fetch_add(1, std::memory_order_relaxed);
+        setupClientSocket(pSocket);
+    }
+    return;
+}
+
+void TcpServer::adoptSocketDescriptor(qintptr socketDescriptor)
+{
+    // m_socketCount was already incremented by shard owner when it dispatched the descriptor
+    QTcpSocket* pSocket = new QTcpSocket(this);
+    if (pSocket->setSocketDescriptor(socketDescriptor) == false)
+    {
+        f_logError(QString("%1: failed to adopt socket descriptor %2 - %3").arg(nameId()).arg(socketDescriptor).arg(pSocket->errorString()));
+        delete pSocket;
+        Net::closeSocketDescriptor(socketDescriptor);
+        m_socketCount.fetch_sub(1, std::memory_order_relaxed);
+        return;
+    }
+    setupClientSocket(pSocket);
+}
+
+void TcpServer::setupClientSocket(QTcpSocket* pSocket)
+{
+    if (m_isAllowAllAdresses == false)
+    {
+        if (m_allowedAddresses.contains(pSocket->peerAddress()) == false)
         {
-            if (m_allowedAddresses.contains(pSocket->peerAddress()) == false)
-            {
-                f_logGeneral(QString("%1: rejected client %3:%4 - client not in allowed list")
-                             .arg(nameId())
-                             .arg(pSocket->peerAddress().toString())
-                             .arg(pSocket->peerPort()));
-                pSocket->abort();
-                pSocket->deleteLater();
-                continue;
-            }
+            f_logGeneral(QString("%1: rejected client %3:%4 - client not in allowed list")
+                         .arg(nameId())
+                         .arg(pSocket->peerAddress().toString())
+                         .arg(pSocket->peerPort()));
+            pSocket->abort();
+            pSocket->deleteLater();
+            m_socketCount.fetch_sub(1, std::memory_order_relaxed);
+            return;
         }
+    }
+    applySocketOptions(pSocket->socketDescriptor());
+
+    const Net::ClientHandle handle = m_clients.insert();
+    ClientData* d = m_clients.find(handle);
+    d->handle = handle;
+    d->pSocket = pSocket;
+    d->peerAddrPort = Net::AddressPort{pSocket->peerAddress(), pSocket->peerPort()};
+    d->localAddrPort = Net::AddressPort{pSocket->localAddress(), pSocket->localPort()};
+    d->frameReader.setBudget(m_pReceiveBudget.get());
+    if (m_isAuthorizationEnabled)
+    {
+        d->deadline = Net::TimerWheel::forCurrentThread()->schedule(m_authTimeoutTime, [pSocket]() { pSocket->close(); });
+    }
+    else
+    {
+        authorizeClient(d);
+        armIdleDeadline(d);
+    }
+    pSocket->setReadBufferSize(s_socketReadBufferSize);
+    if ((m_receiveLimits.partialFrameTimeout > 0) && !m_partialFrameSweepTimer->isActive())
+        m_partialFrameSweepTimer->start(qBound(100, m_receiveLimits.partialFrameTimeout / 4, 1000));
+    connect(pSocket, &QTcpSocket::readyRead, this, [this, handle]() { readClient(handle); });
+    connect(pSocket, &QTcpSocket::disconnected, this, [this, handle]() { onClientDisconnected(handle); });
+    connect(pSocket, &QTcpSocket::bytesWritten, this, [this, handle]() {
+        ClientData* d = m_clients.find(handle);
+        if ((d != nullptr) && d->isAuthorized) // nothing could have been queued before authorization
+            drainSendQueue(d);
+    });
+    connect(pSocket, qOverload<QAbstractSocket::SocketError>(&QAbstractSocket::error), this, [this, handle]() { printSocketError(handle); });
+    f_logGeneral(QString("%1: client %2:%3 (local %4:%5) sockd:%6 connected")
+                 .arg(nameId())
+                 .arg(pSocket->peerAddress().toString())
+                 .arg(pSocket->peerPort())
+                 .arg(pSocket->localAddress().toString())
+                 .arg(pSocket->localPort())
+                 .arg(pSocket->socketDescriptor()));
+    emit clientConnected({pSocket->peerAddress(), pSocket->peerPort()});
+}
 
-        if (m_isAuthorizationEnabled)
+void TcpServer::onNewDescriptor(qintptr socketDescriptor)
+{
+    TcpServer* pShard = pickShard();
+    pShard->m_socketCount.fetch_add(1, std::memory_order_relaxed);
+    emit pShard->adoptSocketDescriptorQueued(socketDescriptor);
+}
+
+TcpServer* TcpServer::pickShard()
+{
+    if (m_shardingPolicy == ShardingPolicy::LeastLoaded)
+    {
+        TcpServer* pLeastLoaded = m_shards.first();
+        for (TcpServer* pShard : qAsConst(m_shards))
         {
-            auto timer = make_shared<QTimer>(this);
-            m_socketAuthMap.insert(pSocket, timer);
-            timer->setInterval(m_authTimeoutTime);
-            timer->setSingleShot(true);
-            connect(timer.get(), &QTimer::timeout, pSocket, &QTcpSocket::close);
-            timer->start();
+            if (pShard->getSocketCount() < pLeastLoaded->getSocketCount())
+                pLeastLoaded = pShard;
         }
-        else
+        return pLeastLoaded;
+    }
+    TcpServer* pShard = m_shards.at(m_nextShardIndex);
+    m_nextShardIndex = (m_nextShardIndex + 1) % m_shards.size();
+    return pShard;
+}
+
+void TcpServer::openShards()
+{
+    // Shards report <this> as NetConnection to callback, so that sharding is invisible to whoever processes received messages
+    auto f_ownerCallback = [f_callback = f_onReceivedMessage, this](QByteArray msg, NetConnection* const, Net::AddressPort addrPort) {
+        f_callback(msg, this, addrPort);
+    };
+    auto f_ownerBatchCallback = [f_callback = f_onReceivedBatch, this](QVector<QByteArray> msgs, NetConnection* const, Net::AddressPort addrPort) {
+        f_callback(std::move(msgs), this, addrPort);
+    };
+    auto f_ownerEncodedCallback = [f_callback = f_onReceivedEncodedMessage, this](QByteArray msg, NetConnection* const, Net::AddressPort addrPort) {
+        f_callback(msg, this, addrPort);
+    };
+    auto f_ownerEncodedBatchCallback = [f_callback = f_onReceivedEncodedBatch, this](QVector<QByteArray> msgs, QVector<int> encodedIndices, NetConnection* const, Net::AddressPort addrPort) {
+        f_callback(std::move(msgs), std::move(encodedIndices), this, addrPort);
+    };
+    for (int i = 0; i < m_shardCount; ++i)
+    {
+        TcpServer* pShard = std::get<0>(Net::instantiateWaitThreadedConnection<TcpServer>());
+        // Shard is idle and has no sockets yet, so it's safe to configure it from here. Everything after that goes through queued signals
+        pShard->setObjectName(QString("%1-shard%2").arg(objectName()).arg(i));
+        pShard->setConnectionId(static_cast<uint>(i));
+        pShard->setLoggingFunctions(f_logGeneral, f_logError);
+        pShard->f_onReceivedMessage = f_ownerCallback;
+        pShard->f_onReceivedEncodedMessage = f_ownerEncodedCallback;
+        if (f_onReceivedBatch)
         {
-            auto ptr = make_shared<ClientData>();
-            ClientData* d = ptr.get();
-            d->pSocket = pSocket;
-            d->peerAddrPort = Net::AddressPort{pSocket->peerAddress(), pSocket->peerPort()};
-            d->localAddrPort = Net::AddressPort{pSocket->localAddress(), pSocket->localPort()};
-
-            m_clientMap.insert(pSocket, ptr);
-            m_clientByPeerAddressPort.insert({pSocket->peerAddress(), pSocket->peerPort()}, d);
-            m_clientsByPeerAddress[pSocket->peerAddress()].insert(pSocket->peerPort(), d);
+            pShard->f_onReceivedBatch = f_ownerBatchCallback;
+            pShard->f_onReceivedEncodedBatch = f_ownerEncodedBatchCallback;
         }
-        connect(pSocket, &QTcpSocket::readyRead, this, &TcpServer::readReceived);
-        connect(pSocket, &QTcpSocket::disconnected, this, &TcpServer::onSocketDisconnected);
-        connect(pSocket, qOverload<QAbstractSocket::SocketError>(&QAbstractSocket::error), this, &TcpServer::printSocketError);
-        f_logGeneral(QString("%1: client %2:%3 (local %4:%5) sockd:%6 connected")
-                     .arg(nameId())
-                     .arg(pSocket->peerAddress().toString())
-                     .arg(pSocket->peerPort())
-                     .arg(pSocket->localAddress().toString())
-                     .arg(pSocket->localPort())
-                     .arg(pSocket->socketDescriptor()));
-        emit clientConnected({pSocket->peerAddress(), pSocket->peerPort()});
+        pShard->m_isAllowAllAdresses = m_isAllowAllAdresses;
+        pShard->m_allowedAddresses = m_allowedAddresses;
+        pShard->m_isAuthorizationEnabled = m_isAuthorizationEnabled;
+        pShard->m_loginData = m_loginData;
+        pShard->m_sendWatermarks = m_sendWatermarks;
+        pShard->m_slowRecipientPolicy = m_slowRecipientPolicy;
+        pShard->m_receiveLimits = m_receiveLimits;
+        pShard->m_idleTimeout = m_idleTimeout;
+        pShard->m_pReceiveBudget = m_pReceiveBudget;
+        pShard->m_pCompression = m_pCompression;
+        pShard->m_connectionSettings = m_connectionSettings;
+        pShard->m_pShardOwner = this;
+        pShard->m_connectionState = ConnectionState::Created;
+
+        connect(pShard, &TcpServer::clientConnected, this, [this, pShard](Net::AddressPort addrPort) {
+            if (m_shards.contains(pShard) == false)
+                return;
+            {
+                QWriteLocker locker(&m_shardRoutingLock);
+                m_shardClientByPeerAddressPort.insert(addrPort, ShardClientData{pShard, QString{}});
+            }
+            emit clientConnected(addrPort);
+        });
+        connect(pShard, &TcpServer::clientAuthorized, this, [this](QString username, Net::AddressPort addrPort) {
+            {
+                QWriteLocker locker(&m_shardRoutingLock);
+                auto iter = m_shardClientByPeerAddressPort.find(addrPort);
+                if (iter == m_shardClientByPeerAddressPort.end())
+                    return;
+                iter.value().loginUsername = username;
+                m_shardClientByLoginUsername.insert(username, addrPort);
+            }
+            emit clientAuthorized(username, addrPort);
+        });
+        connect(pShard, &TcpServer::clientDisconnected, this, [this](Net::AddressPort addrPort) {
+            {
+                QWriteLocker locker(&m_shardRoutingLock);
+                auto iter = m_shardClientByPeerAddressPort.find(addrPort);
+                if (iter == m_shardClientByPeerAddressPort.end())
+                    return;
+                if (!iter.value().loginUsername.isEmpty())
+                    m_shardClientByLoginUsername.remove(iter.value().loginUsername);
+                m_shardClientByPeerAddressPort.erase(iter);
+            }
+            emit clientDisconnected(addrPort);
+        });
+        connect(pShard, &TcpServer::clientCongestionChanged, this, &TcpServer::clientCongestionChanged);
+        m_shards.append(pShard);
     }
-    return;
+    m_nextShardIndex = 0;
+    m_isShardRoutingActive.store(true, std::memory_order_release);
+    f_logGeneral(QString("%1: serving clients with %2 shards").arg(nameId()).arg(m_shards.size()));
+}
+
+void TcpServer::closeShards()
+{
+    if (m_shards.isEmpty())
+        return;
+    m_isShardRoutingActive.store(false, std::memory_order_release);
+    const auto shards = m_shards;
+    m_fanoutStats = getFanoutStats(); // shards' recipients are kept once shards are gone
+    m_shards.clear(); // any queued signals of shards are ignored from now on
+    QList<Net::AddressPort> clients;
+    {
+        // routeMessageToShard() emits under read lock, so no thread can touch a shard after this block
+        QWriteLocker locker(&m_shardRoutingLock);
+        clients = m_shardClientByPeerAddressPort.keys();
+        m_shardClientByPeerAddressPort.clear();
+        m_shardClientByLoginUsername.clear();
+    }
+    for (TcpServer* pShard : shards)
+        Net::destroyWaitThreadedConnection(pShard);
+    for (auto const& addrPort : clients)
+        emit clientDisconnected(addrPort);
 }
 
 qint64 TcpServer::sendMessage(const QByteArray& msg)
 {
+    return broadcastMessage(msg);
+}
+
+qint64 TcpServer::broadcastMessage(QByteArray msg)
+{
+    if (!m_shards.isEmpty())
+    {
+        ++m_fanoutStats.messages;
+        for (TcpServer* pShard : qAsConst(m_shards))
+            emit pShard->broadcastMessageQueued(msg);
+        return msg.size();
+    }
+    ++m_fanoutStats.messages;
+    Net::FanoutPayload payload(*m_pCompression, msg);
+    QVector<Net::ClientHandle> toDisconnect;
+    qint64 ret = 0;
+    m_clients.forEach([this, &payload, &toDisconnect, &ret](Net::ClientHandle, ClientData& d) {
+        if (d.isAuthorized)
+            ret += fanoutTo(payload, &d, toDisconnect);
+    });
+    disconnectSlowRecipients(toDisconnect);
+    return ret;
+}
+
+qint64 TcpServer::multicastMessage(QByteArray msg, QVector<Net::AddressPort> recipients)
+{
+    if (!m_shards.isEmpty())
+    {
+        QHash<TcpServer*, QVector<Net::AddressPort>> recipientsByShard;
+        {
+            QReadLocker locker(&m_shardRoutingLock);
+            for (Net::AddressPort const& addrPort : qAsConst(recipients))
+            {
+                auto iterShard = m_shardClientByPeerAddressPort.constFind(addrPort);
+                if (iterShard != m_shardClientByPeerAddressPort.constEnd())
+                    recipientsByShard[iterShard.value().pShard].append(addrPort);
+            }
+        }
+        ++m_fanoutStats.messages;
+        for (auto iter = recipientsByShard.cbegin(); iter != recipientsByShard.cend(); ++iter)
+            emit iter.key()->multicastMessageQueued(msg, iter.value());
+        return recipientsByShard.isEmpty() ? 0 : msg.size();
+    }
+    ++m_fanoutStats.messages;
+    Net::FanoutPayload payload(*m_pCompression, msg);
+    QVector<Net::ClientHandle> toDisconnect;
     qint64 ret = 0;
-    for (auto clientIter = m_clientMap.begin(); clientIter != m_clientMap.end(); ++clientIter)
-        ret += sendMessageTo(msg, clientIter.key());
+    for (Net::AddressPort const& addrPort : qAsConst(recipients))
+    {
+        if (ClientData* d = m_clients.find(m_clientByPeerAddressPort.value(addrPort)))
+            ret += fanoutTo(payload, d, toDisconnect);
+    }
+    disconnectSlowRecipients(toDisconnect);
     return ret;
 }
 
-// No validity check for pClientSocket since this method is private and all its calls are guaranteed to be safe
-qint64 TcpServer::sendMessageTo(QByteArray msg, QTcpSocket* pClientSocket)
+qint64 TcpServer::fanoutTo(Net::FanoutPayload& payload, ClientData* d, QVector<Net::ClientHandle>& toDisconnect)
+{
+    bool shouldDisconnect = false;
+    if (!admitFanoutRecipient(d->sendQueue, shouldDisconnect))
+    {
+        if (shouldDisconnect)
+            toDisconnect.append(d->handle);
+        return 0;
+    }
+    bool isEncoded = false;
+    const QByteArray& msg = payload.payloadFor(d->peerAddrPort, isEncoded);
+    return sendMessageTo(msg, d, isEncoded);
+}
+
+// After the fan-out loop, since aborted socket is removed from m_clients right away. Every fan-out ends here, so shard publishes its stats here too
+void TcpServer::disconnectSlowRecipients(QVector<Net::ClientHandle> const& toDisconnect)
+{
+    for (Net::ClientHandle const& handle : toDisconnect)
+    {
+        ClientData* d = m_clients.find(handle);
+        if (d == nullptr)
+            continue;
+        f_logGeneral(QString("%1: dropped client %2:%3 - too slow for fan-out, %4 bytes pending")
+                     .arg(nameId())
+                     .arg(d->peerAddrPort.addr.toString())
+                     .arg(d->peerAddrPort.port)
+                     .arg(d->sendQueue.stats().pendingBytes));
+        d->pSocket->abort();
+    }
+    publishFanoutStats();
+}
+
+void TcpServer::publishFanoutStats()
+{
+    if (m_pShardOwner == nullptr)
+        return;
+    QMutexLocker locker(&m_publishedFanoutStatsMutex);
+    m_publishedFanoutStats = m_fanoutStats;
+}
+
+Net::FanoutStats TcpServer::getFanoutStats() const
+{
+    Net::FanoutStats stats = m_fanoutStats;
+    for (TcpServer* pShard : qAsConst(m_shards))
+    {
+        QMutexLocker locker(&pShard->m_publishedFanoutStatsMutex);
+        stats.deliveries += pShard->m_publishedFanoutStats.deliveries;
+        stats.skipped += pShard->m_publishedFanoutStats.skipped;
+        stats.disconnected += pShard->m_publishedFanoutStats.disconnected;
+    }
+    return stats;
+}
+
+// No validity check for d since this method is protected and all its calls are guaranteed to be safe
+// Message is only queued and written asynchronously as socket drains, so the return value is the size of queued frame
+qint64 TcpServer::sendMessageTo(QByteArray msg, ClientData* d, bool isEncoded)
+{
+    static const QMetaMethod s_writeDoneSignal = QMetaMethod::fromSignal(&NetConnection::writeDone);
+    const qint64 frameSize = d->sendQueue.enqueueFrame(msg, isEncoded);
+    drainSendQueue(d);
+    if (isSignalConnected(s_writeDoneSignal))
+        emit writeDone(msg);
+    return frameSize;
+}
+
+void TcpServer::drainSendQueue(ClientData* d)
 {
-    qint64 bytesWritten = -1;
-    const decltype(Net::PendingMessage::pendingSize) msgSize = static_cast<decltype(msgSize)>(msg.size());
-    QByteArray header(reinterpret_cast<const char*>(&msgSize), sizeof(msgSize));
-    bytesWritten = pClientSocket->write(header + msg);
-    pClientSocket->waitForBytesWritten(1000);
-    if (bytesWritten > 0)
-        emit writeDone((bytesWritten == msg.size()) ? msg : msg.mid(0, bytesWritten));
-    return bytesWritten;
+    d->sendQueue.drain(d->pSocket);
+    if (d->sendQueue.updateCongestion(d->pSocket, m_sendWatermarks))
+    {
+        const Net::SendQueueStats& stats = d->sendQueue.stats();
+        emit clientCongestionChanged(d->peerAddrPort, stats.isCongested, stats.pendingBytes);
+    }
 }
 
 qint64 TcpServer::sendMessageTo(QByteArray msg, QHostAddress address, quint16 port)
@@ -177,10 +468,40 @@ qint64 TcpServer::sendMessageTo(QByteArray msg, QHostAddress address, quint16 po
     return sendMessageTo(msg, Net::AddressPort{address, port});
 }
 
+// In sharded mode messages are only queued to the shard which serves the client, so return value is the size of queued message rather than bytes actually written
+void TcpServer::postMessageTo(QByteArray msg, Net::AddressPort addressPort)
+{
+    if (m_isShardRoutingActive.load(std::memory_order_acquire))
+    {
+        routeMessageToShard(msg, addressPort);
+        return;
+    }
+    NetServer::postMessageTo(msg, addressPort);
+}
+
+qint64 TcpServer::routeMessageToShard(const QByteArray& msg, const Net::AddressPort& addressPort)
+{
+    QReadLocker locker(&m_shardRoutingLock);
+    auto iterShard = m_shardClientByPeerAddressPort.constFind(addressPort);
+    if (iterShard == m_shardClientByPeerAddressPort.constEnd())
+    {
+        locker.unlock();
+        f_logError(QString("%1: can't send message to unconnected host %2:%3.")
+                     .arg(nameId())
+                     .arg(addressPort.addr.toString())
+                     .arg(addressPort.port));
+        return -1;
+    }
+    emit iterShard.value().pShard->sendMessageToQueued(msg, addressPort);
+    return msg.size();
+}
+
 qint64 TcpServer::sendMessageTo(QByteArray msg, Net::AddressPort addressPort)
 {
-    auto iter = m_clientByPeerAddressPort.find(addressPort);
-    if (iter == m_clientByPeerAddressPort.end())
+    if (!m_shards.isEmpty())
+        return routeMessageToShard(msg, addressPort);
+    ClientData* d = m_clients.find(m_clientByPeerAddressPort.value(addressPort));
+    if (d == nullptr)
     {
         f_logError(QString("%1: can't send message to unconnected host %2:%3.")
                      .arg(nameId())
@@ -188,12 +509,66 @@ qint64 TcpServer::sendMessageTo(QByteArray msg, Net::AddressPort addressPort)
                      .arg(addressPort.port));
         return -1;
     }
-    return sendMessageTo(msg, iter.value()->pSocket);
+    return sendMessageTo(msg, d);
+}
+
+qint64 TcpServer::sendMessageTo(QByteArray msg, Net::ClientHandle handle)
+{
+    ClientData* d = m_clients.find(handle);
+    if ((d == nullptr) || !d->isAuthorized)
+    {
+        f_logError(QString("%1: can't send message to disconnected client %2#%3.")
+                     .arg(nameId())
+                     .arg(handle.index)
+                     .arg(handle.generation));
+        return -1;
+    }
+    return sendMessageTo(msg, d);
+}
+
+qint64 TcpServer::sendEncodedMessageTo(QByteArray payload, Net::AddressPort addressPort)
+{
+    if (!m_shards.isEmpty()) // queued just before shard routing went live; shard compresses whatever it's given, so hand it the original
+    {
+        if (!m_pCompression->decode(payload))
+            return -1;
+        return routeMessageToShard(payload, addressPort);
+    }
+    ClientData* d = m_clients.find(m_clientByPeerAddressPort.value(addressPort));
+    if (d == nullptr)
+    {
+        f_logError(QString("%1: can't send message to unconnected host %2:%3.")
+                     .arg(nameId())
+                     .arg(addressPort.addr.toString())
+                     .arg(addressPort.port));
+        return -1;
+    }
+    return sendMessageTo(payload, d, true);
 }
 
 qint64 TcpServer::sendMessageTo(QByteArray msg, QHostAddress address)
 {
-    qint64 ret = 0;
+    if (!m_shards.isEmpty())
+    {
+        QSet<TcpServer*> shardsAtAddress;
+        QReadLocker locker(&m_shardRoutingLock);
+        for (auto iter = m_shardClientByPeerAddressPort.cbegin(); iter != m_shardClientByPeerAddressPort.cend(); ++iter)
+        {
+            if (iter.key().addr == address)
+                shardsAtAddress.insert(iter.value().pShard);
+        }
+        if (shardsAtAddress.isEmpty())
+        {
+            f_logError(QString("%1: can't send message to address %2 with no connections to it.")
+                         .arg(nameId())
+                         .arg(address.toString()));
+            return -1;
+        }
+        ++m_fanoutStats.messages;
+        for (TcpServer* pShard : qAsConst(shardsAtAddress))
+            emit pShard->sendMessageToQueued(msg, address);
+        return msg.size();
+    }
     auto iterByAddr = m_clientsByPeerAddress.constFind(address);
     if (iterByAddr == m_clientsByPeerAddress.constEnd())
     {
@@ -202,32 +577,54 @@ qint64 TcpServer::sendMessageTo(QByteArray msg, QHostAddress address)
                      .arg(address.toString()));
         return -1;
     }
-    auto clientsAtAddress = iterByAddr.value();
-    for (auto iterByPort = clientsAtAddress.begin(); iterByPort != clientsAtAddress.end(); ++iterByPort)
-        ret += sendMessageTo(msg, iterByPort.value()->peerAddrPort);
+    ++m_fanoutStats.messages;
+    Net::FanoutPayload payload(*m_pCompression, msg);
+    QVector<Net::ClientHandle> toDisconnect;
+    qint64 ret = 0;
+    for (; (iterByAddr != m_clientsByPeerAddress.constEnd()) && (iterByAddr.key() == address); ++iterByAddr)
+        ret += fanoutTo(payload, m_clients.find(iterByAddr.value()), toDisconnect);
+    disconnectSlowRecipients(toDisconnect);
     return ret;
 }
 
 qint64 TcpServer::sendMessageTo(QByteArray msg, QString loginUsername)
 {
-    auto iter = m_clientsByLoginUsername.find(loginUsername);
-    if (iter == m_clientsByLoginUsername.end())
+    if (!m_shards.isEmpty())
+    {
+        QReadLocker locker(&m_shardRoutingLock);
+        auto iterShard = m_shardClientByLoginUsername.constFind(loginUsername);
+        if (iterShard == m_shardClientByLoginUsername.constEnd())
+        {
+            f_logError(QString("%1: can't send message to unauthorized client username=%2.")
+                         .arg(nameId())
+                         .arg(loginUsername));
+            return -1;
+        }
+        const Net::AddressPort addressPort = iterShard.value();
+        locker.unlock();
+        return routeMessageToShard(msg, addressPort);
+    }
+    ClientData* d = m_clients.find(m_clientsByLoginUsername.value(loginUsername));
+    if (d == nullptr)
     {
         f_logError(QString("%1: can't send message to unauthorized client username=%2.")
                      .arg(nameId())
                      .arg(loginUsername));
         return -1;
     }
-    return sendMessageTo(msg, iter.value()->pSocket);
+    return sendMessageTo(msg, d);
 }
 
-void TcpServer::onSocketDisconnected()
+void TcpServer::onClientDisconnected(Net::ClientHandle handle)
 {
-    QTcpSocket* pSocket = qobject_cast<QTcpSocket*>(sender());
-    auto iterClient = m_clientMap.find(pSocket);
-    if (iterClient != m_clientMap.end()) // socket was authorized
+    ClientData* pData = m_clients.find(handle);
+    if (pData == nullptr)
+        return;
+    const ClientData& d = *pData;
+    QTcpSocket* pSocket = d.pSocket;
+    Net::TimerWheel::forCurrentThread()->cancel(pData->deadline);
+    if (d.isAuthorized)
     {
-        const ClientData& d = *(iterClient.value());
         emit clientDisconnected(d.peerAddrPort);
         QString logText = (getConnectionState() == Net::ConnectionState::Created)
                 ? QString("%1: client %2:%3 (local %4:%5)%7 disconnected") // server is open, disconnect was initiated by client
@@ -240,133 +637,190 @@ void TcpServer::onSocketDisconnected()
                      .arg(d.localAddrPort.port)
                      .arg(m_isAuthorizationEnabled ? QStringLiteral(" (username=%1)").arg(d.loginData.username) : QString{}));
         m_clientByPeerAddressPort.remove(d.peerAddrPort);
-        auto iterByAddr = m_clientsByPeerAddress.find(d.peerAddrPort.addr);
-        iterByAddr.value().remove(d.peerAddrPort.port);
-        if (iterByAddr.value().isEmpty())
-            m_clientsByPeerAddress.erase(iterByAddr);
+        m_clientsByPeerAddress.remove(d.peerAddrPort.addr, handle);
         m_clientsByLoginUsername.remove(d.loginData.username);
-        m_pendingMsgBySocket.remove(pSocket);
-        m_clientMap.erase(iterClient);
-        pSocket->deleteLater();
     }
-    else if (m_isAuthorizationEnabled) // socket was not authorized
+    else
     {
-        auto iterTimer = m_socketAuthMap.find(pSocket);
-        iterTimer.value()->stop();
-        m_socketAuthMap.erase(iterTimer);
-
         QString logText = (getConnectionState() == Net::ConnectionState::Created)
                 ? QString("%1: disconnected unauthorized client(%3:%4)") // server is open, disconnect was initiated by client
                 : QString("%1: unauthorized client(%3:%4) disconnected"); // server is closed, disconnect was initiated by server
         f_logGeneral(logText
                      .arg(nameId())
-                     .arg(pSocket->peerAddress().toString())
-                     .arg(pSocket->peerPort()));
+                     .arg(d.peerAddrPort.addr.toString())
+                     .arg(d.peerAddrPort.port));
+        emit clientDisconnected(d.peerAddrPort); // clientConnected was emitted for it as well
     }
+    m_clients.remove(handle);
+    m_socketCount.fetch_sub(1, std::memory_order_relaxed);
     pSocket->deleteLater();
     return;
 }
 
 void TcpServer::readReceived()
 {
-    QTcpSocket* pSocket = qobject_cast<QTcpSocket*>(sender());
-    Net::PendingMessage& pendingMsg = m_pendingMsgBySocket[pSocket];
-    MAKE_QDATASTREAM_NET_D(streamSocket, pSocket);
-    while (pSocket->bytesAvailable() > 0)
+    QVector<Net::ClientHandle> toRead;
+    m_clients.forEach([&toRead](Net::ClientHandle handle, ClientData& d) {
+        if (d.pSocket->bytesAvailable() > 0)
+            toRead.append(handle);
+    });
+    for (Net::ClientHandle const& handle : qAsConst(toRead))
+        readClient(handle);
+}
+
+void TcpServer::readClient(Net::ClientHandle handle)
+{
+    static const QMetaMethod s_readDoneSignal = QMetaMethod::fromSignal(&NetConnection::readDone);
+    static const QMetaMethod s_readPartialDoneSignal = QMetaMethod::fromSignal(&TcpServer::readPartialDone);
+    ClientData* d = m_clients.find(handle);
+    if (d == nullptr) // readyRead queued before disconnect
+        return;
+    markReadStarted();
+    // Only the handle is kept across deliveries, d is looked up again after each of them
+    QTcpSocket* pSocket = d->pSocket;
+    const Net::AddressPort peerAddrPort = d->peerAddrPort;
+    // Diagnostic signals copy data and take a timestamp, so they are emitted only when somebody listens
+    const bool isReadDoneObserved = isSignalConnected(s_readDoneSignal);
+    const bool isReadPartialDoneObserved = isSignalConnected(s_readPartialDoneSignal);
+    if (isReadPartialDoneObserved != static_cast<bool>(d->frameReader.f_onChunk))
     {
-        if (pendingMsg.pendingSize == 0)
-        {
-            if (pSocket->bytesAvailable() < m_headerSize)
-                break;
-            streamSocket >> pendingMsg.pendingSize;
-            pendingMsg.msg.resize(pendingMsg.pendingSize);
-            pendingMsg.curPos = 0;
-        }
-        const decltype(Net::PendingMessage::pendingSize) availableSize = static_cast<decltype(availableSize)>(pSocket->bytesAvailable());
-        if (availableSize < pendingMsg.pendingSize)
-        {
-            streamSocket.readRawData((pendingMsg.msg.data() + pendingMsg.curPos), availableSize);
-            emit readPartialDone(pendingMsg.msg.mid(pendingMsg.curPos, availableSize));
-            pendingMsg.curPos += availableSize;
-            pendingMsg.pendingSize -= availableSize;
-            break;
-        }
-        streamSocket.readRawData((pendingMsg.msg.data() + pendingMsg.curPos), pendingMsg.pendingSize);
-        emit readPartialDone(pendingMsg.msg.mid(pendingMsg.curPos, pendingMsg.pendingSize));
-        emit readDone(pendingMsg.msg);
-        pendingMsg.curPos = 0;
-        pendingMsg.pendingSize = 0;
-        if (m_isAuthorizationEnabled)
+        if (isReadPartialDoneObserved)
+            d->frameReader.f_onChunk = [this](const char* data, int size) { emit readPartialDone(QByteArray(data, size)); };
+        else
+            d->frameReader.f_onChunk = nullptr;
+    }
+    if ((m_idleTimeout > 0) && d->isAuthorized)
+        Net::TimerWheel::forCurrentThread()->reschedule(d->deadline, m_idleTimeout);
+    QByteArray msg;
+    while (d->frameReader.readFrame(pSocket, msg))
+    {
+        if (isReadDoneObserved)
+            emit readDone(msg);
+        if (!d->isAuthorized)
         {
-            auto iterTimer = m_socketAuthMap.find(pSocket);
-            if (iterTimer != m_socketAuthMap.end()) // client is not authorized
+            MAKE_QDATASTREAM_NET(stream, &msg, QIODevice::ReadOnly);
+            Net::LoginData loginData;
+            stream >> loginData;
+            if (stream.status() != QDataStream::Ok)
             {
-                MAKE_QDATASTREAM_NET(stream, &pendingMsg.msg, QIODevice::ReadOnly);
-                Net::LoginData loginData;
-                stream >> loginData;
-                if (stream.status() != QDataStream::Ok)
-                {
-                    f_logGeneral(QString("%1: received corrupted data from unauthorized client(%3:%4)")
-                                 .arg(nameId())
-                                 .arg(pSocket->peerAddress().toString())
-                                 .arg(pSocket->peerPort()));
-                    pSocket->abort();
-                    return;
-                }
-
-                if (m_clientsByLoginUsername.contains(loginData.username))
-                {
-                    f_logGeneral(QString("%1: received login data from unauthorized client(%3:%4) for already authorized client")
-                                 .arg(nameId())
-                                 .arg(pSocket->peerAddress().toString())
-                                 .arg(pSocket->peerPort()));
-                    pSocket->abort();
-                    return;
-                }
-
-                if (!m_loginData.contains(loginData))
-                {
-                    f_logGeneral(QString("%1: received invalid login data from unauthorized client(%3:%4)")
-                                 .arg(nameId())
-                                 .arg(pSocket->peerAddress().toString())
-                                 .arg(pSocket->peerPort()));
-                    pSocket->abort();
-                    return;
-                }
-
-                iterTimer.value()->stop();
-                m_socketAuthMap.erase(iterTimer);
-
-                auto ptr = make_shared<ClientData>();
-                ClientData* d = ptr.get();
-                d->pSocket = pSocket;
-                d->peerAddrPort = Net::AddressPort{pSocket->peerAddress(), pSocket->peerPort()};
-                d->localAddrPort = Net::AddressPort{pSocket->localAddress(), pSocket->localPort()};
-                d->loginData = loginData;
-
-                m_clientMap.insert(pSocket, ptr);
-                m_clientByPeerAddressPort.insert({pSocket->peerAddress(), pSocket->peerPort()}, d);
-                m_clientsByPeerAddress[pSocket->peerAddress()].insert(pSocket->peerPort(), d);
+                f_logGeneral(QString("%1: received corrupted data from unauthorized client(%3:%4)")
+                             .arg(nameId())
+                             .arg(d->peerAddrPort.addr.toString())
+                             .arg(d->peerAddrPort.port));
+                pSocket->abort();
+                return;
+            }
 
-                m_clientsByLoginUsername.insert(d->loginData.username, d);
+            if (m_clientsByLoginUsername.contains(loginData.username))
+            {
+                f_logGeneral(QString("%1: received login data from unauthorized client(%3:%4) for already authorized client")
+                             .arg(nameId())
+                             .arg(d->peerAddrPort.addr.toString())
+                             .arg(d->peerAddrPort.port));
+                pSocket->abort();
+                return;
+            }
 
-                emit clientAuthorized(d->loginData.username, d->peerAddrPort);
-                f_logGeneral(QString("%1: client %2:%3 (local %4:%5) sockd:%6 authorized as username=%7")
+            if (!m_loginData.contains(loginData))
+            {
+                f_logGeneral(QString("%1: received invalid login data from unauthorized client(%3:%4)")
                              .arg(nameId())
-                             .arg(pSocket->peerAddress().toString())
-                             .arg(pSocket->peerPort())
-                             .arg(pSocket->localAddress().toString())
-                             .arg(pSocket->localPort())
-                             .arg(pSocket->socketDescriptor())
-                             .arg(d->loginData.username));
-                continue;
+                             .arg(d->peerAddrPort.addr.toString())
+                             .arg(d->peerAddrPort.port));
+                pSocket->abort();
+                return;
             }
+
+            Net::TimerWheel::forCurrentThread()->cancel(d->deadline);
+            d->loginData = loginData;
+            authorizeClient(d);
+            armIdleDeadline(d);
+
+            f_logGeneral(QString("%1: client %2:%3 (local %4:%5) sockd:%6 authorized as username=%7")
+                         .arg(nameId())
+                         .arg(peerAddrPort.addr.toString())
+                         .arg(peerAddrPort.port)
+                         .arg(d->localAddrPort.addr.toString())
+                         .arg(d->localAddrPort.port)
+                         .arg(pSocket->socketDescriptor())
+                         .arg(d->loginData.username));
+            emit clientAuthorized(d->loginData.username, peerAddrPort);
+            d = m_clients.find(handle); // directly connected slot may drop the client too
+            if (d == nullptr)
+                break;
+            continue;
         }
-        f_onReceivedMessage(pendingMsg.msg, this, {pSocket->peerAddress(), pSocket->peerPort()});
+        deliverReceivedMessage(msg, peerAddrPort, d->frameReader.isFrameEncoded());
+        // Callback run in this thread may drop the client (removeLoginData(), fan-out to slow recipients), which destroys its ClientData right away
+        d = m_clients.find(handle);
+        if (d == nullptr)
+            break;
     }
+    flushReceivedBatch(peerAddrPort); // frames read before the drop are delivered all the same
+    d = m_clients.find(handle); // batch callback may drop the client as well
+    if ((d != nullptr) && (d->frameReader.shedReason() != Net::ShedReason::None))
+        shedClient(d, d->frameReader.shedReason());
     return;
 }
 
+void TcpServer::authorizeClient(ClientData* d)
+{
+    d->isAuthorized = true;
+    m_clientByPeerAddressPort.insert(d->peerAddrPort, d->handle);
+    m_clientsByPeerAddress.insert(d->peerAddrPort.addr, d->handle);
+    if (m_isAuthorizationEnabled)
+        m_clientsByLoginUsername.insert(d->loginData.username, d->handle);
+}
+
+void TcpServer::shedClient(ClientData* d, Net::ShedReason reason)
+{
+    m_pReceiveBudget->countShed(reason);
+    f_logGeneral(QString("%1: dropped client %2:%3 - %4")
+                 .arg(nameId())
+                 .arg(d->peerAddrPort.addr.toString())
+                 .arg(d->peerAddrPort.port)
+                 .arg(Net::toQString(reason)));
+    d->pSocket->abort(); // onClientDisconnected() releases its receive memory
+}
+
+void TcpServer::armIdleDeadline(ClientData* d)
+{
+    if (m_idleTimeout <= 0)
+        return;
+    const Net::ClientHandle handle = d->handle;
+    d->deadline = Net::TimerWheel::forCurrentThread()->schedule(m_idleTimeout, [this, handle]() {
+        ClientData* d = m_clients.find(handle);
+        if (d == nullptr)
+            return;
+        f_logGeneral(QString("%1: dropped client %2:%3 - idle for %4 msec")
+                     .arg(nameId())
+                     .arg(d->peerAddrPort.addr.toString())
+                     .arg(d->peerAddrPort.port)
+                     .arg(m_idleTimeout));
+        d->pSocket->close();
+    });
+}
+
+// Slow sender holding a half-received frame ties up its memory, so frame has to be completed within partialFrameTimeout
+void TcpServer::sweepPartialFrames()
+{
+    if (m_clients.isEmpty())
+    {
+        m_partialFrameSweepTimer->stop();
+        return;
+    }
+    QVector<Net::ClientHandle> toShed;
+    m_clients.forEach([this, &toShed](Net::ClientHandle handle, ClientData& d) {
+        if (d.frameReader.partialFrameAge() > m_receiveLimits.partialFrameTimeout)
+            toShed.append(handle);
+    });
+    for (Net::ClientHandle const& handle : qAsConst(toShed))
+    {
+        if (ClientData* d = m_clients.find(handle)) // shedding one may have closed another in some callback
+            shedClient(d, Net::ShedReason::PartialFrameTimeout);
+    }
+}
+
 Net::ConnectionSettings TcpServer::getConnectionSettingsActive() const
 {
     Net::ConnectionSettings netSettings = getConnectionSettings();
@@ -377,22 +831,33 @@ Net::ConnectionSettings TcpServer::getConnectionSettingsActive() const
 
 bool TcpServer::getIsClientConnected(const Net::AddressPort addrPort)
 {
-    auto iter = m_clientByPeerAddressPort.constFind(addrPort);
-    if (iter == m_clientByPeerAddressPort.constEnd())
-        return false;
-    return true;
+    if (!m_shards.isEmpty())
+        return m_shardClientByPeerAddressPort.contains(addrPort);
+    return m_clientByPeerAddressPort.contains(addrPort);
 }
 
-void TcpServer::setAuthorizationEnabled(bool isEnabled)
+Net::SendQueueStats TcpServer::getSendQueueStats(const Net::AddressPort addrPort) const
+{
+    const ClientData* d = m_clients.find(m_clientByPeerAddressPort.value(addrPort));
+    if (d == nullptr)
+        return {};
+    return d->sendQueue.stats();
+}
+
+void TcpServer::setShardCount(int shardCount)
 {
     if (m_connectionState == Net::ConnectionState::Created)
     {
-        f_logGeneral(QString("%1: called setAuthorizationEnabled() while connection is open - action forbidden").arg(nameId()));
+        f_logGeneral(QString("%1: called setShardCount() while connection is open - action forbidden").arg(nameId()));
         return;
     }
-    m_isAuthorizationEnabled = isEnabled;
+    m_shardCount = qMax(0, shardCount);
 }
 
+void TcpServer::setShardingPolicy(ShardingPolicy policy)
+{
+    m_shardingPolicy = policy;
+}
 
 void TcpServer::printConnectionInfo() const
 {
@@ -408,12 +873,14 @@ void TcpServer::printConnectionInfo() const
                   "Object name: %3\n"
                   "Port In: %4\n"
                   "Local IP: %5\n"
+                  "Shards: %6\n"
                   "--------------------------------------------")
           .arg(m_connectionTypeName)
           .arg(m_connectionId)
           .arg(objectName())
           .arg(m_pServer->serverPort())
-          .arg(m_pServer->serverAddress().toString());
+          .arg(m_pServer->serverAddress().toString())
+          .arg(m_shardCount);
     f_logGeneral(msg);
     return;
 }
@@ -424,11 +891,13 @@ void TcpServer::printError() const
     return;
 }
 
-void TcpServer::printSocketError() const
+void TcpServer::printSocketError(Net::ClientHandle handle) const
 {
-    QTcpSocket* clientSocket = qobject_cast<QTcpSocket*>(QObject::sender());    
-    auto iterClient = m_clientMap.find(clientSocket);
-    const ClientData& d = *(iterClient.value());
+    const ClientData* pData = m_clients.find(handle);
+    if (pData == nullptr)
+        return;
+    const ClientData& d = *pData;
+    QTcpSocket* clientSocket = d.pSocket;
     QAbstractSocket::SocketError err = clientSocket->error();
     if (err == QAbstractSocket::RemoteHostClosedError)
     {
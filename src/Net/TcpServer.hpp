@@ -1,23 +1,61 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
 #include <memory>
 
+#include <QtCore/QMutex>
+#include <QtCore/QReadWriteLock>
 #include <QtCore/QTimer>
+#include <QtCore/QVector>
 #include <QtNetwork/QTcpServer>
 #include <QtNetwork/QTcpSocket>
 
-#include "NetConnection.hpp"
+#include "ClientTable.hpp"
+#include "FrameReader.hpp"
+#include "NetServer.hpp"
+#include "SendQueue.hpp"
 
-class TcpServer : public NetConnection
+// QTcpServer which can hand out accepted descriptors as is, without wrapping them into QTcpSocket first.
+// QTcpSocket can't be safely moved to another thread once connected, so sharded TcpServer passes raw descriptor to the shard which then makes QTcpSocket in its own thread
+class TcpListener : public QTcpServer
+{
+public:
+    explicit TcpListener(QObject* parent = nullptr) : QTcpServer(parent) {}
+
+    std::function<void(qintptr)> f_onNewDescriptor = {}; // if empty, default QTcpServer behavior (nextPendingConnection) is used
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+};
+
+class TcpServer : public NetServer
 {
     Q_OBJECT
 public:
     struct ClientData
     {
+        Net::ClientHandle handle;
         QTcpSocket* pSocket = nullptr;
         Net::AddressPort peerAddrPort;
         Net::AddressPort localAddrPort;
         Net::LoginData loginData;
+        bool isAuthorized = false;
+        Net::SendQueue sendQueue;
+        Net::FrameReader frameReader; // releases into m_pReceiveBudget on destruction, which is fine since base class members outlive the table
+        Net::TimerWheel::Handle deadline; // authorization deadline, idle deadline once authorized
+    };
+
+    struct ShardClientData
+    {
+        TcpServer* pShard = nullptr;
+        QString loginUsername;
+    };
+
+    enum class ShardingPolicy
+    {
+        RoundRobin,
+        LeastLoaded
     };
 
 protected:
@@ -32,74 +70,104 @@ public:
     TcpServer& operator=(TcpServer&&) = delete;      // Move assignment
 
 protected: // members
-    QTcpServer* m_pServer;
-    QHash<QTcpSocket*, std::shared_ptr<ClientData>> m_clientMap; // need to keep Data as pointer for polymorphic access // should be unique_ptr, but QHash requires copy-able value
-    QHash<Net::AddressPort, ClientData*> m_clientByPeerAddressPort;
-    QHash<QHostAddress, QHash<quint16, ClientData*>> m_clientsByPeerAddress;
-    QHash<QString, ClientData*> m_clientsByLoginUsername;
-
-    QSet<QHostAddress> m_allowedAddresses;
-    bool m_isAllowAllAdresses = true;
-
-    QSet<Net::LoginData> m_loginData;
-    bool m_isAuthorizationEnabled = false;
-    QMap<QTcpSocket*, std::shared_ptr<QTimer>> m_socketAuthMap;
-    const int m_authTimeoutTime = 3000;
-
-    QHash<QTcpSocket*, Net::PendingMessage> m_pendingMsgBySocket;
-    decltype(Net::PendingMessage::pendingSize) m_headerSize = sizeof(m_headerSize);
+    TcpListener* m_pServer;
+    // Every accepted socket, authorized or not. Socket signals and deadlines carry the handle of their client, so reading and writing need no lookup at all;
+    // only addressing by peer or username goes through a hash, and it yields a handle as well
+    Net::ClientTable<ClientData> m_clients;
+    QHash<Net::AddressPort, Net::ClientHandle> m_clientByPeerAddressPort; // authorized only, as are the two below
+    QMultiHash<QHostAddress, Net::ClientHandle> m_clientsByPeerAddress;
+    QHash<QString, Net::ClientHandle> m_clientsByLoginUsername;
+
+    QTimer* m_partialFrameSweepTimer = nullptr;
+    static constexpr qint64 s_socketReadBufferSize = 64 * 1024; // QTcpSocket would buffer everything peer sends otherwise, bypassing receive limits
+
+    // Sharded mode: this TcpServer only accepts connections and hands them to shards - TcpServers, each living in its own NetThread and serving its own sockets.
+    // Shards report their clients back, so routing of sendMessageTo() is done here and then forwarded to the owning shard.
+    // Routing tables are only modified in <this>'s thread, but sendMessageToQueued(msg, addressPort) reads them in caller's thread to skip the extra hop through <this>'s thread
+    int m_shardCount = 0; // 0 - sockets are served by this TcpServer itself
+    ShardingPolicy m_shardingPolicy = ShardingPolicy::RoundRobin;
+    QVector<TcpServer*> m_shards;
+    int m_nextShardIndex = 0;
+    QHash<Net::AddressPort, ShardClientData> m_shardClientByPeerAddressPort;
+    QHash<QString, Net::AddressPort> m_shardClientByLoginUsername;
+    mutable QReadWriteLock m_shardRoutingLock;
+    std::atomic<bool> m_isShardRoutingActive{false};
+    TcpServer* m_pShardOwner = nullptr; // non-null if <this> is a shard
+    std::atomic<int> m_socketCount{0}; // sockets dispatched to or accepted by <this> and not yet closed; read from acceptor's thread to pick least loaded shard
+    Net::FanoutStats m_publishedFanoutStats; // shard's m_fanoutStats as of its last fan-out, read by shard owner
+    mutable QMutex m_publishedFanoutStatsMutex;
 
 public: // methods
     void printConnectionInfo() const override;
 
     QString getLastErrorString() const final { return m_pServer->errorString(); }
     Net::ConnectionSettings getConnectionSettingsActive() const final;
-    inline uint getConnectionCount() const { return m_clientMap.size(); }
+    inline uint getConnectionCount() const override { return m_shards.isEmpty() ? m_clientByPeerAddressPort.size() : m_shardClientByPeerAddressPort.size(); }
+    inline int getSocketCount() const { return m_socketCount.load(std::memory_order_relaxed); }
 
-    void setAllowAllAddresses(bool isAllowed) { m_isAllowAllAdresses = isAllowed; }
-    bool getIsClientConnected(const Net::AddressPort addrPort);
+    bool getIsClientConnected(const Net::AddressPort addrPort) override;
 
-    void setAuthorizationEnabled(bool isEnabled);
-    void addLoginData(Net::LoginData loginData);
-    void removeLoginData(Net::LoginData loginData);
+    Net::SendQueueStats getSendQueueStats(const Net::AddressPort addrPort) const; // must be called from <this>'s thread; in sharded mode only shards hold send queues
+    // In sharded mode messages are counted here, recipients by shards as of their last fan-out
+    Net::FanoutStats getFanoutStats() const override;
+    // Resolve peer once and send by handle afterwards, skipping the hash lookup. Must be called from <this>'s thread;
+    // in sharded mode clients live in shards, so there are no handles and sendMessageTo(addressPort) has to be used
+    Net::ClientHandle getClientHandle(const Net::AddressPort addrPort) const { return m_clientByPeerAddressPort.value(addrPort); }
+    qint64 sendMessageTo(QByteArray msg, Net::ClientHandle handle); // -1 if client is gone
+
+    void setShardCount(int shardCount); // must be called before openConnection()
+    void setShardingPolicy(ShardingPolicy policy);
+    int getShardCount() const { return m_shardCount; }
+    ShardingPolicy getShardingPolicy() const { return m_shardingPolicy; }
 
 protected:
-    qint64 sendMessageTo(QByteArray msg, QTcpSocket* pClientSocket);
+    qint64 sendMessageTo(QByteArray msg, ClientData* d, bool isEncoded = false);
+    qint64 sendEncodedMessageTo(QByteArray payload, Net::AddressPort addressPort) override;
+    void drainSendQueue(ClientData* d);
+    qint64 fanoutTo(Net::FanoutPayload& payload, ClientData* d, QVector<Net::ClientHandle>& toDisconnect);
+    void disconnectSlowRecipients(QVector<Net::ClientHandle> const& toDisconnect);
+    void publishFanoutStats(); // shard only, so that its owner can read them from another thread
+    void setupClientSocket(QTcpSocket* pSocket);
+    void authorizeClient(ClientData* d); // adds client to routing tables
+    void readClient(Net::ClientHandle handle);
+    virtual void onClientDisconnected(Net::ClientHandle handle);
+    void printSocketError(Net::ClientHandle handle) const;
+    void shedClient(ClientData* d, Net::ShedReason reason);
+    void armIdleDeadline(ClientData* d); // pushed back by every read of the client
+
+    void openShards();
+    void closeShards();
+    TcpServer* pickShard();
+    void onNewDescriptor(qintptr socketDescriptor);
+    qint64 routeMessageToShard(const QByteArray& msg, const Net::AddressPort& addressPort); // thread-safe
+    void postMessageTo(QByteArray msg, Net::AddressPort addressPort) override; // in sharded mode message is routed right in the caller's thread
 
 public slots:
     Net::ConnectionState openConnection(Net::ConnectionSettings const& a_connectionSettings) override;
     void closeConnection() override;
     qint64 sendMessage(const QByteArray& msg) override;
-    qint64 sendMessageTo(QByteArray msg, QHostAddress address, quint16 port);
-    qint64 sendMessageTo(QByteArray msg, Net::AddressPort addressPort);
-    qint64 sendMessageTo(QByteArray msg, QHostAddress address);
-    qint64 sendMessageTo(QByteArray msg, QString loginUsername);
+    qint64 sendMessageTo(QByteArray msg, QHostAddress address, quint16 port) override;
+    qint64 sendMessageTo(QByteArray msg, Net::AddressPort addressPort) override;
+    qint64 sendMessageTo(QByteArray msg, QHostAddress address) override;
+    qint64 sendMessageTo(QByteArray msg, QString loginUsername) override;
+    qint64 broadcastMessage(QByteArray msg) override;
+    qint64 multicastMessage(QByteArray msg, QVector<Net::AddressPort> recipients) override;
+
+    void addAllowedAddress(QHostAddress addr) override;
+    void removeAllowedAddress(QHostAddress addr) override;
+    void addLoginData(Net::LoginData loginData) override;
+    void removeLoginData(Net::LoginData loginData) override;
 
-    void addAllowedAddress(QHostAddress addr);
-    void removeAllowedAddress(QHostAddress addr);
+    void adoptSocketDescriptor(qintptr socketDescriptor); // serve socket accepted elsewhere (by shard owner) in <this>'s thread
 
 protected slots:
-    void readReceived() override;
+    void readReceived() override; // reads every client with buffered data; socket signals go straight to readClient()
     virtual void onNewConnection();
-    virtual void onSocketDisconnected();
+    void sweepPartialFrames();
     void printError() const final;
-    void printSocketError() const;
 
 signals:
-    void clientConnected(Net::AddressPort);
-    void clientDisconnected(Net::AddressPort);
-
-    void sendMessageToQueued(QByteArray msg, QHostAddress address, quint16 port);
-    void sendMessageToQueued(QByteArray msg, Net::AddressPort addressPort);
-    void sendMessageToQueued(QByteArray msg, QHostAddress address);
-    void sendMessageToQueued(QByteArray msg, QString loginUsername);
-
-    void addAllowedAddressQueued(QHostAddress addr);
-    void removeAllowedAddressQueued(QHostAddress addr);
-
-    void addLoginDataQueued(Net::LoginData loginData);
-    void removeLoginDataQueued(Net::LoginData loginData);
-    void clientAuthorized(QString username, Net::AddressPort addrPort);
+    void adoptSocketDescriptorQueued(qintptr socketDescriptor);
 
     void readPartialDone(QByteArray msg, QDateTime dt = QDateTime::currentDateTimeUtc()) const;
 };
@@ -0,0 +1,141 @@
+#include "TimerWheel.hpp"
+
+#include <QtCore/QThreadStorage>
+
+using namespace Net;
+
+TimerWheel::TimerWheel()
+    : m_slotHeads(s_slotCount, -1)
+{
+    m_clock.start();
+    m_tickTimer.setInterval(s_tickInterval);
+    QObject::connect(&m_tickTimer, &QTimer::timeout, [this]() { onTick(); });
+}
+
+TimerWheel* TimerWheel::forCurrentThread()
+{
+    static QThreadStorage<TimerWheel*> s_wheels;
+    if (!s_wheels.hasLocalData())
+        s_wheels.setLocalData(new TimerWheel);
+    return s_wheels.localData();
+}
+
+TimerWheel::Handle TimerWheel::schedule(int timeout, std::function<void()> f_onExpired)
+{
+    if (m_tickTimer.isActive() == false)
+    {
+        m_lastTick = currentTick(); // slots passed while idle have nothing in them
+        m_tickTimer.start();
+    }
+    int index = m_freeHead;
+    if (index >= 0)
+    {
+        m_freeHead = m_entries[index].next;
+    }
+    else
+    {
+        index = m_entries.size();
+        m_entries.append(Entry{});
+        m_entries[index].generation = 1;
+    }
+    m_entries[index].f_onExpired = std::move(f_onExpired);
+    link(index, timeout);
+    ++m_size;
+    return Handle{index, m_entries[index].generation};
+}
+
+bool TimerWheel::reschedule(Handle const& handle, int timeout)
+{
+    if (!isCurrent(handle))
+        return false;
+    unlink(handle.index);
+    link(handle.index, timeout);
+    return true;
+}
+
+void TimerWheel::cancel(Handle& handle)
+{
+    if (isCurrent(handle))
+    {
+        unlink(handle.index);
+        release(handle.index);
+        if (m_size == 0)
+            m_tickTimer.stop();
+    }
+    handle = Handle{};
+}
+
+bool TimerWheel::isCurrent(Handle const& handle) const
+{
+    if ((handle.index < 0) || (handle.index >= m_entries.size()))
+        return false;
+    const Entry& e = m_entries[handle.index];
+    return e.isScheduled && (e.generation == handle.generation);
+}
+
+void TimerWheel::link(int index, int timeout)
+{
+    Entry& e = m_entries[index];
+    // Rounded up, so that deadline never fires early; next slot at the least, current one is being processed or already was
+    e.expiryTick = currentTick() + qMax(1, (timeout + s_tickInterval - 1) / s_tickInterval);
+    e.isScheduled = true;
+    int& head = m_slotHeads[static_cast<int>(e.expiryTick % s_slotCount)];
+    e.prev = -1;
+    e.next = head;
+    if (head >= 0)
+        m_entries[head].prev = index;
+    head = index;
+}
+
+void TimerWheel::unlink(int index)
+{
+    Entry& e = m_entries[index];
+    if (e.prev >= 0)
+        m_entries[e.prev].next = e.next;
+    else
+        m_slotHeads[static_cast<int>(e.expiryTick % s_slotCount)] = e.next;
+    if (e.next >= 0)
+        m_entries[e.next].prev = e.prev;
+    e.isScheduled = false;
+}
+
+// Entry must be unlinked already
+void TimerWheel::release(int index)
+{
+    Entry& e = m_entries[index];
+    e.f_onExpired = nullptr;
+    ++e.generation; // outstanding handles of this entry go stale
+    e.next = m_freeHead;
+    m_freeHead = index;
+    --m_size;
+}
+
+void TimerWheel::onTick()
+{
+    const quint64 nowTick = currentTick();
+    // Late tick catches up on the slots it missed, but no more than one turn, since that visits every slot
+    const quint64 firstTick = qMax(m_lastTick + 1, (nowTick >= s_slotCount) ? (nowTick - s_slotCount + 1) : 0);
+    QVector<std::function<void()>> expired;
+    for (quint64 tick = firstTick; tick <= nowTick; ++tick)
+    {
+        int index = m_slotHeads[static_cast<int>(tick % s_slotCount)];
+        while (index >= 0)
+        {
+            Entry& e = m_entries[index];
+            const int next = e.next;
+            if (e.expiryTick <= nowTick) // the rest are due in later turns
+            {
+                expired.append(std::move(e.f_onExpired));
+                unlink(index);
+                release(index);
+            }
+            index = next;
+        }
+    }
+    m_lastTick = nowTick;
+    if (m_size == 0)
+        m_tickTimer.stop();
+    // Callbacks run last, they may well schedule or cancel other deadlines
+    for (auto const& f_onExpired : qAsConst(expired))
+        f_onExpired();
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <functional>
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
+
+namespace Net
+{
+// Hashed timer wheel holding deadlines of all connections of one thread (authorization and idle timeouts) behind a single QTimer,
+// instead of a QTimer per socket. Deadlines are rounded up to whole ticks and fire up to one tick late, which is fine for timeouts of seconds.
+// schedule(), reschedule() and cancel() are O(1) and don't allocate once entry pool has grown; tick timer only runs while something is scheduled.
+// Not thread-safe, use forCurrentThread() from the thread the connection lives in - so every NetThread gets a wheel of its own
+class TimerWheel
+{
+public:
+    // Stays valid until deadline fires or is canceled; generation tells a reused entry from the one handle was made for
+    struct Handle
+    {
+        int index = -1;
+        quint32 generation = 0;
+        bool isValid() const { return index >= 0; }
+    };
+
+    static constexpr int s_tickInterval = 100; // msec
+    static constexpr int s_slotCount = 512; // one turn is ~51 s, longer deadlines go around several times
+
+    TimerWheel();
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    static TimerWheel* forCurrentThread(); // created on first use, destroyed when thread finishes
+
+    Handle schedule(int timeout, std::function<void()> f_onExpired); // msec
+    bool reschedule(Handle const& handle, int timeout); // same callback with new deadline; false if handle is no longer valid
+    void cancel(Handle& handle); // handle is reset; no-op for one which already fired
+    int size() const { return m_size; }
+
+private:
+    struct Entry
+    {
+        std::function<void()> f_onExpired;
+        quint64 expiryTick = 0;
+        quint32 generation = 0;
+        bool isScheduled = false;
+        int prev = -1;
+        int next = -1; // in slot list while scheduled, in free list otherwise
+    };
+
+    quint64 currentTick() const { return static_cast<quint64>(m_clock.elapsed()) / s_tickInterval; }
+    bool isCurrent(Handle const& handle) const;
+    void link(int index, int timeout);
+    void unlink(int index);
+    void release(int index);
+    void onTick();
+
+    QTimer m_tickTimer;
+    QElapsedTimer m_clock;
+    quint64 m_lastTick = 0; // slots up to this one are processed
+    QVector<int> m_slotHeads; // -1 for empty slot
+    QVector<Entry> m_entries;
+    int m_freeHead = -1;
+    int m_size = 0;
+};
+} // namespace Net
@@ -0,0 +1,504 @@
+#include "UringTcpServer.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <QtCore/QMetaMethod>
+#include <QtCore/QSocketNotifier>
+#include <QtCore/QtEndian>
+
+#include <fcntl.h>
+#include <liburing.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+using namespace Net;
+using namespace std;
+
+struct UringTcpServer::Ring
+{
+    io_uring ring{};
+    io_uring_buf_ring* pBufRing = nullptr;
+    std::vector<char> buffers;
+    int eventFd = -1;
+    QSocketNotifier* pNotifier = nullptr;
+};
+
+namespace
+{
+// Operation is kept in the low byte of user_data, the rest is client key or chain id
+enum class Op : quint8
+{
+    Accept = 1,
+    Recv,
+    Send,
+    Cancel
+};
+
+constexpr int s_bufferGroupId = 0;
+constexpr int s_sendFlags = MSG_NOSIGNAL | MSG_WAITALL; // WAITALL makes kernel finish short sends itself, so that links don't break in the middle of a frame
+
+quint64 makeUserData(Op op, quint64 value)
+{
+    return (value << 8) | static_cast<quint64>(op);
+}
+
+quint64 makeClientKey(int fd, quint32 generation)
+{
+    return (static_cast<quint64>(generation & 0xFFFFFF) << 32) | static_cast<quint32>(fd);
+}
+
+quint32 encodeFrameHeader(quint32 payloadSize)
+{
+    return (Net::g_endianness == QDataStream::BigEndian) ? qToBigEndian(payloadSize) : qToLittleEndian(payloadSize);
+}
+
+// Multishot recv is the newest of the features used, it came with 6.0
+bool isKernelSupported(QString& unsupportedReason)
+{
+    utsname name{};
+    int major = 0;
+    int minor = 0;
+    if ((::uname(&name) != 0) || (std::sscanf(name.release, "%d.%d", &major, &minor) != 2))
+    {
+        unsupportedReason = QStringLiteral("unknown kernel version");
+        return false;
+    }
+    if (major < 6)
+    {
+        unsupportedReason = QString("kernel %1.%2 has no multishot recv, 6.0 is needed").arg(major).arg(minor);
+        return false;
+    }
+    return true;
+}
+} // namespace
+
+UringTcpServer::UringTcpServer(const quint8 _connType, const QString _connTypeName, QObject* parent)
+    : EpollTcpServer(_connType, _connTypeName, parent)
+{
+}
+
+UringTcpServer::~UringTcpServer()
+{
+    EpollTcpServer::closeConnection(); // base destructor would no longer reach overrides of this class
+}
+
+bool UringTcpServer::startWatching()
+{
+    QString unsupportedReason;
+    if (initRing(unsupportedReason) == false)
+    {
+        f_logGeneral(QString("%1: io_uring is not usable - %2, falling back to epoll").arg(nameId()).arg(unsupportedReason));
+        return EpollTcpServer::startWatching();
+    }
+    m_isUringActive = true;
+    // io_uring completes operations on non-blocking descriptors with EAGAIN instead of waiting for them
+    ::fcntl(m_listenFd, F_SETFL, ::fcntl(m_listenFd, F_GETFL) & ~O_NONBLOCK);
+    armAccept();
+    flushSubmissions();
+    return true;
+}
+
+bool UringTcpServer::initRing(QString& unsupportedReason)
+{
+    if (isKernelSupported(unsupportedReason) == false)
+        return false;
+    m_pRing.reset(new Ring);
+    io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = s_ringEntries * 4; // every multishot operation may post many completions per submission
+    int ret = io_uring_queue_init_params(s_ringEntries, &m_pRing->ring, &params);
+    if (ret < 0)
+    {
+        unsupportedReason = QString("io_uring_setup() failed: %1").arg(QString::fromLocal8Bit(strerror(-ret)));
+        m_pRing.reset();
+        return false;
+    }
+
+    io_uring_probe* pProbe = io_uring_get_probe_ring(&m_pRing->ring);
+    const bool isOpSupported = (pProbe != nullptr)
+                               && io_uring_opcode_supported(pProbe, IORING_OP_ACCEPT)
+                               && io_uring_opcode_supported(pProbe, IORING_OP_RECV)
+                               && io_uring_opcode_supported(pProbe, IORING_OP_SEND)
+                               && io_uring_opcode_supported(pProbe, IORING_OP_ASYNC_CANCEL);
+    if (pProbe != nullptr)
+        io_uring_free_probe(pProbe);
+    if (!isOpSupported || !(params.features & IORING_FEAT_NODROP))
+    {
+        unsupportedReason = QStringLiteral("needed operations are not supported");
+        io_uring_queue_exit(&m_pRing->ring);
+        m_pRing.reset();
+        return false;
+    }
+
+    m_pRing->pBufRing = io_uring_setup_buf_ring(&m_pRing->ring, s_bufferCount, s_bufferGroupId, 0, &ret);
+    if (m_pRing->pBufRing == nullptr)
+    {
+        unsupportedReason = QString("can't register provided buffer ring: %1").arg(QString::fromLocal8Bit(strerror(-ret)));
+        io_uring_queue_exit(&m_pRing->ring);
+        m_pRing.reset();
+        return false;
+    }
+    m_pRing->buffers.resize(static_cast<size_t>(s_bufferCount) * s_bufferSize);
+    for (int bufferId = 0; bufferId < s_bufferCount; ++bufferId)
+        io_uring_buf_ring_add(m_pRing->pBufRing, m_pRing->buffers.data() + static_cast<size_t>(bufferId) * s_bufferSize, s_bufferSize, static_cast<unsigned short>(bufferId), io_uring_buf_ring_mask(s_bufferCount), bufferId);
+    io_uring_buf_ring_advance(m_pRing->pBufRing, s_bufferCount);
+
+    // Event loop is woken through eventfd, kernel signals it whenever completions are posted
+    m_pRing->eventFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((m_pRing->eventFd < 0) || (io_uring_register_eventfd(&m_pRing->ring, m_pRing->eventFd) < 0))
+    {
+        unsupportedReason = QString("can't register eventfd: %1").arg(QString::fromLocal8Bit(strerror(errno)));
+        if (m_pRing->eventFd >= 0)
+            ::close(m_pRing->eventFd);
+        io_uring_free_buf_ring(&m_pRing->ring, m_pRing->pBufRing, s_bufferCount, s_bufferGroupId);
+        io_uring_queue_exit(&m_pRing->ring);
+        m_pRing.reset();
+        return false;
+    }
+    m_pRing->pNotifier = new QSocketNotifier(m_pRing->eventFd, QSocketNotifier::Read, this);
+    connect(m_pRing->pNotifier, qOverload<QSocketDescriptor, QSocketNotifier::Type>(&QSocketNotifier::activated), this, &UringTcpServer::processCompletions);
+    return true;
+}
+
+// Clients are closed already, so their operations are cancelled. Chains still in flight reference frames held here, so their completions are awaited before ring is gone
+void UringTcpServer::stopWatching()
+{
+    if (m_isUringActive == false)
+    {
+        EpollTcpServer::stopWatching();
+        return;
+    }
+    if (m_listenFd >= 0)
+    {
+        io_uring_sqe* pSqe = io_uring_get_sqe(&m_pRing->ring);
+        if (pSqe != nullptr)
+        {
+            io_uring_prep_cancel_fd(pSqe, m_listenFd, IORING_ASYNC_CANCEL_ALL);
+            io_uring_sqe_set_data64(pSqe, makeUserData(Op::Cancel, 0));
+        }
+    }
+    io_uring_submit(&m_pRing->ring);
+    while (!m_sendChains.isEmpty())
+    {
+        io_uring_cqe* pCqe = nullptr;
+        __kernel_timespec timeout{0, 100 * 1000 * 1000};
+        if (io_uring_wait_cqe_timeout(&m_pRing->ring, &pCqe, &timeout) != 0)
+            break;
+        const quint64 userData = io_uring_cqe_get_data64(pCqe);
+        const int result = pCqe->res;
+        io_uring_cqe_seen(&m_pRing->ring, pCqe);
+        if (static_cast<Op>(userData & 0xFF) == Op::Send)
+            onSent(userData >> 8, result);
+    }
+    m_sendChains.clear();
+
+    delete m_pRing->pNotifier;
+    io_uring_unregister_eventfd(&m_pRing->ring);
+    ::close(m_pRing->eventFd);
+    io_uring_free_buf_ring(&m_pRing->ring, m_pRing->pBufRing, s_bufferCount, s_bufferGroupId);
+    io_uring_queue_exit(&m_pRing->ring);
+    m_pRing.reset();
+    m_isUringActive = false;
+    m_isFlushScheduled = false;
+}
+
+void UringTcpServer::armAccept()
+{
+    io_uring_sqe* pSqe = io_uring_get_sqe(&m_pRing->ring);
+    if (pSqe == nullptr)
+    {
+        flushSubmissions();
+        pSqe = io_uring_get_sqe(&m_pRing->ring);
+    }
+    // Accepted descriptors are left blocking for the same reason
+    io_uring_prep_multishot_accept(pSqe, m_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+    io_uring_sqe_set_data64(pSqe, makeUserData(Op::Accept, 0));
+    scheduleFlush();
+}
+
+bool UringTcpServer::watchClient(ClientData* d)
+{
+    if (m_isUringActive == false)
+        return EpollTcpServer::watchClient(d);
+    UringClientData* pClient = static_cast<UringClientData*>(d);
+    pClient->key = makeClientKey(d->fd, m_nextGeneration++);
+    armRecv(pClient);
+    return true;
+}
+
+void UringTcpServer::armRecv(UringClientData* d)
+{
+    io_uring_sqe* pSqe = io_uring_get_sqe(&m_pRing->ring);
+    if (pSqe == nullptr)
+    {
+        flushSubmissions();
+        pSqe = io_uring_get_sqe(&m_pRing->ring);
+    }
+    io_uring_prep_recv_multishot(pSqe, d->fd, nullptr, 0, 0);
+    pSqe->flags |= IOSQE_BUFFER_SELECT;
+    pSqe->buf_group = s_bufferGroupId;
+    io_uring_sqe_set_data64(pSqe, makeUserData(Op::Recv, d->key));
+    scheduleFlush();
+}
+
+// Operations have to be cancelled while descriptor is still open, cancellation finds them by it. Completions of cancelled ones still arrive, but match no client
+void UringTcpServer::unwatchClient(ClientData* d)
+{
+    if (m_isUringActive == false)
+        return;
+    UringClientData* pClient = static_cast<UringClientData*>(d);
+    io_uring_sqe* pSqe = io_uring_get_sqe(&m_pRing->ring);
+    if (pSqe == nullptr)
+    {
+        flushSubmissions();
+        pSqe = io_uring_get_sqe(&m_pRing->ring);
+    }
+    io_uring_prep_cancel_fd(pSqe, d->fd, IORING_ASYNC_CANCEL_ALL);
+    io_uring_sqe_set_data64(pSqe, makeUserData(Op::Cancel, 0));
+    io_uring_submit(&m_pRing->ring);
+    ++m_ioStats.syscalls;
+    pClient->waitingFrames.clear();
+    pClient->waitingBytes = 0;
+    pClient->inFlightBytes = 0;
+    pClient->isCongested = false;
+}
+
+qint64 UringTcpServer::sendMessageTo(QByteArray msg, ClientData* d, bool isEncoded)
+{
+    if (m_isUringActive == false)
+        return EpollTcpServer::sendMessageTo(msg, d, isEncoded);
+    static const QMetaMethod s_writeDoneSignal = QMetaMethod::fromSignal(&NetConnection::writeDone);
+    UringClientData* pClient = static_cast<UringClientData*>(d);
+    const qint64 frameSize = Net::SendQueue::s_headerSize + msg.size();
+    pClient->waitingFrames.append(Frame{encodeFrameHeader(static_cast<quint32>(msg.size()) | (isEncoded ? Net::g_encodedFrameFlag : 0)), msg});
+    pClient->waitingBytes += frameSize;
+    ++m_ioStats.sentMessages;
+    if (pClient->isChainInFlight == false)
+        submitSendChain(pClient);
+    updateCongestion(pClient);
+    if (isSignalConnected(s_writeDoneSignal))
+        emit writeDone(msg);
+    return frameSize;
+}
+
+// Header and payload of every frame go as separate linked sends, so payload is never copied to prepend the header
+void UringTcpServer::submitSendChain(UringClientData* d)
+{
+    if (d->waitingFrames.isEmpty())
+        return;
+    const int frameCount = qMin(d->waitingFrames.size(), s_maxChainFrames);
+    // Chain split between two submissions would lose its ordering, so it has to fit as a whole
+    if (io_uring_sq_space_left(&m_pRing->ring) < static_cast<unsigned>(frameCount * 2))
+        flushSubmissions();
+
+    const quint64 chainId = m_nextChainId++;
+    SendChain& chain = m_sendChains[chainId];
+    chain.clientKey = d->key;
+    chain.frames = d->waitingFrames.mid(0, frameCount);
+    d->waitingFrames.remove(0, frameCount);
+    io_uring_sqe* pLastSqe = nullptr;
+    for (const Frame& frame : qAsConst(chain.frames))
+    {
+        io_uring_sqe* pSqe = io_uring_get_sqe(&m_pRing->ring);
+        io_uring_prep_send(pSqe, d->fd, &frame.header, sizeof(frame.header), s_sendFlags);
+        io_uring_sqe_set_data64(pSqe, makeUserData(Op::Send, chainId));
+        pSqe->flags |= IOSQE_IO_LINK;
+        pLastSqe = pSqe;
+        ++chain.pendingCount;
+        if (!frame.payload.isEmpty())
+        {
+            pSqe = io_uring_get_sqe(&m_pRing->ring);
+            io_uring_prep_send(pSqe, d->fd, frame.payload.constData(), static_cast<size_t>(frame.payload.size()), s_sendFlags);
+            io_uring_sqe_set_data64(pSqe, makeUserData(Op::Send, chainId));
+            pSqe->flags |= IOSQE_IO_LINK;
+            pLastSqe = pSqe;
+            ++chain.pendingCount;
+        }
+        chain.bytes += Net::SendQueue::s_headerSize + frame.payload.size();
+    }
+    pLastSqe->flags &= ~IOSQE_IO_LINK;
+    d->waitingBytes -= chain.bytes;
+    d->inFlightBytes += chain.bytes;
+    d->isChainInFlight = true;
+    scheduleFlush();
+}
+
+void UringTcpServer::updateCongestion(UringClientData* d)
+{
+    const qint64 pendingBytes = d->waitingBytes + d->inFlightBytes;
+    const bool wasCongested = d->isCongested;
+    if (!wasCongested && pendingBytes >= m_sendWatermarks.high)
+        d->isCongested = true;
+    else if (wasCongested && pendingBytes <= m_sendWatermarks.low)
+        d->isCongested = false;
+    if (wasCongested != d->isCongested)
+        emit clientCongestionChanged(d->peerAddrPort, d->isCongested, pendingBytes);
+}
+
+void UringTcpServer::processCompletions()
+{
+    eventfd_t value = 0;
+    ::eventfd_read(m_pRing->eventFd, &value);
+    ++m_ioStats.syscalls;
+    m_isProcessingCompletions = true;
+    for (;;)
+    {
+        unsigned head = 0;
+        unsigned count = 0;
+        io_uring_cqe* pCqe = nullptr;
+        io_uring_for_each_cqe(&m_pRing->ring, head, pCqe)
+        {
+            handleCompletion(io_uring_cqe_get_data64(pCqe), pCqe->res, pCqe->flags);
+            ++count;
+            if (m_isUringActive == false) // callback has closed the server, ring is gone
+            {
+                m_isProcessingCompletions = false;
+                return;
+            }
+        }
+        if (count == 0)
+            break;
+        io_uring_cq_advance(&m_pRing->ring, count);
+    }
+    m_isProcessingCompletions = false;
+    flushSubmissions();
+}
+
+void UringTcpServer::handleCompletion(quint64 userData, int result, quint32 flags)
+{
+    switch (static_cast<Op>(userData & 0xFF))
+    {
+    case Op::Accept: { onAccepted(result, flags); break; }
+    case Op::Recv: { onReceived(userData >> 8, result, flags); break; }
+    case Op::Send: { onSent(userData >> 8, result); break; }
+    default: { break; }
+    }
+}
+
+void UringTcpServer::onAccepted(int result, quint32 flags)
+{
+    if (result >= 0)
+    {
+        sockaddr_storage peerAddr{};
+        socklen_t peerAddrLen = sizeof(peerAddr);
+        ::getpeername(result, reinterpret_cast<sockaddr*>(&peerAddr), &peerAddrLen);
+        ++m_ioStats.syscalls;
+        addClient(result, peerAddr);
+    }
+    else if (result != -ECANCELED)
+    {
+        m_lastErrorString = QString("accept failed: %1").arg(QString::fromLocal8Bit(strerror(-result)));
+        printError();
+    }
+    if (!(flags & IORING_CQE_F_MORE) && (m_connectionState == ConnectionState::Created) && (result != -ECANCELED))
+        armAccept();
+}
+
+void UringTcpServer::onReceived(quint64 clientKey, int result, quint32 flags)
+{
+    const char* pData = nullptr;
+    int bufferId = -1;
+    if (flags & IORING_CQE_F_BUFFER)
+    {
+        bufferId = static_cast<int>(flags >> IORING_CQE_BUFFER_SHIFT);
+        pData = m_pRing->buffers.data() + static_cast<size_t>(bufferId) * s_bufferSize;
+    }
+
+    UringClientData* d = findClient(clientKey);
+    if (d != nullptr)
+    {
+        const std::shared_ptr<ClientData> keepAlive = m_clientByFd.value(d->fd);
+        bool isOpen = true;
+        if (result > 0)
+        {
+            // Data is copied into client's FrameReader, so that buffer goes back to kernel right away
+            qint64 dataSize = result;
+            markReadStarted(); // the read itself was done by the kernel, only framing is timed
+            pushIdleDeadline(d);
+            QByteArray msg;
+            while (isOpen && d->frameReader.readFrame(pData, dataSize, msg))
+                isOpen = processFrame(d, msg);
+            flushReceivedBatch(d->peerAddrPort);
+            isOpen = isOpen && (d->fd >= 0); // batch callback may close client as well
+            if (isOpen && (d->frameReader.shedReason() != Net::ShedReason::None))
+            {
+                shedClient(d, d->frameReader.shedReason());
+                isOpen = false;
+            }
+        }
+        else if (result != -ENOBUFS) // ENOBUFS - all buffers were taken, multishot stops and is re-armed below
+        {
+            closeClient(d);
+            isOpen = false;
+        }
+        if (isOpen && !(flags & IORING_CQE_F_MORE))
+            armRecv(d);
+    }
+
+    if (bufferId >= 0)
+    {
+        io_uring_buf_ring_add(m_pRing->pBufRing, m_pRing->buffers.data() + static_cast<size_t>(bufferId) * s_bufferSize, s_bufferSize, static_cast<unsigned short>(bufferId), io_uring_buf_ring_mask(s_bufferCount), 0);
+        io_uring_buf_ring_advance(m_pRing->pBufRing, 1);
+    }
+}
+
+void UringTcpServer::onSent(quint64 chainId, int result)
+{
+    auto iterChain = m_sendChains.find(chainId);
+    if (iterChain == m_sendChains.end())
+        return;
+    SendChain& chain = iterChain.value();
+    if (result < 0)
+        chain.isFailed = true;
+    if (--chain.pendingCount > 0)
+        return;
+    const quint64 clientKey = chain.clientKey;
+    const qint64 chainBytes = chain.bytes;
+    const bool isFailed = chain.isFailed;
+    m_sendChains.erase(iterChain);
+
+    UringClientData* d = findClient(clientKey);
+    if (d == nullptr)
+        return;
+    d->inFlightBytes -= chainBytes;
+    d->isChainInFlight = false;
+    if (isFailed)
+    {
+        closeClient(d, QStringLiteral("send failed"));
+        return;
+    }
+    submitSendChain(d);
+    updateCongestion(d);
+}
+
+UringTcpServer::UringClientData* UringTcpServer::findClient(quint64 clientKey) const
+{
+    auto iter = m_clientByFd.constFind(static_cast<int>(clientKey & 0xFFFFFFFF));
+    if (iter == m_clientByFd.constEnd())
+        return nullptr;
+    UringClientData* d = static_cast<UringClientData*>(iter.value().get());
+    return (d->key == clientKey) ? d : nullptr;
+}
+
+// Everything prepared while handling completions is submitted at the end of the batch, the rest on the next event loop iteration
+void UringTcpServer::scheduleFlush()
+{
+    if (m_isProcessingCompletions || m_isFlushScheduled)
+        return;
+    m_isFlushScheduled = true;
+    QMetaObject::invokeMethod(this, [this]() { flushSubmissions(); }, Qt::QueuedConnection);
+}
+
+void UringTcpServer::flushSubmissions()
+{
+    m_isFlushScheduled = false;
+    if (!m_pRing || (io_uring_sq_ready(&m_pRing->ring) == 0))
+        return;
+    io_uring_submit(&m_pRing->ring);
+    ++m_ioStats.syscalls;
+}
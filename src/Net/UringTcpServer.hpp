@@ -0,0 +1,95 @@
+#pragma once
+
+#include <memory>
+
+#include <QtCore/QHash>
+#include <QtCore/QVector>
+
+#include "EpollTcpServer.hpp"
+
+// EpollTcpServer which moves bytes through io_uring when the kernel allows it: one multishot accept, multishot recv per client into a ring of provided buffers,
+// and linked header/payload sends, one chain per client in flight at a time so that frames keep their order. Submissions made while handling a batch of completions
+// go to the kernel together, once per batch. If io_uring or any of the needed features is unavailable, it logs why and runs as plain EpollTcpServer
+class UringTcpServer : public EpollTcpServer
+{
+    Q_OBJECT
+public:
+    struct Frame
+    {
+        quint32 header; // payload size with g_encodedFrameFlag, already encoded in Net::g_endianness
+        QByteArray payload;
+    };
+
+    struct UringClientData : ClientData
+    {
+        quint64 key = 0; // fd and generation, tells completions for a reused descriptor apart
+        bool isChainInFlight = false;
+        QVector<Frame> waitingFrames;
+        qint64 waitingBytes = 0;
+        qint64 inFlightBytes = 0;
+        bool isCongested = false;
+    };
+
+    struct SendChain
+    {
+        quint64 clientKey = 0;
+        QVector<Frame> frames; // referenced by kernel until every send of the chain has completed
+        qint64 bytes = 0;
+        int pendingCount = 0;
+        bool isFailed = false;
+    };
+
+protected:
+    UringTcpServer(const quint8 _connType, const QString _connTypeName, QObject* parent = nullptr);
+
+public:
+    UringTcpServer(QObject* parent = nullptr) : UringTcpServer(Net::ConnectionType::UringTcpServer, "UringTcpServer", parent) {}
+    virtual ~UringTcpServer();
+    UringTcpServer(const UringTcpServer&) = delete;            // Copy constructor
+    UringTcpServer(UringTcpServer&&) = delete;                 // Move constructor
+    UringTcpServer& operator=(const UringTcpServer&) = delete; // Copy assignment
+    UringTcpServer& operator=(UringTcpServer&&) = delete;      // Move assignment
+
+    static constexpr unsigned s_ringEntries = 4096;
+    static constexpr int s_bufferCount = 1024; // must be power of 2
+    static constexpr int s_bufferSize = 16 * 1024;
+    static constexpr int s_maxChainFrames = 64;
+
+protected: // members
+    struct Ring; // keeps liburing out of this header
+    std::unique_ptr<Ring> m_pRing;
+    bool m_isUringActive = false;
+    bool m_isProcessingCompletions = false;
+    bool m_isFlushScheduled = false;
+    quint32 m_nextGeneration = 0;
+    quint64 m_nextChainId = 0;
+    QHash<quint64, SendChain> m_sendChains;
+
+public: // methods
+    bool getIsUringActive() const { return m_isUringActive; } // false if running as EpollTcpServer
+    using EpollTcpServer::sendMessageTo; // not hidden by the ClientData overload below
+
+protected:
+    bool startWatching() override;
+    void stopWatching() override;
+    bool watchClient(ClientData* d) override;
+    void unwatchClient(ClientData* d) override;
+    std::shared_ptr<ClientData> makeClientData() override { return std::make_shared<UringClientData>(); }
+    qint64 sendMessageTo(QByteArray msg, ClientData* d, bool isEncoded = false) override;
+
+    bool initRing(QString& unsupportedReason);
+    void armAccept();
+    void armRecv(UringClientData* d);
+    void submitSendChain(UringClientData* d);
+    void updateCongestion(UringClientData* d);
+    void handleCompletion(quint64 userData, int result, quint32 flags);
+    void onAccepted(int result, quint32 flags);
+    void onReceived(quint64 clientKey, int result, quint32 flags);
+    void onSent(quint64 chainId, int result);
+    void scheduleFlush();
+    void flushSubmissions();
+    UringClientData* findClient(quint64 clientKey) const;
+
+protected slots:
+    void processCompletions();
+};
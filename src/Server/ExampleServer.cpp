@@ -9,6 +9,7 @@
 #include "Common/RegLogger.hpp"
 #include "Common/Utils.hpp"
 #include "Net/NetHeaders.hpp"
+#include "MetricsEndpoint.hpp"
 
 using namespace std;
 using namespace Protocol;
@@ -17,6 +18,11 @@ using namespace Net;
 const QString g_settingsPath{"./ServerSettings.ini"};
 
 ExampleServer::ExampleServer(Net::ConnectionSettings serverSettings, QObject* parent)
+    : ExampleServer(nullptr, serverSettings, parent)
+{
+}
+
+ExampleServer::ExampleServer(NetServer* pServer, Net::ConnectionSettings serverSettings, QObject* parent)
     : QObject{parent}
 {
     RegLoggerThreadWorker::instantiateRegLogger(qApp->applicationDirPath());
@@ -32,26 +38,87 @@ ExampleServer::ExampleServer(Net::ConnectionSettings serverSettings, QObject* pa
     // Using byteSize of Request as cost
     m_cache.setMaxCost(std::numeric_limits<int>::max());
 
+    initMetrics();
+
     using namespace std::placeholders;
-    m_server = std::get<0>(Net::instantiateWaitThreadedConnection<TcpServer>());
-    m_server->setAllowAllAddresses(true);
-    // since m_server works in distinct thread, parseRequest() should work in ExampleServer's thread, since this thread is not occupied with any other work
-    // m_server->setCallbackFunction(std::bind(&ExampleServer::parseRequest, this, _1, _2, _3));
-    m_server->setCallbackFunction([this](QByteArray arg1, NetConnection* const arg2, Net::AddressPort arg3) {
-        QMetaObject::invokeMethod(this, [=](){
-            parseRequest(arg1, arg2, arg3);
-        }, Qt::QueuedConnection);
-    });
-    m_server->setLoggingFunctions(f_logGeneral, f_logError);
-
-    m_server->setAuthorizationEnabled(true);
+    m_server = (pServer != nullptr) ? pServer : instantiateServer();
+    QSettings settingsFile(g_settingsPath, QSettings::IniFormat);
+    const QString localServerName = settingsFile.value("Network/localServerName").toString();
+    if (!localServerName.isEmpty())
+        m_localServer = std::get<0>(Net::instantiateWaitThreadedConnection<LocalServer>());
+    for (NetServer* pServer : servers())
+    {
+        pServer->setAllowAllAddresses(true);
+        // since server works in distinct thread, parseRequest() should work in ExampleServer's thread, since this thread is not occupied with any other work
+        // frames of one read arrive as one batch, through server's lock-free callback channel
+        pServer->setBatchCallbackFunction(std::bind(&ExampleServer::parseRequests, this, _1, _2, _3), this);
+        pServer->setLoggingFunctions(f_logGeneral, f_logError);
+
+        pServer->setAuthorizationEnabled(true);
+    }
 
     loadSettings();
 
-    QObject::connect(m_server, &TcpServer::clientConnected, this, &ExampleServer::onClientConnected);
-    QObject::connect(m_server, &TcpServer::clientDisconnected, this, &ExampleServer::onClientDisconnected);
+    for (NetServer* pServer : servers())
+    {
+        QObject::connect(pServer, &NetServer::clientConnected, this, &ExampleServer::onClientConnected);
+        QObject::connect(pServer, &NetServer::clientDisconnected, this, &ExampleServer::onClientDisconnected);
+        QObject::connect(pServer, &NetServer::clientCongestionChanged, this, &ExampleServer::onClientCongestionChanged);
+    }
 
+    settingsFile.beginGroup("Socket");
+    serverSettings.socketOptions = Net::socketOptionsFromSettings(settingsFile);
+    settingsFile.endGroup();
     Net::openWaitThreadedConnection(m_server, serverSettings);
+    if (m_localServer != nullptr)
+    {
+        Net::ConnectionSettings localSettings;
+        localSettings.localServerName = localServerName;
+        Net::openWaitThreadedConnection(m_localServer, localSettings);
+    }
+}
+
+ExampleServer::~ExampleServer()
+{
+    if (m_traceFilePath.isEmpty() || !Tracing::Tracer::instance().isEnabled())
+        return;
+    if (Tracing::Tracer::instance().writeChromeTrace(m_traceFilePath))
+        f_logGeneral(QString("Trace written to %1").arg(m_traceFilePath));
+    else
+        f_logError(QString("Can't write trace to %1").arg(m_traceFilePath));
+}
+
+// Backend has to be known before anything else is configured, so it's read separately from the rest of settings
+NetServer* ExampleServer::instantiateServer()
+{
+    QSettings settingsFile(g_settingsPath, QSettings::IniFormat);
+    const QString backend = settingsFile.value("Network/backend", QStringLiteral("Qt")).toString();
+#if defined(NET_HAS_EPOLL)
+    if (backend == QStringLiteral("Epoll"))
+        return std::get<0>(Net::instantiateWaitThreadedConnection<EpollTcpServer>());
+#endif
+#if defined(NET_HAS_IO_URING)
+    if (backend == QStringLiteral("Uring")) // runs as Epoll if kernel can't do io_uring
+        return std::get<0>(Net::instantiateWaitThreadedConnection<UringTcpServer>());
+#endif
+    if (backend != QStringLiteral("Qt"))
+        f_logError(QString("Network backend %1 is not available, using Qt").arg(backend));
+    return std::get<0>(Net::instantiateWaitThreadedConnection<TcpServer>());
+}
+
+QVector<NetServer*> ExampleServer::servers() const
+{
+    if (m_localServer == nullptr)
+        return {m_server};
+    return {m_server, m_localServer};
+}
+
+// Local clients are the only ones at localPeerAddress(), so TCP and local clients never share an AddressPort in m_taskMap
+NetServer* ExampleServer::serverOf(Net::AddressPort addrPort) const
+{
+    if ((m_localServer != nullptr) && (addrPort.addr == Net::localPeerAddress()))
+        return m_localServer;
+    return m_server;
 }
 
 void ExampleServer::loadSettings()
@@ -63,7 +130,20 @@ void ExampleServer::loadSettings()
     {
         QString username = key;
         QString password = settingsFile.value(key).toString();
-        m_server->addLoginDataQueued(Net::LoginData{username, password});
+        for (NetServer* pServer : servers())
+            pServer->addLoginDataQueued(Net::LoginData{username, password});
+    }
+    settingsFile.endGroup();
+
+    // Users of LoadGen, which needs one per connection: prefix0..prefix<count-1>, all with the same password
+    settingsFile.beginGroup("GeneratedUsers");
+    const QString generatedUserPrefix = settingsFile.value("prefix").toString();
+    const QString generatedUserPassword = settingsFile.value("password").toString();
+    const int generatedUserCount = settingsFile.value("count", 0).toInt();
+    for (int i = 0; i < generatedUserCount; ++i)
+    {
+        for (NetServer* pServer : servers())
+            pServer->addLoginDataQueued(Net::LoginData{generatedUserPrefix + QString::number(i), generatedUserPassword});
     }
     settingsFile.endGroup();
 
@@ -73,10 +153,122 @@ void ExampleServer::loadSettings()
         m_server->addAllowedAddressQueued(QHostAddress{key});
     }
     settingsFile.endGroup();
+
+    settingsFile.beginGroup("Network");
+    if (TcpServer* pTcpServer = qobject_cast<TcpServer*>(m_server)) // other backends are not sharded
+    {
+        pTcpServer->setShardCount(settingsFile.value("shardCount", 0).toInt());
+        pTcpServer->setShardingPolicy((settingsFile.value("shardingPolicy").toString() == QStringLiteral("LeastLoaded"))
+                                      ? TcpServer::ShardingPolicy::LeastLoaded
+                                      : TcpServer::ShardingPolicy::RoundRobin);
+    }
+    Net::SendWatermarks sendWatermarks;
+    sendWatermarks.low = settingsFile.value("sendLowWatermark", sendWatermarks.low).toLongLong();
+    sendWatermarks.high = settingsFile.value("sendHighWatermark", sendWatermarks.high).toLongLong();
+    Net::ReceiveLimits receiveLimits;
+    receiveLimits.maxFrameSize = settingsFile.value("maxFrameSize", receiveLimits.maxFrameSize).toUInt();
+    receiveLimits.maxConnectionBytes = settingsFile.value("maxConnectionReceiveBytes", receiveLimits.maxConnectionBytes).toLongLong();
+    receiveLimits.maxTotalBytes = settingsFile.value("maxTotalReceiveBytes", receiveLimits.maxTotalBytes).toLongLong();
+    receiveLimits.partialFrameTimeout = settingsFile.value("partialFrameTimeout", receiveLimits.partialFrameTimeout).toInt();
+    const int idleTimeout = settingsFile.value("idleTimeout", 0).toInt(); // msec, 0 - idle clients are kept
+    const QString slowRecipientPolicyName = settingsFile.value("slowRecipientPolicy").toString();
+    const Net::SlowRecipientPolicy slowRecipientPolicy = (slowRecipientPolicyName == QStringLiteral("Skip"))       ? Net::SlowRecipientPolicy::Skip
+                                                       : (slowRecipientPolicyName == QStringLiteral("Disconnect")) ? Net::SlowRecipientPolicy::Disconnect
+                                                                                                                   : Net::SlowRecipientPolicy::Queue;
+    for (NetServer* pServer : servers())
+    {
+        pServer->setSendWatermarks(sendWatermarks);
+        pServer->setReceiveLimits(receiveLimits);
+        pServer->setIdleTimeout(idleTimeout);
+        pServer->setSlowRecipientPolicy(slowRecipientPolicy);
+    }
+    settingsFile.endGroup();
+
+    settingsFile.beginGroup("Compression");
+    Net::CompressionSettings compressionSettings;
+    compressionSettings.maxDecodedSize = receiveLimits.maxFrameSize;
+    compressionSettings.codecMask = Net::codecMaskFromQStringList(settingsFile.value("codecs").toStringList());
+    compressionSettings.threshold = settingsFile.value("threshold", compressionSettings.threshold).toInt();
+    compressionSettings.zlibLevel = settingsFile.value("zlibLevel", compressionSettings.zlibLevel).toInt();
+    for (NetServer* pServer : servers())
+        pServer->setCompressionSettings(compressionSettings);
+    settingsFile.endGroup();
+
+    settingsFile.beginGroup("Tasks");
+    m_maxTasksPerClient = qMax(1, settingsFile.value("maxTasksPerClient", m_maxTasksPerClient).toInt());
+    settingsFile.endGroup();
+
+    settingsFile.beginGroup("Tracing");
+    Tracing::Tracer& tracer = Tracing::Tracer::instance();
+    if (settingsFile.contains("capacity"))
+        tracer.setCapacity(settingsFile.value("capacity").toInt());
+    m_slowRequestThreshold = settingsFile.value("slowRequestThreshold", 0).toInt();
+    m_traceFilePath = settingsFile.value("traceFile").toString();
+    tracer.setEnabled(settingsFile.value("enabled", false).toBool() || (m_slowRequestThreshold > 0)); // slow request breakdown is made of spans as well
+    settingsFile.endGroup();
+}
+
+void ExampleServer::initMetrics()
+{
+    m_pActiveTasks = &m_metrics.gauge(QStringLiteral("server_active_tasks"), QStringLiteral("Tasks added and not finished yet"));
+    m_pCacheHits = &m_metrics.counter(QStringLiteral("server_cache_hits_total"), QStringLiteral("Requests answered with a cached result"));
+    m_pCacheMisses = &m_metrics.counter(QStringLiteral("server_cache_misses_total"), QStringLiteral("Requests not found in the cache"));
+    m_pCacheEvictions = &m_metrics.counter(QStringLiteral("server_cache_evictions_total"), QStringLiteral("Cached results dropped to make room for new ones"));
+
+    QSettings settingsFile(g_settingsPath, QSettings::IniFormat);
+    settingsFile.beginGroup("Metrics");
+    const QHostAddress address{settingsFile.value("address", QStringLiteral("127.0.0.1")).toString()};
+    const quint16 port = settingsFile.value("port", 0).toUInt(); // 0 - metrics are collected, but not served
+    settingsFile.endGroup();
+    if (port == 0)
+        return;
+    m_pMetricsEndpoint = new MetricsEndpoint(std::bind(&ExampleServer::renderMetrics, this), this);
+    if (m_pMetricsEndpoint->listen(address, port))
+        f_logGeneral(QString("Serving metrics at http://%1:%2/metrics").arg(address.toString()).arg(port));
+    else
+        f_logError(QString("Can't serve metrics at %1:%2: %3").arg(address.toString()).arg(port).arg(m_pMetricsEndpoint->errorString()));
+}
+
+ExampleServer::ConnectionMetrics* ExampleServer::connectionMetrics(Net::AddressPort addrPort)
+{
+    auto iter = m_connectionMetrics.find(addrPort);
+    return (iter != m_connectionMetrics.end()) ? &iter.value() : nullptr;
+}
+
+ExampleServer::RequestMetrics& ExampleServer::requestMetrics(Protocol::RequestType type)
+{
+    auto iter = m_requestMetrics.find(static_cast<int>(type));
+    if (iter != m_requestMetrics.end())
+        return iter.value();
+    const QString typeName = toQString(type);
+    const Metrics::Labels labels{{QStringLiteral("type"), typeName.isEmpty() ? QString::number(static_cast<int>(type)) : typeName}};
+    RequestMetrics& m = m_requestMetrics[static_cast<int>(type)];
+    m.requests = &m_metrics.counter(QStringLiteral("server_requests_total"), QStringLiteral("Requests received"), labels);
+    m.decodeTime = &m_metrics.histogram(QStringLiteral("server_decode_seconds"), QStringLiteral("Time to deserialize a request"), labels);
+    m.encodeTime = &m_metrics.histogram(QStringLiteral("server_encode_seconds"), QStringLiteral("Time to serialize a reply"), labels);
+    m.queueWait = &m_metrics.histogram(QStringLiteral("server_queue_wait_seconds"), QStringLiteral("Time from task being added to its start in the thread pool"), labels);
+    m.computeTime = &m_metrics.histogram(QStringLiteral("server_compute_seconds"), QStringLiteral("Time from task's start to its finish"), labels);
+    return m;
+}
+
+QByteArray ExampleServer::renderMetrics()
+{
+    m_metrics.gauge(QStringLiteral("server_connections"), QStringLiteral("Connected clients")).set(m_connectionMetrics.size());
+    m_metrics.gauge(QStringLiteral("server_cache_entries"), QStringLiteral("Results in the cache")).set(m_cache.count());
+    for (NetServer* pServer : servers())
+    {
+        const QString transport = (pServer == m_localServer) ? QStringLiteral("local")
+                                : (pServer->getConnectionType() == Net::ConnectionType::MemoryServer) ? QStringLiteral("memory")
+                                : QStringLiteral("tcp");
+        const Metrics::Labels labels{{QStringLiteral("transport"), transport}};
+        m_metrics.gauge(QStringLiteral("server_receive_memory_bytes"), QStringLiteral("Bytes held by receive buffers"), labels).set(pServer->getReceiveMemoryUsage());
+    }
+    return m_metrics.toPrometheusText();
 }
 
 void ExampleServer::sendRequestToClient(const Protocol::Request* req, Net::AddressPort addrPort)
 {
+    const qint64 encodeStartedAtNs = Tracing::nowNs();
     QByteArray msg;
 #if defined(MESSAGE_FORMAT_BINARY)
     MAKE_QDATASTREAM_NET(stream, &msg, QIODevice::WriteOnly);
@@ -86,51 +278,151 @@ void ExampleServer::sendRequestToClient(const Protocol::Request* req, Net::Addre
     req->serialize(jsonObject);
     msg = QJsonDocument(jsonObject).toJson(QJsonDocument::Compact);
 #endif
-    m_server->sendMessageToQueued(msg, addrPort);
+    const qint64 encodedAtNs = Tracing::nowNs();
+    requestMetrics(req->type).encodeTime->record(encodedAtNs - encodeStartedAtNs);
+    Tracing::Tracer::instance().record("encode", Tracing::currentTraceId(), encodeStartedAtNs, encodedAtNs);
+    if (ConnectionMetrics* m = connectionMetrics(addrPort))
+    {
+        m->framesSent->add();
+        m->bytesSent->add(msg.size());
+    }
+    serverOf(addrPort)->sendMessageToQueued(msg, addrPort);
 }
 
-void ExampleServer::sendErrorToClient(Protocol::ErrorCode errorCode, Net::AddressPort addrPort, QString errorText)
+void ExampleServer::sendErrorToClient(Protocol::ErrorCode errorCode, Net::AddressPort addrPort, QString errorText, quint32 requestId)
 {
     Request_InvalidRequest req;
+    req.requestId = requestId;
     req.errorCode = errorCode;
     req.errorText = errorText;
     sendRequestToClient(&req, addrPort);
 }
 
+// Sends the error itself if the task can't be started
+bool ExampleServer::canStartTask(Net::AddressPort addrPort, quint32 requestId)
+{
+    auto iterClient = m_taskMap.constFind(addrPort);
+    if (iterClient == m_taskMap.constEnd())
+        return true;
+    if (iterClient.value().contains(requestId))
+    {
+        sendErrorToClient(Protocol::ErrorCode::AlreadyRunningTask, addrPort, QString{}, requestId);
+        return false;
+    }
+    if (iterClient.value().size() >= m_maxTasksPerClient)
+    {
+        sendErrorToClient(Protocol::ErrorCode::TaskLimitReached, addrPort, QString{}, requestId);
+        return false;
+    }
+    return true;
+}
+
+Task* ExampleServer::addTask(Net::AddressPort addrPort, quint32 requestId)
+{
+    auto ptr = make_shared<Task>();
+    ptr->addrPort = addrPort;
+    ptr->requestId = requestId;
+    ptr->addedAtNs = Tracing::nowNs();
+    m_taskMap[addrPort].insert(requestId, ptr);
+    m_pActiveTasks->add();
+    return ptr.get();
+}
+
+void ExampleServer::removeTask(Task* task)
+{
+    auto iterClient = m_taskMap.find(task->addrPort);
+    if (iterClient == m_taskMap.end())
+        return;
+    if (iterClient.value().remove(task->requestId) > 0) // deletes task
+        m_pActiveTasks->sub();
+    if (iterClient.value().isEmpty())
+        m_taskMap.erase(iterClient);
+}
+
+void ExampleServer::parseRequests(QVector<QByteArray> msgs, NetConnection* const netConnection, Net::AddressPort addrPort)
+{
+    if (ConnectionMetrics* m = connectionMetrics(addrPort))
+    {
+        m->framesReceived->add(msgs.size());
+        for (QByteArray const& msg : qAsConst(msgs))
+            m->bytesReceived->add(msg.size());
+    }
+    for (QByteArray const& msg : qAsConst(msgs))
+        parseRequest(msg, netConnection, addrPort);
+}
+
 void ExampleServer::parseRequest(QByteArray msg, NetConnection* const, Net::AddressPort addrPort)
 {
     auto lambda_makeConnects = [this](Task* task, QFutureWatcherBase* fw){
         QObject::connect(fw, &QFutureWatcherBase::started, this, [this, task](){
-            f_logGeneral(QStringLiteral("Started task %1 for %2").arg(toQString(task->request->type)).arg(toQString(task->addrPort)));
+            task->startedAtNs = Tracing::nowNs();
+            requestMetrics(task->request->type).queueWait->record(task->startedAtNs - task->addedAtNs);
+            Tracing::Tracer::instance().record("queue", task->traceId, task->addedAtNs, task->startedAtNs);
+            f_logGeneral(QStringLiteral("Started task %1 #%2 for %3").arg(toQString(task->request->type)).arg(task->requestId).arg(toQString(task->addrPort)));
         });
         QObject::connect(fw, &QFutureWatcherBase::finished, this, [this, task](){
-            f_logGeneral(QStringLiteral("Finished task %1 for %2").arg(toQString(task->request->type)).arg(toQString(task->addrPort)));
+            if ((task->startedAtNs >= 0) && (task->finishedAtNs >= 0))
+            {
+                requestMetrics(task->request->type).computeTime->record(task->finishedAtNs - task->startedAtNs);
+                Tracing::Tracer::instance().record("compute", task->traceId, task->startedAtNs, task->finishedAtNs);
+            }
+            const qint64 totalNs = Tracing::nowNs() - task->receivedAtNs;
+            if ((m_slowRequestThreshold > 0) && (totalNs >= m_slowRequestThreshold * 1000000LL) && !task->futureWatcher->isCanceled())
+                logSlowRequest(task, totalNs);
+            f_logGeneral(QStringLiteral("Finished task %1 #%2 for %3").arg(toQString(task->request->type)).arg(task->requestId).arg(toQString(task->addrPort)));
             if (task->futureWatcher->isCanceled())
             {
                 Request_CancelCurrentTask req;
+                req.requestId = task->requestId;
                 sendRequestToClient(&req, task->addrPort); // canceled() is emitted before finished() -> still safe to access task here
             }
-            else
+            else if (task->sharedArray == nullptr) // result in shared memory is not in request, and hash of such request is unique anyway
             {
                 // should be safe to release it at that point, since task is about to be deleted anyway
                 Request* r = task->request.release();
-                m_cache.insert(task->rmsgHash, r, r->byteSize());
+                const int expectedCount = m_cache.count() + (m_cache.contains(task->rmsgHash) ? 0 : 1);
+                if (m_cache.insert(task->rmsgHash, r, r->byteSize()))
+                    m_pCacheEvictions->add(expectedCount - m_cache.count());
             }
-            m_taskMap.remove(task->addrPort);
+            removeTask(task);
         });
         QObject::connect(fw, &QFutureWatcherBase::progressRangeChanged, [this, task](int minimum, int maximum) {
             Request_ProgressRange req;
+            req.requestId = task->requestId;
             req.minimum = minimum;
             req.maximum = maximum;
             sendRequestToClient(&req, task->addrPort);
         });
         QObject::connect(fw, &QFutureWatcherBase::progressValueChanged, [this, task](int progressValue) {
+            if (m_congestedClients.contains(task->addrPort)) // only the latest value matters, it's sent once client catches up
+            {
+                task->deferredProgressValue = progressValue;
+                return;
+            }
             Request_ProgressValue req;
+            req.requestId = task->requestId;
             req.value = progressValue;
             sendRequestToClient(&req, task->addrPort);
         });
     };
 
+    const qint64 parseStartedAtNs = Tracing::nowNs();
+    qint64 headerDecodeNs = 0;
+    const quint64 traceId = Tracing::Tracer::instance().newTraceId();
+    // Batch of frames was read and handed over to this thread as a whole, so every request of the batch gets these stages
+    const Net::ReceiveTiming& receiveTiming = NetConnection::currentReceiveTiming();
+    const qint64 receivedAtNs = (receiveTiming.readStartedAtNs > 0) ? receiveTiming.readStartedAtNs : parseStartedAtNs;
+    if (receiveTiming.readStartedAtNs > 0)
+        Tracing::Tracer::instance().record("read", traceId, receiveTiming.readStartedAtNs, (receiveTiming.enqueuedAtNs > 0) ? receiveTiming.enqueuedAtNs : parseStartedAtNs);
+    if (receiveTiming.enqueuedAtNs > 0)
+        Tracing::Tracer::instance().record("hop", traceId, receiveTiming.enqueuedAtNs, receiveTiming.dispatchedAtNs);
+    // Decode time is that of the header plus that of the whole request, cache lookup in between is left out
+    auto lambda_recordDecode = [this, parseStartedAtNs, &headerDecodeNs, traceId](RequestType type, qint64 unpackStartedAtNs) {
+        const qint64 decodedAtNs = Tracing::nowNs();
+        requestMetrics(type).decodeTime->record(headerDecodeNs + (decodedAtNs - unpackStartedAtNs));
+        Tracing::Tracer::instance().record("parseRequest", traceId, parseStartedAtNs, decodedAtNs);
+    };
+
     Request request;
 #if defined(MESSAGE_FORMAT_BINARY)
     MAKE_QDATASTREAM_NET(streamMsg, &msg, QIODevice::ReadOnly);
@@ -140,8 +432,10 @@ void ExampleServer::parseRequest(QByteArray msg, NetConnection* const, Net::Addr
         onCorruptedMessage(msg);
         return;
     }
+    headerDecodeNs = Tracing::nowNs() - parseStartedAtNs;
 
-    auto lambda_unpackRequest = [this, msg, &streamMsg, addrPort](Request* req) -> bool {
+    auto lambda_unpackRequest = [this, msg, &streamMsg, addrPort, &lambda_recordDecode](Request* req) -> bool {
+        const qint64 unpackStartedAtNs = Tracing::nowNs();
         streamMsg.device()->seek(0);
         streamMsg >> *req;
         if (streamMsg.status() != QDataStream::Ok)
@@ -149,6 +443,7 @@ void ExampleServer::parseRequest(QByteArray msg, NetConnection* const, Net::Addr
             onCorruptedMessage(msg, addrPort);
             return false;
         }
+        lambda_recordDecode(req->type, unpackStartedAtNs);
         return true;
     };
 #elif defined(MESSAGE_FORMAT_JSON)
@@ -166,57 +461,87 @@ void ExampleServer::parseRequest(QByteArray msg, NetConnection* const, Net::Addr
         onCorruptedMessage(msg, addrPort, *errorText);
         return;
     }
+    headerDecodeNs = Tracing::nowNs() - parseStartedAtNs;
 
-    auto lambda_unpackRequest = [this, msg, &msgJsonObject, &errorText, addrPort](Request* req) -> bool {
+    auto lambda_unpackRequest = [this, msg, &msgJsonObject, &errorText, addrPort, &lambda_recordDecode](Request* req) -> bool {
+        const qint64 unpackStartedAtNs = Tracing::nowNs();
         if (!req->deserialize(msgJsonObject, errorText.get()))
         {
             onCorruptedMessage(msg, addrPort, *errorText);
             return false;
         }
+        lambda_recordDecode(req->type, unpackStartedAtNs);
         return true;
     };
 #endif
+    requestMetrics(request.type).requests->add();
 
     quint64 msgHash;
     // check cached requests first
     if (request.type != RequestType::CancelCurrentTask)
     {
-        // easiest way is to hash QByteArray
-        msgHash = hash64_FNV1a(msg);
+        // easiest way is to hash QByteArray; requestId differs between otherwise equal requests, so it's left out
+#if defined(MESSAGE_FORMAT_BINARY)
+        msgHash = hash64_FNV1a(msg.constData() + Request::s_binaryHeaderSize, msg.size() - Request::s_binaryHeaderSize, hash64_FNV1a(msg.constData(), sizeof(RequestType)));
+#elif defined(MESSAGE_FORMAT_JSON)
+        QJsonObject keyJsonObject = msgJsonObject;
+        keyJsonObject.remove(QStringLiteral("requestId"));
+        msgHash = hash64_FNV1a(QJsonDocument(keyJsonObject).toJson(QJsonDocument::Compact));
+#endif
         auto* req = m_cache[msgHash];
         // since requests store incoming data too, might as well do extra checks?
         if (req != nullptr)
         {
-            f_logGeneral(QStringLiteral("Fetched cached result for task %1 for %2").arg(toQString(req->type)).arg(toQString(addrPort)));
+            m_pCacheHits->add();
+            f_logGeneral(QStringLiteral("Fetched cached result for task %1 #%2 for %3").arg(toQString(req->type)).arg(request.requestId).arg(toQString(addrPort)));
+            req->requestId = request.requestId;
             sendRequestToClient(req, addrPort);
             return;
         }
+        m_pCacheMisses->add();
     }
 
     switch (request.type)
     {
     case RequestType::SortArray:
     {
-        if (m_taskMap.contains(addrPort))
-        {
-            sendErrorToClient(Protocol::ErrorCode::AlreadyRunningTask, addrPort);
+        if (!canStartTask(addrPort, request.requestId))
             return;
-        }
         constexpr RequestType ReqT = RequestType::SortArray;
         auto req = make_unique<RStMapper_t<ReqT>>();
         if (!lambda_unpackRequest(req.get())) return;
 
-        auto sequence = divideIntoChunks(req->numbers, m_maxChunkCount, m_minChunkSize);
+        std::unique_ptr<SharedArray> sharedArray;
+        if (req->sharedBlock.isValid())
+        {
+            sharedArray = make_unique<SharedArray>();
+            // only clients of local server share the host, descriptor from a TCP peer names nothing server should attach to
+            if ((addrPort.addr != Net::localPeerAddress()) || !sharedArray->attach(req->sharedBlock))
+            {
+                f_logError(QStringLiteral("Can't attach shared memory %1 of %2: %3").arg(req->sharedBlock.key).arg(toQString(addrPort)).arg(sharedArray->errorString()));
+                sendErrorToClient(Protocol::ErrorCode::SharedMemoryUnavailable, addrPort, QString{}, request.requestId);
+                return;
+            }
+            req->numbers = sharedArray->read();
+        }
+
+        auto sequence = [&]() {
+            Tracing::ScopedSpan span("divideIntoChunks", traceId);
+            return divideIntoChunks(req->numbers, m_maxChunkCount, m_minChunkSize);
+        }();
 
-        auto iter = m_taskMap.insert(addrPort, make_shared<Task>());
-        Task* task = iter.value().get();
+        Task* task = addTask(addrPort, request.requestId);
         task->request = std::move(req);
+        task->sharedArray = std::move(sharedArray);
         task->futureWatcher = make_unique<RFWMapper_t<ReqT>>();
-        task->addrPort = addrPort;
         task->rmsgHash = msgHash;
+        task->traceId = traceId;
+        task->receivedAtNs = receivedAtNs;
         auto* fw = watcher_cast<ReqT>(task->futureWatcher.get());
         QObject::connect(fw, &QFutureWatcherBase::finished, this, [this, task]() {
             constexpr RequestType ReqT = RequestType::SortArray;
+            task->finishedAtNs = Tracing::nowNs();
+            Tracing::ScopedSpan span("finish", task->traceId); // putting the result together and sending it
             auto req = request_cast<ReqT>(task->request.get());
             auto fw = watcher_cast<ReqT>(task->futureWatcher.get());
             if (fw->isCanceled()) // don't send anything if task was canceled
@@ -230,36 +555,45 @@ void ExampleServer::parseRequest(QByteArray msg, NetConnection* const, Net::Addr
                 req->numbers.append(result);
                 std::inplace_merge(req->numbers.begin(), (req->numbers.begin() + idxMiddle), req->numbers.end());
             }
+            if (task->sharedArray != nullptr)
+            {
+                task->sharedArray->write(req->numbers); // result has the size of request, so it always fits
+                req->numbers.clear();
+                req->sharedBlock = task->sharedArray->block();
+                task->sharedArray->detach(); // client is still attached until it reads the result, so segment survives
+            }
 
             sendRequestToClient(task->request.get(), task->addrPort);
         });
         lambda_makeConnects(task, fw);
-        auto future = QtConcurrent::mapped(sequence, &ExampleServer::sortArray); // slightly better to make all inplace_merge in the end instead of reduce?
+        auto future = QtConcurrent::mapped(sequence, TracedChunk<QVector<int>, QVector<int>>{&Kernels::sortArray, traceId}); // slightly better to make all inplace_merge in the end instead of reduce?
         fw->setFuture(future);
         break;
     }
     case RequestType::FindPrimeNumbers:
     {
-        if (m_taskMap.contains(addrPort))
-        {
-            sendErrorToClient(Protocol::ErrorCode::AlreadyRunningTask, addrPort);
+        if (!canStartTask(addrPort, request.requestId))
             return;
-        }
         constexpr RequestType ReqT = RequestType::FindPrimeNumbers;
         auto req = make_unique<RStMapper_t<ReqT>>();
         if (!lambda_unpackRequest(req.get())) return;
 
-        auto sequence = divideIntoChunks(req->x_from, req->x_to, m_maxChunkCount, m_minChunkSize);
+        auto sequence = [&]() {
+            Tracing::ScopedSpan span("divideIntoChunks", traceId);
+            return divideIntoChunks(req->x_from, req->x_to, m_maxChunkCount, m_minChunkSize);
+        }();
 
-        auto iter = m_taskMap.insert(addrPort, make_shared<Task>());
-        Task* task = iter.value().get();
+        Task* task = addTask(addrPort, request.requestId);
         task->request = std::move(req);
         task->futureWatcher = make_unique<RFWMapper_t<ReqT>>();
-        task->addrPort = addrPort;
         task->rmsgHash = msgHash;
+        task->traceId = traceId;
+        task->receivedAtNs = receivedAtNs;
         auto* fw = watcher_cast<ReqT>(task->futureWatcher.get());
         QObject::connect(fw, &QFutureWatcherBase::finished, this, [this, task]() {
             constexpr RequestType ReqT = RequestType::FindPrimeNumbers;
+            task->finishedAtNs = Tracing::nowNs();
+            Tracing::ScopedSpan span("finish", task->traceId); // putting the result together and sending it
             auto req = request_cast<ReqT>(task->request.get());
             auto fw = watcher_cast<ReqT>(task->futureWatcher.get());
             if (fw->isCanceled()) // don't send anything if task was canceled
@@ -270,22 +604,20 @@ void ExampleServer::parseRequest(QByteArray msg, NetConnection* const, Net::Addr
             sendRequestToClient(task->request.get(), task->addrPort);
         });
         lambda_makeConnects(task, fw);
-        auto future = QtConcurrent::mappedReduced(sequence, &ExampleServer::findPrimeNumbersT, &ExampleServer::findPrimeNumbers_reduce, QtConcurrent::OrderedReduce);
+        auto future = QtConcurrent::mappedReduced(sequence, TracedChunk<QVector<int>, std::tuple<int, int>>{&Kernels::findPrimeNumbersT, traceId}, &Kernels::findPrimeNumbers_reduce, QtConcurrent::OrderedReduce);
         fw->setFuture(future);
         break;
     }
     case RequestType::CalculateFunction:
     {
-        if (m_taskMap.contains(addrPort))
-        {
-            sendErrorToClient(Protocol::ErrorCode::AlreadyRunningTask, addrPort);
+        if (!canStartTask(addrPort, request.requestId))
             return;
-        }
         constexpr RequestType ReqT = RequestType::CalculateFunction;
         auto req = make_unique<RStMapper_t<ReqT>>();
         if (!lambda_unpackRequest(req.get())) return;
 
         auto sequence = [&](){
+            Tracing::ScopedSpan span("divideIntoChunks", traceId);
             QVector<std::tuple<Protocol::EquationType, int, int, int, const int, const int, const int>> sequence;
             auto ranges = divideIntoChunks(req->x_from, req->x_to, m_maxChunkCount, m_minChunkSize);
             for (auto const& range : ranges)
@@ -293,15 +625,17 @@ void ExampleServer::parseRequest(QByteArray msg, NetConnection* const, Net::Addr
             return sequence;
         }();
 
-        auto iter = m_taskMap.insert(addrPort, make_shared<Task>());
-        Task* task = iter.value().get();
+        Task* task = addTask(addrPort, request.requestId);
         task->request = std::move(req);
         task->futureWatcher = make_unique<RFWMapper_t<ReqT>>();
-        task->addrPort = addrPort;
         task->rmsgHash = msgHash;
+        task->traceId = traceId;
+        task->receivedAtNs = receivedAtNs;
         auto* fw = watcher_cast<ReqT>(task->futureWatcher.get());
         QObject::connect(fw, &QFutureWatcherBase::finished, this, [this, task]() {
             constexpr RequestType ReqT = RequestType::CalculateFunction;
+            task->finishedAtNs = Tracing::nowNs();
+            Tracing::ScopedSpan span("finish", task->traceId); // putting the result together and sending it
             auto req = request_cast<ReqT>(task->request.get());
             auto fw = watcher_cast<ReqT>(task->futureWatcher.get());
             if (fw->isCanceled()) // don't send anything if task was canceled
@@ -312,7 +646,7 @@ void ExampleServer::parseRequest(QByteArray msg, NetConnection* const, Net::Addr
             sendRequestToClient(task->request.get(), task->addrPort);
         });
         lambda_makeConnects(task, fw);
-        auto future = QtConcurrent::mappedReduced(sequence, &ExampleServer::calculateFunctionT, &ExampleServer::calculateFunction_reduce, QtConcurrent::OrderedReduce);
+        auto future = QtConcurrent::mappedReduced(sequence, TracedChunk<QVector<QPoint>, std::tuple<Protocol::EquationType, int, int, int, const int, const int, const int>>{&Kernels::calculateFunctionT, traceId}, &Kernels::calculateFunction_reduce, QtConcurrent::OrderedReduce);
         fw->setFuture(future);
         break;
     }
@@ -322,25 +656,36 @@ void ExampleServer::parseRequest(QByteArray msg, NetConnection* const, Net::Addr
         auto req = make_unique<RStMapper_t<ReqT>>();
         if (!lambda_unpackRequest(req.get())) return;
 
-        auto iter = m_taskMap.find(addrPort);
-        if (iter == m_taskMap.end())
+        // the rest should be done by functions connected to finished() and canceled(), which answer with requestId of each task
+        QVector<Task*> tasks;
+        auto iterClient = m_taskMap.constFind(addrPort);
+        if (iterClient != m_taskMap.constEnd())
         {
-            f_logError(QStringLiteral("%1; addrPort=%2").arg(toQString(Protocol::ErrorCode::NotRunningAnyTask)).arg(toQString(addrPort)));
-            // Respond to client anyway since it awaits answer
-            sendRequestToClient(req.get(), addrPort);
+            if (req->requestId == 0)
+            {
+                for (auto const& ptr : iterClient.value())
+                    tasks.append(ptr.get());
+            }
+            else if (iterClient.value().contains(req->requestId))
+            {
+                tasks.append(iterClient.value().value(req->requestId).get());
+            }
         }
-        else
+        if (tasks.isEmpty())
         {
-            Task* task = iter.value().get();
-            task->futureWatcher->cancel(); // the rest should be done by functions connected to finished() and canceled()
+            f_logError(QStringLiteral("%1; addrPort=%2; requestId=%3").arg(toQString(Protocol::ErrorCode::NotRunningAnyTask)).arg(toQString(addrPort)).arg(req->requestId));
+            // Respond to client anyway since it awaits answer
+            sendRequestToClient(req.get(), addrPort);
         }
+        for (Task* task : qAsConst(tasks))
+            task->futureWatcher->cancel();
         break;
     }
     default:
     {
         auto errorCode = Protocol::ErrorCode::InvalidRequestType;
         f_logError(QStringLiteral("%1; addrPort=%2; msg=%3").arg(toQString(errorCode)).arg(toQString(addrPort)).arg(QString::fromLatin1(msg.toHex())));
-        sendErrorToClient(errorCode, addrPort);
+        sendErrorToClient(errorCode, addrPort, QString{}, request.requestId);
         return;
     }
     }
@@ -352,91 +697,95 @@ void ExampleServer::onCorruptedMessage(QByteArray msg, Net::AddressPort addrPort
     sendErrorToClient(Protocol::ErrorCode::CorruptedData, addrPort, errorText);
 }
 
-QVector<int> ExampleServer::sortArray(QVector<int> arr)
-{
-    std::sort(arr.begin(), arr.end());
-    return arr;
-}
-
-QVector<int> ExampleServer::findPrimeNumbers(int numFrom, int numTo)
-{
-    auto isPrime = [](int n) -> bool {
-        int limit = sqrt(n);
-        for (int i = 3; i <= limit; i += 2)
-        {
-            if (n % i == 0)
-                return false;
-        }
-        return true;
-    };
-
-    if (numFrom > numTo)
-        return {};
-
-    QVector<int> primes;
-    // Start checking from 3 onwards
-    if (numFrom <= 2)
-    {
-        primes.push_back(2);
-        numFrom = 3;
-    }
-    else if (numFrom % 2 == 0) // Ensure odd starting point
-    {
-        numFrom++;
-    }
-
-    for (int num = numFrom; num <= numTo; num += 2)
-    {
-        if (isPrime(num))
-            primes.push_back(num);
-    }
-    return primes;
-}
-
-QVector<QPoint> ExampleServer::calculateFunction(EquationType equationType, int x_from, int x_to, int x_step, const int constantA, const int constantB, const int constantC)
+// Stages are listed in order of their start; chunks run in parallel, so they are summed up into one entry
+void ExampleServer::logSlowRequest(const Task* task, qint64 totalNs)
 {
-    QVector<int> x_values;
-    x_values.reserve((x_to - x_from) / x_step);
-    for (int x = x_from; x <= x_to; x += x_step)
-        x_values.push_back(x);
-
-    QVector<QPoint> result;
-    switch (equationType)
+    struct Stage
     {
-    case EquationType::Linear:
+        const char* name = nullptr;
+        int count = 0;
+        qint64 totalNs = 0;
+        qint64 maxNs = 0;
+    };
+    QVector<Stage> stages;
+    for (Tracing::Span const& span : Tracing::Tracer::instance().spansOf(task->traceId))
     {
-        for (auto x : x_values)
+        auto iter = std::find_if(stages.begin(), stages.end(), [&span](const Stage& stage) { return qstrcmp(stage.name, span.name) == 0; });
+        if (iter == stages.end())
         {
-            int y = constantA * x + constantB;
-            result.push_back(QPoint{x, y});
+            stages.append(Stage{span.name});
+            iter = stages.end() - 1;
         }
-        break;
+        const qint64 durationNs = span.endNs - span.startNs;
+        ++iter->count;
+        iter->totalNs += durationNs;
+        iter->maxNs = qMax(iter->maxNs, durationNs);
     }
-    case EquationType::Quadratic:
+    QStringList breakdown;
+    for (Stage const& stage : qAsConst(stages))
     {
-        for (auto x : x_values)
-        {
-            int y = constantA * pow(x, 2) + constantB * x + constantC;
-            result.push_back(QPoint{x, y});
-        }
-        break;
-    }
-    default: { break; }
+        if (stage.count == 1)
+            breakdown.append(QStringLiteral("%1 %2 ms").arg(QLatin1String(stage.name)).arg(stage.totalNs / 1e6, 0, 'f', 3));
+        else
+            breakdown.append(QStringLiteral("%1 x%2 %3 ms (max %4 ms)").arg(QLatin1String(stage.name)).arg(stage.count).arg(stage.totalNs / 1e6, 0, 'f', 3).arg(stage.maxNs / 1e6, 0, 'f', 3));
     }
-    return result;
+    f_logGeneral(QStringLiteral("Slow task %1 #%2 for %3: %4 ms total; %5")
+                 .arg(toQString(task->request->type))
+                 .arg(task->requestId)
+                 .arg(toQString(task->addrPort))
+                 .arg(totalNs / 1e6, 0, 'f', 3)
+                 .arg(breakdown.join(QStringLiteral(", "))));
 }
 
+// Authorization is handled by the server itself, only per-connection metrics are set up here
 void ExampleServer::onClientConnected(Net::AddressPort addrPort)
 {
-    return; // Nothing to do I guess, since authorization is handled by TcpServer itself
+    const Metrics::Labels labels{{QStringLiteral("peer"), toQString(addrPort)}};
+    ConnectionMetrics& m = m_connectionMetrics[addrPort];
+    m.framesReceived = &m_metrics.counter(QStringLiteral("server_frames_received_total"), QStringLiteral("Frames received from the client"), labels);
+    m.bytesReceived = &m_metrics.counter(QStringLiteral("server_bytes_received_total"), QStringLiteral("Bytes of frames received from the client, after decompression"), labels);
+    m.framesSent = &m_metrics.counter(QStringLiteral("server_frames_sent_total"), QStringLiteral("Frames sent to the client"), labels);
+    m.bytesSent = &m_metrics.counter(QStringLiteral("server_bytes_sent_total"), QStringLiteral("Bytes of frames sent to the client, before compression"), labels);
 }
 
 // Client can disconnect without sending cancel request -> need to force cancel its task
 void ExampleServer::onClientDisconnected(Net::AddressPort addrPort)
 {
-    auto iter = m_taskMap.find(addrPort);
-    if (iter == m_taskMap.end())
+    m_congestedClients.remove(addrPort);
+    if (m_connectionMetrics.remove(addrPort) > 0)
+        m_metrics.removeSeries(QStringLiteral("peer"), toQString(addrPort));
+    auto iterClient = m_taskMap.constFind(addrPort);
+    if (iterClient == m_taskMap.constEnd())
         return;
-    Task* task = iter.value().get();
-    task->futureWatcher->cancel();
+    for (auto const& ptr : iterClient.value())
+        ptr->futureWatcher->cancel();
+}
+
+// Progress updates are the only replies that can be thinned out, so they are held back while client doesn't read fast enough
+void ExampleServer::onClientCongestionChanged(Net::AddressPort addrPort, bool isCongested, qint64 pendingBytes)
+{
+    f_logGeneral(QStringLiteral("Client %1 %2 (%3 bytes pending)")
+                 .arg(toQString(addrPort))
+                 .arg(isCongested ? QStringLiteral("is congested") : QStringLiteral("caught up"))
+                 .arg(pendingBytes));
+    if (isCongested)
+    {
+        m_congestedClients.insert(addrPort);
+        return;
+    }
+    m_congestedClients.remove(addrPort);
+    auto iterClient = m_taskMap.constFind(addrPort);
+    if (iterClient == m_taskMap.constEnd())
+        return;
+    for (auto const& ptr : iterClient.value())
+    {
+        Task* task = ptr.get();
+        if (task->deferredProgressValue < 0)
+            continue;
+        Request_ProgressValue req;
+        req.requestId = task->requestId;
+        req.value = task->deferredProgressValue;
+        task->deferredProgressValue = -1;
+        sendRequestToClient(&req, addrPort);
+    }
 }
@@ -8,12 +8,18 @@
 #include <QtCore/QFutureWatcher>
 #include <QtCore/QObject>
 #include <QtCore/QPoint>
+#include <QtCore/QSet>
 #include <QtCore/QVector>
 
+#include "Common/Metrics.hpp"
 #include "Common/Protocol.hpp"
+#include "Common/SharedArray.hpp"
+#include "Common/Tracing.hpp"
 #include "Common/Utils.hpp"
-#include "Net/TcpServer.hpp"
+#include "Net/NetServer.hpp"
+#include "Kernels.hpp"
 
+class MetricsEndpoint;
 
 // template of same type as QFutureWatcher? But then to hold task itself there should be base task and shared_ptr...
 struct Task
@@ -21,7 +27,31 @@ struct Task
     std::unique_ptr<Protocol::Request> request;
     std::unique_ptr<QFutureWatcherBase> futureWatcher;
     Net::AddressPort addrPort;
+    quint32 requestId{0};
     quint64 rmsgHash{0}; // not the best place for it, but easier to keep it here
+    int deferredProgressValue{-1}; // latest progress value not sent because client is congested
+    std::unique_ptr<SharedArray> sharedArray; // segment of request's data if it came in shared memory; result goes back there, detached with the task
+    quint64 traceId{0};
+    // Tracing::nowNs() of each stage: received - socket read of the request started (or its parsing, if read wasn't timed), then added, started and finished running
+    qint64 receivedAtNs{0};
+    qint64 addedAtNs{0};
+    qint64 startedAtNs{-1};
+    qint64 finishedAtNs{-1};
+};
+
+// Chunk function of a task, recorded as a span of task's trace on whichever pool thread runs it
+template <typename Result, typename Arg>
+struct TracedChunk
+{
+    using result_type = Result; // QtConcurrent takes result type of a functor from there
+    Result (*f_chunk)(Arg);
+    quint64 traceId;
+
+    Result operator()(Arg arg) const
+    {
+        Tracing::ScopedSpan span("chunk", traceId);
+        return f_chunk(std::move(arg));
+    }
 };
 
 class ExampleServer : public QObject
@@ -29,14 +59,49 @@ class ExampleServer : public QObject
     Q_OBJECT
 public:
     explicit ExampleServer(Net::ConnectionSettings serverSettings, QObject* parent = nullptr);
+    // pServer is made by caller in a NetThread of its choice (e.g. MemoryServer, to benchmark request path without sockets) and is opened with serverSettings;
+    // nullptr - backend is picked by [Network] backend
+    ExampleServer(NetServer* pServer, Net::ConnectionSettings serverSettings, QObject* parent = nullptr);
+    ~ExampleServer() override;
 
 private:
-    TcpServer* m_server;
+    NetServer* m_server;
+    NetServer* m_localServer = nullptr; // serves same-host clients over local socket alongside m_server, if [Network] localServerName is set
 
-    QHash<Net::AddressPort, std::shared_ptr<Task>> m_taskMap;
+    QHash<Net::AddressPort, QHash<quint32, std::shared_ptr<Task>>> m_taskMap; // client -> requestId -> task
+    int m_maxTasksPerClient = 8;
+    QSet<Net::AddressPort> m_congestedClients;
 
     QCache<quint64, Protocol::Request> m_cache;
 
+    // Series are looked up once and kept; per-connection ones are removed from m_metrics when the client disconnects
+    struct ConnectionMetrics
+    {
+        Metrics::Counter* framesReceived = nullptr;
+        Metrics::Counter* bytesReceived = nullptr;
+        Metrics::Counter* framesSent = nullptr;
+        Metrics::Counter* bytesSent = nullptr;
+    };
+    struct RequestMetrics
+    {
+        Metrics::Counter* requests = nullptr;
+        Metrics::Histogram* decodeTime = nullptr;
+        Metrics::Histogram* encodeTime = nullptr;
+        Metrics::Histogram* queueWait = nullptr;
+        Metrics::Histogram* computeTime = nullptr;
+    };
+    Metrics::Registry m_metrics;
+    QHash<Net::AddressPort, ConnectionMetrics> m_connectionMetrics;
+    QHash<int, RequestMetrics> m_requestMetrics; // by RequestType
+    Metrics::Gauge* m_pActiveTasks = nullptr;
+    Metrics::Counter* m_pCacheHits = nullptr;
+    Metrics::Counter* m_pCacheMisses = nullptr;
+    Metrics::Counter* m_pCacheEvictions = nullptr;
+    MetricsEndpoint* m_pMetricsEndpoint = nullptr; // listens if [Metrics] port is set
+
+    int m_slowRequestThreshold = 0; // msec; stage breakdown of tasks which took longer is logged, 0 - not logged
+    QString m_traceFilePath; // Chrome trace is written there on exit, if tracing is enabled
+
     const QString m_dtFormat{QStringLiteral("[yyyy.MM.dd-hh:mm:ss.zzz]")};
     uint m_regId_general = 0;
     std::function<void(QString)> f_logGeneral = [](QString msg) { qInfo(qUtf8Printable(QDateTime::currentDateTimeUtc().toString(QStringLiteral("[yyyy.MM.dd-hh:mm:ss.zzz]")) + msg)); };
@@ -46,32 +111,30 @@ private:
     const int m_minChunkSize = 100;
 
 private:
+    NetServer* instantiateServer();
+    QVector<NetServer*> servers() const;
+    NetServer* serverOf(Net::AddressPort addrPort) const; // one which serves client at addrPort
     void loadSettings();
+    void initMetrics();
+
+    ConnectionMetrics* connectionMetrics(Net::AddressPort addrPort); // nullptr if client is not connected
+    RequestMetrics& requestMetrics(Protocol::RequestType type);
+    QByteArray renderMetrics(); // updates the gauges which are sampled rather than tracked
 
     void sendRequestToClient(const Protocol::Request* req, Net::AddressPort addrPort);
-    void sendErrorToClient(Protocol::ErrorCode errorCode, Net::AddressPort addrPort, QString errorText = QString{});
+    void sendErrorToClient(Protocol::ErrorCode errorCode, Net::AddressPort addrPort, QString errorText = QString{}, quint32 requestId = 0);
+    bool canStartTask(Net::AddressPort addrPort, quint32 requestId);
+    Task* addTask(Net::AddressPort addrPort, quint32 requestId);
+    void removeTask(Task* task);
+    void parseRequests(QVector<QByteArray> msgs, NetConnection* const netConnection, Net::AddressPort addrPort); // all frames of one read from addrPort
     void parseRequest(QByteArray msg, NetConnection* const, Net::AddressPort addrPort);
     void onCorruptedMessage(QByteArray msg, Net::AddressPort addrPort, QString errorText = QString{});
-
-    static QVector<int> sortArray(QVector<int> arr);
-    static void sortArray_reduce(QVector<int>& aggregate, const QVector<int>& part) {
-        aggregate.reserve(aggregate.size() + part.size());
-        auto idxMiddle = aggregate.size();
-        aggregate.append(part);
-        std::inplace_merge(aggregate.begin(), (aggregate.begin() + idxMiddle), aggregate.end());
-    }
-
-    static QVector<int> findPrimeNumbers(int numFrom, int numTo);
-    static QVector<int> findPrimeNumbersT(std::tuple<int, int> args) { return std::apply(&ExampleServer::findPrimeNumbers, args); }
-    static void findPrimeNumbers_reduce(QVector<int>& aggregate, const QVector<int>& part) { aggregate.append(part); }
-
-    static QVector<QPoint> calculateFunction(Protocol::EquationType equationType, int x_from, int x_to, int x_step, const int constantA, const int constantB, const int constantC);
-    static QVector<QPoint> calculateFunctionT(std::tuple<Protocol::EquationType, int, int, int, const int, const int, const int> args) { return std::apply(&ExampleServer::calculateFunction, args); }
-    static void calculateFunction_reduce(QVector<QPoint>& aggregate, const QVector<QPoint>& part) { aggregate.append(part); }
+    void logSlowRequest(const Task* task, qint64 totalNs);
 
 private slots:
     void onClientConnected(Net::AddressPort addrPort);
     void onClientDisconnected(Net::AddressPort addrPort);
+    void onClientCongestionChanged(Net::AddressPort addrPort, bool isCongested, qint64 pendingBytes);
 };
 
 
@@ -0,0 +1,80 @@
+#include "Kernels.hpp"
+
+#include <cmath>
+
+using namespace std;
+using namespace Protocol;
+
+QVector<int> Kernels::sortArray(QVector<int> arr)
+{
+    std::sort(arr.begin(), arr.end());
+    return arr;
+}
+
+QVector<int> Kernels::findPrimeNumbers(int numFrom, int numTo)
+{
+    auto isPrime = [](int n) -> bool {
+        int limit = sqrt(n);
+        for (int i = 3; i <= limit; i += 2)
+        {
+            if (n % i == 0)
+                return false;
+        }
+        return true;
+    };
+
+    if (numFrom > numTo)
+        return {};
+
+    QVector<int> primes;
+    // Start checking from 3 onwards
+    if (numFrom <= 2)
+    {
+        primes.push_back(2);
+        numFrom = 3;
+    }
+    else if (numFrom % 2 == 0) // Ensure odd starting point
+    {
+        numFrom++;
+    }
+
+    for (int num = numFrom; num <= numTo; num += 2)
+    {
+        if (isPrime(num))
+            primes.push_back(num);
+    }
+    return primes;
+}
+
+QVector<QPoint> Kernels::calculateFunction(EquationType equationType, int x_from, int x_to, int x_step, const int constantA, const int constantB, const int constantC)
+{
+    QVector<int> x_values;
+    x_values.reserve((x_to - x_from) / x_step);
+    for (int x = x_from; x <= x_to; x += x_step)
+        x_values.push_back(x);
+
+    QVector<QPoint> result;
+    switch (equationType)
+    {
+    case EquationType::Linear:
+    {
+        for (auto x : x_values)
+        {
+            int y = constantA * x + constantB;
+            result.push_back(QPoint{x, y});
+        }
+        break;
+    }
+    case EquationType::Quadratic:
+    {
+        for (auto x : x_values)
+        {
+            int y = constantA * pow(x, 2) + constantB * x + constantC;
+            result.push_back(QPoint{x, y});
+        }
+        break;
+    }
+    default: { break; }
+    }
+    return result;
+}
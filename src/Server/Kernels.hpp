@@ -0,0 +1,30 @@
+#pragma once
+
+#include <algorithm>
+#include <tuple>
+
+#include <QtCore/QPoint>
+#include <QtCore/QVector>
+
+#include "Common/Protocol.hpp"
+
+// Computations behind Server's tasks, each run on a chunk of task's input in QThreadPool. Kept apart from ExampleServer so that they can be benchmarked alone
+namespace Kernels
+{
+QVector<int> sortArray(QVector<int> arr);
+inline void sortArray_reduce(QVector<int>& aggregate, const QVector<int>& part)
+{
+    aggregate.reserve(aggregate.size() + part.size());
+    auto idxMiddle = aggregate.size();
+    aggregate.append(part);
+    std::inplace_merge(aggregate.begin(), (aggregate.begin() + idxMiddle), aggregate.end());
+}
+
+QVector<int> findPrimeNumbers(int numFrom, int numTo);
+inline QVector<int> findPrimeNumbersT(std::tuple<int, int> args) { return std::apply(&Kernels::findPrimeNumbers, args); }
+inline void findPrimeNumbers_reduce(QVector<int>& aggregate, const QVector<int>& part) { aggregate.append(part); }
+
+QVector<QPoint> calculateFunction(Protocol::EquationType equationType, int x_from, int x_to, int x_step, const int constantA, const int constantB, const int constantC);
+inline QVector<QPoint> calculateFunctionT(std::tuple<Protocol::EquationType, int, int, int, const int, const int, const int> args) { return std::apply(&Kernels::calculateFunction, args); }
+inline void calculateFunction_reduce(QVector<QPoint>& aggregate, const QVector<QPoint>& part) { aggregate.append(part); }
+} // namespace Kernels
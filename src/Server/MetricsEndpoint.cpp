@@ -0,0 +1,65 @@
+#include "MetricsEndpoint.hpp"
+
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+
+MetricsEndpoint::MetricsEndpoint(std::function<QByteArray()> f_render, QObject* parent)
+    : QObject{parent}
+    , m_pTcpServer{new QTcpServer(this)}
+    , f_render{std::move(f_render)}
+{
+    QObject::connect(m_pTcpServer, &QTcpServer::newConnection, this, &MetricsEndpoint::onNewConnection);
+}
+
+bool MetricsEndpoint::listen(const QHostAddress& address, quint16 port)
+{
+    return m_pTcpServer->listen(address, port);
+}
+
+QString MetricsEndpoint::errorString() const
+{
+    return m_pTcpServer->errorString();
+}
+
+void MetricsEndpoint::onNewConnection()
+{
+    while (QTcpSocket* pSocket = m_pTcpServer->nextPendingConnection())
+    {
+        QObject::connect(pSocket, &QTcpSocket::readyRead, this, [this, pSocket]() { readRequest(pSocket); });
+        QObject::connect(pSocket, &QTcpSocket::disconnected, pSocket, &QObject::deleteLater);
+    }
+}
+
+void MetricsEndpoint::readRequest(QTcpSocket* pSocket)
+{
+    const QByteArray head = pSocket->peek(s_maxRequestSize);
+    if (!head.contains("\r\n\r\n") && !head.contains("\n\n"))
+    {
+        if (head.size() >= s_maxRequestSize)
+            reply(pSocket, "431 Request Header Fields Too Large", "text/plain", QByteArray{});
+        return; // headers are not complete yet
+    }
+    pSocket->readAll();
+
+    const QList<QByteArray> requestLine = head.left(head.indexOf('\n')).trimmed().split(' ');
+    const QByteArray method = requestLine.value(0);
+    const QByteArray path = requestLine.value(1);
+    if (method != "GET")
+        reply(pSocket, "405 Method Not Allowed", "text/plain", QByteArray{});
+    else if ((path != "/metrics") && !path.startsWith("/metrics?"))
+        reply(pSocket, "404 Not Found", "text/plain", QByteArray{});
+    else
+        reply(pSocket, "200 OK", "text/plain; version=0.0.4; charset=utf-8", f_render());
+}
+
+void MetricsEndpoint::reply(QTcpSocket* pSocket, QByteArray status, QByteArray contentType, QByteArray body)
+{
+    QByteArray response = "HTTP/1.0 " + status + "\r\n"
+                        + "Content-Type: " + contentType + "\r\n"
+                        + "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                        + "Connection: close\r\n\r\n";
+    response.append(body);
+    QObject::disconnect(pSocket, &QTcpSocket::readyRead, nullptr, nullptr); // anything the client sends after the request is of no interest
+    pSocket->write(response);
+    pSocket->disconnectFromHost(); // closes once everything is written
+}
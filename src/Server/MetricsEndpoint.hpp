@@ -0,0 +1,32 @@
+#pragma once
+
+#include <functional>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QObject>
+#include <QtNetwork/QHostAddress>
+
+class QTcpServer;
+class QTcpSocket;
+
+// Serves GET /metrics over plain HTTP/1.0 for Prometheus to scrape; one request per connection, anything else gets 404.
+// Meant for a local port: there is no authorization, so it should not listen on an address reachable from outside
+class MetricsEndpoint : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MetricsEndpoint(std::function<QByteArray()> f_render, QObject* parent = nullptr);
+
+    bool listen(const QHostAddress& address, quint16 port);
+    QString errorString() const;
+
+private:
+    static constexpr int s_maxRequestSize = 8192; // request line and headers; scrapers send a few hundred bytes
+
+    QTcpServer* m_pTcpServer;
+    std::function<QByteArray()> f_render;
+
+    void onNewConnection();
+    void readRequest(QTcpSocket* pSocket);
+    static void reply(QTcpSocket* pSocket, QByteArray status, QByteArray contentType, QByteArray body);
+};
@@ -1,11 +1,61 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <csignal>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
 #include <QtCore/QCommandLineOption>
 #include <QtCore/QCommandLineParser>
 #include <QtCore/QCoreApplication>
 #include <QtCore/QDir>
+#include <QtCore/QSocketNotifier>
 #include <QtCore/QThreadPool>
 
 #include "ExampleServer.hpp"
 
+// Ctrl+C and service stop have to go through QCoreApplication::quit(), otherwise ExampleServer isn't deleted and the trace isn't written
+#ifdef _WIN32
+static BOOL WINAPI consoleCtrlHandler(DWORD ctrlType)
+{
+    if ((ctrlType != CTRL_C_EVENT) && (ctrlType != CTRL_BREAK_EVENT) && (ctrlType != CTRL_CLOSE_EVENT))
+        return FALSE;
+    QMetaObject::invokeMethod(QCoreApplication::instance(), &QCoreApplication::quit, Qt::QueuedConnection); // handler runs in a thread of its own
+    return TRUE;
+}
+
+static void installQuitHandler()
+{
+    SetConsoleCtrlHandler(consoleCtrlHandler, TRUE);
+}
+#else
+static int s_quitSignalFd[2] = {-1, -1};
+
+static void quitSignalHandler(int)
+{
+    const char byte = 1;
+    [[maybe_unused]] const ssize_t ret = ::write(s_quitSignalFd[0], &byte, sizeof(byte)); // the only async-signal-safe way to reach the event loop
+}
+
+static void installQuitHandler()
+{
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, s_quitSignalFd) != 0)
+        return;
+    auto pNotifier = new QSocketNotifier(s_quitSignalFd[1], QSocketNotifier::Read, QCoreApplication::instance());
+    QObject::connect(pNotifier, &QSocketNotifier::activated, [pNotifier](){
+        pNotifier->setEnabled(false);
+        QCoreApplication::quit();
+    });
+    struct sigaction action = {};
+    action.sa_handler = quitSignalHandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+}
+#endif
+
 int main(int argc, char* argv[])
 {
     QCoreApplication a(argc, argv);
@@ -26,6 +76,7 @@ int main(int argc, char* argv[])
     }
 
     QThreadPool::globalInstance()->setMaxThreadCount(QThread::idealThreadCount());
+    installQuitHandler();
 
     QTimer::singleShot(0, [posArgs](){
         Net::ConnectionSettings serverSettings;